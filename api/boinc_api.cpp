@@ -147,6 +147,9 @@ static double intops_per_cpu_sec = 0;
 static double intops_cumulative = 0;
 static int want_network = 0;
 static int have_network = 1;
+static bool use_msg_rings = false;
+    // the client supports the MSG_RINGs in shared mem;
+    // use them for process control, status and trickle-up msgs
 bool g_sleep = false;
     // simulate unresponsive app by setting to true (debugging)
 static FUNC_PTR timer_callback = 0;
@@ -278,9 +281,35 @@ static int setup_shared_mem() {
 #endif
 #endif  // ! _WIN32
     if (app_client_shm == NULL) return -1;
+    if (aid.shmem_layout_version >= 2) {
+        use_msg_rings = true;
+        app_client_shm->shm->app_layout_version = SHMEM_LAYOUT_VERSION;
+    }
     return 0;
 }
 
+static bool send_app_status_msg(const char* msg) {
+    if (use_msg_rings) {
+        return app_client_shm->shm->app_status_ring.send_msg(msg);
+    }
+    return app_client_shm->shm->app_status.send_msg(msg);
+}
+
+// The client may have sent a msg on the old channel
+// before it saw that we use the ring, so check both.
+// Check the old channel first: anything there was sent
+// before anything in the ring.
+//
+static bool get_process_control_msg(char* buf) {
+    if (app_client_shm->shm->process_control_request.get_msg(buf)) {
+        return true;
+    }
+    if (use_msg_rings) {
+        return app_client_shm->shm->process_control_request_ring.get_msg(buf);
+    }
+    return false;
+}
+
 // Return CPU time of process.
 //
 double boinc_worker_thread_cpu_time() {
@@ -348,7 +377,7 @@ static bool update_app_progress(double cpu_t, double cp_cpu_t) {
         sprintf(buf, "<intops_cumulative>%e</intops_cumulative>\n", intops_cumulative);
         strlcat(msg_buf, buf, MSG_CHANNEL_SIZE);
     }
-    return app_client_shm->shm->app_status.send_msg(msg_buf);
+    return send_app_status_msg(msg_buf);
 }
 
 static void handle_heartbeat_msg() {
@@ -384,7 +413,7 @@ static void parallel_master(int child_pid) {
         interrupt_count++;
         if (app_client_shm) {
             handle_heartbeat_msg();
-            if (app_client_shm->shm->process_control_request.get_msg(buf)) {
+            while (get_process_control_msg(buf)) {
                 if (match_tag(buf, "<suspend/>")) {
                     kill(child_pid, SIGSTOP);
                 } else if (match_tag(buf, "<resume/>")) {
@@ -572,7 +601,13 @@ static void send_trickle_up_msg() {
         strcat(buf, "<have_new_upload_file/>\n");
     }
     if (strlen(buf)) {
-        if (app_client_shm->shm->trickle_up.send_msg(buf)) {
+        bool sent;
+        if (use_msg_rings) {
+            sent = app_client_shm->shm->trickle_up_ring.send_msg(buf);
+        } else {
+            sent = app_client_shm->shm->trickle_up.send_msg(buf);
+        }
+        if (sent) {
             have_new_trickle_up = false;
             have_new_upload_file = false;
         }
@@ -774,7 +809,7 @@ int boinc_report_app_status_aux(
         sprintf(buf, "<bytes_received>%f</bytes_received>\n", bytes_received);
         strcat(msg_buf, buf);
     }
-    if (app_client_shm->shm->app_status.send_msg(msg_buf)) {
+    if (send_app_status_msg(msg_buf)) {
         return 0;
     }
     return ERR_WRITE;
@@ -910,7 +945,7 @@ static void handle_trickle_down_msg() {
 //
 static void handle_process_control_msg() {
     char buf[MSG_CHANNEL_SIZE];
-    if (app_client_shm->shm->process_control_request.get_msg(buf)) {
+    while (get_process_control_msg(buf)) {
 #ifdef DEBUG_BOINC_API
         char log_buf[256]
         fprintf(stderr, "%s got process control msg %s\n",
@@ -1199,10 +1234,30 @@ DWORD WINAPI timer_thread(void *) {
 
 #else
 
+// Wait until the next timer tick.
+// If the client uses MSG_RINGs, handle process control msgs
+// (suspend, quit etc.) as they arrive rather than on the next tick.
+//
+static void timer_sleep() {
+    if (!use_msg_rings || !app_client_shm || !options.handle_process_control) {
+        boinc_sleep(TIMER_PERIOD);
+        return;
+    }
+    double end = dtime() + TIMER_PERIOD;
+    while (1) {
+        double x = end - dtime();
+        if (x <= 0) break;
+        app_client_shm->shm->process_control_request_ring.wait(x);
+        if (app_client_shm->shm->process_control_request_ring.has_msg()) {
+            handle_process_control_msg();
+        }
+    }
+}
+
 static void* timer_thread(void*) {
     block_sigalrm();
     while(1) {
-        boinc_sleep(TIMER_PERIOD);
+        timer_sleep();
         timer_handler();
     }
     return 0;
@@ -77,6 +77,9 @@ int gpu_suspend_reason;
 double non_boinc_cpu_usage;
 
 ACTIVE_TASK::~ACTIVE_TASK() {
+#ifndef SIM
+    unwatch_exit();
+#endif
 }
 
 ACTIVE_TASK::ACTIVE_TASK() {
@@ -84,6 +87,7 @@ ACTIVE_TASK::ACTIVE_TASK() {
     wup = NULL;
     app_version = NULL;
     pid = 0;
+    pidfd = -1;
 
     _task_state = PROCESS_UNINITIALIZED;
     slot = 0;
@@ -120,6 +124,7 @@ ACTIVE_TASK::ACTIVE_TASK() {
     premature_exit_count = 0;
     overdue_checkpoint = false;
     last_deadline_miss_time = 0;
+    graphics_pid = 0;
     strcpy(web_graphics_url, "");
 }
 
@@ -219,6 +224,9 @@ void ACTIVE_TASK::cleanup_task() {
         gstate.retry_shmem_time = 0;
     }
 #endif
+#ifndef SIM
+    unwatch_exit();
+#endif
 
     if (config.exit_after_finish) {
         exit(0);
@@ -284,8 +292,34 @@ void procinfo_show(PROCINFO& pi, PROC_MAP& pm) {
 }
 #endif
 
+// Find a process running the task's graphics app,
+// and mark it as a BOINC process.
+// Return its PID, or 0 if none.
+//
+static int find_graphics_app(ACTIVE_TASK* atp, PROC_MAP& pm) {
+    char* name = atp->app_version->graphics_exec_file;
+    PROC_MAP::iterator i;
+
+    if (!strlen(name)) return 0;
+    if (atp->graphics_pid) {
+        i = pm.find(atp->graphics_pid);
+        if (i != pm.end() && !strcmp(i->second.command, name)) {
+            i->second.is_boinc_app = true;
+            return atp->graphics_pid;
+        }
+    }
+    for (i=pm.begin(); i!=pm.end(); i++) {
+        if (!strcmp(i->second.command, name)) {
+            i->second.is_boinc_app = true;
+            return i->first;
+        }
+    }
+    return 0;
+}
+
 void ACTIVE_TASK_SET::get_memory_usage() {
     static double last_mem_time=0;
+    static double last_full_scan_time=0;
     unsigned int i;
     int retval;
     static bool first = true;
@@ -303,7 +337,53 @@ void ACTIVE_TASK_SET::get_memory_usage() {
 
     last_mem_time = gstate.now;
     PROC_MAP pm;
-    retval = procinfo_setup(pm);
+
+    // We need the whole process table only to see
+    // how much CPU non-BOINC processes are using,
+    // and whether exclusive apps are running.
+    // Otherwise look only at our tasks, their descendants,
+    // and their graphics apps.
+    // Graphics apps aren't descendants,
+    // so we find them in an occasional scan of the whole table.
+    //
+    bool all_procs = true;
+#ifdef __linux__
+    if (!gstate.global_prefs.suspend_cpu_usage
+        && config.exclusive_apps.empty()
+        && config.exclusive_gpu_apps.empty()
+    ) {
+        vector<int> pids;
+        bool need_graphics_scan = false;
+        for (i=0; i<active_tasks.size(); i++) {
+            ACTIVE_TASK* atp = active_tasks[i];
+            if (atp->task_state() == PROCESS_UNINITIALIZED) continue;
+            if (atp->pid ==0) continue;
+            pids.push_back(atp->pid);
+            pids.insert(
+                pids.end(), atp->other_pids.begin(), atp->other_pids.end()
+            );
+            if (atp->graphics_pid) {
+                pids.push_back(atp->graphics_pid);
+            } else if (strlen(atp->app_version->graphics_exec_file)) {
+                need_graphics_scan = true;
+            }
+        }
+        if (!need_graphics_scan
+            || gstate.now - last_full_scan_time < GRAPHICS_SCAN_PERIOD
+        ) {
+            retval = procinfo_setup_descendants(pm, pids);
+            if (!retval) {
+                all_procs = false;
+            } else {
+                pm.clear();
+            }
+        }
+    }
+#endif
+    if (all_procs) {
+        retval = procinfo_setup(pm);
+        last_full_scan_time = gstate.now;
+    }
     if (retval) {
         if (log_flags.mem_usage_debug) {
             msg_printf(NULL, MSG_INTERNAL_ERROR,
@@ -333,6 +413,7 @@ void ACTIVE_TASK_SET::get_memory_usage() {
             v = &(atp->other_pids);
         }
         procinfo_app(pi, v, pm, atp->app_version->graphics_exec_file);
+        atp->graphics_pid = find_graphics_app(atp, pm);
         pi.working_set_size_smoothed = .5*(pi.working_set_size_smoothed + pi.working_set_size);
 
         int pf = pi.page_fault_count - last_page_fault_count;
@@ -363,6 +444,14 @@ void ACTIVE_TASK_SET::get_memory_usage() {
         }
     }
 
+    if (!all_procs) {
+        // if the preference is set later, start over
+        //
+        non_boinc_cpu_usage = 0;
+        first = true;
+        return;
+    }
+
     // get info on non-BOINC processes.
     // mem usage info is not useful because most OSs don't
     // move idle processes out of RAM, so physical memory is always full.
@@ -772,7 +861,29 @@ void MSG_QUEUE::init(char* n) {
 }
 
 void MSG_QUEUE::msg_queue_send(const char* msg, MSG_CHANNEL& channel) {
-    if ((msgs.size()==0) && channel.send_msg(msg)) {
+    send(msg, &channel, NULL);
+}
+
+void MSG_QUEUE::msg_queue_send(const char* msg, MSG_RING& ring) {
+    send(msg, NULL, &ring);
+}
+
+void MSG_QUEUE::msg_queue_poll(MSG_CHANNEL& channel) {
+    poll(&channel, NULL);
+}
+
+void MSG_QUEUE::msg_queue_poll(MSG_RING& ring) {
+    poll(NULL, &ring);
+}
+
+static inline bool send_msg(
+    const char* msg, MSG_CHANNEL* channel, MSG_RING* ring
+) {
+    return ring?ring->send_msg(msg):channel->send_msg(msg);
+}
+
+void MSG_QUEUE::send(const char* msg, MSG_CHANNEL* channel, MSG_RING* ring) {
+    if ((msgs.size()==0) && send_msg(msg, channel, ring)) {
         if (log_flags.app_msg_send) {
             msg_printf(NULL, MSG_INFO, "[app_msg_send] sent %s to %s", msg, name);
         }
@@ -786,7 +897,7 @@ void MSG_QUEUE::msg_queue_send(const char* msg, MSG_CHANNEL& channel) {
     if (!last_block) last_block = gstate.now;
 }
 
-void MSG_QUEUE::msg_queue_poll(MSG_CHANNEL& channel) {
+void MSG_QUEUE::poll(MSG_CHANNEL* channel, MSG_RING* ring) {
     if (msgs.size() > 0) {
         if (log_flags.app_msg_send) {
             msg_printf(NULL, MSG_INFO,
@@ -794,7 +905,7 @@ void MSG_QUEUE::msg_queue_poll(MSG_CHANNEL& channel) {
                 (int)msgs.size(), name
             );
         }
-        if (channel.send_msg(msgs[0].c_str())) {
+        if (send_msg(msgs[0].c_str(), channel, ring)) {
             if (log_flags.app_msg_send) {
                 msg_printf(NULL, MSG_INFO, "[app_msg_send] poll: delayed sent %s", (msgs[0].c_str()));
             }
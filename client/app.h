@@ -69,6 +69,9 @@ struct ACTIVE_TASK {
     APP_VERSION* app_version;
     PROCESS_ID pid;
 	PROCINFO procinfo;
+    int pidfd;
+        // Linux: descriptor that becomes readable when the process exits
+        // (see watch_exit()); -1 if none
 
     // START OF ITEMS SAVED IN STATE FILE
     int _task_state;
@@ -150,6 +153,10 @@ struct ACTIVE_TASK {
         // but not descendants of the main process
         // (e.g. VMs created by vboxwrapper)
         // These are communicated via the app_status message channel
+    int graphics_pid;
+        // a process running the app version's graphics app, or 0.
+        // The Manager runs these, so they're not our descendants;
+        // we find them by name when we scan the whole process table
     char web_graphics_url[256];
 
     void set_task_state(int, const char*);
@@ -219,6 +226,9 @@ struct ACTIVE_TASK {
     bool process_exists();
     bool has_task_exited();
         // return true if this task has exited
+    void watch_exit();
+        // arrange to be woken up when the process exits
+    void unwatch_exit();
 
     int suspend();
         // tell a process to stop executing (but stay in mem)
@@ -229,6 +239,12 @@ struct ACTIVE_TASK {
         // preempt (via suspend or quit) a running task
     int resume_or_start(bool);
     void send_network_available();
+    bool app_uses_rings() {
+        return app_client_shm.shm->app_layout_version >= 2;
+    }
+        // whether the app uses the MSG_RINGs in shared mem
+        // (its API library is new enough)
+    void send_process_control_msg(const char*);
 #ifdef _WIN32
     void handle_exited_app(unsigned long);
 #else
@@ -267,6 +283,12 @@ class ACTIVE_TASK_SET {
 public:
     typedef std::vector<ACTIVE_TASK*> active_tasks_v;
     active_tasks_v active_tasks;
+    bool exit_pending;
+        // a process has exited; check for this without waiting
+        // for TASK_POLL_PERIOD
+    ACTIVE_TASK_SET() {
+        exit_pending = false;
+    }
     ACTIVE_TASK* lookup_pid(int);
     ACTIVE_TASK* lookup_result(RESULT*);
     void init();
@@ -53,6 +53,9 @@
 #if HAVE_SYS_WAIT_H
 #include <sys/wait.h>
 #endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include <vector>
 
@@ -71,6 +74,7 @@ using std::vector;
 #include "file_names.h"
 #include "proc_control.h"
 #include "sandbox.h"
+#include "epoll_set.h"
 
 #include "app.h"
 
@@ -83,8 +87,23 @@ bool ACTIVE_TASK_SET::poll() {
     bool action;
     unsigned int i;
     static double last_time = 0;
-    if (gstate.now - last_time < TASK_POLL_PERIOD) return false;
+    if (gstate.now - last_time < TASK_POLL_PERIOD) {
+        // if a process has exited, handle it now
+        // rather than at the next poll
+        //
+        if (!exit_pending) return false;
+        exit_pending = false;
+        action = false;
+        while (check_app_exited()) {
+            action = true;
+        }
+        if (action) {
+            gstate.set_client_state_dirty("ACTIVE_TASK_SET::poll");
+        }
+        return action;
+    }
     last_time = gstate.now;
+    exit_pending = false;
 
     action = check_app_exited();
     send_heartbeats();
@@ -149,10 +168,7 @@ bool ACTIVE_TASK::kill_all_children() {
 //
 int ACTIVE_TASK::request_exit() {
     if (!app_client_shm.shm) return 1;
-    process_control_queue.msg_queue_send(
-        "<quit/>",
-        app_client_shm.shm->process_control_request
-    );
+    send_process_control_msg("<quit/>");
     set_task_state(PROCESS_QUIT_PENDING, "request_exit()");
     quit_time = gstate.now;
     get_descendants(pid, descendants);
@@ -163,10 +179,7 @@ int ACTIVE_TASK::request_exit() {
 //
 int ACTIVE_TASK::request_abort() {
     if (!app_client_shm.shm) return 1;
-    process_control_queue.msg_queue_send(
-        "<abort/>",
-        app_client_shm.shm->process_control_request
-    );
+    send_process_control_msg("<abort/>");
     return 0;
 }
 
@@ -601,13 +614,62 @@ void ACTIVE_TASK_SET::process_control_poll() {
             }
             atp->kill_task(true);
         } else {
-            atp->process_control_queue.msg_queue_poll(
-                atp->app_client_shm.shm->process_control_request
-            );
+            if (atp->app_uses_rings()) {
+                atp->process_control_queue.msg_queue_poll(
+                    atp->app_client_shm.shm->process_control_request_ring
+                );
+            } else {
+                atp->process_control_queue.msg_queue_poll(
+                    atp->app_client_shm.shm->process_control_request
+                );
+            }
         }
     }
 }
 
+#ifdef USE_EPOLL
+static void task_exited(int, int, void* arg) {
+    ACTIVE_TASK* atp = (ACTIVE_TASK*)arg;
+
+    // the descriptor stays readable; we only need to hear about it once
+    //
+    atp->unwatch_exit();
+    gstate.active_tasks.exit_pending = true;
+    epoll_set.wakeup = true;
+}
+#endif
+
+// Linux: get a pidfd for the task's process, and watch it with epoll.
+// It becomes readable when the process exits,
+// so we notice that (and can start another job) right away
+// rather than at the next ACTIVE_TASK_SET::poll().
+// Requires Linux 5.3; otherwise we just poll.
+//
+void ACTIVE_TASK::watch_exit() {
+#if defined(USE_EPOLL) && defined(SYS_pidfd_open)
+    if (!epoll_set.active()) return;
+    unwatch_exit();
+    pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0) {
+        pidfd = -1;
+        return;
+    }
+    if (epoll_set.set(pidfd, EPOLL_SET_READ, task_exited, this)) {
+        close(pidfd);
+        pidfd = -1;
+    }
+#endif
+}
+
+void ACTIVE_TASK::unwatch_exit() {
+#ifdef USE_EPOLL
+    if (pidfd < 0) return;
+    epoll_set.remove(pidfd);
+    close(pidfd);
+    pidfd = -1;
+#endif
+}
+
 // See if any processes have exited
 //
 bool ACTIVE_TASK_SET::check_app_exited() {
@@ -845,10 +907,7 @@ int ACTIVE_TASK::request_reread_app_info() {
     init_app_init_data(aid);
     int retval = write_app_init_file(aid);
     if (retval) return retval;
-    process_control_queue.msg_queue_send(
-        "<reread_app_info/>",
-        app_client_shm.shm->process_control_request
-    );
+    send_process_control_msg("<reread_app_info/>");
     return 0;
 }
 
@@ -1082,10 +1141,7 @@ int ACTIVE_TASK::suspend() {
     }
     int n = process_control_queue.msg_queue_purge("<resume/>");
     if (n == 0) {
-        process_control_queue.msg_queue_send(
-            "<suspend/>",
-            app_client_shm.shm->process_control_request
-        );
+        send_process_control_msg("<suspend/>");
     }
     set_task_state(PROCESS_SUSPENDED, "suspend");
     return 0;
@@ -1107,21 +1163,29 @@ int ACTIVE_TASK::unsuspend() {
     }
     int n = process_control_queue.msg_queue_purge("<suspend/>");
     if (n == 0) {
-        process_control_queue.msg_queue_send(
-            "<resume/>",
-            app_client_shm.shm->process_control_request
-        );
+        send_process_control_msg("<resume/>");
     }
     set_task_state(PROCESS_EXECUTING, "unsuspend");
     return 0;
 }
 
+// send a process control msg, queueing it if the channel is full.
+//
+void ACTIVE_TASK::send_process_control_msg(const char* msg) {
+    if (app_uses_rings()) {
+        process_control_queue.msg_queue_send(
+            msg, app_client_shm.shm->process_control_request_ring
+        );
+    } else {
+        process_control_queue.msg_queue_send(
+            msg, app_client_shm.shm->process_control_request
+        );
+    }
+}
+
 void ACTIVE_TASK::send_network_available() {
     if (!app_client_shm.shm) return;
-    process_control_queue.msg_queue_send(
-        "<network_available/>",
-        app_client_shm.shm->process_control_request
-    );
+    send_process_control_msg("<network_available/>");
     return;
 }
 
@@ -1141,8 +1205,19 @@ bool ACTIVE_TASK::get_app_status_msg() {
         );
         return false;
     }
-    if (!app_client_shm.shm->app_status.get_msg(msg_buf)) {
-        return false;
+    if (app_uses_rings()) {
+        // the app may have sent several status msgs since we last looked;
+        // each one supersedes the previous one, so use the last
+        //
+        bool found = false;
+        while (app_client_shm.shm->app_status_ring.get_msg(msg_buf)) {
+            found = true;
+        }
+        if (!found) return false;
+    } else {
+        if (!app_client_shm.shm->app_status.get_msg(msg_buf)) {
+            return false;
+        }
     }
     if (log_flags.app_msg_receive) {
         msg_printf(this->wup->project, MSG_INFO,
@@ -1215,7 +1290,12 @@ bool ACTIVE_TASK::get_trickle_up_msg() {
     int retval;
 
     if (!app_client_shm.shm) return false;
-    if (app_client_shm.shm->trickle_up.get_msg(msg_buf)) {
+    while (1) {
+        if (app_uses_rings()) {
+            if (!app_client_shm.shm->trickle_up_ring.get_msg(msg_buf)) break;
+        } else {
+            if (!app_client_shm.shm->trickle_up.get_msg(msg_buf)) break;
+        }
         if (match_tag(msg_buf, "<have_new_trickle_up/>")) {
             if (log_flags.app_msg_receive) {
                 msg_printf(NULL, MSG_INFO,
@@ -1236,6 +1316,7 @@ bool ACTIVE_TASK::get_trickle_up_msg() {
             handle_upload_files();
         }
         found = true;
+        if (!app_uses_rings()) break;
     }
     return found;
 }
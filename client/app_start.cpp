@@ -264,6 +264,7 @@ void ACTIVE_TASK::init_app_init_data(APP_INIT_DATA& aid) {
 #else
     aid.shmem_seg_name = shmem_seg_name;
 #endif
+    aid.shmem_layout_version = SHMEM_LAYOUT_VERSION;
     aid.wu_cpu_time = checkpoint_cpu_time;
 }
 
@@ -1015,6 +1016,7 @@ int ACTIVE_TASK::start(bool first_time) {
             "[task] ACTIVE_TASK::start(): forked process: pid %d\n", pid
         );
     }
+    watch_exit();
 
 #endif
     set_task_state(PROCESS_EXECUTING, "start");
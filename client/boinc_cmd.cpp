@@ -380,12 +380,13 @@ int main(int argc, char** argv) {
         retval = rpc.get_messages(seqno, messages);
         if (!retval) {
             unsigned int j;
+            char buf[TIME_STRING_LEN];
             for (j=0; j<messages.messages.size(); j++) {
                 MESSAGE& md = *messages.messages[j];
                 strip_whitespace(md.body);
                 printf("%d: %s (%s) [%s] %s\n",
                     md.seqno,
-                    time_to_string(md.timestamp),
+                    time_to_string(md.timestamp, buf),
                     prio_name(md.priority),
                     md.project.c_str(),
                     md.body.c_str()
@@ -402,12 +403,13 @@ int main(int argc, char** argv) {
         retval = rpc.get_notices(seqno, notices);
         if (!retval) {
             unsigned int j;
+            char buf[TIME_STRING_LEN];
             for (j=0; j<notices.notices.size(); j++) {
                 NOTICE& n = *notices.notices[j];
                 strip_whitespace(n.description);
                 printf("%d: (%s) %s\n",
                     n.seqno,
-                    time_to_string(n.create_time),
+                    time_to_string(n.create_time, buf),
                     n.description.c_str()
                 );
             }
@@ -220,7 +220,7 @@ int main(int argc, char** argv) {
             msg_type.clear();
             msg_body.clear();
 
-            msg_datetime = time_to_string(double(pMsg->timestamp));
+            msg_datetime = time_to_string(double(pMsg->timestamp), buf);
             msg_project = pMsg->project;
             msg_priority = prio_name(pMsg->priority);
             msg_body = pMsg->body;
@@ -53,8 +53,8 @@ extern void show_message(
 //
 void show_message(PROJ_AM *p, char* msg, int priority, bool is_html, const char* link) {
     const char* x;
-    char message[1024], event_msg[1024];
-    char* time_string = time_to_string(gstate.now);
+    char message[1024], event_msg[1024], time_buf[TIME_STRING_LEN];
+    char* time_string = time_to_string(gstate.now, time_buf);
 
     // Cycle the log files if needed
     //
@@ -51,12 +51,14 @@
 #include "hostinfo.h"
 #include "hostinfo_network.h"
 #include "network.h"
+#include "epoll_set.h"
 #include "http_curl.h"
 #include "client_msgs.h"
 #include "shmem.h"
 #include "sandbox.h"
 #include "cs_notice.h"
 #include "cs_trickle.h"
+#include "cs_files.h"
 
 #include "client_state.h"
 
@@ -78,6 +80,16 @@ CLIENT_STATE::CLIENT_STATE()
     scheduler_op = new SCHEDULER_OP(http_ops);
 #endif
     client_state_dirty = false;
+    state_generation = 0;
+    state_journal_ok = false;
+    state_nitems = 0;
+    for (int i=0; i<NSTATE_ITEMS; i++) {
+        state_hash[i] = 0;
+    }
+    state_file_size = 0;
+    state_journal_size = 0;
+    state_bytes_written = 0;
+    state_write_start_time = 0;
     check_all_logins = false;
     cmdline_gui_rpc_port = 0;
     run_cpu_benchmarks = false;
@@ -637,6 +649,23 @@ void CLIENT_STATE::do_io_or_sleep(double x) {
     double end_time = now + x;
     int loops = 0;
 
+#ifdef USE_EPOLL
+    // the handlers of ready descriptors are called from epoll_set.wait()
+    //
+    if (epoll_set.active()) {
+        epoll_set.wakeup = false;
+        while (1) {
+            epoll_set.wait(http_ops->epoll_timeout(x));
+            http_ops->epoll_timer();
+            if (requested_exit || epoll_set.wakeup) break;
+            set_now();
+            if (now >= end_time) break;
+            x = end_time - now;
+        }
+        return;
+    }
+#endif
+
     while (1) {
         curl_fds.zero();
         gui_rpc_fds.zero();
@@ -887,6 +916,7 @@ bool CLIENT_STATE::poll_slow_events() {
     POLL_ACTION(create_and_delete_pers_file_xfers ,
         create_and_delete_pers_file_xfers
     );
+    POLL_ACTION(async_verify           , async_verifier.poll    );
     POLL_ACTION(handle_finished_apps   , handle_finished_apps   );
     POLL_ACTION(update_results         , update_results         );
     if (!tasks_suspended) {
@@ -955,44 +985,29 @@ APP* CLIENT_STATE::lookup_app(PROJECT* p, const char* name) {
     return 0;
 }
 
+// The following lookups use indices (see STATE_INDEX)
+// since there may be many thousands of results, WUs and files,
+// and lookups are done for each item in the state file
+// and in scheduler replies.
+//
 RESULT* CLIENT_STATE::lookup_result(PROJECT* p, const char* name) {
-    for (unsigned int i=0; i<results.size(); i++) {
-        RESULT* rp = results[i];
-        if (rp->project == p && !strcmp(name, rp->name)) return rp;
-    }
-    return 0;
+    return result_index.lookup(results, STATE_KEY(p, name));
 }
 
 WORKUNIT* CLIENT_STATE::lookup_workunit(PROJECT* p, const char* name) {
-    for (unsigned int i=0; i<workunits.size(); i++) {
-        WORKUNIT* wup = workunits[i];
-        if (wup->project == p && !strcmp(name, wup->name)) return wup;
-    }
-    return 0;
+    return workunit_index.lookup(workunits, STATE_KEY(p, name));
 }
 
 APP_VERSION* CLIENT_STATE::lookup_app_version(
     APP* app, char* platform, int version_num, char* plan_class
 ) {
-    for (unsigned int i=0; i<app_versions.size(); i++) {
-        APP_VERSION* avp = app_versions[i];
-        if (avp->app != app) continue;
-        if (version_num != avp->version_num) continue;
-        if (strcmp(avp->platform, platform)) continue;
-        if (strcmp(avp->plan_class, plan_class)) continue;
-        return avp;
-    }
-    return 0;
+    return app_version_index.lookup(
+        app_versions, STATE_KEY(app, platform, plan_class, version_num)
+    );
 }
 
 FILE_INFO* CLIENT_STATE::lookup_file_info(PROJECT* p, const char* name) {
-    for (unsigned int i=0; i<file_infos.size(); i++) {
-        FILE_INFO* fip = file_infos[i];
-        if (fip->project == p && !strcmp(fip->name, name)) {
-            return fip;
-        }
-    }
-    return 0;
+    return file_info_index.lookup(file_infos, STATE_KEY(p, name));
 }
 
 // functions to create links between state objects
@@ -1321,6 +1336,7 @@ bool CLIENT_STATE::garbage_collect_always() {
                         rp->name
                     );
                 }
+                result_index.remove(rp);
                 delete rp;
                 result_iter = results.erase(result_iter);
                 action = true;
@@ -1397,6 +1413,7 @@ bool CLIENT_STATE::garbage_collect_always() {
                     wup->name
                 );
             }
+            workunit_index.remove(wup);
             delete wup;
             wu_iter = workunits.erase(wu_iter);
             action = true;
@@ -1428,6 +1445,7 @@ bool CLIENT_STATE::garbage_collect_always() {
                 }
             }
             if (found) {
+                app_version_index.remove(avp);
                 delete avp;
                 avp_iter = app_versions.erase(avp_iter);
                 action = true;
@@ -1488,6 +1506,7 @@ bool CLIENT_STATE::garbage_collect_always() {
                     fip->name
                 );
             }
+            file_info_index.remove(fip);
             delete fip;
             fi_iter = file_infos.erase(fi_iter);
             action = true;
@@ -1781,6 +1800,7 @@ int CLIENT_STATE::reset_project(PROJECT* project, bool detaching) {
         while (avp_iter != app_versions.end()) {
             avp = *avp_iter;
             if (avp->project == project) {
+                app_version_index.remove(avp);
                 avp_iter = app_versions.erase(avp_iter);
                 delete avp;
             } else {
@@ -1836,6 +1856,7 @@ int CLIENT_STATE::detach_project(PROJECT* project) {
     while (fi_iter != file_infos.end()) {
         fip = *fi_iter;
         if (fip->project == project) {
+            file_info_index.remove(fip);
             fi_iter = file_infos.erase(fi_iter);
             delete fip;
         } else {
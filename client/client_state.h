@@ -19,6 +19,9 @@
 #define _CLIENT_STATE_
 
 #ifndef _WIN32
+#include <cstring>
+#include <deque>
+#include <map>
 #include <string>
 #include <vector>
 #include <ctime>
@@ -64,6 +67,148 @@ using std::vector;
     // project: no downloading or runnable results
     // overall: at least one idle CPU
 
+// The key of a result, workunit, file info or app version
+// in a STATE_INDEX.
+// For app versions "owner" is the APP and "name" is the platform;
+// otherwise "owner" is the PROJECT.
+// The key has its own copies of the names,
+// so the map stays valid even if an object is freed before it's removed.
+//
+struct STATE_KEY {
+    const void* owner;
+    std::string name;
+    std::string plan_class;
+    int version_num;
+    STATE_KEY(const void* o, const char* n, const char* pc="", int v=0)
+        : owner(o), name(n), plan_class(pc), version_num(v) {
+    }
+    bool operator<(const STATE_KEY& k) const {
+        if (owner != k.owner) return owner < k.owner;
+        int n = name.compare(k.name);
+        if (n) return n < 0;
+        n = plan_class.compare(k.plan_class);
+        if (n) return n < 0;
+        return version_num < k.version_num;
+    }
+};
+
+inline STATE_KEY state_key(RESULT* p) {
+    return STATE_KEY(p->project, p->name);
+}
+inline STATE_KEY state_key(WORKUNIT* p) {
+    return STATE_KEY(p->project, p->name);
+}
+inline STATE_KEY state_key(FILE_INFO* p) {
+    return STATE_KEY(p->project, p->name);
+}
+inline STATE_KEY state_key(APP_VERSION* p) {
+    return STATE_KEY(p->app, p->platform, p->plan_class, p->version_num);
+}
+
+// An index of the objects in one of CLIENT_STATE's vectors,
+// so that lookups aren't linear searches.
+// Objects are indexed lazily, from the end of the vector;
+// code that appends to the vector needn't do anything,
+// but code that removes an object from it must call remove(),
+// and code that reorders it must call clear().
+//
+template <class T> class STATE_INDEX {
+    typedef std::map<STATE_KEY, T*> MAP;
+    MAP map;
+    size_t nindexed;
+        // the first nindexed elements of the vector are indexed
+    bool dups;
+        // some indexed objects have the same key;
+        // only the first of these is in the map
+public:
+    STATE_INDEX() {
+        clear();
+    }
+    void clear() {
+        map.clear();
+        nindexed = 0;
+        dups = false;
+    }
+    T* lookup(vector<T*>& v, const STATE_KEY& key) {
+        if (nindexed > v.size()) clear();
+        for (; nindexed < v.size(); nindexed++) {
+            T* p = v[nindexed];
+            if (!map.insert(std::make_pair(state_key(p), p)).second) {
+                dups = true;
+            }
+        }
+        typename MAP::iterator i = map.find(key);
+        return (i == map.end())?NULL:i->second;
+    }
+    void remove(T* p) {
+        typename MAP::iterator i = map.find(state_key(p));
+        if (i == map.end()) return;     // not indexed yet
+        if (dups || i->second != p) {
+            clear();
+            return;
+        }
+        map.erase(i);
+        nindexed--;
+    }
+};
+
+// items of the state file that aren't in a vector;
+// CLIENT_STATE::state_hash[] has their hashes
+//
+#define STATE_HOST_INFO     0
+#define STATE_TIME_STATS    1
+#define STATE_NET_STATS     2
+#define STATE_AUTO_UPDATE   3
+#define STATE_ACTIVE_TASKS  4
+#define STATE_GLOBALS       5
+#define NSTATE_ITEMS        6
+
+struct STATE_WRITER;
+
+// the log of changes to the GUI state, for the get_state_changes() RPC;
+// see cs_statefile.cpp
+//
+#define GUI_STATE_MAX_DELETIONS 1000
+
+struct GUI_STATE_ITEM {
+    unsigned int hash;
+        // hash of the item's XML
+    int seqno;
+        // sequence number of the last change
+    int scan;
+        // the last reply in which the item was seen
+    std::string deleted_xml;
+        // what to send when it's deleted
+    GUI_STATE_ITEM() {
+        hash = 0;
+        seqno = 0;
+        scan = 0;
+    }
+};
+
+struct GUI_STATE_DELETION {
+    int seqno;
+    std::string key;
+    std::string xml;
+};
+
+struct GUI_STATE_LOG {
+    std::map<std::string, GUI_STATE_ITEM> items;
+        // key is type ("c", "p", "a", "v", "w", "r") plus
+        // the item's project URL and name
+    std::deque<GUI_STATE_DELETION> deletions;
+    int seqno;
+    int scan;
+    int deletions_dropped;
+        // seqno of the last deletion we've forgotten;
+        // a GUI whose state is older gets the full state
+    int epoch;
+
+    GUI_STATE_LOG();
+    GUI_STATE_ITEM* lookup(const char* key, const char* deleted_xml);
+    void deleted(const std::string& key, GUI_STATE_ITEM&);
+};
+
 // encapsulates the global variables of the core client.
 // If you add anything here, initialize it in the constructor
 //
@@ -76,6 +221,10 @@ struct CLIENT_STATE {
     vector<WORKUNIT*> workunits;
     vector<RESULT*> results;
         // list of jobs, ordered by increasing arrival time
+    STATE_INDEX<FILE_INFO> file_info_index;
+    STATE_INDEX<APP_VERSION> app_version_index;
+    STATE_INDEX<WORKUNIT> workunit_index;
+    STATE_INDEX<RESULT> result_index;
 
     PERS_FILE_XFER_SET* pers_file_xfers;
     HTTP_OP_SET* http_ops;
@@ -195,6 +344,27 @@ struct CLIENT_STATE {
         // so that the Manager can tell the user what the problem is
 
     bool client_state_dirty;
+
+    // the state journal; see cs_statefile.cpp
+    //
+    int state_generation;
+        // incremented each time the state file is written;
+        // journal records from other generations are ignored
+    bool state_journal_ok;
+        // the last state file write succeeded,
+        // so we can append changes to the journal
+    int state_nitems;
+        // number of items (projects, files, jobs etc.) in the state
+        // as of the last write
+    unsigned int state_hash[NSTATE_ITEMS];
+    double state_file_size;
+    double state_journal_size;
+        // bytes written to the state file, and to the journal since then
+    double state_bytes_written;
+        // total bytes written to state file and journal
+    double state_write_start_time;
+    GUI_STATE_LOG gui_state_log;
+
     int old_major_version;
     int old_minor_version;
     int old_release;
@@ -416,12 +586,18 @@ struct CLIENT_STATE {
     void set_client_state_dirty(const char*);
     int parse_state_file();
     int parse_state_file_aux(const char*);
-    int write_state(MIOFILE&);
+    void parse_state_items(XML_PARSER&, bool journal);
+    int replay_state_journal();
+    int write_state(STATE_WRITER&);
     int write_state_file();
+    int write_state_journal();
     int write_state_file_if_needed();
     void check_anonymous();
     int parse_app_info(PROJECT*, FILE*);
+    int write_host_info_gui(MIOFILE&);
+    int write_client_info_gui(MIOFILE&);
     int write_state_gui(MIOFILE&);
+    int write_state_changes_gui(MIOFILE&, int epoch, int since);
     int write_file_transfers_gui(MIOFILE&);
     int write_tasks_gui(MIOFILE&, bool);
     void sort_results();
@@ -523,6 +699,10 @@ extern void print_suspend_tasks_message(int);
 
 #define MEMORY_USAGE_PERIOD     10
 
+#define GRAPHICS_SCAN_PERIOD    300
+    // when scanning only task descendants, scan the whole process table
+    // this often to find graphics apps we don't know about
+
 //////// WORK FETCH
 
 #define WORK_FETCH_PERIOD   60
@@ -49,6 +49,7 @@
 #include "client_state.h"
 #include "pers_file_xfer.h"
 #include "sandbox.h"
+#include "cs_files.h"
 
 #include "client_types.h"
 
@@ -62,6 +63,9 @@ PROJECT::PROJECT() {
 void PROJECT::init() {
     strcpy(master_url, "");
     strcpy(authenticator, "");
+    journal_hash = 0;
+    gui_state_item = NULL;
+    journal_files_hash = 0;
     project_specific_prefs = "";
     gui_urls = "";
     resource_share = 100;
@@ -786,6 +790,8 @@ int APP::parse(XML_PARSER& xp) {
     strcpy(user_friendly_name, "");
     project = NULL;
     non_cpu_intensive = false;
+    journal_hash = 0;
+    gui_state_item = NULL;
     while (!xp.get_tag()) {
         if (xp.match_tag("/app")) {
             if (!strlen(user_friendly_name)) {
@@ -821,6 +827,14 @@ int APP::parse(XML_PARSER& xp) {
     return ERR_XML_PARSE;
 }
 
+// Copy the fields written to the state file
+// from an APP parsed from the state journal.
+//
+void APP::copy_state_fields(APP& a) {
+    strcpy(user_friendly_name, a.user_friendly_name);
+    non_cpu_intensive = a.non_cpu_intensive;
+}
+
 int APP::write(MIOFILE& out) {
     out.printf(
         "<app>\n"
@@ -858,6 +872,15 @@ FILE_INFO::FILE_INFO() {
     strcpy(xml_signature, "");
     strcpy(file_signature, "");
     cert_sigs = 0;
+    journal_hash = 0;
+}
+
+FILE_INFO::~FILE_INFO() {
+#ifndef SIM
+    if (status == FILE_VERIFY_PENDING) {
+        async_verifier.cancel(this);
+    }
+#endif
 }
 
 void FILE_INFO::reset() {
@@ -982,7 +1005,12 @@ int FILE_INFO::parse(XML_PARSER& xp) {
         if (xp.parse_str("md5_cksum", md5_cksum, sizeof(md5_cksum))) continue;
         if (xp.parse_double("nbytes", nbytes)) continue;
         if (xp.parse_double("max_nbytes", max_nbytes)) continue;
-        if (xp.parse_int("status", status)) continue;
+        if (xp.parse_int("status", status)) {
+            // a background verification was interrupted; start over
+            //
+            if (status == FILE_VERIFY_PENDING) status = FILE_NOT_PRESENT;
+            continue;
+        }
         if (xp.parse_bool("executable", executable)) continue;
         if (xp.parse_bool("uploaded", uploaded)) continue;
         if (xp.parse_bool("sticky", sticky)) continue;
@@ -1182,6 +1210,24 @@ const char* URL_LIST::get_current_url(FILE_INFO& fi) {
     return urls[current_index].c_str();
 }
 
+// Copy the fields that change while the client runs
+// from a FILE_INFO parsed from the state journal.
+// Takes ownership of its PERS_FILE_XFER, if any.
+//
+void FILE_INFO::copy_state_fields(FILE_INFO& fi) {
+    nbytes = fi.nbytes;
+    status = fi.status;
+    uploaded = fi.uploaded;
+    sticky = fi.sticky;
+    gzip_when_done = fi.gzip_when_done;
+    signature_required = fi.signature_required;
+    download_urls.replace(fi.download_urls);
+    upload_urls.replace(fi.upload_urls);
+    error_msg = fi.error_msg;
+    pers_file_xfer = fi.pers_file_xfer;
+    fi.pers_file_xfer = NULL;
+}
+
 // merges information from a new FILE_INFO that has the same name as one
 // that is already present in the client state file.
 //
@@ -1215,7 +1261,9 @@ int FILE_INFO::merge_info(FILE_INFO& new_info) {
 // (couldn't download, RSA/MD5 check failed, etc)
 //
 bool FILE_INFO::had_failure(int& failnum) {
-    if (status != FILE_NOT_PRESENT && status != FILE_PRESENT) {
+    if (status != FILE_NOT_PRESENT && status != FILE_PRESENT
+        && status != FILE_VERIFY_PENDING
+    ) {
         failnum = status;
         return true;
     }
@@ -1293,6 +1341,8 @@ int APP_VERSION::parse(XML_PARSER& xp) {
     strcpy(missing_coproc_name, "");
     dont_throttle = false;
     needs_network = false;
+    journal_hash = 0;
+    gui_state_item = NULL;
 
     while (!xp.get_tag()) {
         if (xp.match_tag("/app_version")) return 0;
@@ -1352,6 +1402,26 @@ int APP_VERSION::parse(XML_PARSER& xp) {
     return ERR_XML_PARSE;
 }
 
+// Copy the fields written to the state file
+// from an APP_VERSION parsed from the state journal.
+// The app version's files don't change, so keep our (linked) FILE_REFs.
+//
+void APP_VERSION::copy_state_fields(APP_VERSION& av) {
+    strcpy(api_version, av.api_version);
+    avg_ncpus = av.avg_ncpus;
+    max_ncpus = av.max_ncpus;
+    gpu_usage = av.gpu_usage;
+    gpu_ram = av.gpu_ram;
+    flops = av.flops;
+    strcpy(cmdline, av.cmdline);
+    strcpy(file_prefix, av.file_prefix);
+    needs_network = av.needs_network;
+    missing_coproc = av.missing_coproc;
+    missing_coproc_usage = av.missing_coproc_usage;
+    strcpy(missing_coproc_name, av.missing_coproc_name);
+    dont_throttle = av.dont_throttle;
+}
+
 int APP_VERSION::write(MIOFILE& out, bool write_file_info) {
     unsigned int i;
     int retval;
@@ -1546,6 +1616,8 @@ int WORKUNIT::parse(XML_PARSER& xp) {
     rsc_fpops_bound = 4e9*SECONDS_PER_DAY*7;
     rsc_memory_bound = 1e8;
     rsc_disk_bound = 1e9;
+    journal_hash = 0;
+    gui_state_item = NULL;
     while (!xp.get_tag()) {
         if (xp.match_tag("/workunit")) return 0;
         if (xp.parse_str("name", name, sizeof(name))) continue;
@@ -1580,6 +1652,19 @@ int WORKUNIT::parse(XML_PARSER& xp) {
     return ERR_XML_PARSE;
 }
 
+// Copy the fields written to the state file
+// from a WORKUNIT parsed from the state journal.
+// Its input files don't change, so keep our (linked) FILE_REFs.
+//
+void WORKUNIT::copy_state_fields(WORKUNIT& wu) {
+    version_num = wu.version_num;
+    command_line = wu.command_line;
+    rsc_fpops_est = wu.rsc_fpops_est;
+    rsc_fpops_bound = wu.rsc_fpops_bound;
+    rsc_memory_bound = wu.rsc_memory_bound;
+    rsc_disk_bound = wu.rsc_disk_bound;
+}
+
 int WORKUNIT::write(MIOFILE& out) {
     unsigned int i;
 
@@ -1707,6 +1792,8 @@ void RESULT::clear() {
     coproc_missing = false;
     report_immediately = false;
     schedule_backoff = 0;
+    journal_hash = 0;
+    gui_state_item = NULL;
 }
 
 // parse a <result> element from scheduling server.
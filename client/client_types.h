@@ -59,6 +59,7 @@ extern const char* rsc_name(int);
 extern COPROCS coprocs;
 
 struct FILE_INFO;
+struct GUI_STATE_ITEM;
 
 // represents a list of URLs (e.g. to download a file)
 // and a current position in that list
@@ -98,6 +99,9 @@ struct URL_LIST {
 //
 #define FILE_NOT_PRESENT    0
 #define FILE_PRESENT        1
+#define FILE_VERIFY_PENDING 2
+    // the file's signature or checksum is being checked
+    // in another thread (see cs_files.h)
 
 struct FILE_INFO {
     char name[256];
@@ -132,9 +136,11 @@ struct FILE_INFO {
     std::string error_msg;
         // if permanent error occurs during file xfer, it's recorded here
     CERT_SIGS* cert_sigs;
+    unsigned int journal_hash;
+        // hash of XML when last written to state file or journal
 
     FILE_INFO();
-    ~FILE_INFO(){}
+    ~FILE_INFO();
     void reset();
     int set_permissions();
     int parse(XML_PARSER&);
@@ -145,7 +151,10 @@ struct FILE_INFO {
     bool had_failure(int& failnum);
     void failure_message(std::string&);
     int merge_info(FILE_INFO&);
-    int verify_file(bool, bool);
+    void copy_state_fields(FILE_INFO&);
+    int verify_file(bool, bool, bool allow_async=false);
+    int check_signature(int retval, bool verified, bool show_errors);
+    int check_md5(int retval, const char* cksum, bool show_errors);
     bool verify_file_certs();
     int gzip();
         // gzip file and add .gz to name
@@ -485,6 +494,13 @@ struct PROJECT : PROJ_AM {
     //
     std::vector<TRICKLE_UP_OP*> trickle_up_ops;
 
+    unsigned int journal_hash;
+    unsigned int journal_files_hash;
+        // hashes of XML (project, project files) when last written
+        // to state file or journal
+    GUI_STATE_ITEM* gui_state_item;
+        // entry in the log of GUI state changes (see cs_statefile.cpp)
+
     PROJECT();
     ~PROJECT(){}
     void init();
@@ -544,6 +560,8 @@ struct APP {
     char user_friendly_name[256];
     bool non_cpu_intensive;
     PROJECT* project;
+    unsigned int journal_hash;
+    GUI_STATE_ITEM* gui_state_item;
 #ifdef SIM
     double latency_bound;
     double fpops_est;
@@ -557,6 +575,7 @@ struct APP {
 
     int parse(XML_PARSER&);
     int write(MIOFILE&);
+    void copy_state_fields(APP&);
 };
 
 struct GPU_USAGE {
@@ -600,6 +619,8 @@ struct APP_VERSION {
     bool dont_throttle;
 
     int index;  // temp var for make_scheduler_request()
+    unsigned int journal_hash;
+    GUI_STATE_ITEM* gui_state_item;
 #ifdef SIM
     bool dont_use;
 #endif
@@ -608,6 +629,7 @@ struct APP_VERSION {
     ~APP_VERSION(){}
     int parse(XML_PARSER&);
     int write(MIOFILE&, bool write_file_info = true);
+    void copy_state_fields(APP_VERSION&);
     bool had_download_failure(int& failnum);
     void get_file_errors(std::string&);
     void clear_errors();
@@ -635,11 +657,14 @@ struct WORKUNIT {
     double rsc_fpops_bound;
     double rsc_memory_bound;
     double rsc_disk_bound;
+    unsigned int journal_hash;
+    GUI_STATE_ITEM* gui_state_item;
 
     WORKUNIT(){}
     ~WORKUNIT(){}
     int parse(XML_PARSER&);
     int write(MIOFILE&);
+    void copy_state_fields(WORKUNIT&);
     bool had_download_failure(int& failnum);
     void get_file_errors(std::string&);
     void clear_errors();
@@ -707,6 +732,8 @@ struct RESULT {
     APP* app;
     WORKUNIT* wup;
     PROJECT* project;
+    unsigned int journal_hash;
+    GUI_STATE_ITEM* gui_state_item;
 
     RESULT(){}
     ~RESULT(){}
@@ -308,11 +308,16 @@ void CLIENT_STATE::assign_results_to_projects() {
     unsigned int i;
     RESULT* rp;
     PROJECT* project;
+    vector<RESULT*> task_results;
+        // results with an ACTIVE_TASK, sorted;
+        // lookup_active_task_by_result() is linear in the number of tasks,
+        // and we'd do it for every result
 
     // scan results with an ACTIVE_TASK
     //
     for (i=0; i<active_tasks.active_tasks.size(); i++) {
         ACTIVE_TASK *atp = active_tasks.active_tasks[i];
+        task_results.push_back(atp->result);
         if (!atp->runnable()) continue;
         rp = atp->result;
         if (rp->already_selected) continue;
@@ -341,11 +346,12 @@ void CLIENT_STATE::assign_results_to_projects() {
 
     // Now consider results that don't have an active task
     //
+    sort(task_results.begin(), task_results.end());
     for (i=0; i<results.size(); i++) {
         rp = results[i];
         if (rp->already_selected) continue;
         if (rp->uses_coprocs()) continue;
-        if (lookup_active_task_by_result(rp)) continue;
+        if (binary_search(task_results.begin(), task_results.end(), rp)) continue;
         if (!rp->runnable()) continue;
 
         project = rp->project;
@@ -456,65 +462,81 @@ RESULT* first_coproc_result(int rsc_type) {
 
 // Return earliest-deadline result for given resource type;
 // return only results projected to miss their deadline,
-// or from projects with extreme DCF
+// or from projects with extreme DCF.
+// If there's a tie, pick the job with the least remaining time
+// (but don't pick an unstarted job over one that's started)
 //
-static RESULT* earliest_deadline_result(int rsc_type) {
-    RESULT *best_result = NULL;
-    ACTIVE_TASK* best_atp = NULL;
-    unsigned int i;
+// make_run_list() calls this once for each job it picks;
+// rather than scanning all results each time,
+// init_edf_candidates() makes a sorted list of candidates
+// at the start of each scheduling pass.
+// A candidate that's been selected, or whose project has used up
+// its deadline misses, stays that way until the next pass,
+// so we can skip past it for good.
+//
+struct EDF_CANDIDATE {
+    RESULT* rp;
+    bool started;
+    double time_remaining;
+};
 
-    for (i=0; i<gstate.results.size(); i++) {
+static vector<EDF_CANDIDATE> edf_candidates[MAX_RSC];
+static unsigned int edf_next[MAX_RSC];
+
+static inline bool edf_before(const EDF_CANDIDATE& c0, const EDF_CANDIDATE& c1) {
+    if (c0.rp->report_deadline < c1.rp->report_deadline) return true;
+    if (c0.rp->report_deadline > c1.rp->report_deadline) return false;
+    if (c0.started && !c1.started) return true;
+    if (!c0.started && c1.started) return false;
+    return c0.time_remaining < c1.time_remaining;
+}
+
+static void init_edf_candidates() {
+    for (int j=0; j<coprocs.n_rsc; j++) {
+        edf_candidates[j].clear();
+        edf_next[j] = 0;
+    }
+    for (unsigned int i=0; i<gstate.results.size(); i++) {
         RESULT* rp = gstate.results[i];
-        if (rp->resource_type() != rsc_type) continue;
-        if (rp->already_selected) continue;
         if (!rp->runnable()) continue;
         if (rp->non_cpu_intensive()) continue;
-        PROJECT* p = rp->project;
-
-        bool only_deadline_misses = true;
 
         // treat projects with DCF>90 as if they had deadline misses
         //
-        if (p->duration_correction_factor < 90.0) {
-            int d = p->rsc_pwf[rsc_type].deadlines_missed_copy;
-            if (!d) {
-                continue;
-            }
-        } else {
-            only_deadline_misses = false;
+        if (rp->project->duration_correction_factor < 90.0) {
+            if (!rp->rr_sim_misses_deadline) continue;
         }
+        EDF_CANDIDATE c;
+        c.rp = rp;
+        c.started = (gstate.lookup_active_task_by_result(rp) != NULL);
+        c.time_remaining = rp->estimated_time_remaining();
+        edf_candidates[rp->resource_type()].push_back(c);
+    }
+    for (int j=0; j<coprocs.n_rsc; j++) {
+        // stable, so that ties go to the earlier result
+        //
+        stable_sort(
+            edf_candidates[j].begin(), edf_candidates[j].end(), edf_before
+        );
+    }
+}
 
-        if (only_deadline_misses && !rp->rr_sim_misses_deadline) {
-            continue;
-        }
-        bool new_best = false;
-        if (best_result) {
-            if (rp->report_deadline < best_result->report_deadline) {
-                new_best = true;
-            }
-        } else {
-            new_best = true;
-        }
-        if (new_best) {
-            best_result = rp;
-            best_atp = gstate.lookup_active_task_by_result(rp);
-            continue;
-        }
-        if (rp->report_deadline > best_result->report_deadline) {
-            continue;
-        }
+static RESULT* earliest_deadline_result(int rsc_type) {
+    RESULT *best_result = NULL;
+    vector<EDF_CANDIDATE>& v = edf_candidates[rsc_type];
 
-        // If there's a tie, pick the job with the least remaining time
-        // (but don't pick an unstarted job over one that's started)
-        //
-        ACTIVE_TASK* atp = gstate.lookup_active_task_by_result(rp);
-        if (best_atp && !atp) continue;
-        if (rp->estimated_time_remaining() < best_result->estimated_time_remaining()
-            || (!best_atp && atp)
-        ) {
-            best_result = rp;
-            best_atp = atp;
+    while (edf_next[rsc_type] < v.size()) {
+        RESULT* rp = v[edf_next[rsc_type]].rp;
+        PROJECT* p = rp->project;
+        if (!rp->already_selected) {
+            if (p->duration_correction_factor >= 90.0
+                || p->rsc_pwf[rsc_type].deadlines_missed_copy
+            ) {
+                best_result = rp;
+                break;
+            }
         }
+        edf_next[rsc_type]++;
     }
     if (!best_result) return NULL;
 
@@ -870,6 +892,7 @@ void CLIENT_STATE::make_run_list(vector<RESULT*>& run_list) {
             p->rsc_pwf[j].deadlines_missed_copy = p->rsc_pwf[j].deadlines_missed;
         }
     }
+    init_edf_candidates();
     for (i=0; i<app_versions.size(); i++) {
         app_versions[i]->max_working_set_size = 0;
     }
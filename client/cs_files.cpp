@@ -34,6 +34,7 @@
 #include "crypt.h"
 #include "str_util.h"
 #include "filesys.h"
+#include "util.h"
 #include "cert_sig.h"
 #include "error_numbers.h"
 
@@ -42,6 +43,7 @@
 #include "client_state.h"
 #include "client_msgs.h"
 #include "file_xfer.h"
+#include "cs_files.h"
 
 using std::vector;
 
@@ -118,12 +120,17 @@ bool FILE_INFO::verify_file_certs() {
 //    In this case "strict" is false,
 //    and we just check existence and size (no checksum)
 //
+// If "allow_async" is set and the file is large,
+// the signature or checksum is checked in another thread;
+// set status to FILE_VERIFY_PENDING and return ERR_IN_PROGRESS.
+// ASYNC_VERIFIER::poll() finishes the job.
+//
 // If a failure occurs, set the file's "status" field.
 // This will cause the app_version or workunit that used the file
 // to error out (via APP_VERSION::had_download_failure()
 // WORKUNIT::had_download_failure())
 //
-int FILE_INFO::verify_file(bool strict, bool show_errors) {
+int FILE_INFO::verify_file(bool strict, bool show_errors, bool allow_async) {
     char cksum[64], pathname[256];
     bool verified;
     int retval;
@@ -183,55 +190,297 @@ int FILE_INFO::verify_file(bool strict, bool show_errors) {
             );
             return ERR_NO_SIGNATURE;
         }
+#ifndef SIM
+        if (allow_async && size >= ASYNC_VERIFY_MIN_SIZE) {
+            async_verifier.add(this, pathname, size, show_errors);
+            return ERR_IN_PROGRESS;
+        }
+#endif
         retval = verify_file2(
             pathname, file_signature, project->code_sign_key, verified
         );
-        if (retval) {
+        return check_signature(retval, verified, show_errors);
+    } else if (strlen(md5_cksum)) {
+#ifndef SIM
+        if (allow_async && size >= ASYNC_VERIFY_MIN_SIZE) {
+            async_verifier.add(this, pathname, size, show_errors);
+            return ERR_IN_PROGRESS;
+        }
+#endif
+        retval = md5_file(pathname, cksum, local_nbytes);
+        return check_md5(retval, cksum, show_errors);
+    }
+    return 0;
+}
+
+// Given the result of verify_file2(), return an error (and set status)
+// if the signature check failed
+//
+int FILE_INFO::check_signature(int retval, bool verified, bool show_errors) {
+    if (retval) {
+        msg_printf(project, MSG_INTERNAL_ERROR,
+            "Signature verification error for %s",
+            name
+        );
+        error_msg = "signature verification error";
+        status = ERR_RSA_FAILED;
+        return ERR_RSA_FAILED;
+    }
+    if (!verified && show_errors) {
+        msg_printf(project, MSG_INTERNAL_ERROR,
+            "Signature verification failed for %s",
+           name
+        );
+        error_msg = "signature verification failed";
+        status = ERR_RSA_FAILED;
+        return ERR_RSA_FAILED;
+    }
+    return 0;
+}
+
+// Given the result of md5_file(), return an error (and set status)
+// if it failed or the checksum is wrong
+//
+int FILE_INFO::check_md5(int retval, const char* cksum, bool show_errors) {
+    if (retval) {
+        msg_printf(project, MSG_INTERNAL_ERROR,
+            "MD5 computation error for %s: %s\n",
+            name, boincerror(retval)
+        );
+        error_msg = "MD5 computation error";
+        status = retval;
+        return retval;
+    }
+    if (strcmp(cksum, md5_cksum)) {
+        if (show_errors) {
             msg_printf(project, MSG_INTERNAL_ERROR,
-                "Signature verification error for %s",
-                name
+                "MD5 check failed for %s", name
             );
-            error_msg = "signature verification error";
-            status = ERR_RSA_FAILED;
-            return ERR_RSA_FAILED;
-        }
-        if (!verified && show_errors) {
             msg_printf(project, MSG_INTERNAL_ERROR,
-                "Signature verification failed for %s",
-               name
+                "expected %s, got %s\n", md5_cksum, cksum
             );
-            error_msg = "signature verification failed";
-            status = ERR_RSA_FAILED;
-            return ERR_RSA_FAILED;
         }
-    } else if (strlen(md5_cksum)) {
-        retval = md5_file(pathname, cksum, local_nbytes);
-        if (retval) {
-            msg_printf(project, MSG_INTERNAL_ERROR,
-                "MD5 computation error for %s: %s\n",
-                name, boincerror(retval)
+        error_msg = "MD5 check failed";
+        status = ERR_MD5_FAILED;
+        return ERR_MD5_FAILED;
+    }
+    return 0;
+}
+
+#ifndef SIM
+
+ASYNC_VERIFIER async_verifier;
+
+ASYNC_VERIFIER::ASYNC_VERIFIER() {
+    nthreads = 0;
+    nfiles = 0;
+    nbytes = 0;
+    busy_time = 0;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI verify_thread(LPVOID p) {
+#else
+static void* verify_thread(void* p) {
+#endif
+    THREAD* tp = (THREAD*)p;
+    ASYNC_VERIFIER* avp = (ASYNC_VERIFIER*)tp->arg;
+    delete tp;
+    avp->verify_files();
+    return 0;
+}
+
+// Queue a file for verification,
+// and start a thread if fewer than ASYNC_VERIFY_NTHREADS are running
+//
+void ASYNC_VERIFIER::add(
+    FILE_INFO* fip, const char* path, double size, bool show_errors
+) {
+    ASYNC_VERIFY* avp = new ASYNC_VERIFY;
+    avp->fip = fip;
+    avp->show_errors = show_errors;
+    avp->path = path;
+    avp->is_signed = fip->signature_required;
+    if (avp->is_signed) {
+        avp->signature = fip->file_signature;
+        avp->key = fip->project->code_sign_key;
+    }
+    avp->size = size;
+    avp->retval = 0;
+    avp->verified = false;
+    strcpy(avp->cksum, "");
+    avp->elapsed = 0;
+    avp->done = false;
+    fip->status = FILE_VERIFY_PENDING;
+    verifies.push_back(avp);
+
+    if (log_flags.file_xfer_debug) {
+        msg_printf(fip->project, MSG_INFO,
+            "[file_xfer] verifying %s (%.0f bytes) in background",
+            fip->name, size
+        );
+    }
+
+    lock.lock();
+    queue.push_back(avp);
+    bool start = (nthreads < ASYNC_VERIFY_NTHREADS);
+    if (start) nthreads++;
+    lock.unlock();
+    if (!start) return;
+
+    THREAD* tp = new THREAD;
+    if (tp->run(verify_thread, this)) {
+        // couldn't create a thread; do the work in this one
+        //
+        delete tp;
+        verify_files();
+    }
+}
+
+void ASYNC_VERIFIER::verify_files() {
+    ASYNC_VERIFY* avp;
+    double t, local_nbytes;
+
+    while (1) {
+        lock.lock();
+        if (queue.empty()) {
+            nthreads--;
+            lock.unlock();
+            return;
+        }
+        avp = queue.front();
+        queue.pop_front();
+        lock.unlock();
+
+        t = dtime();
+        if (avp->is_signed) {
+            avp->retval = verify_file2(
+                avp->path.c_str(), avp->signature.c_str(), avp->key.c_str(),
+                avp->verified
             );
-            error_msg = "MD5 computation error";
-            status = retval;
-            return retval;
+        } else {
+            avp->retval = md5_file(avp->path.c_str(), avp->cksum, local_nbytes);
         }
-        if (strcmp(cksum, md5_cksum)) {
-            if (show_errors) {
-                msg_printf(project, MSG_INTERNAL_ERROR,
-                    "MD5 check failed for %s", name
-                );
-                msg_printf(project, MSG_INTERNAL_ERROR,
-                    "expected %s, got %s\n", md5_cksum, cksum
-                );
-            }
-            error_msg = "MD5 check failed";
-            status = ERR_MD5_FAILED;
-            return ERR_MD5_FAILED;
+        avp->elapsed = dtime() - t;
+
+        lock.lock();
+        avp->done = true;
+        lock.unlock();
+    }
+}
+
+// The FILE_INFO is being deleted; discard the result when it arrives
+//
+void ASYNC_VERIFIER::cancel(FILE_INFO* fip) {
+    for (unsigned int i=0; i<verifies.size(); i++) {
+        if (verifies[i]->fip == fip) {
+            verifies[i]->fip = NULL;
         }
     }
-    return 0;
 }
 
+// finish handling a downloaded file once it's been verified
+//
+static void file_verified(FILE_INFO* fip, int retval) {
+    if (retval) {
+        msg_printf(fip->project, MSG_INTERNAL_ERROR,
+            "Checksum or signature error for %s", fip->name
+        );
+        fip->status = retval;
+    } else {
+        // Set the appropriate permissions depending on whether
+        // it's an executable or normal file
+        //
+        retval = fip->set_permissions();
+        fip->status = FILE_PRESENT;
+    }
+
+    // if it's a user file, tell running apps to reread prefs
+    //
+    if (fip->is_user_file) {
+        gstate.active_tasks.request_reread_prefs(fip->project);
+    }
+
+    // if it's a project file, make a link in project dir
+    //
+    if (fip->is_project_file) {
+        PROJECT* p = fip->project;
+        p->write_symlink_for_project_file(fip);
+        p->update_project_files_downloaded_time();
+    }
+}
+
+// handle the result of a background verification.
+// If the file has a PERS_FILE_XFER, we were checking whether
+// a file already on disk is valid (see PERS_FILE_XFER::create_xfer());
+// otherwise it was just downloaded.
+//
+static void async_verify_done(ASYNC_VERIFY& av) {
+    FILE_INFO* fip = av.fip;
+    int retval;
+
+    if (!fip) return;
+    if (fip->status != FILE_VERIFY_PENDING) return;
+    fip->status = FILE_NOT_PRESENT;
+    if (av.is_signed) {
+        retval = fip->check_signature(av.retval, av.verified, av.show_errors);
+    } else {
+        retval = fip->check_md5(av.retval, av.cksum, av.show_errors);
+    }
+    if (log_flags.file_xfer_debug) {
+        msg_printf(fip->project, MSG_INFO,
+            "[file_xfer] verified %s in %.2f sec: %s",
+            fip->name, av.elapsed, retval?boincerror(retval):"OK"
+        );
+    }
+    PERS_FILE_XFER* pfx = fip->pers_file_xfer;
+    if (pfx) {
+        pfx->existing_file_verified(retval);
+    } else {
+        file_verified(fip, retval);
+    }
+}
+
+bool ASYNC_VERIFIER::poll() {
+    vector<ASYNC_VERIFY*> done;
+    unsigned int i;
+
+    if (verifies.empty()) return false;
+
+    lock.lock();
+    vector<ASYNC_VERIFY*>::iterator iter = verifies.begin();
+    while (iter != verifies.end()) {
+        if ((*iter)->done) {
+            done.push_back(*iter);
+            iter = verifies.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+    lock.unlock();
+    if (done.empty()) return false;
+
+    for (i=0; i<done.size(); i++) {
+        ASYNC_VERIFY* avp = done[i];
+        nfiles++;
+        nbytes += avp->size;
+        busy_time += avp->elapsed;
+        async_verify_done(*avp);
+        delete avp;
+    }
+    if (log_flags.file_xfer_debug) {
+        msg_printf(NULL, MSG_INFO,
+            "[file_xfer] background verification: %d files, %.2f MB/sec",
+            nfiles, busy_time?nbytes/busy_time/MEGA:0
+        );
+    }
+    gstate.request_schedule_cpus("file verified");
+    gstate.set_client_state_dirty("file verified");
+    return true;
+}
+
+#endif
+
 #ifndef SIM
 // scan FILE_INFOs and create PERS_FILE_XFERs as needed.
 // NOTE: this doesn't start the file transfers
@@ -292,37 +541,19 @@ bool CLIENT_STATE::create_and_delete_pers_file_xfers() {
                 }
                 fip->uploaded = true;
                 active_tasks.upload_notify_app(fip);
+            } else if (fip->status == FILE_PRESENT) {
+                // PERS_FILE_XFER::create_xfer() found a valid file on disk;
+                // don't verify it again
+                //
+                file_verified(fip, 0);
             } else if (fip->status >= 0) {
                 // file transfer did not fail (non-negative status)
 
                 // verify the file with RSA or MD5, and change permissions
                 //
-                retval = fip->verify_file(true, true);
-                if (retval) {
-                    msg_printf(fip->project, MSG_INTERNAL_ERROR,
-                        "Checksum or signature error for %s", fip->name
-                    );
-                    fip->status = retval;
-                } else {
-                    // Set the appropriate permissions depending on whether
-                    // it's an executable or normal file
-                    //
-                    retval = fip->set_permissions();
-                    fip->status = FILE_PRESENT;
-                }
-
-                // if it's a user file, tell running apps to reread prefs
-                //
-                if (fip->is_user_file) {
-                    active_tasks.request_reread_prefs(fip->project);
-                }
-
-                // if it's a project file, make a link in project dir
-                //
-                if (fip->is_project_file) {
-                    PROJECT* p = fip->project;
-                    p->write_symlink_for_project_file(fip);
-                    p->update_project_files_downloaded_time();
+                retval = fip->verify_file(true, true, true);
+                if (retval != ERR_IN_PROGRESS) {
+                    file_verified(fip, retval);
                 }
             }
             iter = pers_file_xfers->pers_file_xfers.erase(iter);
@@ -0,0 +1,89 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2012 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _CS_FILES_H_
+#define _CS_FILES_H_
+
+// Verifying a file (computing its MD5, and checking its signature
+// if it's signed) can take minutes if the file is large,
+// and the client can't do anything else meanwhile.
+// So files of at least ASYNC_VERIFY_MIN_SIZE bytes
+// are verified in separate threads (up to ASYNC_VERIFY_NTHREADS),
+// and the result is handled by ASYNC_VERIFIER::poll().
+// While this is happening the file's status is FILE_VERIFY_PENDING.
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "md5_file.h"
+#include "thread.h"
+
+#define ASYNC_VERIFY_MIN_SIZE   1e6
+#define ASYNC_VERIFY_NTHREADS   2
+
+struct FILE_INFO;
+
+struct ASYNC_VERIFY {
+    FILE_INFO* fip;
+        // NULL if the FILE_INFO has been deleted
+    bool show_errors;
+    std::string path;
+    bool is_signed;
+        // if set, check signature; otherwise compute MD5
+    std::string signature;
+    std::string key;
+    double size;
+
+    // the following are set by the thread
+    //
+    int retval;
+    bool verified;
+    char cksum[MD5_LEN];
+    double elapsed;
+    bool done;
+};
+
+struct ASYNC_VERIFIER {
+    std::vector<ASYNC_VERIFY*> verifies;
+        // all files being verified; used only by the main thread
+    std::deque<ASYNC_VERIFY*> queue;
+        // those not yet started
+    int nthreads;
+        // number of threads running
+    THREAD_LOCK lock;
+        // protects queue, nthreads, and ASYNC_VERIFY::done
+
+    // statistics, for <file_xfer_debug>
+    //
+    int nfiles;
+    double nbytes;
+    double busy_time;
+
+    ASYNC_VERIFIER();
+    void add(FILE_INFO*, const char* path, double size, bool show_errors);
+    void cancel(FILE_INFO*);
+        // call this before deleting a FILE_INFO
+    bool poll();
+        // handle finished verifications; return true if any
+    void verify_files();
+        // thread function: verify queued files until there are none left
+};
+
+extern ASYNC_VERIFIER async_verifier;
+
+#endif
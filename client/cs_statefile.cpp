@@ -106,21 +106,66 @@ int CLIENT_STATE::parse_state_file() {
         old_release = BOINC_RELEASE;
         return ERR_FOPEN;
     }
-    return parse_state_file_aux(fname);
+    int retval = parse_state_file_aux(fname);
+    if (retval) return retval;
+#ifndef SIM
+    replay_state_journal();
+#endif
+    return 0;
 }
 
 int CLIENT_STATE::parse_state_file_aux(const char* fname) {
-    PROJECT *project=NULL;
-    int retval=0;
-    int failnum;
-    bool btemp;
-    string stemp;
+    double start_time = dtime();
 
     FILE* f = fopen(fname, "r");
     if (!f) return ERR_FOPEN;
     MIOFILE mf;
     XML_PARSER xp(&mf);
     mf.init_file(f);
+    parse_state_items(xp, false);
+    sort_results();
+    fclose(f);
+    if (log_flags.statefile_debug) {
+        msg_printf(0, MSG_INFO,
+            "[statefile] parsed %s in %.3f sec: %d results, %d workunits, %d files",
+            fname, dtime() - start_time, (int)results.size(),
+            (int)workunits.size(), (int)file_infos.size()
+        );
+    }
+    
+    // if total resource share is zero, set all shares to 1
+    //
+    if (projects.size()) {
+        unsigned int i;
+        double x=0;
+        for (i=0; i<projects.size(); i++) {
+            x += projects[i]->resource_share;
+        }
+        if (!x) {
+            msg_printf(NULL, MSG_INFO,
+                "All projects have zero resource share; setting to 100"
+            );
+            for (i=0; i<projects.size(); i++) {
+                projects[i]->resource_share = 100;
+            }
+        }
+    }
+    return 0;
+}
+
+// Parse the items in the state file, or in a state journal record.
+// In the latter case an item replaces the existing one
+// with the same name, if any.
+//
+void CLIENT_STATE::parse_state_items(XML_PARSER& xp, bool journal) {
+    PROJECT *project=NULL;
+    int retval=0;
+    int failnum;
+    bool btemp;
+    string stemp;
+    char buf[256];
+    int itemp;
+
     while (!xp.get_tag()) {
         if (xp.match_tag("/client_state")) {
             break;
@@ -128,6 +173,17 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
         if (xp.match_tag("client_state")) {
             continue;
         }
+        if (xp.match_tag("journal_record") || xp.match_tag("/journal_record")) {
+            continue;
+        }
+        if (xp.parse_str("journal_project", buf, sizeof(buf))) {
+            project = lookup_project(buf);
+            continue;
+        }
+        if (xp.parse_int("state_generation", itemp)) {
+            if (!journal) state_generation = itemp;
+            continue;
+        }
         if (xp.match_tag("project")) {
             PROJECT temp_project;
             retval = temp_project.parse_state(xp);
@@ -174,6 +230,12 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
                 delete app;
                 continue;
             }
+            APP* old_app = journal?lookup_app(project, app->name):NULL;
+            if (old_app) {
+                old_app->copy_state_fields(*app);
+                delete app;
+                continue;
+            }
             retval = link_app(project, app);
             if (retval) {
                 msg_printf(project, MSG_INTERNAL_ERROR,
@@ -203,20 +265,34 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
                 delete fip;
                 continue;
             }
-            retval = link_file_info(project, fip);
-            if (project->anonymous_platform && retval == ERR_NOT_UNIQUE) {
-                delete fip;
-                continue;
-            }
-            if (retval) {
-                msg_printf(project, MSG_INTERNAL_ERROR,
-                    "Can't handle file info %s in state file",
-                    fip->name
-                );
+            FILE_INFO* old_fip = journal?lookup_file_info(project, fip->name):NULL;
+            if (old_fip) {
+#ifndef SIM
+                if (old_fip->pers_file_xfer) {
+                    pers_file_xfers->remove(old_fip->pers_file_xfer);
+                    delete old_fip->pers_file_xfer;
+                    old_fip->pers_file_xfer = NULL;
+                }
+#endif
+                old_fip->copy_state_fields(*fip);
                 delete fip;
-                continue;
+                fip = old_fip;
+            } else {
+                retval = link_file_info(project, fip);
+                if (project->anonymous_platform && retval == ERR_NOT_UNIQUE) {
+                    delete fip;
+                    continue;
+                }
+                if (retval) {
+                    msg_printf(project, MSG_INTERNAL_ERROR,
+                        "Can't handle file info %s in state file",
+                        fip->name
+                    );
+                    delete fip;
+                    continue;
+                }
+                file_infos.push_back(fip);
             }
-            file_infos.push_back(fip);
 #ifndef SIM
             // If the file had a failure before,
             // don't start another file transfer
@@ -291,6 +367,17 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
                     avp->missing_coproc_name
                 );
             }
+            if (journal) {
+                APP* app = lookup_app(project, avp->app_name);
+                APP_VERSION* old_avp = app?lookup_app_version(
+                    app, avp->platform, avp->version_num, avp->plan_class
+                ):NULL;
+                if (old_avp) {
+                    old_avp->copy_state_fields(*avp);
+                    delete avp;
+                    continue;
+                }
+            }
             retval = link_app_version(project, avp);
             if (retval) {
                 delete avp;
@@ -316,6 +403,12 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
                 delete wup;
                 continue;
             }
+            WORKUNIT* old_wup = journal?lookup_workunit(project, wup->name):NULL;
+            if (old_wup) {
+                old_wup->copy_state_fields(*wup);
+                delete wup;
+                continue;
+            }
             retval = link_workunit(project, wup);
             if (retval) {
                 msg_printf(project, MSG_INTERNAL_ERROR,
@@ -380,6 +473,14 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
                 rp->coproc_missing = true;
             }
             rp->wup->version_num = rp->version_num;
+            if (journal) {
+                RESULT* old_rp = lookup_result(project, rp->name);
+                if (old_rp) {
+                    *old_rp = *rp;
+                    delete rp;
+                    continue;
+                }
+            }
             results.push_back(rp);
             continue;
         }
@@ -428,6 +529,9 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
             continue;
         }
         if (xp.match_tag("active_task_set")) {
+            if (journal) {
+                active_tasks.free_mem();
+            }
             retval = active_tasks.parse(xp);
             if (retval) {
                 msg_printf(NULL, MSG_INTERNAL_ERROR,
@@ -511,27 +615,6 @@ int CLIENT_STATE::parse_state_file_aux(const char* fname) {
         }
         xp.skip_unexpected();
     }
-    sort_results();
-    fclose(f);
-    
-    // if total resource share is zero, set all shares to 1
-    //
-    if (projects.size()) {
-        unsigned int i;
-        double x=0;
-        for (i=0; i<projects.size(); i++) {
-            x += projects[i]->resource_share;
-        }
-        if (!x) {
-            msg_printf(NULL, MSG_INFO,
-                "All projects have zero resource share; setting to 100"
-            );
-            for (i=0; i<projects.size(); i++) {
-                projects[i]->resource_share = 100;
-            }
-        }
-    }
-    return 0;
 }
 
 void CLIENT_STATE::sort_results() {
@@ -540,10 +623,139 @@ void CLIENT_STATE::sort_results() {
         results.end(),
         arrived_first
     );
+
+    // the index is of a prefix of the vector; rebuild it
+    //
+    result_index.clear();
 }
 
 #ifndef SIM
 
+// The state journal.
+//
+// Writing the whole state file is expensive if there are many jobs,
+// and most changes (a job starting or checkpointing,
+// a file transfer finishing, new jobs arriving)
+// affect only a few items (projects, files, jobs etc.).
+// So we keep a hash of each item's XML as of when it was last written,
+// and when the state is dirty we append the items that have changed
+// to a journal file (client_state_journal.xml) instead.
+// On startup the journal is applied to the state file,
+// and a new state file is written.
+//
+// We write the state file instead of the journal
+// - if items have been deleted
+// - if the journal would be bigger than the state file
+// - if the last write failed
+// - if <no_state_journal> is set in cc_config.xml
+//
+// The state file has a generation number, which is incremented
+// each time it's written.
+// Journal records have the generation of the state file they follow;
+// others (e.g. if we crashed after writing the state file
+// but before deleting the journal) are ignored.
+
+// hash of an item's XML.
+// This is FNV-1a, but 8 bytes at a time (with a shift to mix high bits
+// into low ones), since we hash the whole GUI state on each
+// get_state_changes() RPC.
+//
+static unsigned int state_item_hash(const char* p, int n) {
+    unsigned long long h = 14695981039346656037ull, w;
+    int i;
+    for (i=0; i+8<=n; i+=8) {
+        memcpy(&w, p+i, 8);
+        h = (h ^ w) * 1099511628211ull;
+        h ^= h >> 32;
+    }
+    for (; i<n; i++) {
+        h = (h ^ (unsigned char)p[i]) * 1099511628211ull;
+    }
+    unsigned int x = (unsigned int)(h ^ (h >> 32));
+    return x?x:1;
+}
+
+// Writes the items of the state to the state file or a journal record.
+// Each item is written to a buffer (mf) and then passed to done(),
+// which compares its hash with the one from the last write.
+//
+struct STATE_WRITER {
+    MFILE& out;
+    bool journal;
+    MFILE item;
+    MIOFILE mf;
+    PROJECT* project;
+    bool project_written;
+    int nitems;
+        // number of items
+    int nold;
+        // number of items that were in the last write
+    int nwritten;
+    double nbytes;
+
+    STATE_WRITER(MFILE& _out, bool _journal): out(_out) {
+        journal = _journal;
+        mf.init_mfile(&item);
+        project = NULL;
+        project_written = false;
+        nitems = 0;
+        nold = 0;
+        nwritten = 0;
+        nbytes = 0;
+    }
+
+    // the following items belong to the given project.
+    // In the journal, if one of them is written, and the project
+    // itself hasn't been, precede it with a <journal_project> element
+    //
+    void set_project(PROJECT* p) {
+        project = p;
+        project_written = false;
+    }
+
+    // We've written an item to mf; write it to the output if needed.
+    // Return true if written
+    //
+    bool done(unsigned int& hash) {
+        char* p;
+        int n;
+        bool write;
+
+        item.get_buf(p, n);
+        unsigned int h = state_item_hash(p, n);
+        nitems++;
+        if (hash) nold++;
+        write = !journal || h != hash;
+        if (write) {
+            if (journal && project && !project_written) {
+                out.printf(
+                    "<journal_project>%s</journal_project>\n",
+                    project->master_url
+                );
+                project_written = true;
+            }
+            if (p) out.puts(p);
+            nwritten++;
+            nbytes += n;
+        }
+        hash = h;
+        free(p);
+        return write;
+    }
+};
+
+// log bytes written, and bytes/hour since the first write
+//
+static void show_state_write(const char* what, double nbytes, int nitems) {
+    gstate.state_bytes_written += nbytes;
+    double dt = gstate.now - gstate.state_write_start_time;
+    msg_printf(0, MSG_INFO,
+        "[statefile] Wrote %s: %.0f bytes, %d items; %.0f bytes/hour",
+        what, nbytes, nitems,
+        dt>0?gstate.state_bytes_written*3600/dt:0
+    );
+}
+
 // Write the client_state.xml file
 //
 int CLIENT_STATE::write_state_file() {
@@ -553,6 +765,8 @@ int CLIENT_STATE::write_state_file() {
     char win_error_msg[4096];
 #endif
 
+    if (!state_write_start_time) state_write_start_time = now;
+    state_journal_ok = false;
     for (attempt=1; attempt<=MAX_STATE_FILE_WRITE_ATTEMPTS; attempt++) {
         if (attempt > 1) boinc_sleep(1.0);
             
@@ -576,9 +790,8 @@ int CLIENT_STATE::write_state_file() {
             if (attempt < MAX_STATE_FILE_WRITE_ATTEMPTS) continue;
             return ERR_FOPEN;
         }
-        MIOFILE miof;
-        miof.init_mfile(&mf);
-        ret1 = write_state(miof);
+        STATE_WRITER sw(mf, false);
+        ret1 = write_state(sw);
         ret2 = mf.close();
         if (ret1) {
             if ((attempt == MAX_STATE_FILE_WRITE_ATTEMPTS) || log_flags.statefile_debug) {
@@ -642,7 +855,22 @@ int CLIENT_STATE::write_state_file() {
                 "[statefile] Done writing state file"
             );
         }
-        if (!retval) break;     // Success!
+        if (!retval) {
+            // Success!
+            //
+            state_generation++;
+            state_nitems = sw.nitems;
+            state_file_size = sw.nbytes;
+            state_journal_size = 0;
+            state_journal_ok = true;
+            if (boinc_file_exists(STATE_JOURNAL_FILE_NAME)) {
+                boinc_delete_file(STATE_JOURNAL_FILE_NAME);
+            }
+            if (log_flags.statefile_debug) {
+                show_state_write("state file", sw.nbytes, sw.nitems);
+            }
+            break;
+        }
         
         if ((attempt == MAX_STATE_FILE_WRITE_ATTEMPTS) || log_flags.statefile_debug) {
 #ifdef _WIN32
@@ -662,29 +890,41 @@ int CLIENT_STATE::write_state_file() {
     return 0;
 }
 
-int CLIENT_STATE::write_state(MIOFILE& f) {
+// Write the state, item by item.
+// In a journal record, write only the items that have changed.
+//
+int CLIENT_STATE::write_state(STATE_WRITER& sw) {
     unsigned int i, j;
     int retval;
+    MIOFILE& f = sw.mf;
 
 #ifdef SIM
     fprintf(stderr, "simulator shouldn't write state file\n");
     exit(1);
 #endif
-    f.printf("<client_state>\n");
+    if (!sw.journal) sw.out.printf("<client_state>\n");
     retval = host_info.write(f, true, true);
     if (retval) return retval;
+    sw.done(state_hash[STATE_HOST_INFO]);
     retval = time_stats.write(f, false);
     if (retval) return retval;
+    sw.done(state_hash[STATE_TIME_STATS]);
     retval = net_stats.write(f);
     if (retval) return retval;
+    sw.done(state_hash[STATE_NET_STATS]);
     for (j=0; j<projects.size(); j++) {
         PROJECT* p = projects[j];
+        sw.set_project(NULL);
         retval = p->write_state(f);
         if (retval) return retval;
+        bool written = sw.done(p->journal_hash);
+        sw.set_project(p);
+        sw.project_written = written;
         for (i=0; i<apps.size(); i++) {
             if (apps[i]->project == p) {
                 retval = apps[i]->write(f);
                 if (retval) return retval;
+                sw.done(apps[i]->journal_hash);
             }
         }
         for (i=0; i<file_infos.size(); i++) {
@@ -695,26 +935,38 @@ int CLIENT_STATE::write_state(MIOFILE& f) {
             if (fip->anonymous_platform_file) continue;
             retval = fip->write(f, false);
             if (retval) return retval;
+            sw.done(fip->journal_hash);
         }
         for (i=0; i<app_versions.size(); i++) {
             if (app_versions[i]->project == p) {
                 app_versions[i]->write(f);
+                sw.done(app_versions[i]->journal_hash);
             }
         }
         for (i=0; i<workunits.size(); i++) {
-            if (workunits[i]->project == p) workunits[i]->write(f);
+            if (workunits[i]->project == p) {
+                workunits[i]->write(f);
+                sw.done(workunits[i]->journal_hash);
+            }
         }
         for (i=0; i<results.size(); i++) {
-            if (results[i]->project == p) results[i]->write(f, false);
+            if (results[i]->project == p) {
+                results[i]->write(f, false);
+                sw.done(results[i]->journal_hash);
+            }
         }
         p->write_project_files(f);
+        sw.done(p->journal_files_hash);
 #ifdef ENABLE_AUTO_UPDATE
         if (auto_update.present && auto_update.project==p) {
             auto_update.write(f);
+            sw.done(state_hash[STATE_AUTO_UPDATE]);
         }
 #endif
     }
+    sw.set_project(NULL);
     active_tasks.write(f);
+    sw.done(state_hash[STATE_ACTIVE_TASKS]);
     f.printf(
         "<platform_name>%s</platform_name>\n"
         "<core_client_major_version>%d</core_client_major_version>\n"
@@ -749,23 +1001,143 @@ int CLIENT_STATE::write_state(MIOFILE& f) {
     if (strlen(main_host_venue)) {
         f.printf("<host_venue>%s</host_venue>\n", main_host_venue);
     }
-    f.printf("</client_state>\n");
+    sw.done(state_hash[STATE_GLOBALS]);
+    if (!sw.journal) {
+        sw.out.printf(
+            "<state_generation>%d</state_generation>\n"
+            "</client_state>\n",
+            state_generation+1
+        );
+    }
     return 0;
 }
 
-// Write the client_state.xml file if necessary
+// Append the items that have changed since the last write
+// to the state journal.
+// Write the state file instead if needed (see above).
+//
+int CLIENT_STATE::write_state_journal() {
+    MFILE mf;
+    int retval;
+
+    mf.printf(
+        "<journal_record>\n"
+        "<state_generation>%d</state_generation>\n",
+        state_generation
+    );
+    STATE_WRITER sw(mf, true);
+    retval = write_state(sw);
+    if (retval) return retval;
+    if (sw.nold < state_nitems) {
+        if (log_flags.statefile_debug) {
+            msg_printf(0, MSG_INFO,
+                "[statefile] %d items deleted; writing state file",
+                state_nitems - sw.nold
+            );
+        }
+        return write_state_file();
+    }
+    state_nitems = sw.nitems;
+    if (!sw.nwritten) return 0;
+    if (state_journal_size + sw.nbytes > state_file_size) {
+        return write_state_file();
+    }
+    mf.printf("</journal_record>\n");
+    state_journal_ok = false;
+    retval = mf.open(STATE_JOURNAL_FILE_NAME, "a");
+    if (retval) {
+        msg_printf(0, MSG_INTERNAL_ERROR,
+            "Can't open %s: %s",
+            STATE_JOURNAL_FILE_NAME, boincerror(retval)
+        );
+        return retval;
+    }
+    retval = mf.close();
+    if (retval) {
+        // the record may be partly written;
+        // writing the state file deletes the journal
+        //
+        msg_printf(0, MSG_INTERNAL_ERROR,
+            "Can't write %s: %s; writing state file",
+            STATE_JOURNAL_FILE_NAME, boincerror(retval)
+        );
+        return write_state_file();
+    }
+    state_journal_ok = true;
+    state_journal_size += sw.nbytes;
+    if (log_flags.statefile_debug) {
+        show_state_write("state journal record", sw.nbytes, sw.nwritten);
+    }
+    return 0;
+}
+
+// Write the state file or a journal record if necessary
 // TODO: write no more often than X seconds
 //
 int CLIENT_STATE::write_state_file_if_needed() {
     int retval;
     if (client_state_dirty) {
         client_state_dirty = false;
-        retval = write_state_file();
+        if (state_journal_ok && !config.no_state_journal) {
+            retval = write_state_journal();
+        } else {
+            retval = write_state_file();
+        }
         if (retval) return retval;
     }
     return 0;
 }
 
+// Apply the records in the state journal, if any,
+// that follow the state file we just parsed.
+// The last record may be incomplete if we crashed while writing it;
+// ignore it.
+//
+int CLIENT_STATE::replay_state_journal() {
+    char* buf;
+    char* p;
+    char* q;
+    char* r;
+    char c;
+    int retval, gen, n=0;
+    const char* end_tag = "</journal_record>";
+
+    if (!boinc_file_exists(STATE_JOURNAL_FILE_NAME)) return 0;
+    retval = read_file_malloc(STATE_JOURNAL_FILE_NAME, buf);
+    if (retval) return retval;
+    p = buf;
+    while (1) {
+        q = strstr(p, "<journal_record>");
+        if (!q) break;
+        r = strstr(q, end_tag);
+        if (!r) break;
+        r += strlen(end_tag);
+        c = *r;
+        *r = 0;
+        gen = -1;
+        parse_int(q, "<state_generation>", gen);
+        if (gen == state_generation) {
+            MIOFILE mf;
+            XML_PARSER xp(&mf);
+            mf.init_buf_read(q);
+            parse_state_items(xp, true);
+            n++;
+        }
+        *r = c;
+        p = r;
+    }
+    free(buf);
+    if (n) {
+        sort_results();
+    }
+    if (log_flags.statefile_debug) {
+        msg_printf(0, MSG_INFO,
+            "[statefile] Applied %d state journal records", n
+        );
+    }
+    return 0;
+}
+
 #endif // ifndef SIM
 
 // look for app_versions.xml file in project dir.
@@ -887,15 +1259,21 @@ int CLIENT_STATE::parse_app_info(PROJECT* p, FILE* in) {
     return ERR_XML_PARSE;
 }
 
+GUI_STATE_LOG::GUI_STATE_LOG() {
+    seqno = 0;
+    scan = 0;
+    deletions_dropped = 0;
+    epoch = (int)time(0);
+}
+
 #ifndef SIM
 
-int CLIENT_STATE::write_state_gui(MIOFILE& f) {
-    unsigned int i, j;
+// the parts of the GUI state not associated with projects.
+// These are written before and after the projects
+//
+int CLIENT_STATE::write_host_info_gui(MIOFILE& f) {
     int retval;
 
-    f.printf("<client_state>\n");
-
-#if 1
     // NOTE: the following stuff is not in CC_STATE.
     // However, BoincView (which does its own parsing) expects it
     // to be in the get_state() reply, so leave it in for now
@@ -916,28 +1294,12 @@ int CLIENT_STATE::write_state_gui(MIOFILE& f) {
     if (retval) return retval;
     retval = net_stats.write(f);
     if (retval) return retval;
-#endif
+    return 0;
+}
+
+int CLIENT_STATE::write_client_info_gui(MIOFILE& f) {
+    unsigned int i;
 
-    for (j=0; j<projects.size(); j++) {
-        PROJECT* p = projects[j];
-        retval = p->write_state(f, true);
-        if (retval) return retval;
-        for (i=0; i<apps.size(); i++) {
-            if (apps[i]->project == p) {
-                retval = apps[i]->write(f);
-                if (retval) return retval;
-            }
-        }
-        for (i=0; i<app_versions.size(); i++) {
-            if (app_versions[i]->project == p) app_versions[i]->write(f);
-        }
-        for (i=0; i<workunits.size(); i++) {
-            if (workunits[i]->project == p) workunits[i]->write(f);
-        }
-        for (i=0; i<results.size(); i++) {
-            if (results[i]->project == p) results[i]->write_gui(f);
-        }
-    }
     f.printf(
         "<platform_name>%s</platform_name>\n"
         "<core_client_major_version>%d</core_client_major_version>\n"
@@ -963,11 +1325,332 @@ int CLIENT_STATE::write_state_gui(MIOFILE& f) {
     if (strlen(main_host_venue)) {
         f.printf("<host_venue>%s</host_venue>\n", main_host_venue);
     }
+    return 0;
+}
+
+int CLIENT_STATE::write_state_gui(MIOFILE& f) {
+    unsigned int i, j;
+    int retval;
+
+    f.printf("<client_state>\n");
+
+    retval = write_host_info_gui(f);
+    if (retval) return retval;
+
+    for (j=0; j<projects.size(); j++) {
+        PROJECT* p = projects[j];
+        retval = p->write_state(f, true);
+        if (retval) return retval;
+        for (i=0; i<apps.size(); i++) {
+            if (apps[i]->project == p) {
+                retval = apps[i]->write(f);
+                if (retval) return retval;
+            }
+        }
+        for (i=0; i<app_versions.size(); i++) {
+            if (app_versions[i]->project == p) app_versions[i]->write(f);
+        }
+        for (i=0; i<workunits.size(); i++) {
+            if (workunits[i]->project == p) workunits[i]->write(f);
+        }
+        for (i=0; i<results.size(); i++) {
+            if (results[i]->project == p) results[i]->write_gui(f);
+        }
+    }
+
+    retval = write_client_info_gui(f);
+    if (retval) return retval;
 
     f.printf("</client_state>\n");
     return 0;
 }
 
+// The get_state_changes() RPC.
+// The GUI state is a set of items: the global info (host, prefs etc.),
+// and the projects, apps, app versions, workunits and results.
+// Each time we reply, we write each item to a buffer and hash it.
+// If the item is new or its hash has changed,
+// it gets the next sequence number.
+// The GUI passes the sequence number of its last reply,
+// and we send it only the items with greater sequence numbers,
+// followed by the items that have been deleted since then.
+// Items belonging to a project are preceded by
+// <project_context> if the project itself isn't being sent.
+//
+// Sequence numbers are valid only for the lifetime of the client;
+// the reply includes an "epoch" (the client's start time),
+// and if the GUI passes a different one we send everything.
+// We also send everything if the GUI's sequence number
+// is older than the deletions we've remembered.
+// In this case the reply includes <full/>,
+// and the GUI should discard its old state.
+
+// Writes items of the GUI state;
+// each is written to a buffer (mf) and then passed to done().
+//
+struct GUI_STATE_WRITER {
+    MIOFILE& out;
+    GUI_STATE_LOG& log;
+    int since;
+    MFILE item;
+    MIOFILE mf;
+    PROJECT* project;
+    bool project_written;
+    int nwritten;
+
+    GUI_STATE_WRITER(MIOFILE& _out, GUI_STATE_LOG& _log, int _since):
+        out(_out), log(_log)
+    {
+        since = _since;
+        mf.init_mfile(&item);
+        project = NULL;
+        project_written = false;
+        nwritten = 0;
+    }
+
+    void set_project(PROJECT* p) {
+        project = p;
+        project_written = false;
+    }
+
+    // We've written an item to mf.
+    // Update its sequence number, and write it if it's changed
+    //
+    void done(GUI_STATE_ITEM& gi) {
+        const char* p;
+        int n;
+
+        item.peek_buf(p, n);
+        unsigned int h = state_item_hash(p, n);
+        if (!gi.seqno || h != gi.hash) {
+            gi.hash = h;
+            gi.seqno = ++log.seqno;
+        }
+        gi.scan = log.scan;
+        if (gi.seqno > since) {
+            if (project && !project_written) {
+                out.printf(
+                    "<project_context>%s</project_context>\n",
+                    project->master_url
+                );
+                project_written = true;
+            }
+            out.printf("%s", p);
+            nwritten++;
+        }
+        item.clear();
+    }
+};
+
+// Return the log entry for an item, creating it if needed.
+// "key" identifies the item (type, project URL, and name);
+// "deleted_xml" is what to send when it's deleted.
+// If an item with the same key was deleted, forget the deletion;
+// otherwise a GUI that missed both would get the new item
+// followed by the deletion.
+// The new item replaces the old one in the GUI's state.
+//
+GUI_STATE_ITEM* GUI_STATE_LOG::lookup(
+    const char* key, const char* deleted_xml
+) {
+    GUI_STATE_ITEM& gi = items[key];
+    if (!gi.seqno) {
+        std::deque<GUI_STATE_DELETION>::iterator iter = deletions.begin();
+        while (iter != deletions.end()) {
+            if (iter->key == key) {
+                iter = deletions.erase(iter);
+            } else {
+                iter++;
+            }
+        }
+    }
+    gi.deleted_xml = deleted_xml;
+    return &gi;
+}
+
+// record deletion of an item, and forget the oldest deletions
+//
+void GUI_STATE_LOG::deleted(const std::string& key, GUI_STATE_ITEM& gi) {
+    GUI_STATE_DELETION gd;
+    gd.seqno = ++seqno;
+    gd.key = key;
+    gd.xml = gi.deleted_xml;
+    deletions.push_back(gd);
+    while (deletions.size() > GUI_STATE_MAX_DELETIONS) {
+        deletions_dropped = deletions.front().seqno;
+        deletions.pop_front();
+    }
+}
+
+// Projects etc. point to their log entries,
+// so we need to build their keys only the first time we see them.
+// An entry is erased only when its object no longer exists.
+//
+int CLIENT_STATE::write_state_changes_gui(
+    MIOFILE& f, int epoch, int since
+) {
+    GUI_STATE_LOG& log = gui_state_log;
+    unsigned int i, j;
+    int retval;
+    char key[1024], buf[1024];
+    std::map<std::string, GUI_STATE_ITEM>::iterator iter;
+
+    bool full = !since || epoch != log.epoch
+        || since < log.deletions_dropped || since > log.seqno;
+    if (full) since = 0;
+    log.scan++;
+    GUI_STATE_WRITER gw(f, log, since);
+
+    f.printf("<client_state_changes>\n");
+    if (full) {
+        f.printf("<full/>\n");
+    }
+
+    gw.mf.printf("<client_info>\n");
+    retval = write_host_info_gui(gw.mf);
+    if (retval) return retval;
+    retval = write_client_info_gui(gw.mf);
+    if (retval) return retval;
+    gw.mf.printf("</client_info>\n");
+    gw.done(log.items["c"]);
+
+    for (j=0; j<projects.size(); j++) {
+        PROJECT* p = projects[j];
+        gw.set_project(p);
+        p->write_state(gw.mf, true);
+        if (!p->gui_state_item) {
+            snprintf(key, sizeof(key), "p %s", p->master_url);
+            snprintf(buf, sizeof(buf),
+                "<deleted_project>\n"
+                "    <master_url>%s</master_url>\n"
+                "</deleted_project>\n",
+                p->master_url
+            );
+            p->gui_state_item = log.lookup(key, buf);
+        }
+        gw.done(*p->gui_state_item);
+        for (i=0; i<apps.size(); i++) {
+            APP* app = apps[i];
+            if (app->project != p) continue;
+            app->write(gw.mf);
+            if (!app->gui_state_item) {
+                snprintf(key, sizeof(key), "a %s %s",
+                    p->master_url, app->name
+                );
+                snprintf(buf, sizeof(buf),
+                    "<deleted_app>\n"
+                    "    <project_url>%s</project_url>\n"
+                    "    <name>%s</name>\n"
+                    "</deleted_app>\n",
+                    p->master_url, app->name
+                );
+                app->gui_state_item = log.lookup(key, buf);
+            }
+            gw.done(*app->gui_state_item);
+        }
+        for (i=0; i<app_versions.size(); i++) {
+            APP_VERSION* avp = app_versions[i];
+            if (avp->project != p) continue;
+            avp->write(gw.mf);
+            if (!avp->gui_state_item) {
+                snprintf(key, sizeof(key), "v %s %s %d %s",
+                    p->master_url, avp->app_name, avp->version_num,
+                    avp->plan_class
+                );
+                snprintf(buf, sizeof(buf),
+                    "<deleted_app_version>\n"
+                    "    <project_url>%s</project_url>\n"
+                    "    <app_name>%s</app_name>\n"
+                    "    <version_num>%d</version_num>\n"
+                    "    <plan_class>%s</plan_class>\n"
+                    "</deleted_app_version>\n",
+                    p->master_url, avp->app_name, avp->version_num,
+                    avp->plan_class
+                );
+                avp->gui_state_item = log.lookup(key, buf);
+            }
+            gw.done(*avp->gui_state_item);
+        }
+        for (i=0; i<workunits.size(); i++) {
+            WORKUNIT* wup = workunits[i];
+            if (wup->project != p) continue;
+            wup->write(gw.mf);
+            if (!wup->gui_state_item) {
+                snprintf(key, sizeof(key), "w %s %s",
+                    p->master_url, wup->name
+                );
+                snprintf(buf, sizeof(buf),
+                    "<deleted_workunit>\n"
+                    "    <project_url>%s</project_url>\n"
+                    "    <name>%s</name>\n"
+                    "</deleted_workunit>\n",
+                    p->master_url, wup->name
+                );
+                wup->gui_state_item = log.lookup(key, buf);
+            }
+            gw.done(*wup->gui_state_item);
+        }
+        for (i=0; i<results.size(); i++) {
+            RESULT* rp = results[i];
+            if (rp->project != p) continue;
+            rp->write_gui(gw.mf);
+            if (!rp->gui_state_item) {
+                snprintf(key, sizeof(key), "r %s %s",
+                    p->master_url, rp->name
+                );
+                snprintf(buf, sizeof(buf),
+                    "<deleted_result>\n"
+                    "    <project_url>%s</project_url>\n"
+                    "    <name>%s</name>\n"
+                    "</deleted_result>\n",
+                    p->master_url, rp->name
+                );
+                rp->gui_state_item = log.lookup(key, buf);
+            }
+            gw.done(*rp->gui_state_item);
+        }
+    }
+
+    // items we didn't see have been deleted.
+    // Record results before workunits etc.,
+    // so that the GUI never has a result without its workunit
+    //
+    const char* types = "rwvap";
+    for (i=0; types[i]; i++) {
+        key[0] = types[i];
+        key[1] = 0;
+        iter = log.items.lower_bound(key);
+        while (iter != log.items.end() && iter->first[0] == types[i]) {
+            if (iter->second.scan == log.scan) {
+                iter++;
+                continue;
+            }
+            log.deleted(iter->first, iter->second);
+            log.items.erase(iter++);
+        }
+    }
+
+    if (!full) {
+        for (i=0; i<log.deletions.size(); i++) {
+            if (log.deletions[i].seqno <= since) continue;
+            f.printf("%s", log.deletions[i].xml.c_str());
+        }
+    }
+    f.printf(
+        "<epoch>%d</epoch>\n"
+        "<seqno>%d</seqno>\n"
+        "</client_state_changes>\n",
+        log.epoch, log.seqno
+    );
+    if (log_flags.gui_rpc_debug) {
+        msg_printf(0, MSG_INFO,
+            "[gui_rpc] get_state_changes since %d: sent %d of %d items",
+            since, gw.nwritten, (int)log.items.size()
+        );
+    }
+    return 0;
+}
+
 int CLIENT_STATE::write_tasks_gui(MIOFILE& f, bool active_only) {
     unsigned int i;
 
@@ -0,0 +1,139 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2012 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "config.h"
+#include "epoll_set.h"
+
+#ifdef USE_EPOLL
+
+#include <cerrno>
+#include <cmath>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#include "error_numbers.h"
+
+#define EPOLL_SET_MAX_EVENTS    64
+
+EPOLL_SET epoll_set;
+
+EPOLL_SET::EPOLL_SET() {
+    epfd = -1;
+    seqno = 0;
+    wakeup = false;
+}
+
+int EPOLL_SET::init() {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) return ERR_SOCKET;
+    return 0;
+}
+
+static unsigned int epoll_events(int events) {
+    unsigned int e = 0;
+    if (events & EPOLL_SET_READ) e |= EPOLLIN;
+    if (events & EPOLL_SET_WRITE) e |= EPOLLOUT;
+    return e;
+}
+
+int EPOLL_SET::set(int fd, int events, EPOLL_HANDLER handler, void* arg) {
+    struct epoll_event ev;
+    int retval, op;
+
+    if (fd < 0) return ERR_SOCKET;
+    if (fd >= (int)watches.size()) {
+        EPOLL_WATCH w;
+        w.handler = NULL;
+        w.arg = NULL;
+        w.events = 0;
+        w.seqno = 0;
+        watches.resize(fd+1, w);
+    }
+    EPOLL_WATCH& w = watches[fd];
+    if (w.handler) {
+        op = EPOLL_CTL_MOD;
+    } else {
+        op = EPOLL_CTL_ADD;
+        w.seqno = ++seqno;
+    }
+    ev.events = epoll_events(events);
+    ev.data.u64 = ((unsigned long long)w.seqno << 32) | (unsigned int)fd;
+    retval = epoll_ctl(epfd, op, fd, &ev);
+    if (retval && op == EPOLL_CTL_ADD && errno == EEXIST) {
+        // the kernel still has the descriptor
+        // (e.g. it was dup'd before being closed without remove())
+        //
+        retval = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    } else if (retval && op == EPOLL_CTL_MOD && errno == ENOENT) {
+        // the descriptor was closed (which removes it from the epoll set)
+        // and the number reused without remove(); add the new one
+        //
+        w.seqno = ++seqno;
+        ev.data.u64 = ((unsigned long long)w.seqno << 32) | (unsigned int)fd;
+        retval = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (retval) {
+        w.handler = NULL;
+        return ERR_SOCKET;
+    }
+    w.handler = handler;
+    w.arg = arg;
+    w.events = events;
+    return 0;
+}
+
+void EPOLL_SET::remove(int fd) {
+    if (fd < 0 || fd >= (int)watches.size()) return;
+    EPOLL_WATCH& w = watches[fd];
+    if (!w.handler) return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    w.handler = NULL;
+    w.arg = NULL;
+}
+
+int EPOLL_SET::wait(double timeout) {
+    struct epoll_event events[EPOLL_SET_MAX_EVENTS];
+    int i, n, ms;
+
+    ms = timeout>0?(int)ceil(timeout*1000):0;
+    n = epoll_wait(epfd, events, EPOLL_SET_MAX_EVENTS, ms);
+    if (n < 0) return 0;        // e.g. EINTR
+    for (i=0; i<n; i++) {
+        int fd = (int)(events[i].data.u64 & 0xffffffff);
+        unsigned int s = (unsigned int)(events[i].data.u64 >> 32);
+
+        // a previous handler may have removed or replaced this descriptor
+        //
+        if (fd >= (int)watches.size()) continue;
+        EPOLL_WATCH& w = watches[fd];
+        if (!w.handler || w.seqno != s) continue;
+
+        int e = 0;
+        if (events[i].events & EPOLLIN) e |= EPOLL_SET_READ;
+        if (events[i].events & EPOLLOUT) e |= EPOLL_SET_WRITE;
+        if (events[i].events & (EPOLLERR|EPOLLHUP)) e |= EPOLL_SET_ERROR;
+
+        // copy these; the handler may change "watches"
+        //
+        EPOLL_HANDLER handler = w.handler;
+        void* arg = w.arg;
+        handler(fd, e, arg);
+    }
+    return n;
+}
+
+#endif
@@ -0,0 +1,84 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2012 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef _EPOLL_SET_H_
+#define _EPOLL_SET_H_
+
+// On Linux the client waits for network I/O (GUI RPC and curl sockets)
+// using epoll rather than select().
+// With select(), do_io_or_sleep() rebuilds the descriptor sets
+// on each pass, each wakeup costs time proportional to
+// the number of descriptors, and descriptors >= FD_SETSIZE can't be used.
+// With epoll, a descriptor is registered when it's created,
+// along with a handler function;
+// EPOLL_SET::wait() calls the handlers of the ones that are ready.
+//
+// If epoll isn't available at runtime, we use select() as before.
+
+#if defined(HAVE_EPOLL_CREATE1) && !defined(SIM)
+#define USE_EPOLL
+#endif
+
+#ifdef USE_EPOLL
+
+#include <vector>
+
+#define EPOLL_SET_READ      1
+#define EPOLL_SET_WRITE     2
+#define EPOLL_SET_ERROR     4
+
+typedef void (*EPOLL_HANDLER)(int fd, int events, void* arg);
+
+struct EPOLL_WATCH {
+    EPOLL_HANDLER handler;
+        // NULL if descriptor isn't registered
+    void* arg;
+    int events;
+    unsigned int seqno;
+        // distinguishes successive uses of a descriptor,
+        // so that we don't pass an event for a closed descriptor
+        // to the handler of a new one with the same number
+};
+
+struct EPOLL_SET {
+    int epfd;
+    std::vector<EPOLL_WATCH> watches;
+        // indexed by descriptor
+    unsigned int seqno;
+    bool wakeup;
+        // set by a handler to make do_io_or_sleep() return
+        // (e.g. so that an exited task is handled right away)
+
+    EPOLL_SET();
+    int init();
+    bool active() {
+        return epfd >= 0;
+    }
+    int set(int fd, int events, EPOLL_HANDLER, void* arg);
+        // register a descriptor, or change its events or handler
+    void remove(int fd);
+        // call this before closing a registered descriptor
+    int wait(double timeout);
+        // wait up to the given time (seconds) for I/O,
+        // and call the handlers of ready descriptors.
+        // Return the number of ready descriptors
+};
+
+extern EPOLL_SET epoll_set;
+
+#endif
+#endif
@@ -86,6 +86,7 @@ extern void send_log_after(const char* filename, double t, MIOFILE& mf);
 #define STATE_FILE_NEXT             "client_state_next.xml"
 #define STATE_FILE_NAME             "client_state.xml"
 #define STATE_FILE_PREV             "client_state_prev.xml"
+#define STATE_JOURNAL_FILE_NAME     "client_state_journal.xml"
 #define STDERR_FILE_NAME            "stderr.txt"
 #define STDOUT_FILE_NAME            "stdout.txt"
 #define SWITCHER_DIR                "switcher"
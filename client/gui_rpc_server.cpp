@@ -65,6 +65,7 @@
 #include "file_names.h"
 #include "client_msgs.h"
 #include "client_state.h"
+#include "epoll_set.h"
 #include "sandbox.h"
 
 using std::string;
@@ -89,6 +90,9 @@ GUI_RPC_CONN::GUI_RPC_CONN(int s) :
 }
 
 GUI_RPC_CONN::~GUI_RPC_CONN() {
+#ifdef USE_EPOLL
+    epoll_set.remove(sock);
+#endif
     boinc_close_socket(sock);
 }
 
@@ -202,8 +206,23 @@ int GUI_RPC_CONN_SET::get_allowed_hosts() {
     return 0;
 }
 
+#ifdef USE_EPOLL
+static void gui_rpc_listen_ready(int, int, void*) {
+    gstate.gui_rpcs.accept_connection();
+}
+
+static void gui_rpc_conn_ready(int, int events, void* arg) {
+    gstate.gui_rpcs.conn_ready((GUI_RPC_CONN*)arg, events);
+}
+#endif
+
 int GUI_RPC_CONN_SET::insert(GUI_RPC_CONN* p) {
     gui_rpcs.push_back(p);
+#ifdef USE_EPOLL
+    if (epoll_set.active()) {
+        epoll_set.set(p->sock, EPOLL_SET_READ, gui_rpc_conn_ready, p);
+    }
+#endif
     return 0;
 }
 
@@ -287,6 +306,11 @@ int GUI_RPC_CONN_SET::init(bool last_time) {
         lsock = -1;
         return ERR_LISTEN;
     }
+#ifdef USE_EPOLL
+    if (epoll_set.active()) {
+        epoll_set.set(lsock, EPOLL_SET_READ, gui_rpc_listen_ready, NULL);
+    }
+#endif
     return 0;
 }
 
@@ -358,73 +382,81 @@ bool GUI_RPC_CONN_SET::check_allowed_list(sockaddr_storage& peer_ip) {
     return false;
 }
 
-void GUI_RPC_CONN_SET::got_select(FDSET_GROUP& fg) {
-    int sock, retval;
-    vector<GUI_RPC_CONN*>::iterator iter;
+// accept a connection on the listening socket
+//
+void GUI_RPC_CONN_SET::accept_connection() {
+    int sock;
     GUI_RPC_CONN* gr;
     bool is_local = false;
+    struct sockaddr_storage addr;
+
+    // For unknown reasons, the FD_ISSET() in got_select() succeeds
+    // after a SIGTERM, SIGHUP, SIGINT or SIGQUIT is received,
+    // even if there is no data available on the socket.
+    // This causes the accept() call to block, preventing the main 
+    // loop from processing the exit request.
+    // This is a workaround for that problem.
+    //
+    if (gstate.requested_exit) {
+        return;
+    }
 
-    if (lsock < 0) return;
-
-    if (FD_ISSET(lsock, &fg.read_fds)) {
-        struct sockaddr_storage addr;
-
-        // For unknown reasons, the FD_ISSET() above succeeds
-        // after a SIGTERM, SIGHUP, SIGINT or SIGQUIT is received,
-        // even if there is no data available on the socket.
-        // This causes the accept() call to block, preventing the main 
-        // loop from processing the exit request.
-        // This is a workaround for that problem.
-        //
-        if (gstate.requested_exit) {
-            return;
-        }
-
-        BOINC_SOCKLEN_T addr_len = sizeof(addr);
-        sock = accept(lsock, (struct sockaddr*)&addr, (BOINC_SOCKLEN_T*)&addr_len);
-        if (sock == -1) {
-            return;
-        }
+    BOINC_SOCKLEN_T addr_len = sizeof(addr);
+    sock = accept(lsock, (struct sockaddr*)&addr, (BOINC_SOCKLEN_T*)&addr_len);
+    if (sock == -1) {
+        return;
+    }
 
-        // apps shouldn't inherit the socket!
-        //
+    // apps shouldn't inherit the socket!
+    //
 #ifndef _WIN32
-        fcntl(sock, F_SETFD, FD_CLOEXEC);
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
 #endif
 
-        bool allowed;
-         
-        // accept the connection if:
-        // 1) allow_remote_gui_rpc is set or
-        // 2) client host is included in "remote_hosts" file or
-        // 3) client is on localhost
+    bool allowed;
+     
+    // accept the connection if:
+    // 1) allow_remote_gui_rpc is set or
+    // 2) client host is included in "remote_hosts" file or
+    // 3) client is on localhost
+    //
+    if (is_localhost(addr)) {
+        allowed = true;
+        is_local = true;
+    } else {
+        // reread host file because IP addresses might have changed
         //
-        if (is_localhost(addr)) {
-            allowed = true;
-            is_local = true;
-        } else {
-            // reread host file because IP addresses might have changed
-            //
-            get_allowed_hosts();
-            allowed = check_allowed_list(addr);
-        }
+        get_allowed_hosts();
+        allowed = check_allowed_list(addr);
+    }
 
-        if (!(config.allow_remote_gui_rpc) && !(allowed)) {
-            show_connect_error(addr);
-            boinc_close_socket(sock);
-        } else {
-            gr = new GUI_RPC_CONN(sock);
-            if (strlen(password)) {
-                gr->auth_needed = true;
-            }
-            gr->is_local = is_local;
-            if (log_flags.gui_rpc_debug) {
-                msg_printf(0, MSG_INFO,
-                    "[gui_rpc] got new GUI RPC connection"
-                );
-            }
-            insert(gr);
+    if (!(config.allow_remote_gui_rpc) && !(allowed)) {
+        show_connect_error(addr);
+        boinc_close_socket(sock);
+    } else {
+        gr = new GUI_RPC_CONN(sock);
+        if (strlen(password)) {
+            gr->auth_needed = true;
+        }
+        gr->is_local = is_local;
+        if (log_flags.gui_rpc_debug) {
+            msg_printf(0, MSG_INFO,
+                "[gui_rpc] got new GUI RPC connection"
+            );
         }
+        insert(gr);
+    }
+}
+
+void GUI_RPC_CONN_SET::got_select(FDSET_GROUP& fg) {
+    int retval;
+    vector<GUI_RPC_CONN*>::iterator iter;
+    GUI_RPC_CONN* gr;
+
+    if (lsock < 0) return;
+
+    if (FD_ISSET(lsock, &fg.read_fds)) {
+        accept_connection();
     }
 
     // delete connections with failed sockets
@@ -463,6 +495,36 @@ void GUI_RPC_CONN_SET::got_select(FDSET_GROUP& fg) {
     }
 }
 
+#ifdef USE_EPOLL
+// epoll version of the above, for a single connection
+//
+void GUI_RPC_CONN_SET::conn_ready(GUI_RPC_CONN* gr, int events) {
+    int retval = 0;
+
+    if (events & EPOLL_SET_READ) {
+        retval = gr->handle_rpc();
+        if (retval && log_flags.gui_rpc_debug) {
+            msg_printf(NULL, MSG_INFO,
+                "[gui_rpc] handler returned %d, closing socket\n",
+                retval
+            );
+        }
+    } else if (events & EPOLL_SET_ERROR) {
+        retval = ERR_READ;
+    }
+    if (!retval) return;
+    vector<GUI_RPC_CONN*>::iterator iter = gui_rpcs.begin();
+    while (iter != gui_rpcs.end()) {
+        if (*iter == gr) {
+            gui_rpcs.erase(iter);
+            break;
+        }
+        iter++;
+    }
+    delete gr;
+}
+#endif
+
 // called when client is shutting down
 //
 void GUI_RPC_CONN_SET::close() {
@@ -472,6 +534,9 @@ void GUI_RPC_CONN_SET::close() {
         );
     }
     if (lsock >= 0) {
+#ifdef USE_EPOLL
+        epoll_set.remove(lsock);
+#endif
         boinc_close_socket(lsock);
         lsock = -1;
     }
@@ -110,6 +110,9 @@ public:
     char password[256];
     void get_fdset(FDSET_GROUP&, FDSET_GROUP&);
     void got_select(FDSET_GROUP&);
+    void accept_connection();
+    void conn_ready(GUI_RPC_CONN*, int events);
+        // called if USE_EPOLL (see epoll_set.h)
     int init(bool last_time);
     void close();
     bool recent_rpc_needs_network(double interval);
@@ -1019,6 +1019,16 @@ static void handle_get_state(GUI_RPC_CONN& grc) {
     gstate.write_state_gui(grc.mfout);
 }
 
+static void handle_get_state_changes(GUI_RPC_CONN& grc) {
+    int epoch = 0, seqno = 0;
+
+    while (!grc.xp.get_tag()) {
+        if (grc.xp.parse_int("epoch", epoch)) continue;
+        if (grc.xp.parse_int("seqno", seqno)) continue;
+    }
+    gstate.write_state_changes_gui(grc.mfout, epoch, seqno);
+}
+
 static void handle_set_cc_config(GUI_RPC_CONN& grc) {
     int retval;
     char buf[65536];
@@ -1171,6 +1181,7 @@ GUI_RPC gui_rpcs[] = {
     GUI_RPC("get_screensaver_tasks", handle_get_screensaver_tasks,  false,  false,  true),
     GUI_RPC("get_simple_gui_info", handle_get_simple_gui_info,      false,  false,  true),
     GUI_RPC("get_state", handle_get_state,                          false,  false,  true),
+    GUI_RPC("get_state_changes", handle_get_state_changes,          false,  false,  true),
     GUI_RPC("get_statistics", handle_get_statistics,                false,  false,  true),
 
     // ops requiring local auth start here
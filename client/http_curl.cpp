@@ -53,6 +53,7 @@
 #include "cs_proxy.h"
 #include "net_stats.h"
 
+#include "epoll_set.h"
 #include "http_curl.h"
 
 using std::min;
@@ -846,11 +847,99 @@ void HTTP_OP::setup_proxy_session(bool no_proxy) {
 //
 fd_set read_fds, write_fds, error_fds;
 
+#ifdef USE_EPOLL
+
+// If we're using epoll, curl tells us which of its sockets to watch
+// (curl_socket_func()) and when it next needs to be called
+// to handle timeouts (curl_timer_func()).
+// We call curl_multi_socket_action() when a socket is ready
+// or the time arrives.
+// This replaces curl_multi_fdset() and curl_multi_perform(),
+// which look at all transfers on each call.
+
+static double curl_timer_time = 0;
+    // when curl wants to be called; 0 if never
+
+static void curl_socket_ready(int fd, int events, void*) {
+    int running, mask = 0;
+
+    if (events & EPOLL_SET_READ) mask |= CURL_CSELECT_IN;
+    if (events & EPOLL_SET_WRITE) mask |= CURL_CSELECT_OUT;
+    if (events & EPOLL_SET_ERROR) mask |= CURL_CSELECT_ERR;
+    curl_multi_socket_action(g_curlMulti, fd, mask, &running);
+    gstate.http_ops->read_messages();
+}
+
+static int curl_socket_func(
+    CURL*, curl_socket_t s, int what, void*, void*
+) {
+    switch (what) {
+    case CURL_POLL_REMOVE:
+        epoll_set.remove(s);
+        break;
+    case CURL_POLL_IN:
+        epoll_set.set(s, EPOLL_SET_READ, curl_socket_ready, NULL);
+        break;
+    case CURL_POLL_OUT:
+        epoll_set.set(s, EPOLL_SET_WRITE, curl_socket_ready, NULL);
+        break;
+    case CURL_POLL_INOUT:
+        epoll_set.set(
+            s, EPOLL_SET_READ|EPOLL_SET_WRITE, curl_socket_ready, NULL
+        );
+        break;
+    }
+    return 0;
+}
+
+static int curl_timer_func(CURLM*, long timeout_ms, void*) {
+    if (timeout_ms < 0) {
+        curl_timer_time = 0;
+    } else {
+        curl_timer_time = dtime() + timeout_ms/1000.;
+    }
+    return 0;
+}
+
+// return how long we can wait for I/O (at most "max")
+// before curl needs to be called
+//
+double HTTP_OP_SET::epoll_timeout(double max) {
+    if (!curl_timer_time) return max;
+    double x = curl_timer_time - dtime();
+    if (x < 0) return 0;
+    if (x > max) return max;
+    return x;
+}
+
+// if curl's timer has expired, call it
+//
+void HTTP_OP_SET::epoll_timer() {
+    int running;
+
+    if (!curl_timer_time || curl_timer_time > dtime()) return;
+    curl_timer_time = 0;
+    curl_multi_socket_action(g_curlMulti, CURL_SOCKET_TIMEOUT, 0, &running);
+    read_messages();
+}
+
+#endif
+
 // call these once at the start of the program and once at the end
 //
 int curl_init() {
     curl_global_init(CURL_GLOBAL_ALL);
     g_curlMulti = curl_multi_init();
+#ifdef USE_EPOLL
+    if (g_curlMulti && epoll_set.active()) {
+        curl_multi_setopt(
+            g_curlMulti, CURLMOPT_SOCKETFUNCTION, curl_socket_func
+        );
+        curl_multi_setopt(
+            g_curlMulti, CURLMOPT_TIMERFUNCTION, curl_timer_func
+        );
+    }
+#endif
     return (int)(g_curlMulti == NULL);
 }
 
@@ -1053,10 +1142,6 @@ void HTTP_OP::handle_messages(CURLMsg *pcurlMsg) {
 }
 
 void HTTP_OP_SET::got_select(FDSET_GROUP&, double timeout) {
-    int iNumMsg;
-    HTTP_OP* hop = NULL;
-    CURLMsg *pcurlMsg = NULL;
-
     int iRunning = 0;  // curl flags for max # of fds & # running queries
     CURLMcode curlMErr;
 
@@ -1069,8 +1154,16 @@ void HTTP_OP_SET::got_select(FDSET_GROUP&, double timeout) {
         if (dtime() - gstate.now > timeout) break;
     }
 
-    // read messages from curl that may have come in from the above loop
-    //
+    read_messages();
+}
+
+// read messages from curl about finished transfers
+//
+void HTTP_OP_SET::read_messages() {
+    int iNumMsg;
+    HTTP_OP* hop = NULL;
+    CURLMsg *pcurlMsg = NULL;
+
     while (1) {
         pcurlMsg = curl_multi_info_read(g_curlMulti, &iNumMsg);
         if (!pcurlMsg) break;
@@ -200,6 +200,10 @@ public:
 
 	void get_fdset(FDSET_GROUP&);
     void got_select(FDSET_GROUP&, double);
+    void read_messages();
+    double epoll_timeout(double max);
+    void epoll_timer();
+        // the above two are used if USE_EPOLL (see epoll_set.h)
     HTTP_OP* lookup_curl(CURL* pcurl);
         // lookup by easycurl handle
     void cleanup_temp_files();
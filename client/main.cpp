@@ -62,6 +62,7 @@
 #include "file_names.h"
 #include "log_flags.h"
 #include "client_msgs.h"
+#include "epoll_set.h"
 #include "http_curl.h"
 #include "sandbox.h"
 
@@ -254,6 +255,11 @@ static int initialize() {
     }
 #endif
 
+#ifdef USE_EPOLL
+    // do this before curl_init(); it tells curl how to wait for I/O
+    //
+    epoll_set.init();
+#endif
     curl_init();
 
 #ifdef _WIN32
@@ -49,6 +49,7 @@ PERS_FILE_XFER::PERS_FILE_XFER() {
     last_time = 0;
     last_bytes_xferred = 0;
     pers_xfer_done = false;
+    existing_file_invalid = false;
     fxp = NULL;
     fip = NULL;
 }
@@ -96,30 +97,19 @@ int PERS_FILE_XFER::create_xfer() {
         return ERR_IDLE_PERIOD;
     }
 
-    // if download, see if file already exists and is valid
+    // if download, see if file already exists and is valid.
+    // If it's large this is done in the background;
+    // existing_file_verified() is called when it's done.
     //
     if (!is_upload) {
-        char pathname[256];
-        get_pathname(fip, pathname, sizeof(pathname));
-
-        if (!fip->verify_file(true, false)) {
-            retval = fip->set_permissions();
-            fip->status = FILE_PRESENT;
-            pers_xfer_done = true;
-
-            if (log_flags.file_xfer) {
-                msg_printf(
-                    fip->project, MSG_INFO,
-                    "File %s exists already, skipping download", fip->name
-                );
-            }
-
-            return 0;
-        } else {
-            // Mark file as not present but don't delete it.
-            // It might partly downloaded.
-            //
-            fip->status = FILE_NOT_PRESENT;
+        if (fip->status == FILE_VERIFY_PENDING) {
+            return ERR_IN_PROGRESS;
+        }
+        if (!existing_file_invalid) {
+            retval = fip->verify_file(true, false, true);
+            if (retval == ERR_IN_PROGRESS) return retval;
+            existing_file_verified(retval);
+            if (pers_xfer_done) return 0;
         }
     }
 
@@ -161,6 +151,30 @@ int PERS_FILE_XFER::create_xfer() {
     return 0;
 }
 
+// We've checked whether a file to be downloaded is already on disk
+// and valid; if so we're done
+//
+void PERS_FILE_XFER::existing_file_verified(int retval) {
+    if (!retval) {
+        retval = fip->set_permissions();
+        fip->status = FILE_PRESENT;
+        pers_xfer_done = true;
+
+        if (log_flags.file_xfer) {
+            msg_printf(
+                fip->project, MSG_INFO,
+                "File %s exists already, skipping download", fip->name
+            );
+        }
+    } else {
+        // Mark file as not present but don't delete it.
+        // It might partly downloaded.
+        //
+        fip->status = FILE_NOT_PRESENT;
+        existing_file_invalid = true;
+    }
+}
+
 // Poll the status of this persistent file transfer.
 // If it's time to start it, then attempt to start it.
 // If it has finished or failed:
@@ -99,6 +99,9 @@ public:
         // Save how much is transferred when transfer isn't active, used
         // to display progress in GUI.
     bool pers_xfer_done;
+    bool existing_file_invalid;
+        // a background check found that the file on disk isn't valid;
+        // don't check it again before downloading
     FILE_XFER* fxp;
         // nonzero if file xfer in progress
     FILE_INFO* fip;
@@ -113,6 +116,7 @@ public:
     int write(MIOFILE& fout);
     int parse(XML_PARSER&);
     int create_xfer();
+    void existing_file_verified(int retval);
     int start_xfer();
     void suspend();
 };
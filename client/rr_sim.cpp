@@ -63,13 +63,21 @@ inline void rsc_string(RESULT* rp, char* buf) {
 //
 struct RR_SIM {
     vector<RESULT*> active;
+        // jobs running in the simulation, GPU jobs first
+    vector<RESULT*> rsc_active[MAX_RSC];
+        // the jobs picked for each processor type
+    bool pick_needed[MAX_RSC];
+        // a job for this processor type finished since we picked jobs for it.
+        // The jobs picked for a processor type depend only on
+        // its pending lists (project priorities start at the same
+        // place each time) so if this is false we can reuse them.
 
     inline void activate(RESULT* rp) {
         PROJECT* p = rp->project;
-        active.push_back(rp);
         rsc_work_fetch[0].sim_nused += rp->avp->avg_ncpus;
         p->rsc_pwf[0].sim_nused += rp->avp->avg_ncpus;
         int rt = rp->avp->gpu_usage.rsc_type;
+        rsc_active[rt].push_back(rp);
         if (rt) {
             rsc_work_fetch[rt].sim_nused += rp->avp->gpu_usage.usage;
             p->rsc_pwf[rt].sim_nused += rp->avp->gpu_usage.usage;
@@ -80,7 +88,11 @@ struct RR_SIM {
     void pick_jobs_to_run(double reltime);
     void simulate();
 
-    RR_SIM() {}
+    RR_SIM() {
+        for (int i=0; i<MAX_RSC; i++) {
+            pick_needed[i] = true;
+        }
+    }
     ~RR_SIM() {}
 
 };
@@ -168,10 +180,19 @@ void RR_SIM::init_pending_lists() {
 // pick jobs to run; put them in "active" list.
 // Simulate what the job scheduler would do:
 // pick a job from the project P with highest scheduling priority,
-// then adjust P's scheduling priority
+// then adjust P's scheduling priority.
+// Only processor types for which a job has finished
+// since the last call need to be redone.
 //
 void RR_SIM::pick_jobs_to_run(double reltime) {
-    active.clear();
+    int rt;
+
+    // GPU jobs use CPUs too; if we redo a GPU type, redo the CPU.
+    //
+    for (rt=1; rt<coprocs.n_rsc; rt++) {
+        if (pick_needed[rt]) pick_needed[0] = true;
+    }
+    if (!pick_needed[0]) return;
 
     // save and restore rec_temp
     //
@@ -182,9 +203,13 @@ void RR_SIM::pick_jobs_to_run(double reltime) {
 
     // loop over resource types; do the GPUs first
     //
-    for (int rt=coprocs.n_rsc-1; rt>=0; rt--) {
+    for (rt=coprocs.n_rsc-1; rt>=0; rt--) {
         vector<PROJECT*> project_heap;
 
+        if (!pick_needed[rt]) continue;
+        pick_needed[rt] = false;
+        rsc_active[rt].clear();
+
         // Make a heap of projects with runnable jobs for this resource,
         // ordered by scheduling priority.
         // Clear usage counts.
@@ -251,9 +276,11 @@ void RR_SIM::pick_jobs_to_run(double reltime) {
                 pop_heap(project_heap.begin(), project_heap.end());
                 project_heap.pop_back();
             } else if (!rp->rrsim_done) {
-                // Otherwise reshuffle the heap
+                // Otherwise reshuffle the heap.
+                // Only p's priority has changed, so this is O(log n)
                 //
-                make_heap(project_heap.begin(), project_heap.end());
+                pop_heap(project_heap.begin(), project_heap.end());
+                push_heap(project_heap.begin(), project_heap.end());
             }
         }
     }
@@ -262,6 +289,11 @@ void RR_SIM::pick_jobs_to_run(double reltime) {
         PROJECT* p = gstate.projects[i];
         p->pwf.rec_temp = p->pwf.rec_temp_save;
     }
+
+    active.clear();
+    for (rt=coprocs.n_rsc-1; rt>=0; rt--) {
+        active.insert(active.end(), rsc_active[rt].begin(), rsc_active[rt].end());
+    }
 }
 
 static void record_nidle_now() {
@@ -370,6 +402,7 @@ void RR_SIM::simulate() {
             }
         } else {
             rpbest->rrsim_done = true;
+            pick_needed[rpbest->avp->gpu_usage.rsc_type] = true;
             pbest = rpbest->project;
             if (log_flags.rr_simulation) {
                 msg_printf(pbest, MSG_INFO,
@@ -261,6 +261,7 @@ void CLIENT_STATE::handle_completed_results(PROJECT* p) {
                 spp->project_results.nresults_met_deadline++;
             }
             html_msg += buf;
+            result_index.remove(rp);
             delete rp;
             result_iter = results.erase(result_iter);
         } else {
@@ -407,7 +408,7 @@ bool CLIENT_STATE::simulate_rpc(PROJECT* p) {
         new_results.push_back(rp);
 #if 0
         sprintf(buf, "got job %s: CPU time %.2f, deadline %s<br>",
-            rp->name, rp->final_cpu_time, time_to_string(rp->report_deadline)
+            rp->name, rp->final_cpu_time, time_to_string(rp->report_deadline, buf2)
         );
         html_msg += buf;
 #endif
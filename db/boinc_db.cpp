@@ -48,6 +48,19 @@ extern "C" {
 
 DB_CONN boinc_db;
 
+// programs that access the DB from several threads
+// give each thread its own connection (see DB_CONN_POOL)
+//
+static __thread DB_CONN* thread_db_conn = 0;
+
+DB_CONN* thread_db() {
+    return thread_db_conn?thread_db_conn:&boinc_db;
+}
+
+void set_thread_db(DB_CONN* p) {
+    thread_db_conn = p;
+}
+
 static struct random_init {
     random_init() {
         srand48(getpid() + time(0));
@@ -88,54 +101,60 @@ void SCHED_TRIGGER_ITEM::clear() {
 void FILESET_SCHED_TRIGGER_ITEM::clear() {memset(this, 0, sizeof(*this));}
 
 DB_PLATFORM::DB_PLATFORM(DB_CONN* dc) :
-    DB_BASE("platform", dc?dc:&boinc_db){}
+    DB_BASE("platform", dc?dc:thread_db()){}
 DB_APP::DB_APP(DB_CONN* dc) :
-    DB_BASE("app", dc?dc:&boinc_db){}
+    DB_BASE("app", dc?dc:thread_db()){}
 DB_APP_VERSION::DB_APP_VERSION(DB_CONN* dc) :
-    DB_BASE("app_version", dc?dc:&boinc_db){}
+    DB_BASE("app_version", dc?dc:thread_db()){}
 DB_USER::DB_USER(DB_CONN* dc) :
-    DB_BASE("user", dc?dc:&boinc_db){}
+    DB_BASE("user", dc?dc:thread_db()){}
 DB_TEAM::DB_TEAM(DB_CONN* dc) :
-    DB_BASE("team", dc?dc:&boinc_db){}
+    DB_BASE("team", dc?dc:thread_db()){}
 DB_HOST::DB_HOST(DB_CONN* dc) :
-    DB_BASE("host", dc?dc:&boinc_db){}
+    DB_BASE("host", dc?dc:thread_db()){}
 DB_WORKUNIT::DB_WORKUNIT(DB_CONN* dc) :
-    DB_BASE("workunit", dc?dc:&boinc_db){}
+    DB_BASE("workunit", dc?dc:thread_db()){}
 DB_CREDITED_JOB::DB_CREDITED_JOB(DB_CONN* dc) :
-    DB_BASE("credited_job", dc?dc:&boinc_db){}
+    DB_BASE("credited_job", dc?dc:thread_db()){}
 DB_RESULT::DB_RESULT(DB_CONN* dc) :
-    DB_BASE("result", dc?dc:&boinc_db){}
+    DB_BASE("result", dc?dc:thread_db()){}
 DB_MSG_FROM_HOST::DB_MSG_FROM_HOST(DB_CONN* dc) :
-    DB_BASE("msg_from_host", dc?dc:&boinc_db){}
+    DB_BASE("msg_from_host", dc?dc:thread_db()){}
 DB_MSG_TO_HOST::DB_MSG_TO_HOST(DB_CONN* dc) :
-    DB_BASE("msg_to_host", dc?dc:&boinc_db){}
+    DB_BASE("msg_to_host", dc?dc:thread_db()){}
 DB_ASSIGNMENT::DB_ASSIGNMENT(DB_CONN* dc) :
-    DB_BASE("assignment", dc?dc:&boinc_db){}
+    DB_BASE("assignment", dc?dc:thread_db()){}
 DB_HOST_APP_VERSION::DB_HOST_APP_VERSION(DB_CONN* dc) :
-    DB_BASE("host_app_version", dc?dc:&boinc_db){}
+    DB_BASE("host_app_version", dc?dc:thread_db()){}
 DB_STATE_COUNTS::DB_STATE_COUNTS(DB_CONN* dc) :
-    DB_BASE("state_counts", dc?dc:&boinc_db){}
+    DB_BASE("state_counts", dc?dc:thread_db()){}
 DB_TRANSITIONER_ITEM_SET::DB_TRANSITIONER_ITEM_SET(DB_CONN* dc) :
-    DB_BASE_SPECIAL(dc?dc:&boinc_db){}
+    DB_BASE_SPECIAL(dc?dc:thread_db()
+){
+    started = false;
+    last_batch = false;
+}
 DB_VALIDATOR_ITEM_SET::DB_VALIDATOR_ITEM_SET(DB_CONN* dc) :
-    DB_BASE_SPECIAL(dc?dc:&boinc_db){}
+    DB_BASE_SPECIAL(dc?dc:thread_db()){}
 DB_WORK_ITEM::DB_WORK_ITEM(DB_CONN* dc) :
-    DB_BASE_SPECIAL(dc?dc:&boinc_db
+    DB_BASE_SPECIAL(dc?dc:thread_db()
 ){
     start_id = 0;
+    end_id = 0;
+    prefetched = 0;
 }
 DB_IN_PROGRESS_RESULT::DB_IN_PROGRESS_RESULT(DB_CONN* dc) :
-    DB_BASE_SPECIAL(dc?dc:&boinc_db){}
+    DB_BASE_SPECIAL(dc?dc:thread_db()){}
 DB_SCHED_RESULT_ITEM_SET::DB_SCHED_RESULT_ITEM_SET(DB_CONN* dc) :
-    DB_BASE_SPECIAL(dc?dc:&boinc_db){}
+    DB_BASE_SPECIAL(dc?dc:thread_db()){}
 DB_FILE::DB_FILE(DB_CONN* dc) :
-    DB_BASE("file", dc?dc:&boinc_db){}
+    DB_BASE("file", dc?dc:thread_db()){}
 DB_FILESET::DB_FILESET(DB_CONN* dc) :
-    DB_BASE("fileset", dc?dc:&boinc_db){}
+    DB_BASE("fileset", dc?dc:thread_db()){}
 DB_FILESET_FILE::DB_FILESET_FILE(DB_CONN* dc) :
-    DB_BASE("fileset_file", dc?dc:&boinc_db){}
+    DB_BASE("fileset_file", dc?dc:thread_db()){}
 DB_SCHED_TRIGGER::DB_SCHED_TRIGGER(DB_CONN* dc) :
-    DB_BASE("sched_trigger", dc?dc:&boinc_db) {
+    DB_BASE("sched_trigger", dc?dc:thread_db()) {
     id = 0;
     fileset_id = 0;
     need_work = false;
@@ -144,9 +163,9 @@ DB_SCHED_TRIGGER::DB_SCHED_TRIGGER(DB_CONN* dc) :
     working_set_removal = false;
 }
 DB_FILESET_SCHED_TRIGGER_ITEM::DB_FILESET_SCHED_TRIGGER_ITEM(DB_CONN* dc) :
-    DB_BASE_SPECIAL(dc?dc:&boinc_db){}
+    DB_BASE_SPECIAL(dc?dc:thread_db()){}
 DB_FILESET_SCHED_TRIGGER_ITEM_SET::DB_FILESET_SCHED_TRIGGER_ITEM_SET(DB_CONN* dc) :
-    DB_BASE_SPECIAL(dc?dc:&boinc_db){}
+    DB_BASE_SPECIAL(dc?dc:thread_db()){}
 
 int DB_PLATFORM::get_id() {return id;}
 int DB_APP::get_id() {return id;}
@@ -1284,26 +1303,76 @@ void TRANSITIONER_ITEM::parse(MYSQL_ROW& r) {
 }
 
 int DB_TRANSITIONER_ITEM_SET::enumerate(
-    int transition_time, int nresult_limit,
+    int transition_time, int nwu_limit,
     int wu_id_modulus, int wu_id_remainder,
     std::vector<TRANSITIONER_ITEM>& items
 ) {
-    int retval;
+    int retval, n;
     char query[MAX_QUERY_LEN];
-    char mod_clause[256];;
+    char mod_clause[256], start_clause[256];
     MYSQL_ROW row;
+    MYSQL_RES* rp;
     TRANSITIONER_ITEM new_item;
 
     if (!cursor.active) {
+        // do batched updates before looking for more WUs
+        //
+        retval = write_batch.flush(db);
+        if (retval) return retval;
+        if (started && last_batch) {
+            started = false;
+            last_batch = false;
+            return ERR_DB_NOT_FOUND;
+        }
         if (wu_id_modulus) {
             sprintf(mod_clause,
-                " and wu.id %% %d = %d ",
+                " and id %% %d = %d ",
                 wu_id_modulus, wu_id_remainder
             );
         } else {
             strcpy(mod_clause, "");
         }
+        if (started) {
+            sprintf(start_clause,
+                " and (transition_time > %d or (transition_time = %d and id > %d)) ",
+                last_transition_time, last_transition_time, last_id
+            );
+        } else {
+            strcpy(start_clause, "");
+        }
 
+        // get the IDs of the next batch of WUs.
+        // (transition_time, id) are both in the wu_timeout index,
+        // so this doesn't read the workunit table itself.
+        //
+        sprintf(query,
+            "select id, transition_time from workunit force index(wu_timeout) "
+            "where transition_time < %d %s %s "
+            "order by transition_time, id "
+            "limit %d",
+            transition_time, start_clause, mod_clause, nwu_limit
+        );
+        retval = db->do_query(query);
+        if (retval) return mysql_errno(db->mysql);
+        rp = mysql_store_result(db->mysql);
+        if (!rp) return mysql_errno(db->mysql);
+        std::string id_list;
+        n = 0;
+        while ((row = mysql_fetch_row(rp))) {
+            if (n) id_list += ",";
+            id_list += row[0];
+            last_id = atoi(row[0]);
+            last_transition_time = atoi(row[1]);
+            n++;
+        }
+        mysql_free_result(rp);
+        if (n == 0) {
+            started = false;
+            last_batch = false;
+            return ERR_DB_NOT_FOUND;
+        }
+        started = true;
+        last_batch = (n < nwu_limit);
 
         sprintf(query,
             "SELECT "
@@ -1341,10 +1410,10 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
             "   workunit AS wu "
             "       LEFT JOIN result AS res ON wu.id = res.workunitid "
             "WHERE "
-            "   wu.transition_time < %d %s "
-            "LIMIT "
-            "   %d ",
-            transition_time, mod_clause, nresult_limit
+            "   wu.id in (%s) "
+            "ORDER BY "
+            "   wu.id ",
+            id_list.c_str()
         );
 
         retval = db->do_query(query);
@@ -1358,11 +1427,16 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
 
         row = mysql_fetch_row(cursor.rp);
         if (!row) {
+            // the WUs were deleted since we got their IDs
+            //
             mysql_free_result(cursor.rp);
             cursor.active = false;
             retval = mysql_errno(db->mysql);
             if (retval) return ERR_DB_CONN_LOST;
-            return ERR_DB_NOT_FOUND;
+            return enumerate(
+                transition_time, nwu_limit, wu_id_modulus, wu_id_remainder,
+                items
+            );
         }
         last_item.parse(row);
         nitems_this_query = 1;
@@ -1373,16 +1447,11 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
         items.push_back(last_item);
         row = mysql_fetch_row(cursor.rp);
         if (!row) {
+            // end of batch; the last group is complete
+            //
             mysql_free_result(cursor.rp);
             cursor.active = false;
-
-            // if got fewer rows than requested, last group is complete
-            //
-            if (nitems_this_query < nresult_limit) {
-                return 0;
-            } else {
-                return ERR_DB_NOT_FOUND;
-            }
+            return 0;
         }
         new_item.parse(row);
         nitems_this_query++;
@@ -1398,15 +1467,17 @@ int DB_TRANSITIONER_ITEM_SET::enumerate(
 
 int DB_TRANSITIONER_ITEM_SET::update_result(TRANSITIONER_ITEM& ti) {
     char query[MAX_QUERY_LEN];
+    DB_ROW_UPDATE ru;
 
-    sprintf(query,
-        "update result set server_state=%d, outcome=%d, "
-        "validate_state=%d, file_delete_state=%d where id=%u",
-        ti.res_server_state,
-        ti.res_outcome,
-        ti.res_validate_state,
-        ti.res_file_delete_state,
-        ti.res_id
+    ru.add("server_state", "%d", ti.res_server_state);
+    ru.add("outcome", "%d", ti.res_outcome);
+    ru.add("validate_state", "%d", ti.res_validate_state);
+    ru.add("file_delete_state", "%d", ti.res_file_delete_state);
+    if (write_batch.max_rows) {
+        return write_batch.update(db, "result", ti.res_id, ru);
+    }
+    sprintf(query, "update result set %s where id=%u",
+        ru.set_clause().c_str(), ti.res_id
     );
     int retval = db->do_query(query);
     if (db->affected_rows() != 1) return ERR_DB_NOT_FOUND;
@@ -1417,47 +1488,39 @@ int DB_TRANSITIONER_ITEM_SET::update_workunit(
     TRANSITIONER_ITEM& ti, TRANSITIONER_ITEM& ti_original
 ) {
     char query[MAX_QUERY_LEN];
-    char updates[4096], buf[256];
+    DB_ROW_UPDATE ru;
 
-    strcpy(updates, "");
     if (ti.need_validate != ti_original.need_validate) {
-        sprintf(buf, " need_validate=%d,", ti.need_validate);
-        strcat(updates, buf);
+        ru.add("need_validate", "%d", ti.need_validate);
     }
     if (ti.error_mask != ti_original.error_mask) {
-        sprintf(buf, " error_mask=%d,", ti.error_mask);
-        strcat(updates, buf);
+        ru.add("error_mask", "%d", ti.error_mask);
     }
     if (ti.assimilate_state != ti_original.assimilate_state) {
-        sprintf(buf, " assimilate_state=%d,", ti.assimilate_state);
-        strcat(updates, buf);
+        ru.add("assimilate_state", "%d", ti.assimilate_state);
     }
     if (ti.file_delete_state != ti_original.file_delete_state) {
-        sprintf(buf, " file_delete_state=%d,", ti.file_delete_state);
-        strcat(updates, buf);
+        ru.add("file_delete_state", "%d", ti.file_delete_state);
     }
     if (ti.transition_time != ti_original.transition_time) {
-        sprintf(buf, " transition_time=%d,", ti.transition_time);
-        strcat(updates, buf);
+        ru.add("transition_time", "%d", ti.transition_time);
     }
     if (ti.hr_class != ti_original.hr_class) {
-        sprintf(buf, " hr_class=%d,", ti.hr_class);
-        strcat(updates, buf);
+        ru.add("hr_class", "%d", ti.hr_class);
     }
     if (ti.app_version_id != ti_original.app_version_id) {
-        sprintf(buf, " app_version_id=%d,", ti.app_version_id);
-        strcat(updates, buf);
+        ru.add("app_version_id", "%d", ti.app_version_id);
     }
-    int n = strlen(updates);
-    if (n == 0) {
+    if (ru.empty()) {
         return 0;
     }
 
-    // trim the final comma
-    //
-    updates[n-1] = 0;
-
-    sprintf(query, "update workunit set %s where id=%d", updates, ti.id);
+    if (write_batch.max_rows) {
+        return write_batch.update(db, "workunit", ti.id, ru);
+    }
+    sprintf(query, "update workunit set %s where id=%d",
+        ru.set_clause().c_str(), ti.id
+    );
     return db->do_query(query);
 }
 
@@ -1515,6 +1578,11 @@ int DB_VALIDATOR_ITEM_SET::enumerate(
     VALIDATOR_ITEM new_item;
 
     if (!cursor.active) {
+        // do batched updates first,
+        // so that the query doesn't return WUs we've already handled
+        //
+        retval = write_batch.flush(db);
+        if (retval) return retval;
         if (wu_id_modulus) {
             sprintf(mod_clause,
                 " and wu.id %% %d = %d ",
@@ -1621,19 +1689,20 @@ int DB_VALIDATOR_ITEM_SET::enumerate(
 
 int DB_VALIDATOR_ITEM_SET::update_result(RESULT& res) {
     char query[MAX_QUERY_LEN];
-
-    sprintf(query,
-        "update result set validate_state=%d, granted_credit=%.15e, "
-        "server_state=%d, outcome=%d, opaque=%lf, random=%d, runtime_outlier=%d "
-        "where id=%u",
-        res.validate_state,
-        res.granted_credit,
-        res.server_state,
-        res.outcome,
-        res.opaque,
-        res.random,
-        res.runtime_outlier?1:0,
-        res.id
+    DB_ROW_UPDATE ru;
+
+    ru.add("validate_state", "%d", res.validate_state);
+    ru.add("granted_credit", "%.15e", res.granted_credit);
+    ru.add("server_state", "%d", res.server_state);
+    ru.add("outcome", "%d", res.outcome);
+    ru.add("opaque", "%lf", res.opaque);
+    ru.add("random", "%d", res.random);
+    ru.add("runtime_outlier", "%d", res.runtime_outlier?1:0);
+    if (write_batch.max_rows) {
+        return write_batch.update(db, "result", res.id, ru);
+    }
+    sprintf(query, "update result set %s where id=%u",
+        ru.set_clause().c_str(), res.id
     );
     int retval = db->do_query(query);
     if (db->affected_rows() != 1) return ERR_DB_NOT_FOUND;
@@ -1643,20 +1712,20 @@ int DB_VALIDATOR_ITEM_SET::update_result(RESULT& res) {
 
 int DB_VALIDATOR_ITEM_SET::update_workunit(WORKUNIT& wu) {
     char query[MAX_QUERY_LEN];
-
-    sprintf(query,
-        "update workunit set need_validate=0, error_mask=%d, "
-        "assimilate_state=%d, transition_time=%d, "
-        "target_nresults=%d, "
-        "canonical_resultid=%u, canonical_credit=%.15e "
-        "where id=%d",
-        wu.error_mask,
-        wu.assimilate_state,
-        wu.transition_time,
-        wu.target_nresults,
-        wu.canonical_resultid,
-        wu.canonical_credit,
-        wu.id
+    DB_ROW_UPDATE ru;
+
+    ru.add("need_validate", "0");
+    ru.add("error_mask", "%d", wu.error_mask);
+    ru.add("assimilate_state", "%d", wu.assimilate_state);
+    ru.add("transition_time", "%d", wu.transition_time);
+    ru.add("target_nresults", "%d", wu.target_nresults);
+    ru.add("canonical_resultid", "%u", wu.canonical_resultid);
+    ru.add("canonical_credit", "%.15e", wu.canonical_credit);
+    if (write_batch.max_rows) {
+        return write_batch.update(db, "workunit", wu.id, ru);
+    }
+    sprintf(query, "update workunit set %s where id=%d",
+        ru.set_clause().c_str(), wu.id
     );
     int retval = db->do_query(query);
     if (db->affected_rows() != 1) return ERR_DB_NOT_FOUND;
@@ -1744,39 +1813,58 @@ int DB_WORK_ITEM::enumerate(
     return 0;
 }
 
+void DB_WORK_ITEM::enum_all_query(
+    char* query, int after_id, int limit, const char* select_clause
+) {
+    // use "r1" to refer to the result, since the feeder assumes that
+    // (historical reasons)
+    //
+    sprintf(query,
+        "select high_priority r1.id, r1.priority, r1.server_state, r1.report_deadline, workunit.* from result r1 force index(ind_res_st), workunit force index(primary), app"
+        " where r1.server_state=%d and r1.workunitid=workunit.id and r1.id>%d "
+        " and workunit.appid=app.id and app.deprecated=0 "
+        " %s "
+        "limit %d",
+        RESULT_SERVER_STATE_UNSENT,
+        after_id,
+        select_clause,
+        limit
+    );
+}
+
 int DB_WORK_ITEM::enumerate_all(
     int limit, const char* select_clause
 ) {
     char query[MAX_QUERY_LEN];
-    int retval;
+    int retval, nrows;
     MYSQL_ROW row;
     if (!cursor.active) {
-        // use "r1" to refer to the result, since the feeder assumes that
-        // (historical reasons)
-        //
-        sprintf(query,
-            "select high_priority r1.id, r1.priority, r1.server_state, r1.report_deadline, workunit.* from result r1 force index(ind_res_st), workunit force index(primary), app"
-            " where r1.server_state=%d and r1.workunitid=workunit.id and r1.id>%d "
-            " and workunit.appid=app.id and app.deprecated=0 "
-            " %s "
-            "limit %d",
-            RESULT_SERVER_STATE_UNSENT,
-            start_id,
-            select_clause,
-            limit
-        );
-        retval = db->do_query(query);
-        if (retval) return mysql_errno(db->mysql);
-        cursor.rp = mysql_store_result(db->mysql);
-        if (!cursor.rp) return mysql_errno(db->mysql);
+        if (prefetched) {
+            cursor.rp = prefetched;
+            prefetched = 0;
+        } else {
+            enum_all_query(query, start_id, limit, select_clause);
+            retval = db->do_query(query);
+            if (retval) return mysql_errno(db->mysql);
+            cursor.rp = mysql_store_result(db->mysql);
+            if (!cursor.rp) return mysql_errno(db->mysql);
+        }
 
         // if query gets no rows, start over in ID space
         //
-        if (mysql_num_rows(cursor.rp) == 0) {
+        nrows = (int)mysql_num_rows(cursor.rp);
+        if (nrows == 0) {
             mysql_free_result(cursor.rp);
             start_id = 0;
             return ERR_DB_NOT_FOUND;
         }
+
+        // note where the next batch starts
+        //
+        mysql_data_seek(cursor.rp, nrows-1);
+        row = mysql_fetch_row(cursor.rp);
+        end_id = atoi(row[0]);
+        mysql_data_seek(cursor.rp, 0);
         cursor.active = true;
     }
     row = mysql_fetch_row(cursor.rp);
@@ -34,6 +34,10 @@
 #include "parse.h"
 
 extern DB_CONN boinc_db;
+extern DB_CONN* thread_db();
+    // the DB connection used by default in the calling thread:
+    // the one passed to set_thread_db(), or boinc_db if none
+extern void set_thread_db(DB_CONN*);
 
 // Sizes of text buffers in memory, corresponding to database BLOBs.
 // The following is for regular blobs, 64KB
@@ -855,21 +859,45 @@ public:
 };
 
 // The transitioner uses this to get (WU, result) pairs efficiently.
-// Each call to enumerate() returns a list of the pairs for a single WU
+// Each call to enumerate() returns a list of the pairs for a single WU.
+//
+// WUs are enumerated in batches, in order of (transition_time, id).
+// For each batch we first get the IDs of the next nwu_limit WUs
+// from the wu_timeout index alone,
+// starting after the last WU of the previous batch,
+// then get those WUs and their results.
+// So each batch reads only the index entries it needs,
+// and a WU's results are never split between batches.
+// The wu_id_modulus/remainder test (for running several transitioners)
+// is also done on index entries,
+// so WUs belonging to other transitioners cost only an index read.
 //
 class DB_TRANSITIONER_ITEM_SET : public DB_BASE_SPECIAL {
 public:
     DB_TRANSITIONER_ITEM_SET(DB_CONN* p=0);
     TRANSITIONER_ITEM last_item;
     int nitems_this_query;
+    bool started;
+        // whether the following are defined
+    int last_transition_time;
+    int last_id;
+        // the (transition_time, id) of the last WU in the previous batch
+    bool last_batch;
+        // the current batch is the last of this enumeration
+    DB_WRITE_BATCH write_batch;
+        // if write_batch.max_rows is set, update_result() and
+        // update_workunit() are batched, and done before the next query
 
     int enumerate(
         int transition_time,
-        int nresult_limit,
+        int nwu_limit,
         int wu_id_modulus,
         int wu_id_remainder,
         std::vector<TRANSITIONER_ITEM>& items
     );
+        // return ERR_DB_NOT_FOUND when all WUs with
+        // transition_time earlier than the given one have been returned.
+        // The next call starts over.
     int update_result(TRANSITIONER_ITEM&);
     int update_workunit(TRANSITIONER_ITEM&, TRANSITIONER_ITEM&);
 };
@@ -882,6 +910,9 @@ public:
     DB_VALIDATOR_ITEM_SET(DB_CONN* p=0);
     VALIDATOR_ITEM last_item;
     int nitems_this_query;
+    DB_WRITE_BATCH write_batch;
+        // if write_batch.max_rows is set, update_result() and
+        // update_workunit() are batched, and done before the next query
 
     int enumerate(
         int appid,
@@ -910,15 +941,26 @@ class DB_WORK_ITEM : public WORK_ITEM, public DB_BASE_SPECIAL {
     int start_id;
         // when enumerate_all is used, keeps track of which ID to start from
 public:
+    int end_id;
+        // when enumerate_all is used, the ID of the last result
+        // in the current batch; the next batch starts after it
+    MYSQL_RES* prefetched;
+        // if nonzero, the result of enumerate_all()'s next query,
+        // done in advance (e.g. by another thread and DB connection).
+        // enumerate_all() uses this rather than doing the query.
     DB_WORK_ITEM(DB_CONN* p=0);
     int enumerate(
         int limit, const char* select_clause, const char* order_clause
     );
         // used by feeder
+    void enum_all_query(
+        char* query, int after_id, int limit, const char* select_clause
+    );
+        // the query done by enumerate_all()
     int enumerate_all(
         int limit, const char* select_clause
     );
-        // used by feeder when HR is used.
+        // used by feeder when HR or prefetching is used.
         // Successive calls cycle through all results.
     int read_result();
         // used by scheduler to read result server state
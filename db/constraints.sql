@@ -15,8 +15,10 @@ alter table user
     add index user_name(name),
     add index user_tot (total_credit desc),
         -- db_dump.C
-    add index user_avg (expavg_credit desc);
+    add index user_avg (expavg_credit desc),
         -- db_dump.C
+    add index user_avg_time (expavg_time);
+        -- db_dump --delta
 
 alter table team
     add unique(name),
@@ -26,6 +28,8 @@ alter table team
         -- db_dump.C
     add index team_tot (total_credit desc),
         -- db_dump.C
+    add index team_avg_time (expavg_time),
+        -- db_dump --delta
     add index team_userid (userid);
 
 alter table workunit
@@ -82,8 +86,10 @@ alter table host
         -- html_user/host_user.php
     add index host_avg (expavg_credit desc),
         -- db_dump.C
-    add index host_tot (total_credit desc);
+    add index host_tot (total_credit desc),
         -- db_dump.C
+    add index host_avg_time (expavg_time);
+        -- db_dump --delta
 
 alter table profile
     add fulltext index profile_reponse(response1, response2),
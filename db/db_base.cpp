@@ -19,9 +19,11 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cstdarg>
 #include <mysql.h>
 
 #include "error_numbers.h"
+#include "util.h"
 #include "str_util.h"
 #include "str_replace.h"
 #include "db_base.h"
@@ -35,6 +37,7 @@ bool g_print_queries = false;
 
 DB_CONN::DB_CONN() {
     mysql = 0;
+    nqueries = 0;
 }
 
 int DB_CONN::open(char* db_name, char* db_host, char* db_user, char* dbpassword) {
@@ -87,6 +90,58 @@ void DB_CONN::close() {
     if (mysql) mysql_close(mysql);
 }
 
+DB_CONN_POOL::DB_CONN_POOL() {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+}
+
+int DB_CONN_POOL::open(
+    int n, char* db_name, char* db_host, char* db_user, char* dbpassword
+) {
+    int retval;
+    for (int i=0; i<n; i++) {
+        DB_CONN* dc = new DB_CONN;
+        retval = dc->open(db_name, db_host, db_user, dbpassword);
+        if (retval) {
+            delete dc;
+            close();
+            return retval;
+        }
+        conns.push_back(dc);
+        free_conns.push_back(dc);
+    }
+    return 0;
+}
+
+// get a connection, waiting if none is free
+//
+DB_CONN* DB_CONN_POOL::get() {
+    pthread_mutex_lock(&mutex);
+    while (free_conns.empty()) {
+        pthread_cond_wait(&cond, &mutex);
+    }
+    DB_CONN* dc = free_conns.back();
+    free_conns.pop_back();
+    pthread_mutex_unlock(&mutex);
+    return dc;
+}
+
+void DB_CONN_POOL::put(DB_CONN* dc) {
+    pthread_mutex_lock(&mutex);
+    free_conns.push_back(dc);
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+void DB_CONN_POOL::close() {
+    for (unsigned int i=0; i<conns.size(); i++) {
+        conns[i]->close();
+        delete conns[i];
+    }
+    conns.clear();
+    free_conns.clear();
+}
+
 int DB_CONN::set_isolation_level(ISOLATION_LEVEL level) {
     const char* level_str;
     char query[256];
@@ -120,6 +175,7 @@ int DB_CONN::do_query(const char* p) {
         fprintf(stderr, "query: %s\n", p);
 #endif
     }
+    nqueries++;
     retval = mysql_query(mysql, p);
     if (retval) {
         fprintf(stderr, "Database error: %s\nquery=%s\n", error_string(), p);
@@ -175,6 +231,192 @@ int DB_CONN::ping() {
     return 0;
 }
 
+// get the number of rows read on this connection so far,
+// i.e. the sum of the session's Handler_read_* counters.
+// Note: the query itself reads a few rows (Handler_read_rnd_next).
+//
+int DB_CONN::rows_examined(double& n) {
+    int retval;
+    MYSQL_ROW row;
+    MYSQL_RES* rp;
+
+    retval = do_query("show session status like 'Handler_read%'");
+    if (retval) return retval;
+    rp = mysql_store_result(mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    n = 0;
+    while ((row = mysql_fetch_row(rp))) {
+        n += atof(row[1]);
+    }
+    mysql_free_result(rp);
+    return 0;
+}
+
+void DB_ROW_UPDATE::add(const char* field, const char* format, ...) {
+    char buf[MAX_QUERY_LEN];
+    va_list va;
+
+    va_start(va, format);
+    vsnprintf(buf, sizeof(buf), format, va);
+    va_end(va);
+    fields.push_back(field);
+    values.push_back(buf);
+}
+
+std::string DB_ROW_UPDATE::set_clause() {
+    std::string s;
+    for (unsigned int i=0; i<fields.size(); i++) {
+        if (i) s += ", ";
+        s += fields[i] + "=" + values[i];
+    }
+    return s;
+}
+
+DB_WRITE_BATCH::DB_WRITE_BATCH() {
+    max_rows = 0;
+    npending = 0;
+    nflushes = 0;
+    nstatements = 0;
+    nrows_flushed = 0;
+    flush_time = 0;
+}
+
+bool DB_WRITE_BATCH::is_pending(int id, TABLE_UPDATES& tu) {
+    for (unsigned int i=0; i<tu.id_list.size(); i++) {
+        if (tu.id_list[i] == id) return true;
+    }
+    return false;
+}
+
+int DB_WRITE_BATCH::update(
+    DB_CONN* db, const char* table, int id, DB_ROW_UPDATE& ru
+) {
+    char query[MAX_QUERY_LEN], buf[256];
+    unsigned int i, j, k;
+    int retval;
+
+    if (!max_rows) {
+        sprintf(query, "update %s set %s where id=%d",
+            table, ru.set_clause().c_str(), id
+        );
+        retval = db->do_query(query);
+        if (retval) return retval;
+        if (db->affected_rows() != 1) return ERR_DB_NOT_FOUND;
+        return 0;
+    }
+
+    for (i=0; i<tables.size(); i++) {
+        if (tables[i].table == table) break;
+    }
+    if (i == tables.size()) {
+        TABLE_UPDATES tu;
+        tu.table = table;
+        tables.push_back(tu);
+    }
+
+    // a row can appear only once per statement; if it's already there,
+    // flush the pending updates first
+    //
+    if (is_pending(id, tables[i])) {
+        retval = flush(db);
+        if (retval) return retval;
+    }
+    TABLE_UPDATES& tu = tables[i];
+
+    for (k=0; k<ru.fields.size(); k++) {
+        for (j=0; j<tu.fields.size(); j++) {
+            if (tu.fields[j] == ru.fields[k]) break;
+        }
+        if (j == tu.fields.size()) {
+            tu.fields.push_back(ru.fields[k]);
+            tu.cases.push_back("");
+        }
+        sprintf(buf, " when %d then ", id);
+        tu.cases[j] += buf;
+        tu.cases[j] += ru.values[k];
+    }
+    if (!tu.id_list.empty()) tu.ids += ",";
+    sprintf(buf, "%d", id);
+    tu.ids += buf;
+    tu.id_list.push_back(id);
+    npending++;
+
+    if (npending >= max_rows) {
+        retval = flush(db);
+        if (retval) return retval;
+    }
+    return 0;
+}
+
+// do the pending updates.
+// Rows that no longer exist (e.g. deleted by another daemon
+// since they were enumerated) are logged but aren't an error;
+// only DB errors are returned, in which case
+// the pending updates are discarded.
+//
+int DB_WRITE_BATCH::flush(DB_CONN* db) {
+    int retval, nrows = 0, nmissing = 0;
+    unsigned int i, j;
+
+    if (!npending) return 0;
+    double start = dtime();
+    retval = db->start_transaction();
+    for (i=0; i<tables.size() && !retval; i++) {
+        TABLE_UPDATES& tu = tables[i];
+        if (tu.id_list.empty()) continue;
+        std::string query = "update " + tu.table + " set ";
+        for (j=0; j<tu.fields.size(); j++) {
+            if (j) query += ", ";
+            query += tu.fields[j] + " = case id" + tu.cases[j];
+            query += " else " + tu.fields[j] + " end";
+        }
+        query += " where id in (" + tu.ids + ")";
+        retval = db->do_query(query.c_str());
+        if (retval) {
+            db->rollback_transaction();
+            break;
+        }
+        nmissing += (int)tu.id_list.size() - db->affected_rows();
+        nstatements++;
+        nrows += (int)tu.id_list.size();
+    }
+    if (!retval) {
+        retval = db->commit_transaction();
+    }
+    for (i=0; i<tables.size(); i++) {
+        TABLE_UPDATES& tu = tables[i];
+        tu.fields.clear();
+        tu.cases.clear();
+        tu.ids.clear();
+        tu.id_list.clear();
+    }
+    npending = 0;
+    if (retval) return retval;
+    nflushes++;
+    nrows_flushed += nrows;
+    flush_time += dtime() - start;
+    if (nmissing > 0) {
+#ifdef _USING_FCGI_
+        log_messages.printf(MSG_NORMAL,
+#else
+        fprintf(stderr,
+#endif
+            "batched update: %d of %d rows not found\n", nmissing, nrows
+        );
+    }
+    return 0;
+}
+
+void DB_WRITE_BATCH::get_stats(char* buf) {
+    sprintf(buf,
+        "%.0f rows updated in %d statements, %d flushes; "
+        "%.2f ms/flush, %.0f rows/sec",
+        nrows_flushed, nstatements, nflushes,
+        nflushes?1000*flush_time/nflushes:0,
+        flush_time>0?nrows_flushed/flush_time:0
+    );
+}
+
 DB_BASE::DB_BASE(const char *tn, DB_CONN* p) : db(p), table_name(tn) {
 }
 
@@ -20,6 +20,8 @@
 
 #include <cstdlib>
 #include <string>
+#include <vector>
+#include <pthread.h>
 #include <mysql.h>
 
 extern bool g_print_queries;
@@ -78,11 +80,94 @@ public:
     void print_error(const char*);
     const char* error_string();
     int ping();
+    int rows_examined(double&);
     int start_transaction();
     int rollback_transaction();
     int commit_transaction();
 
     MYSQL* mysql;
+    double nqueries;
+        // number of queries done on this connection
+};
+
+// A set of connections to a database,
+// for programs that access it from several threads.
+// A thread takes a connection with get()
+// (typically making it the thread's default with set_thread_db())
+// and returns it with put().
+// Each thread that uses a connection must call mysql_thread_init()
+// when it starts, and mysql_thread_end() before it exits.
+//
+class DB_CONN_POOL {
+public:
+    DB_CONN_POOL();
+    int open(int n, char* name, char* host, char* user, char* passwd);
+    DB_CONN* get();
+    void put(DB_CONN*);
+    void close();
+    int nconns() { return (int)conns.size(); }
+private:
+    std::vector<DB_CONN*> conns;
+    std::vector<DB_CONN*> free_conns;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+// Accumulates updates of rows (identified by ID) in one or more tables,
+// and does them together, inside a transaction,
+// with one multi-row UPDATE per table:
+//
+// update result set
+//     server_state = case id when 5 then 4 when 6 then 5 else server_state end,
+//     outcome = case id when 6 then 1 else outcome end
+// where id in (5,6)
+//
+// The columns to set in an update of one row, and their new values.
+// Values are SQL expressions (e.g. numbers, or escaped and quoted strings).
+//
+struct DB_ROW_UPDATE {
+    std::vector<std::string> fields;
+    std::vector<std::string> values;
+
+    void add(const char* field, const char* format, ...);
+        // add a column; its value is given printf-style
+    bool empty() {return fields.empty();}
+    std::string set_clause();
+        // "f1=v1, f2=v2", for an ordinary update query
+};
+
+// Updates aren't visible to other queries until flush().
+//
+class DB_WRITE_BATCH {
+public:
+    DB_WRITE_BATCH();
+    int max_rows;
+        // if nonzero, flush when this many rows are pending;
+        // if zero, do each update immediately
+    int npending;
+        // number of rows with pending updates
+
+    // counters, for tuning max_rows
+    //
+    int nflushes;
+    int nstatements;
+    double nrows_flushed;
+    double flush_time;
+
+    int update(DB_CONN*, const char* table, int id, DB_ROW_UPDATE&);
+    int flush(DB_CONN*);
+    void get_stats(char*);
+private:
+    struct TABLE_UPDATES {
+        std::string table;
+        std::vector<std::string> fields;
+        std::vector<std::string> cases;
+            // for each field, the "when id then value" parts
+        std::string ids;
+        std::vector<int> id_list;
+    };
+    std::vector<TABLE_UPDATES> tables;
+    bool is_pending(int id, TABLE_UPDATES&);
 };
 
 // Base for derived classes that can access the DB
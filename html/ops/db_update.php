@@ -796,6 +796,15 @@ function update_9_20_2011() {
         add manage tinyint not null
     ");
 }
+
+// for db_dump --delta
+//
+function update_1_14_2012() {
+    do_query("alter table user add index user_avg_time (expavg_time)");
+    do_query("alter table team add index team_avg_time (expavg_time)");
+    do_query("alter table host add index host_avg_time (expavg_time)");
+}
+
 // Updates are done automatically if you use "upgrade".
 //
 // If you need to do updates manually,
@@ -819,6 +828,7 @@ $db_updates = array (
     array(24137, "update_9_6_2011"),
     array(24225, "update_9_15_2011"),
     array(24248, "update_9_20_2011"),
+    array(24249, "update_1_14_2012"),
 );
 
 
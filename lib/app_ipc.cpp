@@ -23,6 +23,12 @@
 #include "config.h"
 #include <cstring>
 #include <string>
+#ifdef __linux__
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 #endif
 
 #ifdef _MSC_VER
@@ -36,6 +42,7 @@
 #include "str_replace.h"
 #include "str_util.h"
 #include "url.h"
+#include "util.h"
 
 #include "app_ipc.h"
 
@@ -120,6 +127,7 @@ void APP_INIT_DATA::copy(const APP_INIT_DATA& a) {
     gpu_device_num                = a.gpu_device_num;
     ncpus                         = a.ncpus;
     checkpoint_period             = a.checkpoint_period;
+    shmem_layout_version          = a.shmem_layout_version;
     wu_cpu_time                   = a.wu_cpu_time;
     if (a.project_preferences) {
         project_preferences = strdup(a.project_preferences);
@@ -189,6 +197,12 @@ int write_init_data_file(FILE* f, APP_INIT_DATA& ai) {
 #else
     fprintf(f, "<shm_key>%d</shm_key>\n", ai.shmem_seg_name);
 #endif
+    if (ai.shmem_layout_version) {
+        fprintf(f,
+            "<shmem_layout_version>%d</shmem_layout_version>\n",
+            ai.shmem_layout_version
+        );
+    }
     fprintf(f,
         "<slot>%d</slot>\n"
         "<wu_cpu_time>%f</wu_cpu_time>\n"
@@ -282,6 +296,7 @@ void APP_INIT_DATA::clear() {
     gpu_device_num = 0;
     ncpus = 0;
     memset(&shmem_seg_name, 0, sizeof(shmem_seg_name));
+    shmem_layout_version = 0;
     wu_cpu_time = 0;
 }
 
@@ -381,6 +396,7 @@ int parse_init_data_file(FILE* f, APP_INIT_DATA& ai) {
         if (xp.parse_double("ncpus", ai.ncpus)) continue;
         if (xp.parse_double("fraction_done_start", ai.fraction_done_start)) continue;
         if (xp.parse_double("fraction_done_end", ai.fraction_done_end)) continue;
+        if (xp.parse_int("shmem_layout_version", ai.shmem_layout_version)) continue;
         xp.skip_unexpected(false, "parse_init_data_file");
     }
     fprintf(stderr, "parse_init_data_file: no end tag\n");
@@ -414,6 +430,95 @@ void MSG_CHANNEL::send_msg_overwrite(const char* msg) {
     buf[0] = 1;
 }
 
+// The sender and receiver are in different processes,
+// possibly on different CPUs.
+// Make sure that message data is written before "head" says it's there,
+// and read before "tail" says it's free.
+//
+#ifdef _WIN32
+#define MSG_RING_BARRIER()  MemoryBarrier()
+#else
+#define MSG_RING_BARRIER()  __sync_synchronize()
+#endif
+
+#define MSG_RING_MASK   (MSG_RING_SIZE-1)
+
+bool MSG_RING::has_msg() {
+    return head != tail;
+}
+
+bool MSG_RING::send_msg(const char* msg) {
+    unsigned int h = head, n, i;
+
+    n = (unsigned int)strlen(msg);
+    if (n > MSG_CHANNEL_SIZE-1) n = MSG_CHANNEL_SIZE-1;
+    if (MSG_RING_SIZE - (h - tail) < n+1) return false;
+    MSG_RING_BARRIER();
+    for (i=0; i<n; i++) {
+        buf[(h+i) & MSG_RING_MASK] = msg[i];
+    }
+    buf[(h+n) & MSG_RING_MASK] = 0;
+    MSG_RING_BARRIER();
+    head = h + n + 1;
+    nsent++;
+    MSG_RING_BARRIER();
+#ifdef __linux__
+    if (waiting) {
+        syscall(SYS_futex, (int*)&nsent, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+#endif
+    return true;
+}
+
+bool MSG_RING::get_msg(char* msg) {
+    unsigned int t = tail, n, i;
+
+    n = head - t;
+    if (!n) return false;
+    if (n > MSG_RING_SIZE) {
+        // the other side has scribbled on the ring; discard its contents
+        //
+        tail = head;
+        return false;
+    }
+    MSG_RING_BARRIER();
+    for (i=0; i<n; i++) {
+        char c = buf[(t+i) & MSG_RING_MASK];
+        if (i < MSG_CHANNEL_SIZE) msg[i] = c;
+        if (!c) break;
+    }
+    MSG_RING_BARRIER();
+    if (i == n) {
+        // no terminating null; discard what's there
+        //
+        tail = t + n;
+        return false;
+    }
+    msg[MSG_CHANNEL_SIZE-1] = 0;
+    tail = t + i + 1;
+    return true;
+}
+
+void MSG_RING::wait(double timeout) {
+    if (timeout <= 0) return;
+#ifdef __linux__
+    int n = nsent;
+    waiting = 1;
+    MSG_RING_BARRIER();
+    if (!has_msg()) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)timeout;
+        ts.tv_nsec = (long)((timeout - ts.tv_sec)*1e9);
+        syscall(SYS_futex, (int*)&nsent, FUTEX_WAIT, n, &ts, NULL, 0);
+    }
+    waiting = 0;
+#else
+    if (!has_msg()) {
+        boinc_sleep(timeout);
+    }
+#endif
+}
+
 int APP_CLIENT_SHM::decode_graphics_msg(char* msg, GRAPHICS_MSG& m) {
     int i;
 
@@ -60,6 +60,42 @@ struct MSG_CHANNEL {
                             // write message, overwriting any msg already there
 };
 
+// A MSG_RING holds a sequence of messages (null-terminated strings)
+// sent by one process and received by another.
+// The sender advances "head" and the receiver advances "tail"
+// (each counts bytes, modulo 2^32);
+// since each is changed by only one side, no lock is needed.
+// Unlike a MSG_CHANNEL, the sender can send a message
+// before the receiver has read the previous one.
+// On Linux the receiver can wait (on a futex) for a message.
+//
+#define MSG_RING_SIZE 8192
+    // must be a power of 2
+
+struct MSG_RING {
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    volatile int nsent;
+        // number of messages sent; the receiver waits on this
+    volatile int waiting;
+        // receiver is waiting; sender must wake it up
+    char buf[MSG_RING_SIZE];
+
+    bool get_msg(char*);    // msg buffer must be MSG_CHANNEL_SIZE
+    bool has_msg();
+    bool send_msg(const char*);
+        // returns false if there's no room.
+        // Messages longer than MSG_CHANNEL_SIZE-1 are truncated
+    void wait(double timeout);
+        // wait up to the given time (seconds) for a message
+};
+
+// Layout versions of SHARED_MEM:
+// 1: MSG_CHANNELs only
+// 2: MSG_RINGs added at the end
+//
+#define SHMEM_LAYOUT_VERSION    2
+
 struct SHARED_MEM {
     MSG_CHANNEL process_control_request;
         // core->app
@@ -95,6 +131,20 @@ struct SHARED_MEM {
     MSG_CHANNEL trickle_down;
         // core->app
         // <have_new_trickle_down/>
+
+    // The following are in layout version 2.
+    // The client passes the layout version in APP_INIT_DATA;
+    // an app must not touch them if it's less than 2
+    // (the segment was created by an older client, and is smaller).
+    // An app that uses the rings sets app_layout_version,
+    // and from then on the client uses the rings
+    // instead of the corresponding channels.
+    //
+    int app_layout_version;
+    int pad;
+    MSG_RING process_control_request_ring;
+    MSG_RING app_status_ring;
+    MSG_RING trickle_up_ring;
 };
 
 // MSG_QUEUE provides a queuing mechanism for shared-mem messages
@@ -107,6 +157,12 @@ struct MSG_QUEUE {
 	void init(char*);
     void msg_queue_send(const char*, MSG_CHANNEL& channel);
     void msg_queue_poll(MSG_CHANNEL& channel);
+    void msg_queue_send(const char*, MSG_RING& ring);
+    void msg_queue_poll(MSG_RING& ring);
+        // same, for a ring; msgs are queued here only if it's full
+    void send(const char*, MSG_CHANNEL*, MSG_RING*);
+    void poll(MSG_CHANNEL*, MSG_RING*);
+        // implementation of the above
 	int msg_queue_purge(const char*);
 	bool timeout(double);
 };
@@ -203,6 +259,7 @@ struct APP_INIT_DATA {
     //
     double checkpoint_period;     // recommended checkpoint period
     SHMEM_SEG_NAME shmem_seg_name;
+    int shmem_layout_version;   // see SHARED_MEM
     double wu_cpu_time;       // cpu time from previous episodes
 
     APP_INIT_DATA();
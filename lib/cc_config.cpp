@@ -221,6 +221,7 @@ void CONFIG::defaults() {
     no_gpus = false;
     no_info_fetch = false;
     no_priority_change = false;
+    no_state_journal = false;
     os_random_only = false;
     proxy_info.clear();
     rec_half_life = 10*86400;
@@ -375,6 +376,7 @@ int CONFIG::parse_options(XML_PARSER& xp) {
         if (xp.parse_bool("no_gpus", no_gpus)) continue;
         if (xp.parse_bool("no_info_fetch", no_info_fetch)) continue;
         if (xp.parse_bool("no_priority_change", no_priority_change)) continue;
+        if (xp.parse_bool("no_state_journal", no_state_journal)) continue;
         if (xp.parse_bool("os_random_only", os_random_only)) continue;
 #ifndef SIM
         if (xp.match_tag("proxy_info")) {
@@ -556,6 +558,7 @@ int CONFIG::write(MIOFILE& out, LOG_FLAGS& log_flags) {
         "        <no_gpus>%d</no_gpus>\n"
         "        <no_info_fetch>%d</no_info_fetch>\n"
         "        <no_priority_change>%d</no_priority_change>\n"
+        "        <no_state_journal>%d</no_state_journal>\n"
         "        <os_random_only>%d</os_random_only>\n",
         max_file_xfers,
         max_file_xfers_per_project,
@@ -568,6 +571,7 @@ int CONFIG::write(MIOFILE& out, LOG_FLAGS& log_flags) {
         no_gpus,
         no_info_fetch,
         no_priority_change,
+        no_state_journal,
         os_random_only
     );
     
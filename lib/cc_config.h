@@ -164,6 +164,7 @@ struct CONFIG {
     bool no_gpus;
     bool no_info_fetch;
     bool no_priority_change;
+    bool no_state_journal;
     bool os_random_only;
     PROXY_INFO proxy_info;
     double rec_half_life;
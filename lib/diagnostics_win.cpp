@@ -1042,6 +1042,7 @@ int diagnostics_finish_message_monitor() {
 
 int diagnostics_message_monitor_dump() {
     unsigned int i;
+    char buf[TIME_STRING_LEN];
     PBOINC_MESSAGEMONITORENTRY pMessageEntry = NULL;
 
     // Wait for the MessageMonitorSync mutex before writing updates
@@ -1055,7 +1056,7 @@ int diagnostics_message_monitor_dump() {
         fprintf(
             stderr, 
             "[%s] %s",
-            time_to_string(pMessageEntry->timestamp),
+            time_to_string(pMessageEntry->timestamp, buf),
             pMessageEntry->message.c_str()
         );
     }
@@ -57,6 +57,7 @@ using std::vector;
 
 RPC_CLIENT::RPC_CLIENT() {
     sock = -1;
+    no_state_changes = false;
 }
 
 RPC_CLIENT::~RPC_CLIENT() {
@@ -121,6 +122,7 @@ int RPC_CLIENT::get_ip_addr(const char* host, int port) {
 }
 
 int RPC_CLIENT::init(const char* host, int port) {
+    no_state_changes = false;
     int retval = get_ip_addr(host, port);
     if (retval) return retval;
     boinc_socket(sock);
@@ -160,6 +162,7 @@ int RPC_CLIENT::init_asynch(
     int retval;
     retry = _retry;
     timeout = _timeout;
+    no_state_changes = false;
 
     retval = get_ip_addr(host, port);
     if (retval) return retval;
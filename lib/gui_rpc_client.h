@@ -381,6 +381,9 @@ public:
     HOST_INFO host_info;
     bool have_nvidia;           // redundant; include for compat (set by <have_cuda/>)
     bool have_ati;              // redundant; include for compat
+    int epoch;
+    int seqno;
+        // from the last get_state_changes() reply
 
     CC_STATE();
     ~CC_STATE();
@@ -395,7 +398,9 @@ public:
 
     void print();
     void clear();
+    bool parse_element(XML_PARSER&, char* buf, PROJECT*&, bool update);
     int parse(XML_PARSER&);
+    int parse_changes(XML_PARSER&);
 };
 
 class PROJECTS {
@@ -626,6 +631,9 @@ struct RPC_CLIENT {
     double timeout;
     bool retry;
     sockaddr_storage addr;
+    bool no_state_changes;
+        // the client doesn't support get_state_changes();
+        // reset when we connect
 
     int send_request(const char*);
     int get_reply(char*&);
@@ -650,6 +658,7 @@ struct RPC_CLIENT {
     int authorize(const char* passwd);
     int exchange_versions(VERSION_INFO&);
     int get_state(CC_STATE&);
+    int get_state_changes(CC_STATE&);
     int get_results(RESULTS&, bool active_only = false);
     int get_file_transfers(FILE_TRANSFERS&);
     int get_simple_gui_info(SIMPLE_GUI_INFO&);
@@ -757,11 +757,166 @@ CC_STATE::~CC_STATE() {
     clear();
 }
 
+// Parse a project, app, app version, workunit or result,
+// or one of the global items,
+// in a get_state() or get_state_changes() reply.
+// Projects etc. are added to the state;
+// if "update" is set and the state already has the object,
+// the new one is copied into it, so that pointers to it remain valid.
+// Return true if buf was one of these.
+//
+bool CC_STATE::parse_element(
+    XML_PARSER& xp, char* buf, PROJECT*& project, bool update
+) {
+    string platform;
+    int retval;
+
+    if (parse_bool(buf, "executing_as_daemon", executing_as_daemon)) return true;
+    if (match_tag(buf, "<project>")) {
+        PROJECT* p = new PROJECT();
+        retval = p->parse(xp);
+        if (retval) {
+            // should never happen
+            delete p;
+            project = NULL;
+            return true;
+        }
+        PROJECT* old = update?lookup_project(p->master_url):NULL;
+        if (old) {
+            *old = *p;
+            delete p;
+            project = old;
+        } else {
+            projects.push_back(p);
+            project = p;
+        }
+        return true;
+    }
+    if (match_tag(buf, "<app>")) {
+        APP* app = new APP();
+        retval = app->parse(xp);
+        if (retval || !project) {
+            delete app;
+            return true;
+        }
+        app->project = project;
+        APP* old = update?lookup_app(project, app->name):NULL;
+        if (old) {
+            *old = *app;
+            delete app;
+        } else {
+            apps.push_back(app);
+        }
+        return true;
+    }
+    if (match_tag(buf, "<app_version>")) {
+        APP_VERSION* app_version = new APP_VERSION();
+        retval = app_version->parse(xp);
+        if (retval || !project) {
+            delete app_version;
+            return true;
+        }
+        app_version->project = project;
+        app_version->app = lookup_app(project, app_version->app_name);
+        if (!app_version->app) {
+            delete app_version;
+            return true;
+        }
+        APP_VERSION* old = update?lookup_app_version(
+            project, app_version->app, app_version->version_num,
+            app_version->plan_class
+        ):NULL;
+        if (old) {
+            *old = *app_version;
+            delete app_version;
+        } else {
+            app_versions.push_back(app_version);
+        }
+        return true;
+    }
+    if (match_tag(buf, "<workunit>")) {
+        WORKUNIT* wu = new WORKUNIT();
+        retval = wu->parse(xp);
+        if (retval || !project) {
+            delete wu;
+            return true;
+        }
+        wu->project = project;
+        wu->app = lookup_app(project, wu->app_name);
+        if (!wu->app) {
+            delete wu;
+            return true;
+        }
+        WORKUNIT* old = update?lookup_wu(project, wu->name):NULL;
+        if (old) {
+            *old = *wu;
+            delete wu;
+        } else {
+            wus.push_back(wu);
+        }
+        return true;
+    }
+    if (match_tag(buf, "<result>")) {
+        RESULT* result = new RESULT();
+        retval = result->parse(xp);
+        if (retval || !project) {
+            delete result;
+            return true;
+        }
+        result->project = project;
+        result->wup = lookup_wu(project, result->wu_name);
+        if (!result->wup) {
+            delete result;
+            return true;
+        }
+        result->app = result->wup->app;
+        APP_VERSION* avp;
+        if (result->version_num) {
+            avp = lookup_app_version(
+                project, result->app, result->version_num,
+                result->plan_class
+            );
+        } else {
+            avp = lookup_app_version_old(
+                project, result->app, result->wup->version_num
+            );
+        }
+        if (!avp) {
+            delete result;
+            return true;
+        }
+        result->avp = avp;
+        RESULT* old = update?lookup_result(project, result->name):NULL;
+        if (old) {
+            *old = *result;
+            delete result;
+        } else {
+            results.push_back(result);
+        }
+        return true;
+    }
+    if (match_tag(buf, "<global_preferences>")) {
+        bool flag = false;
+        GLOBAL_PREFS_MASK mask;
+        global_prefs.parse(xp, "", flag, mask);
+        return true;
+    }
+    if (parse_str(buf, "<platform>", platform)) {
+        platforms.push_back(platform);
+        return true;
+    }
+    if (match_tag(buf, "host_info")) {
+        host_info.parse(xp);
+        return true;
+    }
+    if (parse_bool(buf, "have_cuda", have_nvidia)) return true;
+    if (parse_bool(buf, "have_ati", have_ati)) return true;
+    return false;
+}
+
 int CC_STATE::parse(XML_PARSER& xp) {
     char buf[256];
-    string platform;
     PROJECT* project = NULL;
-    int retval;
 
     MIOFILE& in = *(xp.f);
     while (in.fgets(buf, 256)) {
@@ -769,113 +924,101 @@ int CC_STATE::parse(XML_PARSER& xp) {
             return ERR_AUTHENTICATOR;
         }
         if (match_tag(buf, "</client_state>")) break;
+        if (parse_element(xp, buf, project, false)) continue;
+    }
+    return 0;
+}
 
-        if (parse_bool(buf, "executing_as_daemon", executing_as_daemon)) continue;
-        if (match_tag(buf, "<project>")) {
-            project = new PROJECT();
-            retval = project->parse(xp);
-            if (retval) {
-                // should never happen
-                delete project;
-                project = NULL;
-                continue;
-            }
-            projects.push_back(project);
-            continue;
+// remove an object from one of the state's lists, and delete it
+//
+template <class T> static void remove_item(vector<T*>& v, T* p) {
+    if (!p) return;
+    for (unsigned int i=0; i<v.size(); i++) {
+        if (v[i] == p) {
+            v.erase(v.begin()+i);
+            delete p;
+            return;
         }
-        if (match_tag(buf, "<app>")) {
-            APP* app = new APP();
-            retval = app->parse(xp);
-            if (retval || !project) {
-                delete app;
-                continue;
-            }
-            app->project = project;
-            apps.push_back(app);
+    }
+}
+
+// Parse a get_state_changes() reply, and update the state accordingly.
+// If the reply contains <full/> (e.g. the client has restarted)
+// discard the old state first.
+//
+int CC_STATE::parse_changes(XML_PARSER& xp) {
+    char buf[256], url[256], name[256], plan_class[64];
+    int version_num;
+    PROJECT* project = NULL;
+    bool found_end = false;
+
+    MIOFILE& in = *(xp.f);
+    while (in.fgets(buf, 256)) {
+        if (match_tag(buf, "<unauthorized")) {
+            return ERR_AUTHENTICATOR;
+        }
+        if (match_tag(buf, "</client_state_changes>")) {
+            found_end = true;
+            break;
+        }
+        if (match_tag(buf, "<full/>")) {
+            clear();
             continue;
         }
-        if (match_tag(buf, "<app_version>")) {
-            APP_VERSION* app_version = new APP_VERSION();
-            retval = app_version->parse(xp);
-            if (retval || !project) {
-                delete app_version;
-                continue;
-            }
-            app_version->project = project;
-            app_version->app = lookup_app(project, app_version->app_name);
-            if (!app_version->app) {
-                delete app_version;
-                continue;
-            }
-            app_versions.push_back(app_version);
+        if (parse_int(buf, "<epoch>", epoch)) continue;
+        if (parse_int(buf, "<seqno>", seqno)) continue;
+        if (parse_str(buf, "<project_context>", url, sizeof(url))) {
+            project = lookup_project(url);
             continue;
         }
-        if (match_tag(buf, "<workunit>")) {
-            WORKUNIT* wu = new WORKUNIT();
-            retval = wu->parse(xp);
-            if (retval || !project) {
-                delete wu;
-                continue;
-            }
-            wu->project = project;
-            wu->app = lookup_app(project, wu->app_name);
-            if (!wu->app) {
-                delete wu;
-                continue;
-            }
-            wus.push_back(wu);
+        if (match_tag(buf, "<client_info>")) {
+            platforms.clear();
+            have_nvidia = false;
+            have_ati = false;
             continue;
         }
-        if (match_tag(buf, "<result>")) {
-            RESULT* result = new RESULT();
-            retval = result->parse(xp);
-            if (retval || !project) {
-                delete result;
-                continue;
-            }
-            result->project = project;
-            result->wup = lookup_wu(project, result->wu_name);
-            if (!result->wup) {
-                delete result;
-                continue;
+        if (match_tag(buf, "<deleted_")) {
+            strcpy(url, "");
+            strcpy(name, "");
+            strcpy(plan_class, "");
+            version_num = 0;
+            bool is_project = match_tag(buf, "<deleted_project>");
+            bool is_app = match_tag(buf, "<deleted_app>");
+            bool is_app_version = match_tag(buf, "<deleted_app_version>");
+            bool is_wu = match_tag(buf, "<deleted_workunit>");
+            while (in.fgets(buf, 256)) {
+                if (match_tag(buf, "</deleted_")) break;
+                if (parse_str(buf, "<master_url>", url, sizeof(url))) continue;
+                if (parse_str(buf, "<project_url>", url, sizeof(url))) continue;
+                if (parse_str(buf, "<name>", name, sizeof(name))) continue;
+                if (parse_str(buf, "<app_name>", name, sizeof(name))) continue;
+                if (parse_int(buf, "<version_num>", version_num)) continue;
+                if (parse_str(buf, "<plan_class>", plan_class, sizeof(plan_class))) continue;
             }
-            result->app = result->wup->app;
-            APP_VERSION* avp;
-            if (result->version_num) {
-                avp = lookup_app_version(
-                    project, result->app, result->version_num,
-                    result->plan_class
+            PROJECT* p = lookup_project(url);
+            if (!p) continue;
+            if (is_project) {
+                remove_item(projects, p);
+                project = NULL;
+            } else if (is_app) {
+                remove_item(apps, lookup_app(p, name));
+            } else if (is_app_version) {
+                APP* app = lookup_app(p, name);
+                if (!app) continue;
+                remove_item(
+                    app_versions,
+                    lookup_app_version(p, app, version_num, plan_class)
                 );
+            } else if (is_wu) {
+                remove_item(wus, lookup_wu(p, name));
             } else {
-                avp = lookup_app_version_old(
-                    project, result->app, result->wup->version_num
-                );
+                remove_item(results, lookup_result(p, name));
             }
-            if (!avp) {
-                delete result;
-                continue;
-            }
-            result->avp = avp;
-            results.push_back(result);
-            continue;
-        }
-        if (match_tag(buf, "<global_preferences>")) {
-            bool flag = false;
-            GLOBAL_PREFS_MASK mask;
-            global_prefs.parse(xp, "", flag, mask);
-            continue;
-        }
-        if (parse_str(buf, "<platform>", platform)) {
-            platforms.push_back(platform);
             continue;
         }
-        if (match_tag(buf, "host_info")) {
-            host_info.parse(xp);
-            continue;
-        }
-        if (parse_bool(buf, "have_cuda", have_nvidia)) continue;
-        if (parse_bool(buf, "have_ati", have_ati)) continue;
+        if (parse_element(xp, buf, project, true)) continue;
     }
+    if (!found_end) return ERR_XML_PARSE;
     return 0;
 }
 
@@ -906,6 +1049,8 @@ void CC_STATE::clear() {
     host_info.clear_host_info();
     have_nvidia = false;
     have_ati = false;
+    epoch = 0;
+    seqno = 0;
 }
 
 PROJECT* CC_STATE::lookup_project(const char* url) {
@@ -1367,6 +1512,43 @@ int RPC_CLIENT::get_state(CC_STATE& state) {
     return state.parse(rpc.xp);
 }
 
+// Get the changes to the client's state since the last call,
+// and update "state" accordingly.
+// The first call (or a call after state.clear()) gets the whole state.
+// Objects that haven't been deleted stay at the same addresses.
+// If the client doesn't support get_state_changes(), use get_state(),
+// and keep using it until we reconnect.
+//
+int RPC_CLIENT::get_state_changes(CC_STATE& state) {
+    int retval;
+    SET_LOCALE sl;
+    char buf[256];
+
+    if (no_state_changes) return get_state(state);
+
+    RPC rpc(this);
+    sprintf(buf,
+        "<get_state_changes>\n"
+        "   <epoch>%d</epoch>\n"
+        "   <seqno>%d</seqno>\n"
+        "</get_state_changes>\n",
+        state.epoch, state.seqno
+    );
+    retval = rpc.do_rpc(buf);
+    if (retval) return retval;
+    if (!strstr(rpc.mbuf, "<client_state_changes>")) {
+        no_state_changes = true;
+        return get_state(state);
+    }
+    retval = state.parse_changes(rpc.xp);
+    if (retval) {
+        // start over next time
+        //
+        state.clear();
+    }
+    return retval;
+}
+
 int RPC_CLIENT::get_results(RESULTS& t, bool active_only) {
     int retval;
     SET_LOCALE sl;
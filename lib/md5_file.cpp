@@ -32,16 +32,35 @@
 #include <wincrypt.h>
 #endif
 
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
 #include "md5.h"
 #include "md5_file.h"
 #include "error_numbers.h"
 
+// Read files in chunks this big.
+// With 4KB reads, hashing a large file spends much of its time
+// in per-call overhead.
+//
+#define MD5_FILE_BUFSIZE    (256*1024)
 
-int md5_file(const char* path, char* output, double& nbytes) {
-    unsigned char buf[4096];
+static void md5_hex(md5_state_t& state, char* output) {
     unsigned char binout[16];
+    int i;
+
+    md5_finish(&state, binout);
+    for (i=0; i<16; i++) {
+        sprintf(output+2*i, "%02x", binout[i]);
+    }
+    output[32] = 0;
+}
+
+int md5_file(const char* path, char* output, double& nbytes) {
+    unsigned char* buf;
     md5_state_t state;
-    int i, n;
+    int n;
 
     nbytes = 0;
 #ifndef _USING_FCGI_
@@ -59,34 +78,29 @@ int md5_file(const char* path, char* output, double& nbytes) {
 
         return ERR_FOPEN;
     }
+    buf = (unsigned char*)malloc(MD5_FILE_BUFSIZE);
+    if (!buf) {
+        fclose(f);
+        return ERR_MALLOC;
+    }
     md5_init(&state);
     while (1) {
-        n = (int)fread(buf, 1, 4096, f);
+        n = (int)fread(buf, 1, MD5_FILE_BUFSIZE, f);
         if (n<=0) break;
         nbytes += n;
         md5_append(&state, buf, n);
     }
-    md5_finish(&state, binout);
-    for (i=0; i<16; i++) {
-        sprintf(output+2*i, "%02x", binout[i]);
-    }
-    output[32] = 0;
+    free(buf);
+    md5_hex(state, output);
     fclose(f);
     return 0;
 }
 
 int md5_block(const unsigned char* data, int nbytes, char* output) {
-    unsigned char binout[16];
-    int i;
-
     md5_state_t state;
     md5_init(&state);
     md5_append(&state, data, nbytes);
-    md5_finish(&state, binout);
-    for (i=0; i<16; i++) {
-        sprintf(output+2*i, "%02x", binout[i]);
-    }
-    output[32] = 0;
+    md5_hex(state, output);
     return 0;
 }
 
@@ -96,6 +110,384 @@ std::string md5_string(const unsigned char* data, int nbytes) {
     return std::string(output);
 }
 
+////////////// hashing several blocks or files at once ////////////////
+//
+// MD5 is inherently serial within a stream,
+// but independent streams can be hashed in the lanes of SIMD registers:
+// 4 at once with SSE2, 8 with AVX2.
+// We use GCC's vector extensions, and choose the lane count
+// at run time depending on the CPU.
+// With other compilers or CPUs we use the scalar code in md5.c.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MD5_SIMD
+#endif
+
+#define MD5_MAX_LANES   8
+
+#ifdef MD5_SIMD
+
+typedef md5_word_t md5_v4 __attribute__((vector_size(16)));
+typedef md5_word_t md5_v8 __attribute__((vector_size(32)));
+
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, k, s, t) \
+    a += f(b, c, d) + X[k] + (md5_word_t)t; \
+    a = ((a << s) | (a >> (32-s))) + b
+
+// Process nblocks 64-byte blocks from each of L streams.
+// This is inlined into functions compiled for the appropriate CPU.
+//
+template <class V, int L>
+static inline __attribute__((always_inline)) void md5_lanes(
+    md5_state_t** states, const md5_byte_t** data, int nblocks
+) {
+    V a, b, c, d, aa, bb, cc, dd, X[16];
+    md5_word_t w;
+    int i, j, n;
+
+    for (j=0; j<L; j++) {
+        a[j] = states[j]->abcd[0];
+        b[j] = states[j]->abcd[1];
+        c[j] = states[j]->abcd[2];
+        d[j] = states[j]->abcd[3];
+    }
+    for (n=0; n<nblocks; n++) {
+        for (i=0; i<16; i++) {
+            for (j=0; j<L; j++) {
+                memcpy(&w, data[j] + 64*n + 4*i, 4);
+                X[i][j] = w;
+            }
+        }
+        aa = a; bb = b; cc = c; dd = d;
+
+        MD5_STEP(MD5_F, a, b, c, d,  0,  7, 0xd76aa478);
+        MD5_STEP(MD5_F, d, a, b, c,  1, 12, 0xe8c7b756);
+        MD5_STEP(MD5_F, c, d, a, b,  2, 17, 0x242070db);
+        MD5_STEP(MD5_F, b, c, d, a,  3, 22, 0xc1bdceee);
+        MD5_STEP(MD5_F, a, b, c, d,  4,  7, 0xf57c0faf);
+        MD5_STEP(MD5_F, d, a, b, c,  5, 12, 0x4787c62a);
+        MD5_STEP(MD5_F, c, d, a, b,  6, 17, 0xa8304613);
+        MD5_STEP(MD5_F, b, c, d, a,  7, 22, 0xfd469501);
+        MD5_STEP(MD5_F, a, b, c, d,  8,  7, 0x698098d8);
+        MD5_STEP(MD5_F, d, a, b, c,  9, 12, 0x8b44f7af);
+        MD5_STEP(MD5_F, c, d, a, b, 10, 17, 0xffff5bb1);
+        MD5_STEP(MD5_F, b, c, d, a, 11, 22, 0x895cd7be);
+        MD5_STEP(MD5_F, a, b, c, d, 12,  7, 0x6b901122);
+        MD5_STEP(MD5_F, d, a, b, c, 13, 12, 0xfd987193);
+        MD5_STEP(MD5_F, c, d, a, b, 14, 17, 0xa679438e);
+        MD5_STEP(MD5_F, b, c, d, a, 15, 22, 0x49b40821);
+
+        MD5_STEP(MD5_G, a, b, c, d,  1,  5, 0xf61e2562);
+        MD5_STEP(MD5_G, d, a, b, c,  6,  9, 0xc040b340);
+        MD5_STEP(MD5_G, c, d, a, b, 11, 14, 0x265e5a51);
+        MD5_STEP(MD5_G, b, c, d, a,  0, 20, 0xe9b6c7aa);
+        MD5_STEP(MD5_G, a, b, c, d,  5,  5, 0xd62f105d);
+        MD5_STEP(MD5_G, d, a, b, c, 10,  9, 0x02441453);
+        MD5_STEP(MD5_G, c, d, a, b, 15, 14, 0xd8a1e681);
+        MD5_STEP(MD5_G, b, c, d, a,  4, 20, 0xe7d3fbc8);
+        MD5_STEP(MD5_G, a, b, c, d,  9,  5, 0x21e1cde6);
+        MD5_STEP(MD5_G, d, a, b, c, 14,  9, 0xc33707d6);
+        MD5_STEP(MD5_G, c, d, a, b,  3, 14, 0xf4d50d87);
+        MD5_STEP(MD5_G, b, c, d, a,  8, 20, 0x455a14ed);
+        MD5_STEP(MD5_G, a, b, c, d, 13,  5, 0xa9e3e905);
+        MD5_STEP(MD5_G, d, a, b, c,  2,  9, 0xfcefa3f8);
+        MD5_STEP(MD5_G, c, d, a, b,  7, 14, 0x676f02d9);
+        MD5_STEP(MD5_G, b, c, d, a, 12, 20, 0x8d2a4c8a);
+
+        MD5_STEP(MD5_H, a, b, c, d,  5,  4, 0xfffa3942);
+        MD5_STEP(MD5_H, d, a, b, c,  8, 11, 0x8771f681);
+        MD5_STEP(MD5_H, c, d, a, b, 11, 16, 0x6d9d6122);
+        MD5_STEP(MD5_H, b, c, d, a, 14, 23, 0xfde5380c);
+        MD5_STEP(MD5_H, a, b, c, d,  1,  4, 0xa4beea44);
+        MD5_STEP(MD5_H, d, a, b, c,  4, 11, 0x4bdecfa9);
+        MD5_STEP(MD5_H, c, d, a, b,  7, 16, 0xf6bb4b60);
+        MD5_STEP(MD5_H, b, c, d, a, 10, 23, 0xbebfbc70);
+        MD5_STEP(MD5_H, a, b, c, d, 13,  4, 0x289b7ec6);
+        MD5_STEP(MD5_H, d, a, b, c,  0, 11, 0xeaa127fa);
+        MD5_STEP(MD5_H, c, d, a, b,  3, 16, 0xd4ef3085);
+        MD5_STEP(MD5_H, b, c, d, a,  6, 23, 0x04881d05);
+        MD5_STEP(MD5_H, a, b, c, d,  9,  4, 0xd9d4d039);
+        MD5_STEP(MD5_H, d, a, b, c, 12, 11, 0xe6db99e5);
+        MD5_STEP(MD5_H, c, d, a, b, 15, 16, 0x1fa27cf8);
+        MD5_STEP(MD5_H, b, c, d, a,  2, 23, 0xc4ac5665);
+
+        MD5_STEP(MD5_I, a, b, c, d,  0,  6, 0xf4292244);
+        MD5_STEP(MD5_I, d, a, b, c,  7, 10, 0x432aff97);
+        MD5_STEP(MD5_I, c, d, a, b, 14, 15, 0xab9423a7);
+        MD5_STEP(MD5_I, b, c, d, a,  5, 21, 0xfc93a039);
+        MD5_STEP(MD5_I, a, b, c, d, 12,  6, 0x655b59c3);
+        MD5_STEP(MD5_I, d, a, b, c,  3, 10, 0x8f0ccc92);
+        MD5_STEP(MD5_I, c, d, a, b, 10, 15, 0xffeff47d);
+        MD5_STEP(MD5_I, b, c, d, a,  1, 21, 0x85845dd1);
+        MD5_STEP(MD5_I, a, b, c, d,  8,  6, 0x6fa87e4f);
+        MD5_STEP(MD5_I, d, a, b, c, 15, 10, 0xfe2ce6e0);
+        MD5_STEP(MD5_I, c, d, a, b,  6, 15, 0xa3014314);
+        MD5_STEP(MD5_I, b, c, d, a, 13, 21, 0x4e0811a1);
+        MD5_STEP(MD5_I, a, b, c, d,  4,  6, 0xf7537e82);
+        MD5_STEP(MD5_I, d, a, b, c, 11, 10, 0xbd3af235);
+        MD5_STEP(MD5_I, c, d, a, b,  2, 15, 0x2ad7d2bb);
+        MD5_STEP(MD5_I, b, c, d, a,  9, 21, 0xeb86d391);
+
+        a += aa; b += bb; c += cc; d += dd;
+    }
+    for (j=0; j<L; j++) {
+        states[j]->abcd[0] = a[j];
+        states[j]->abcd[1] = b[j];
+        states[j]->abcd[2] = c[j];
+        states[j]->abcd[3] = d[j];
+    }
+}
+
+__attribute__((target("sse2")))
+static void md5_lanes_sse2(
+    md5_state_t** states, const md5_byte_t** data, int nblocks
+) {
+    md5_lanes<md5_v4, 4>(states, data, nblocks);
+}
+
+__attribute__((target("avx2")))
+static void md5_lanes_avx2(
+    md5_state_t** states, const md5_byte_t** data, int nblocks
+) {
+    md5_lanes<md5_v8, 8>(states, data, nblocks);
+}
+
+#endif  // MD5_SIMD
+
+static int md5_max_lanes = MD5_MAX_LANES;
+
+void md5_set_max_lanes(int n) {
+    md5_max_lanes = n;
+}
+
+// the number of streams we can hash at once; 0 if no SIMD
+//
+int md5_nlanes() {
+#ifdef MD5_SIMD
+    static int nlanes = -1;
+    if (nlanes < 0) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            nlanes = 8;
+        } else if (__builtin_cpu_supports("sse2")) {
+            nlanes = 4;
+        } else {
+            nlanes = 0;
+        }
+    }
+    if (nlanes > md5_max_lanes) {
+        return md5_max_lanes >= 4 ? 4 : 0;
+    }
+    return nlanes;
+#else
+    return 0;
+#endif
+}
+
+// add nbytes to the message length in an MD5 state,
+// as md5_append() does
+//
+static inline void md5_add_count(md5_state_t* state, int nbytes) {
+    md5_word_t nbits = (md5_word_t)(nbytes << 3);
+    state->count[1] += nbytes >> 29;
+    state->count[0] += nbits;
+    if (state->count[0] < nbits) state->count[1]++;
+}
+
+// Equivalent to calling md5_append(states[i], data[i], nbytes[i])
+// for i = 0..n-1, but the whole 64-byte blocks of the streams
+// are hashed md5_nlanes() at a time.
+//
+static void md5_append_multi(
+    int n, md5_state_t** states, const md5_byte_t** data, const int* nbytes
+) {
+    int i, j;
+    int nlanes = md5_nlanes();
+
+    if (nlanes == 0 || n < 2) {
+        for (i=0; i<n; i++) {
+            md5_append(states[i], data[i], nbytes[i]);
+        }
+        return;
+    }
+
+#ifdef MD5_SIMD
+    std::vector<const md5_byte_t*> p(n);
+    std::vector<int> left(n), nblocks(n);
+    int lane[MD5_MAX_LANES];
+    md5_state_t* lane_states[MD5_MAX_LANES];
+    const md5_byte_t* lane_data[MD5_MAX_LANES];
+    md5_state_t dummy_state;
+    int next = 0, nactive, first, k;
+
+    for (i=0; i<n; i++) {
+        p[i] = data[i];
+        left[i] = nbytes[i];
+
+        // if the state has a partial block buffered, complete it
+        //
+        int off = (states[i]->count[0] >> 3) & 63;
+        if (off) {
+            int m = 64 - off;
+            if (m > left[i]) m = left[i];
+            md5_append(states[i], p[i], m);
+            p[i] += m;
+            left[i] -= m;
+        }
+        nblocks[i] = left[i]/64;
+    }
+
+    md5_init(&dummy_state);
+    for (j=0; j<nlanes; j++) {
+        lane[j] = -1;
+    }
+    while (1) {
+        // assign streams with blocks left to idle lanes
+        //
+        nactive = 0;
+        first = -1;
+        for (j=0; j<nlanes; j++) {
+            if (lane[j] >= 0 && nblocks[lane[j]] == 0) lane[j] = -1;
+            while (lane[j] < 0 && next < n) {
+                if (nblocks[next]) lane[j] = next;
+                next++;
+            }
+            if (lane[j] >= 0) {
+                nactive++;
+                if (first < 0) first = lane[j];
+            }
+        }
+        if (nactive == 0) break;
+        if (nactive == 1) {
+            // not worth using SIMD for one stream
+            //
+            md5_append(states[first], p[first], 64*nblocks[first]);
+            p[first] += 64*nblocks[first];
+            left[first] -= 64*nblocks[first];
+            nblocks[first] = 0;
+            continue;
+        }
+
+        // hash as many blocks as the shortest stream has.
+        // Idle lanes hash the first stream's data into a dummy state.
+        //
+        k = nblocks[first];
+        for (j=0; j<nlanes; j++) {
+            i = lane[j];
+            if (i < 0) {
+                lane_states[j] = &dummy_state;
+                lane_data[j] = p[first];
+            } else {
+                if (nblocks[i] < k) k = nblocks[i];
+                lane_states[j] = states[i];
+                lane_data[j] = p[i];
+            }
+        }
+        if (nlanes == 8) {
+            md5_lanes_avx2(lane_states, lane_data, k);
+        } else {
+            md5_lanes_sse2(lane_states, lane_data, k);
+        }
+        for (j=0; j<nlanes; j++) {
+            i = lane[j];
+            if (i < 0) continue;
+            md5_add_count(states[i], 64*k);
+            p[i] += 64*k;
+            left[i] -= 64*k;
+            nblocks[i] -= k;
+        }
+    }
+
+    // buffer the partial blocks at the ends
+    //
+    for (i=0; i<n; i++) {
+        if (left[i]) md5_append(states[i], p[i], left[i]);
+    }
+#endif
+}
+
+int md5_blocks(
+    int n, const unsigned char** data, const int* nbytes, char** outputs
+) {
+    std::vector<md5_state_t> states(n);
+    std::vector<md5_state_t*> sp(n);
+    int i;
+
+    for (i=0; i<n; i++) {
+        md5_init(&states[i]);
+        sp[i] = &states[i];
+    }
+    md5_append_multi(n, &sp[0], data, nbytes);
+    for (i=0; i<n; i++) {
+        md5_hex(states[i], outputs[i]);
+    }
+    return 0;
+}
+
+// Read the files a chunk at a time, in md5_nlanes() slots;
+// when a file is finished, start the next one in its slot.
+//
+int md5_files(
+    int n, const char** paths, char** outputs, double* nbytes, int* retvals
+) {
+    int nslots = md5_nlanes();
+    if (nslots < 1) nslots = 1;
+    std::vector<FILE*> files(nslots, (FILE*)NULL);
+    std::vector<int> index(nslots, -1);
+    std::vector<md5_state_t> states(n);
+    std::vector<unsigned char> buf((size_t)nslots*MD5_FILE_BUFSIZE);
+    md5_state_t* sp[MD5_MAX_LANES];
+    const md5_byte_t* bp[MD5_MAX_LANES];
+    int lens[MD5_MAX_LANES];
+    int i, j, m, next = 0, retval = 0;
+
+    while (1) {
+        m = 0;
+        for (j=0; j<nslots; j++) {
+            while (!files[j] && next < n) {
+                i = next++;
+                nbytes[i] = 0;
+#ifndef _USING_FCGI_
+                files[j] = fopen(paths[i], "rb");
+#else
+                files[j] = FCGI::fopen(paths[i], "rb");
+#endif
+                if (!files[j]) {
+                    retvals[i] = retval = ERR_FOPEN;
+                    strcpy(outputs[i], "");
+                    continue;
+                }
+                index[j] = i;
+                md5_init(&states[i]);
+            }
+            if (!files[j]) continue;
+            i = index[j];
+            unsigned char* b = &buf[(size_t)j*MD5_FILE_BUFSIZE];
+            int k = (int)fread(b, 1, MD5_FILE_BUFSIZE, files[j]);
+            if (k <= 0) {
+                fclose(files[j]);
+                files[j] = NULL;
+                md5_hex(states[i], outputs[i]);
+                retvals[i] = 0;
+                j--;        // start the next file in this slot
+                continue;
+            }
+            nbytes[i] += k;
+            sp[m] = &states[i];
+            bp[m] = b;
+            lens[m] = k;
+            m++;
+        }
+        if (m == 0) break;
+        md5_append_multi(m, sp, bp, lens);
+    }
+    return retval;
+}
+
 int make_random_string(char* out) {
     char buf[256];
 #ifdef _WIN32
@@ -28,6 +28,29 @@ extern int md5_block(const unsigned char* data, int nbytes, char* output);
 
 extern std::string md5_string(const unsigned char* data, int nbytes);
 
+// Compute the MD5s of n blocks, or n files.
+// On x86 CPUs with SSE2 or AVX2, 4 or 8 of them are hashed at once;
+// this is faster than doing them one at a time
+// (unless one of them is much larger than the others).
+// The outputs must be MD5_LEN chars.
+// md5_files() sets retvals[i] for each file,
+// and returns nonzero if any of them couldn't be read.
+//
+extern int md5_blocks(
+    int n, const unsigned char** data, const int* nbytes, char** outputs
+);
+extern int md5_files(
+    int n, const char** paths, char** outputs, double* nbytes, int* retvals
+);
+
+// the number of blocks or files hashed at once (0 if no SIMD)
+//
+extern int md5_nlanes();
+
+// for testing: use at most n lanes
+//
+extern void md5_set_max_lanes(int n);
+
 inline std::string md5_string(std::string const& data) {
     return md5_string((const unsigned char*) data.c_str(), (int)data.size());
 }
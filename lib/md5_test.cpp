@@ -1,14 +1,178 @@
+// md5_test: compute the MD5 of files, and measure how fast this is.
+//
+// Usage: md5_test file
+//      print the MD5 and size of the file
+// md5_test --bench [--threads N] file ...
+//      hash the files with md5_file(), first one at a time
+//      and then using N threads (default 2),
+//      the way the client verifies large downloads,
+//      and print the throughput of each.
+//      Run it twice; the first run may be dominated by disk I/O.
+// md5_test --bench_blocks [--size N] [--nblocks N]
+//      hash N (default 64) in-memory blocks of about N bytes
+//      (default 1MB) with md5_block(), one at a time,
+//      and with md5_blocks() using 4 and 8 lanes if the CPU allows,
+//      check that the results agree, and print the throughput of each.
+
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <pthread.h>
 
 #include "md5_file.h"
+#include "util.h"
+
+using std::vector;
+
+vector<const char*> files;
+int next_file;
+double total_nbytes;
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void* hash_files(void*) {
+    char out[MD5_LEN];
+    double nbytes;
+
+    while (1) {
+        pthread_mutex_lock(&mutex);
+        if (next_file >= (int)files.size()) {
+            pthread_mutex_unlock(&mutex);
+            return 0;
+        }
+        const char* path = files[next_file++];
+        pthread_mutex_unlock(&mutex);
+
+        if (md5_file(path, out, nbytes)) {
+            fprintf(stderr, "can't hash %s\n", path);
+            exit(1);
+        }
+        pthread_mutex_lock(&mutex);
+        total_nbytes += nbytes;
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+void bench(int nthreads) {
+    vector<pthread_t> threads(nthreads);
+    int i;
+
+    next_file = 0;
+    total_nbytes = 0;
+    double t = dtime();
+    for (i=0; i<nthreads; i++) {
+        pthread_create(&threads[i], NULL, hash_files, NULL);
+    }
+    for (i=0; i<nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    t = dtime() - t;
+    printf("%d thread(s): %.0f bytes in %.3f sec: %.1f MB/sec\n",
+        nthreads, total_nbytes, t, t>0?total_nbytes/t/MEGA:0
+    );
+}
+
+void bench_blocks(int size, int nblocks) {
+    vector<unsigned char*> data(nblocks);
+    vector<int> nbytes(nblocks);
+    vector<char*> out1(nblocks), out2(nblocks);
+    double total = 0, t;
+    int i, j, lanes;
+
+    for (i=0; i<nblocks; i++) {
+        // vary the sizes so that the streams end at different places
+        //
+        nbytes[i] = size + (i*37)%131;
+        data[i] = (unsigned char*)malloc(nbytes[i]);
+        for (j=0; j<nbytes[i]; j++) {
+            data[i][j] = rand();
+        }
+        out1[i] = (char*)malloc(MD5_LEN);
+        out2[i] = (char*)malloc(MD5_LEN);
+        total += nbytes[i];
+    }
+
+    t = dtime();
+    for (i=0; i<nblocks; i++) {
+        md5_block(data[i], nbytes[i], out1[i]);
+    }
+    t = dtime() - t;
+    printf("md5_block(): %.3f GB/sec\n", t>0?total/t/1e9:0);
+
+    for (lanes=4; lanes<=8; lanes += 4) {
+        md5_set_max_lanes(lanes);
+        if (md5_nlanes() != lanes) {
+            printf("%d lanes: not supported on this CPU\n", lanes);
+            continue;
+        }
+        t = dtime();
+        md5_blocks(
+            nblocks, (const unsigned char**)&data[0], &nbytes[0], &out2[0]
+        );
+        t = dtime() - t;
+        for (i=0; i<nblocks; i++) {
+            if (strcmp(out1[i], out2[i])) {
+                printf("%d lanes: wrong MD5 for block %d: %s != %s\n",
+                    lanes, i, out2[i], out1[i]
+                );
+                exit(1);
+            }
+        }
+        printf("md5_blocks(), %d lanes: %.3f GB/sec\n",
+            lanes, t>0?total/t/1e9:0
+        );
+    }
+}
+
+void usage() {
+    fprintf(stderr,
+        "Usage: md5_test file\n"
+        "       md5_test --bench [--threads N] file ...\n"
+        "       md5_test --bench_blocks [--size N] [--nblocks N]\n"
+    );
+    exit(1);
+}
 
-int main(int, char** argv) {
-    char out[33];
+int main(int argc, char** argv) {
+    char out[MD5_LEN];
     double nbytes;
+    int i, nthreads = 2;
 
-    md5_file(argv[1], out, nbytes);
-    printf("%s\n%f bytes\n", out, nbytes);
+    if (argc < 2) usage();
+    if (!strcmp(argv[1], "--bench_blocks")) {
+        int size = 1000000, nblocks = 64;
+        for (i=2; i<argc; i++) {
+            if (!strcmp(argv[i], "--size")) {
+                if (!argv[++i]) usage();
+                size = atoi(argv[i]);
+            } else if (!strcmp(argv[i], "--nblocks")) {
+                if (!argv[++i]) usage();
+                nblocks = atoi(argv[i]);
+            } else {
+                usage();
+            }
+        }
+        if (size < 0 || nblocks < 1) usage();
+        bench_blocks(size, nblocks);
+        return 0;
+    }
+    if (strcmp(argv[1], "--bench")) {
+        md5_file(argv[1], out, nbytes);
+        printf("%s\n%f bytes\n", out, nbytes);
+        return 0;
+    }
+    for (i=2; i<argc; i++) {
+        if (!strcmp(argv[i], "--threads")) {
+            if (!argv[++i]) usage();
+            nthreads = atoi(argv[i]);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty() || nthreads < 1) usage();
 
+    bench(1);
+    if (nthreads > 1) bench(nthreads);
     return 0;
 }
 
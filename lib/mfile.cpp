@@ -55,6 +55,9 @@ int MFILE::open(const char* path, const char* mode) {
 }
 
 // seems like Win's realloc is stupid,  Make it smart.
+// Do the same where we can get the size of a block;
+// otherwise each write reallocs the buffer to its exact length,
+// which shrinks the initial 64KB block and then grows it again
 //
 static inline char* realloc_aux(char* p, size_t len) {
     if (!p) {
@@ -63,6 +66,9 @@ static inline char* realloc_aux(char* p, size_t len) {
 #ifdef _WIN32
     if (_msize(p) >= (unsigned int)len) return p;
     return (char*) realloc(p, len*2);
+#elif defined(HAVE_MALLOC_USABLE_SIZE)
+    if (malloc_usable_size(p) >= len) return p;
+    return (char*) realloc(p, len*2);
 #else
     return (char*) realloc(p, len);
 #endif
@@ -140,10 +146,13 @@ int MFILE::puts(const char* p) {
     return n;
 }
 
+// write the buffer to the file and close it.
+// Returns an error if the write or flush failed.
+//
 int MFILE::close() {
     int retval = 0;
     if (f) {
-        flush();
+        retval = flush();
         fclose(f);
         f = NULL;
     }
@@ -178,3 +187,8 @@ void MFILE::get_buf(char*& b, int& l) {
     len = 0;
 }
 
+void MFILE::peek_buf(const char*& b, int& l) {
+    b = buf?buf:"";
+    l = len;
+}
+
@@ -50,6 +50,14 @@ public:
         // get the MFILE's internal buffer and its length.
         // The caller assumes ownership of the buffer and must free() it.
         // The MFILE's buffer is set to empty
+    void peek_buf(const char*&, int&);
+        // get the MFILE's internal buffer and its length.
+        // The MFILE keeps the buffer
+    void clear() {
+        len = 0;
+        if (buf) *buf = 0;
+    }
+        // discard the contents but keep the buffer
 };
 
 #endif
@@ -22,6 +22,7 @@
 #include <cassert>
 #include <cstring>
 #include <string>
+#include <pthread.h>
 #endif
 
 #include "str_util.h"
@@ -41,6 +42,8 @@ using std::string;
 // CLIENT_MSG_LOG does the same thing for client debugging output.
 //
 // MSG_LOG has an "indent_level" state for how many spaces to indent output.
+// It's kept per thread (where the compiler supports that),
+// since a server may log from several threads at once.
 // This corresponds in general to the function-call recursion level.
 // Call MSG_LOG::enter_level() to increase or decrease by 1 level.
 // The SCOPE_MSG_LOG class takes care of these calls for you.
@@ -62,12 +65,41 @@ using std::string;
 
 // See sched/sched_msg_log.C and client/client_msg_log.C for those classes.
 
+#define MAX_INDENT 39
+
+#if defined(__GNUC__) && !defined(__APPLE__) && !defined(_WIN32)
+static __thread int indent_level = 0;
+#else
+static int indent_level = 0;
+#endif
+
+// MAX_INDENT spaces
+//
+static const char* blanks = "                                       ";
+
+static inline const char* indent_spaces() {
+    return blanks + MAX_INDENT - indent_level;
+}
+
+// Keep messages from different threads from being interleaved.
+// We can't use flockfile(), since output may be an FCGI stream.
+//
+#ifndef _WIN32
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static inline void lock_output() {
+    pthread_mutex_lock(&output_mutex);
+}
+static inline void unlock_output() {
+    pthread_mutex_unlock(&output_mutex);
+}
+#else
+static inline void lock_output() {}
+static inline void unlock_output() {}
+#endif
+
 MSG_LOG::MSG_LOG(FILE* output_) {
     output = output_;
-    indent_level = 0;
-    spaces[0] = 0;
     pid = 0;
-    strcpy(spaces+1, "                                                                              ");
 }
 
 void MSG_LOG::enter_level(int diff) {
@@ -75,27 +107,33 @@ void MSG_LOG::enter_level(int diff) {
 
     if (indent_level <= 0 ) indent_level = 0;
     if ((indent_level + diff) <= 0) return;
-    if (indent_level >= 39 ) indent_level = 39;
-    if ((indent_level + diff) >= 39) return;
+    if (indent_level >= MAX_INDENT ) indent_level = MAX_INDENT;
+    if ((indent_level + diff) >= MAX_INDENT) return;
 
-    spaces[indent_level] = ' ';
     indent_level += diff*2;
-    spaces[indent_level] = 0;
 
     assert (indent_level >= 0);
 }
 
+void MSG_LOG::set_indent_level(int new_indent_level) {
+    if (new_indent_level < 0) indent_level = 0;
+    else if (new_indent_level > MAX_INDENT) indent_level = MAX_INDENT;
+    else indent_level = new_indent_level;
+}
+
 void MSG_LOG::vprintf(int kind, const char* format, va_list va) {
-    char buf[256];
-    const char* now_timestamp = precision_time_to_string(dtime());
+    char buf[256], now_timestamp[TIME_STRING_LEN];
     if (!v_message_wanted(kind)) return;
     if (pid) {
         sprintf(buf, " [PID=%-5d]", pid);
     } else {
         buf[0] = 0;
     }
-    fprintf(output, "%s%s %s%s ", now_timestamp, buf, v_format_kind(kind), spaces);
+    precision_time_to_string(dtime(), now_timestamp);
+    lock_output();
+    fprintf(output, "%s%s %s%s ", now_timestamp, buf, v_format_kind(kind), indent_spaces());
     vfprintf(output, format, va);
+    unlock_output();
 }
 
 // break a multi-line string into lines (so that we show prefix on each line)
@@ -110,10 +148,13 @@ void MSG_LOG::vprintf_multiline(
     if (prefix_format) {
         vsprintf(sprefix, prefix_format, va);
     }
-    const char* now_timestamp = precision_time_to_string(dtime());
+    char now_timestamp[TIME_STRING_LEN];
+    precision_time_to_string(dtime(), now_timestamp);
     const char* skind = v_format_kind(kind);
+    const char* spaces = indent_spaces();
 
     string line;
+    lock_output();
     while (*str) {
         if (*str == '\n') {
             fprintf(output, "%s %s%s %s%s\n", now_timestamp, skind, spaces, sprefix, line.c_str());
@@ -126,6 +167,7 @@ void MSG_LOG::vprintf_multiline(
     if (!line.empty()) {
         fprintf(output, "%s %s[%s] %s%s\n", now_timestamp, spaces, skind, sprefix, line.c_str());
     }
+    unlock_output();
 }
 
 void MSG_LOG::vprintf_file(
@@ -137,8 +179,10 @@ void MSG_LOG::vprintf_file(
     if (prefix_format) {
         vsprintf(sprefix, prefix_format, va);
     }
-    const char* now_timestamp = precision_time_to_string(dtime());
+    char now_timestamp[TIME_STRING_LEN];
+    precision_time_to_string(dtime(), now_timestamp);
     const char* skind = v_format_kind(kind);
+    const char* spaces = indent_spaces();
 
 #ifndef _USING_FCGI_
     FILE* f = fopen(filename, "r");
@@ -148,9 +192,11 @@ void MSG_LOG::vprintf_file(
     if (!f) return;
     char buf[256];
 
+    lock_output();
     while (fgets(buf, 256, f)) {
         fprintf(output, "%s %s%s %s%s\n", now_timestamp, skind, spaces, sprefix, buf);
     }
+    unlock_output();
     fclose(f);
 }
 
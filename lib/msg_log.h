@@ -42,9 +42,7 @@
 class MSG_LOG {
 public:
     int debug_level;
-    char spaces[80];
     FILE* output;
-    int indent_level;
     int pid;
 
     MSG_LOG(FILE* output);
@@ -52,6 +50,8 @@ public:
 
     void enter_level(int = 1);
     void leave_level() { enter_level(-1); }
+    void set_indent_level(int);
+        // the indentation is per thread
     MSG_LOG& operator++() { enter_level(); return *this; }
     MSG_LOG& operator--() { leave_level(); return *this; }
 
@@ -34,6 +34,10 @@
 #include <math.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #if HAVE_IEEEFP_H
 #include <ieeefp.h>
 #endif
@@ -44,6 +48,7 @@
 #endif
 
 #include "error_numbers.h"
+#include "util.h"
 #include "str_util.h"
 #include "str_replace.h"
 #include "parse.h"
@@ -1036,3 +1041,393 @@ int XML_PARSER::copy_element(string& out) {
     out += end_tag;
     return 0;
 }
+
+void XML_STR::copy(char* buf, int buflen) const {
+    int n = len;
+    if (n > buflen-1) n = buflen-1;
+    memcpy(buf, p, n);
+    buf[n] = 0;
+}
+
+XML_BUF_PARSER::XML_BUF_PARSER() {
+    file_buf = 0;
+    file_len = 0;
+    file_mapped = false;
+    init("", 0);
+}
+
+XML_BUF_PARSER::XML_BUF_PARSER(const char* _buf, int len) {
+    file_buf = 0;
+    file_len = 0;
+    file_mapped = false;
+    init(_buf, len);
+}
+
+XML_BUF_PARSER::~XML_BUF_PARSER() {
+    free_file();
+}
+
+// release the buffer of a previous init_file()
+//
+void XML_BUF_PARSER::free_file() {
+    if (!file_buf) return;
+#ifndef _WIN32
+    if (file_mapped) {
+        munmap(file_buf, file_len);
+    } else {
+        free(file_buf);
+    }
+#else
+    free(file_buf);
+#endif
+    file_buf = 0;
+    file_len = 0;
+    file_mapped = false;
+}
+
+void XML_BUF_PARSER::init(const char* _buf, int len) {
+    buf = _buf;
+    p = buf;
+    end = buf + len;
+    tag_start = buf;
+    is_tag = false;
+    empty_element = false;
+    cdata = false;
+    tag_hash = 0;
+    parsed_tag = XML_STR();
+    attrs = XML_STR();
+}
+
+int XML_BUF_PARSER::init_file(const char* path) {
+    free_file();
+    init("", 0);
+#ifndef _WIN32
+    struct stat sbuf;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return ERR_FOPEN;
+    if (fstat(fd, &sbuf) == 0 && sbuf.st_size > 0) {
+        void* q = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (q != MAP_FAILED) {
+            ::close(fd);
+            file_buf = (char*)q;
+            file_len = sbuf.st_size;
+            file_mapped = true;
+            init(file_buf, (int)file_len);
+            return 0;
+        }
+    }
+    ::close(fd);
+#endif
+    int retval = read_file_malloc(path, file_buf, 0, false);
+    if (retval) return retval;
+    file_len = strlen(file_buf);
+    init(file_buf, (int)file_len);
+    return 0;
+}
+
+static inline bool xml_isspace(char c) {
+    return isspace((unsigned char)c) != 0;
+}
+
+static const char* find_str(
+    const char* p, const char* end, const char* s, int n
+) {
+    for (; p+n <= end; p++) {
+        if (*p == *s && !memcmp(p, s, n)) return p;
+    }
+    return NULL;
+}
+
+// Scan the next tag or text item.
+// Return true iff reached EOF
+//
+bool XML_BUF_PARSER::get_aux() {
+    const char* q;
+    cdata = false;
+    while (1) {
+        while (p < end && xml_isspace(*p)) p++;
+        if (p >= end) return true;
+        tag_start = p;
+        if (*p != '<') {
+            // text: up to next <, minus trailing whitespace
+            //
+            q = (const char*)memchr(p, '<', end-p);
+            if (!q) q = end;
+            parsed_tag.p = p;
+            p = q;
+            while (q > parsed_tag.p && xml_isspace(q[-1])) q--;
+            parsed_tag.len = (int)(q - parsed_tag.p);
+            is_tag = false;
+            return false;
+        }
+        if (end-p >= 4 && !memcmp(p, "<!--", 4)) {
+            q = find_str(p+4, end, "-->", 3);
+            if (!q) return true;
+            p = q+3;
+            continue;
+        }
+        if (end-p >= 9 && !memcmp(p, "<![CDATA[", 9)) {
+            q = find_str(p+9, end, "]]>", 3);
+            if (!q) return true;
+            parsed_tag.p = p+9;
+            parsed_tag.len = (int)(q - parsed_tag.p);
+            p = q+3;
+            is_tag = false;
+            cdata = true;
+            return false;
+        }
+
+        // a tag: <name [attrs] [/]>
+        //
+        q = (const char*)memchr(p, '>', end-p);
+        if (!q) return true;
+        const char* name = p+1;
+        const char* name_end = name;
+        while (name_end < q && !xml_isspace(*name_end)) name_end++;
+        empty_element = (q[-1] == '/' && q-1 >= name);
+        if (empty_element && name_end == q) name_end--;
+        parsed_tag.p = name;
+        parsed_tag.len = (int)(name_end - name);
+        const char* a = name_end;
+        const char* a_end = empty_element?q-1:q;
+        while (a < a_end && xml_isspace(*a)) a++;
+        while (a_end > a && xml_isspace(a_end[-1])) a_end--;
+        attrs.p = a;
+        attrs.len = (int)(a_end - a);
+        tag_hash = xml_tag_hash(parsed_tag.p, parsed_tag.len);
+        p = q+1;
+        is_tag = true;
+        return false;
+    }
+}
+
+// Get the next tag or text item.
+// Return true iff reached EOF
+//
+bool XML_BUF_PARSER::get_tag() {
+    empty_element = false;
+    attrs = XML_STR();
+    return get_aux();
+}
+
+// match a tag by name; "foo/" matches <foo/>
+//
+bool XML_BUF_PARSER::match_tag(const char* name) {
+    if (!is_tag) return false;
+    int n = (int)strlen(name);
+    if (empty_element) {
+        return n == parsed_tag.len+1 && name[n-1] == '/'
+            && !memcmp(name, parsed_tag.p, parsed_tag.len);
+    }
+    return parsed_tag.equals(name, n);
+}
+
+// parse a start tag (optionally preceded by <?xml>)
+//
+bool XML_BUF_PARSER::parse_start(const char* start_tag) {
+    if (get_tag() || !is_tag) return false;
+    if (parsed_tag.len && parsed_tag.p[0] == '?') {
+        if (get_tag() || !is_tag) return false;
+    }
+    return match_tag(start_tag);
+}
+
+// get the next item and return true if it's the end tag
+// for the given name
+//
+bool XML_BUF_PARSER::get_end_tag(const char* name, int len) {
+    if (get_tag()) return false;
+    if (!is_tag || empty_element) return false;
+    return parsed_tag.len == len+1 && parsed_tag.p[0] == '/'
+        && !memcmp(parsed_tag.p+1, name, len);
+}
+
+// We just got the tag "t".
+// If it's followed by a string and the matching close tag,
+// return the string (without copying or unescaping it).
+//
+bool XML_BUF_PARSER::parse_str(const XML_TAG& t, XML_STR& s) {
+    if (!is_tag || tag_hash != t.hash || !parsed_tag.equals(t.name, t.len)) {
+        return false;
+    }
+    if (empty_element) {
+        s = XML_STR();
+        return true;
+    }
+    if (get_tag()) return false;
+    if (is_tag) {
+        if (parsed_tag.len == t.len+1 && parsed_tag.p[0] == '/'
+            && !memcmp(parsed_tag.p+1, t.name, t.len)
+        ) {
+            s = XML_STR();
+            return true;
+        }
+        return false;
+    }
+    XML_STR val = parsed_tag;
+    bool was_cdata = cdata;
+    if (!get_end_tag(t.name, t.len)) return false;
+    s = val;
+    cdata = was_cdata;
+    return true;
+}
+
+bool XML_BUF_PARSER::parse_str(const XML_TAG& t, char* out, int len) {
+    XML_STR s;
+    if (!parse_str(t, s)) return false;
+    s.copy(out, len);
+    if (!cdata) {
+        xml_unescape(out);
+    }
+    return true;
+}
+
+bool XML_BUF_PARSER::parse_string(const char* start_tag, string& str) {
+    XML_STR s;
+    if (!parse_str(start_tag, s)) return false;
+    str = s.str();
+    if (!cdata) {
+        xml_unescape(str);
+    }
+    return true;
+}
+
+// We just got the tag "name".
+// Get its contents, which should be a number, into val.
+// If the element is empty (<name></name>) set "empty".
+//
+bool XML_BUF_PARSER::get_number(
+    const char* name, char* val, int vallen, bool& empty
+) {
+    int len = (int)strlen(name);
+    empty = false;
+    if (get_tag()) return false;
+    if (is_tag) {
+        if (parsed_tag.len == len+1 && parsed_tag.p[0] == '/'
+            && !memcmp(parsed_tag.p+1, name, len)
+        ) {
+            empty = true;
+            return true;
+        }
+        return false;
+    }
+    if (parsed_tag.len >= vallen) return false;
+    parsed_tag.copy(val, vallen);
+    return get_end_tag(name, len);
+}
+
+bool XML_BUF_PARSER::parse_int(const XML_TAG& t, int& i) {
+    char val[256], *endp;
+    bool empty;
+
+    if (!match_tag(t)) return false;
+    if (!get_number(t.name, val, sizeof(val), empty)) return false;
+    if (empty) {
+        i = 0;
+        return true;
+    }
+    errno = 0;
+    int x = strtol(val, &endp, 0);
+    if (errno) return false;
+    if (*endp) return false;
+    i = x;
+    return true;
+}
+
+bool XML_BUF_PARSER::parse_double(const XML_TAG& t, double& x) {
+    char val[256], *endp;
+    bool empty;
+
+    if (!match_tag(t)) return false;
+    if (!get_number(t.name, val, sizeof(val), empty)) return false;
+    if (empty) {
+        x = 0;
+        return true;
+    }
+    errno = 0;
+    double y = strtod(val, &endp);
+    if (errno) return false;
+    if (*endp) return false;
+    x = y;
+    return true;
+}
+
+bool XML_BUF_PARSER::parse_bool(const XML_TAG& t, bool& b) {
+    char val[256], *endp;
+    bool empty;
+
+    if (!is_tag || tag_hash != t.hash || !parsed_tag.equals(t.name, t.len)) {
+        return false;
+    }
+
+    // <tag/> means true
+    //
+    if (empty_element) {
+        b = true;
+        return true;
+    }
+    if (!get_number(t.name, val, sizeof(val), empty)) return false;
+    if (empty) return false;
+    bool x = (strtol(val, &endp, 0) != 0);
+    if (*endp) return false;
+    b = x;
+    return true;
+}
+
+bool XML_BUF_PARSER::parse_str(const char* start_tag, XML_STR& s) {
+    return parse_str(XML_TAG(start_tag), s);
+}
+
+bool XML_BUF_PARSER::parse_str(const char* start_tag, char* out, int len) {
+    return parse_str(XML_TAG(start_tag), out, len);
+}
+
+bool XML_BUF_PARSER::parse_int(const char* start_tag, int& i) {
+    return parse_int(XML_TAG(start_tag), i);
+}
+
+bool XML_BUF_PARSER::parse_double(const char* start_tag, double& x) {
+    return parse_double(XML_TAG(start_tag), x);
+}
+
+bool XML_BUF_PARSER::parse_bool(const char* start_tag, bool& b) {
+    return parse_bool(XML_TAG(start_tag), b);
+}
+
+// We got an unexpected tag.
+// If it's an end tag or <foo/>, do nothing.
+// Otherwise skip until the matching end tag, if any
+//
+void XML_BUF_PARSER::skip_unexpected(bool verbose, const char* where) {
+    if (verbose) {
+        fprintf(stderr, "Unrecognized XML in %s: %.*s\n",
+            where, parsed_tag.len, parsed_tag.p
+        );
+    }
+    if (!is_tag || empty_element) return;
+    if (parsed_tag.len && parsed_tag.p[0] == '/') return;
+    int depth = 1;
+    while (!get_tag()) {
+        if (!is_tag || empty_element) continue;
+        if (parsed_tag.len && parsed_tag.p[0] == '/') {
+            if (--depth == 0) return;
+        } else if (parsed_tag.p[0] != '?' && parsed_tag.p[0] != '!') {
+            depth++;
+        }
+    }
+}
+
+// we just parsed a tag.
+// copy this entire element, including start and end tags, to the string
+//
+int XML_BUF_PARSER::copy_element(string& out) {
+    const char* start = tag_start;
+    if (!is_tag) return ERR_XML_PARSE;
+    if (!empty_element) {
+        if (parsed_tag.len && parsed_tag.p[0] == '/') return ERR_XML_PARSE;
+        skip_unexpected();
+        if (!is_tag) return ERR_XML_PARSE;
+    }
+    out.assign(start, p - start);
+    return 0;
+}
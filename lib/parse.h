@@ -67,6 +67,117 @@ public:
     }
 };
 
+// A parser that works on XML in memory (e.g. a request body,
+// or a file read or mapped with init_file()).
+// Unlike XML_PARSER it doesn't copy tags or text;
+// it returns them as XML_STRs (pointers into the buffer).
+// Its interface is otherwise like that of XML_PARSER,
+// so code can be switched from one to the other.
+// It also lets you match tags by pre-hashed name (XML_TAG):
+//
+//  static XML_TAG tag_result("result");
+//  ...
+//  if (xp.match_tag(tag_result)) ...
+//
+// The buffer must remain valid while the parser is used.
+
+// a string in the parser's buffer; not NULL-terminated
+//
+struct XML_STR {
+    const char* p;
+    int len;
+    XML_STR() {
+        p = "";
+        len = 0;
+    }
+    inline bool equals(const char* s, int n) const {
+        return len == n && !memcmp(p, s, n);
+    }
+    inline bool equals(const char* s) const {
+        return equals(s, (int)strlen(s));
+    }
+    inline std::string str() const {
+        return std::string(p, len);
+    }
+    void copy(char* buf, int buflen) const;
+};
+
+// FNV-1a hash of a tag name
+//
+inline unsigned int xml_tag_hash(const char* p, int len) {
+    unsigned int h = 2166136261u;
+    for (int i=0; i<len; i++) {
+        h = (h ^ (unsigned char)p[i]) * 16777619u;
+    }
+    return h;
+}
+
+struct XML_TAG {
+    const char* name;
+    int len;
+    unsigned int hash;
+    XML_TAG(const char* n) {
+        name = n;
+        len = (int)strlen(n);
+        hash = xml_tag_hash(n, len);
+    }
+};
+
+class XML_BUF_PARSER {
+    const char* buf;
+    const char* end;
+    const char* p;
+    const char* tag_start;
+    bool cdata;
+    char* file_buf;
+    size_t file_len;
+    bool file_mapped;
+    bool get_aux();
+    bool get_end_tag(const char* name, int len);
+    bool get_number(const char* name, char* val, int vallen, bool& empty);
+    void free_file();
+    // we may own file_buf; don't copy
+    XML_BUF_PARSER(const XML_BUF_PARSER&);
+    XML_BUF_PARSER& operator=(const XML_BUF_PARSER&);
+public:
+    XML_STR parsed_tag;
+        // tag name (with leading / for end tag), or text
+    XML_STR attrs;
+    unsigned int tag_hash;
+    bool is_tag;
+    bool empty_element;
+        // tag was of the form <foo/>
+
+    XML_BUF_PARSER();
+    XML_BUF_PARSER(const char* buf, int len);
+    ~XML_BUF_PARSER();
+    void init(const char* buf, int len);
+    int init_file(const char* path);
+        // parse the given file (memory-mapped if possible).
+        // Frees the buffer of any previous init_file()
+
+    bool get_tag();
+    bool match_tag(const char*);
+    inline bool match_tag(const XML_TAG& t) {
+        return is_tag && !empty_element && tag_hash == t.hash
+            && parsed_tag.equals(t.name, t.len);
+    }
+    bool parse_start(const char*);
+    bool parse_str(const char*, XML_STR&);
+    bool parse_str(const char*, char*, int);
+    bool parse_string(const char*, std::string&);
+    bool parse_int(const char*, int&);
+    bool parse_double(const char*, double&);
+    bool parse_bool(const char*, bool&);
+    bool parse_str(const XML_TAG&, XML_STR&);
+    bool parse_str(const XML_TAG&, char*, int);
+    bool parse_int(const XML_TAG&, int&);
+    bool parse_double(const XML_TAG&, double&);
+    bool parse_bool(const XML_TAG&, bool&);
+    int copy_element(std::string&);
+    void skip_unexpected(bool verbose=false, const char* msg="");
+};
+
 extern bool boinc_is_finite(double);
 
 /////////////// START DEPRECATED XML PARSER
@@ -1,8 +1,23 @@
-// test program for XML parser
+// test program for XML parsers
+//
+// parse_test
+//      parse foo.xml with XML_PARSER and XML_BUF_PARSER
+// parse_test --bench [files...]
+//      compare the speed of XML_PARSER and XML_BUF_PARSER
+//      on the given files (e.g. client_state.xml, a scheduler request)
+//      or, if none, on a synthesized client state file
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
 
 #include "parse.h"
+#include "str_replace.h"
+#include "str_util.h"
+#include "util.h"
+
+using std::string;
 
 void parse(FILE* f) {
     bool flag;
@@ -41,9 +56,310 @@ void parse(FILE* f) {
     printf("unexpected EOF\n");
 }
 
-int main() {
+void parse_buf(const char* path) {
+    bool flag;
+    XML_BUF_PARSER xp;
+    char name[256];
+    int val;
+    double x;
+
+    if (xp.init_file(path)) {
+        printf("can't open %s\n", path);
+        return;
+    }
+    if (!xp.parse_start("blah")) {
+        printf("missing start tag\n");
+        return;
+    }
+    while (!xp.get_tag()) {
+        if (!xp.is_tag) {
+            printf("unexpected text: %s\n", xp.parsed_tag.str().c_str());
+            continue;
+        }
+        if (xp.match_tag("/blah")) {
+            printf("success\n");
+            return;
+        } else if (xp.parse_str("str", name, sizeof(name))) {
+            printf("got str: %s\n", name);
+        } else if (xp.parse_int("int", val)) {
+            printf("got int: %d\n", val);
+        } else if (xp.parse_double("double", x)) {
+            printf("got double: %f\n", x);
+        } else if (xp.parse_bool("bool", flag)) {
+            printf("got bool: %d\n", flag);
+        } else {
+            printf("unparsed tag: %s\n", xp.parsed_tag.str().c_str());
+            xp.skip_unexpected(true, "xml test");
+        }
+    }
+    printf("unexpected EOF\n");
+}
+
+// make something that looks like a client state file
+// with the given number of workunits and results
+//
+void make_client_state(string& s, int n) {
+    char buf[4096];
+    s = "<?xml version=\"1.0\" encoding=\"ISO-8859-1\" ?>\n<client_state>\n";
+    for (int i=0; i<n; i++) {
+        snprintf(buf, sizeof(buf),
+            "<workunit>\n"
+            "    <name>wu_%d_blah_blah</name>\n"
+            "    <app_name>setiathome_enhanced</app_name>\n"
+            "    <version_num>603</version_num>\n"
+            "    <rsc_fpops_est>%f</rsc_fpops_est>\n"
+            "    <rsc_fpops_bound>%f</rsc_fpops_bound>\n"
+            "    <rsc_memory_bound>33554432.000000</rsc_memory_bound>\n"
+            "    <rsc_disk_bound>33554432.000000</rsc_disk_bound>\n"
+            "    <command_line>\n-np 7 &lt;foo&gt;\n</command_line>\n"
+            "    <file_ref>\n"
+            "        <file_name>wu_%d_in</file_name>\n"
+            "        <open_name>in.dat</open_name>\n"
+            "    </file_ref>\n"
+            "</workunit>\n"
+            "<result>\n"
+            "    <name>wu_%d_blah_blah_0</name>\n"
+            "    <final_cpu_time>0.000000</final_cpu_time>\n"
+            "    <final_elapsed_time>0.000000</final_elapsed_time>\n"
+            "    <exit_status>0</exit_status>\n"
+            "    <state>2</state>\n"
+            "    <platform>x86_64-pc-linux-gnu</platform>\n"
+            "    <version_num>603</version_num>\n"
+            "    <wu_name>wu_%d_blah_blah</wu_name>\n"
+            "    <report_deadline>%f</report_deadline>\n"
+            "    <received_time>%f</received_time>\n"
+            "    <ready_to_report/>\n"
+            "    <file_ref>\n"
+            "        <file_name>wu_%d_blah_blah_0_0</file_name>\n"
+            "        <open_name>result.sah</open_name>\n"
+            "    </file_ref>\n"
+            "</result>\n",
+            i, 1e13+i, 1e14+i, i, i, i, 1.3e9+i, 1.3e9-i, i
+        );
+        s += buf;
+    }
+    s += "</client_state>\n";
+}
+
+// make something that looks like a scheduler request
+// reporting the given number of results
+//
+void make_sched_request(string& s, int n) {
+    char buf[4096];
+    s = "<scheduler_request>\n"
+        "    <authenticator>0123456789abcdef0123456789abcdef</authenticator>\n"
+        "    <hostid>12345</hostid>\n"
+        "    <rpc_seqno>100</rpc_seqno>\n"
+        "    <platform_name>x86_64-pc-linux-gnu</platform_name>\n"
+        "    <work_req_seconds>8640.000000</work_req_seconds>\n";
+    for (int i=0; i<n; i++) {
+        snprintf(buf, sizeof(buf),
+            "<result>\n"
+            "    <name>wu_%d_blah_blah_0</name>\n"
+            "    <final_cpu_time>%f</final_cpu_time>\n"
+            "    <final_elapsed_time>%f</final_elapsed_time>\n"
+            "    <exit_status>0</exit_status>\n"
+            "    <state>5</state>\n"
+            "    <platform>x86_64-pc-linux-gnu</platform>\n"
+            "    <version_num>603</version_num>\n"
+            "    <app_version_num>603</app_version_num>\n"
+            "<stderr_out>\n"
+            "<![CDATA[\n"
+            "<core_client_version>7.0.8</core_client_version>\n"
+            "called boinc_finish\n"
+            "]]>\n"
+            "</stderr_out>\n"
+            "</result>\n",
+            i, 3000.+i, 3100.+i
+        );
+        s += buf;
+    }
+    s += "</scheduler_request>\n";
+}
+
+// Parse <result> elements the way RESULT::parse() does.
+// Return the number of results.
+//
+int parse_results_old(const string& doc, double& sum) {
+    MIOFILE mf;
+    XML_PARSER xp(&mf);
+    char name[256];
+    string stderr_out;
+    double x;
+    int n = 0, i;
+
+    mf.init_buf_read(doc.c_str());
+    while (!xp.get_tag()) {
+        if (!xp.match_tag("result")) continue;
+        n++;
+        while (!xp.get_tag()) {
+            if (xp.match_tag("/result")) break;
+            if (xp.parse_str("name", name, sizeof(name))) continue;
+            if (xp.parse_str("wu_name", name, sizeof(name))) continue;
+            if (xp.parse_double("final_cpu_time", x)) {sum += x; continue;}
+            if (xp.parse_double("final_elapsed_time", x)) {sum += x; continue;}
+            if (xp.parse_double("report_deadline", x)) {sum += x; continue;}
+            if (xp.parse_double("received_time", x)) {sum += x; continue;}
+            if (xp.parse_int("exit_status", i)) continue;
+            if (xp.parse_int("state", i)) continue;
+            if (xp.parse_str("platform", name, sizeof(name))) continue;
+            if (xp.parse_int("version_num", i)) continue;
+            if (xp.parse_int("app_version_num", i)) continue;
+            if (xp.match_tag("stderr_out")) {
+                copy_element_contents(*xp.f, "</stderr_out>", stderr_out);
+                continue;
+            }
+            xp.skip_unexpected();
+        }
+    }
+    return n;
+}
+
+int parse_results_new(const string& doc, double& sum) {
+    static XML_TAG
+        tag_result("result"), tag_end_result("/result"),
+        tag_name("name"), tag_wu_name("wu_name"),
+        tag_final_cpu_time("final_cpu_time"),
+        tag_final_elapsed_time("final_elapsed_time"),
+        tag_report_deadline("report_deadline"),
+        tag_received_time("received_time"),
+        tag_exit_status("exit_status"), tag_state("state"),
+        tag_platform("platform"), tag_version_num("version_num"),
+        tag_app_version_num("app_version_num"),
+        tag_stderr_out("stderr_out");
+    XML_BUF_PARSER xp(doc.c_str(), (int)doc.size());
+    char name[256];
+    XML_STR stderr_out;
+    double x;
+    int n = 0, i;
+
+    while (!xp.get_tag()) {
+        if (!xp.match_tag(tag_result)) continue;
+        n++;
+        while (!xp.get_tag()) {
+            if (xp.match_tag(tag_end_result)) break;
+            if (xp.parse_str(tag_name, name, sizeof(name))) continue;
+            if (xp.parse_str(tag_wu_name, name, sizeof(name))) continue;
+            if (xp.parse_double(tag_final_cpu_time, x)) {sum += x; continue;}
+            if (xp.parse_double(tag_final_elapsed_time, x)) {sum += x; continue;}
+            if (xp.parse_double(tag_report_deadline, x)) {sum += x; continue;}
+            if (xp.parse_double(tag_received_time, x)) {sum += x; continue;}
+            if (xp.parse_int(tag_exit_status, i)) continue;
+            if (xp.parse_int(tag_state, i)) continue;
+            if (xp.parse_str(tag_platform, name, sizeof(name))) continue;
+            if (xp.parse_int(tag_version_num, i)) continue;
+            if (xp.parse_int(tag_app_version_num, i)) continue;
+            if (xp.parse_str(tag_stderr_out, stderr_out)) continue;
+            xp.skip_unexpected();
+        }
+    }
+    return n;
+}
+
+// Tokenize the document, and try to parse the contents
+// of each element as a number.
+// Return the number of items (the parsers count these differently
+// when a parse fails).
+//
+int bench_old(const string& doc, double& sum) {
+    MIOFILE mf;
+    XML_PARSER xp(&mf);
+    char prev[256];
+    double x;
+    int n = 0;
+
+    mf.init_buf_read(doc.c_str());
+    prev[0] = 0;
+    while (!xp.get_tag()) {
+        n++;
+        if (!xp.is_tag) continue;
+        if (xp.parsed_tag[0] == '/') continue;
+        safe_strcpy(prev, xp.parsed_tag);
+        if (xp.parse_double(prev, x)) sum += x;
+    }
+    return n;
+}
+
+int bench_new(const string& doc, double& sum) {
+    XML_BUF_PARSER xp(doc.c_str(), (int)doc.size());
+    char prev[256];
+    double x;
+    int n = 0;
+
+    while (!xp.get_tag()) {
+        n++;
+        if (!xp.is_tag) continue;
+        if (xp.parsed_tag.p[0] == '/') continue;
+        xp.parsed_tag.copy(prev, sizeof(prev));
+        if (xp.parse_double(prev, x)) sum += x;
+    }
+    return n;
+}
+
+typedef int (*BENCH_FUNC)(const string&, double&);
+
+void bench_pass(
+    const char* what, const string& doc, BENCH_FUNC f_old, BENCH_FUNC f_new
+) {
+    double t, t_old, t_new, sum_old=0, sum_new=0;
+    int i, n_old=0, n_new=0, niter = 1;
+
+    // repeat small documents so that times are measurable
+    //
+    if (doc.size() < 10000000) niter = (int)(10000000/(doc.size()+1)) + 1;
+
+    t = dtime();
+    for (i=0; i<niter; i++) n_old = f_old(doc, sum_old);
+    t_old = dtime() - t;
+    t = dtime();
+    for (i=0; i<niter; i++) n_new = f_new(doc, sum_new);
+    t_new = dtime() - t;
+
+    printf("   %s (x %d):\n", what, niter);
+    printf("      XML_PARSER:     %d, %.1f MB/sec, sum %g\n",
+        n_old, niter*doc.size()/t_old/1e6, sum_old
+    );
+    printf("      XML_BUF_PARSER: %d, %.1f MB/sec, sum %g\n",
+        n_new, niter*doc.size()/t_new/1e6, sum_new
+    );
+    printf("      speedup: %.2f\n", t_old/t_new);
+}
+
+void bench(const char* name, const string& doc) {
+    printf("%s: %.0f bytes\n", name, (double)doc.size());
+    bench_pass("tokenize", doc, bench_old, bench_new);
+    bench_pass("parse results", doc, parse_results_old, parse_results_new);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        if (argc == 2) {
+            string doc;
+            make_client_state(doc, 10000);
+            bench("client state (10000 results)", doc);
+            make_sched_request(doc, 100);
+            bench("scheduler request (100 results)", doc);
+            return 0;
+        }
+        for (int i=2; i<argc; i++) {
+            char* p;
+            if (read_file_malloc(argv[i], p, 0, false)) {
+                fprintf(stderr, "can't read %s\n", argv[i]);
+                continue;
+            }
+            bench(argv[i], string(p));
+            free(p);
+        }
+        return 0;
+    }
     FILE* f = fopen("foo.xml", "r");
+    if (!f) {
+        fprintf(stderr, "can't open foo.xml\n");
+        return 1;
+    }
     parse(f);
+    fclose(f);
+    parse_buf("foo.xml");
 }
 
 /* try it with something like:
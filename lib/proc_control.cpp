@@ -64,6 +64,18 @@ void get_descendants(int pid, vector<int>& pids) {
     int retval;
     PROC_MAP pm;
     pids.clear();
+#ifdef __linux__
+    // look only at the descendants, not the whole process table
+    //
+    vector<int> children;
+    if (!procinfo_children(pid, pids)) {
+        for (unsigned int i=0; i<pids.size(); i++) {
+            procinfo_children(pids[i], children);
+            pids.insert(pids.end(), children.begin(), children.end());
+        }
+        return;
+    }
+#endif
     retval = procinfo_setup(pm);
     if (retval) return;
     get_descendants_aux(pm, pid, pids);
@@ -67,6 +67,15 @@ extern void find_children(PROC_MAP&);
 extern int procinfo_setup(PROC_MAP&);
 	// call this first to get data structure
 
+#ifdef __linux__
+extern int procinfo_setup_descendants(PROC_MAP&, std::vector<int>& pids);
+    // same, but only the given processes and their descendants.
+    // Returns ERR_NOT_IMPLEMENTED if the kernel doesn't support this
+
+extern int procinfo_children(int pid, std::vector<int>& children);
+    // get the IDs of a process's children (same return)
+#endif
+
 extern void procinfo_app(
     PROCINFO&, std::vector<int>* other_pids, PROC_MAP&, char* graphics_exec_file
 );
@@ -37,6 +37,9 @@
 #include <sys/wait.h>
 #include <dirent.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <set>
 
 #if HAVE_UNISTD_H
 #include <unistd.h>
@@ -46,10 +49,13 @@
 #include <procfs.h>  // definitions for solaris /proc structs
 #endif
 
+#include "error_numbers.h"
 #include "procinfo.h"
 #include "str_util.h"
 #include "str_replace.h"
 
+using std::map;
+using std::set;
 using std::vector;
 
 // see:
@@ -98,6 +104,7 @@ struct PROC_STAT {
     int processor;
 
     int parse(char*);
+    void get_procinfo(PROCINFO&, int client_pid);
 };
 
 int PROC_STAT::parse(char* buf) {
@@ -160,6 +167,27 @@ int PROC_STAT::parse(char* buf) {
     return 1;
 }
 
+void PROC_STAT::get_procinfo(PROCINFO& p, int client_pid) {
+    p.clear();
+    p.id = pid;
+    p.parentid = ppid;
+    p.swap_size = vsize;
+    // rss = pages, need bytes
+    // assumes page size = 4k
+    p.working_set_size = rss * (float)getpagesize();
+    // page faults: I/O + non I/O
+    p.page_fault_count = majflt + minflt;
+    // times are in jiffies, need seconds
+    // assumes 100 jiffies per second
+    p.user_time = utime / 100.;
+    p.kernel_time = stime / 100.;
+    strlcpy(p.command, comm, sizeof(p.command));
+    p.is_boinc_app = (p.id == client_pid || strcasestr(p.command, "boinc"));
+    p.is_low_priority = (priority == 39);
+        // Linux seems to add 20 here,
+        // but this isn't documented anywhere
+}
+
 // build table of all processes in system
 //
 int procinfo_setup(PROC_MAP& pm) {
@@ -225,24 +253,7 @@ int procinfo_setup(PROC_MAP& pm) {
             if (retval) {
                 final_retval = retval;
             } else {
-                p.clear();
-                p.id = ps.pid;
-                p.parentid = ps.ppid;
-                p.swap_size = ps.vsize;
-                // rss = pages, need bytes
-                // assumes page size = 4k
-                p.working_set_size = ps.rss * (float)getpagesize();
-                // page faults: I/O + non I/O
-                p.page_fault_count = ps.majflt + ps.minflt;
-                // times are in jiffies, need seconds
-                // assumes 100 jiffies per second
-                p.user_time = ps.utime / 100.;
-                p.kernel_time = ps.stime / 100.;
-                strlcpy(p.command, ps.comm, sizeof(p.command));
-                p.is_boinc_app = (p.id == pid || strcasestr(p.command, "boinc"));
-                p.is_low_priority = (ps.priority == 39);
-                    // Linux seems to add 20 here,
-                    // but this isn't documented anywhere
+                ps.get_procinfo(p, pid);
                 pm.insert(std::pair<int, PROCINFO>(p.id, p));
             }
         }
@@ -254,3 +265,122 @@ int procinfo_setup(PROC_MAP& pm) {
     return final_retval;
 
 }
+
+#if defined(__linux__)
+
+// Linux 3.5 and later list the children of each thread
+// in /proc/PID/task/TID/children.
+// Using these we can find the descendants of a process
+// without reading the stat file of every process in the system,
+// which is expensive on hosts with thousands of processes.
+
+static int children_supported = -1;
+    // -1: don't know yet
+
+int procinfo_children(int pid, vector<int>& children) {
+    char path[256];
+    DIR* dir;
+    dirent* tid;
+
+    children.clear();
+    if (children_supported < 0) {
+        sprintf(path, "/proc/self/task/%d/children", getpid());
+        children_supported = access(path, R_OK)?0:1;
+    }
+    if (!children_supported) return ERR_NOT_IMPLEMENTED;
+
+    sprintf(path, "/proc/%d/task", pid);
+    dir = opendir(path);
+    if (!dir) return 0;     // process has exited
+    while (1) {
+        tid = readdir(dir);
+        if (!tid) break;
+        if (!isdigit(tid->d_name[0])) continue;
+        sprintf(path, "/proc/%d/task/%s/children", pid, tid->d_name);
+        FILE* f = fopen(path, "r");
+        if (!f) continue;
+        int child;
+        while (fscanf(f, "%d", &child) == 1) {
+            children.push_back(child);
+        }
+        fclose(f);
+    }
+    closedir(dir);
+    return 0;
+}
+
+// Descriptors of the stat files of the processes
+// found by the last procinfo_setup_descendants(),
+// so that we don't have to open them each time.
+// An open stat file refers to a particular process;
+// once that process has exited, reads fail,
+// even if its ID has been reused.
+//
+static map<int, int> stat_fds;
+
+static int read_stat_file(int pid, PROC_STAT& ps) {
+    char buf[1024];
+    int fd, n;
+
+    map<int, int>::iterator i = stat_fds.find(pid);
+    if (i == stat_fds.end()) {
+        sprintf(buf, "/proc/%d/stat", pid);
+        fd = open(buf, O_RDONLY);
+        if (fd < 0) return ERR_OPEN;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        stat_fds[pid] = fd;
+    } else {
+        fd = i->second;
+    }
+    n = pread(fd, buf, sizeof(buf)-1, 0);
+    if (n <= 0) {
+        close(fd);
+        stat_fds.erase(pid);
+        return ERR_READ;
+    }
+    buf[n] = 0;
+    return ps.parse(buf);
+}
+
+// Like procinfo_setup(), but include only the given processes
+// and their descendants.
+// Returns ERR_NOT_IMPLEMENTED if the kernel doesn't support this;
+// use procinfo_setup() in that case.
+//
+int procinfo_setup_descendants(PROC_MAP& pm, vector<int>& pids) {
+    vector<int> todo = pids, children;
+    set<int> seen;
+    PROC_STAT ps;
+    PROCINFO p;
+    int retval, client_pid = getpid();
+
+    while (todo.size()) {
+        int pid = todo.back();
+        todo.pop_back();
+        if (seen.count(pid)) continue;
+        seen.insert(pid);
+        if (!read_stat_file(pid, ps)) {
+            ps.get_procinfo(p, client_pid);
+            pm.insert(std::pair<int, PROCINFO>(p.id, p));
+        }
+        retval = procinfo_children(pid, children);
+        if (retval) return retval;
+        todo.insert(todo.end(), children.begin(), children.end());
+    }
+
+    // close the stat files of processes that aren't there any more
+    //
+    map<int, int>::iterator i = stat_fds.begin();
+    while (i != stat_fds.end()) {
+        if (seen.count(i->first)) {
+            i++;
+        } else {
+            close(i->second);
+            stat_fds.erase(i++);
+        }
+    }
+    find_children(pm);
+    return 0;
+}
+
+#endif
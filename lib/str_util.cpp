@@ -31,6 +31,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <time.h>
 #if HAVE_ALLOCA_H
 #include "alloca.h"
 #endif
@@ -345,16 +346,27 @@ void strip_whitespace(string& str) {
     }
 }
 
-char* time_to_string(double t) {
-    static char buf[100];
-    time_t x = (time_t)t;
-    struct tm* tm = localtime(&x);
-    strftime(buf, sizeof(buf)-1, "%d-%b-%Y %H:%M:%S", tm);
+// thread-safe localtime()
+//
+static struct tm* local_time(time_t x, struct tm* tmp) {
+#ifdef _WIN32
+    // Windows' localtime() uses a per-thread buffer
+    //
+    *tmp = *localtime(&x);
+#else
+    localtime_r(&x, tmp);
+#endif
+    return tmp;
+}
+
+char* time_to_string(double t, char* buf) {
+    struct tm tm;
+    strftime(buf, TIME_STRING_LEN, "%d-%b-%Y %H:%M:%S", local_time((time_t)t, &tm));
     return buf;
 }
 
-char* precision_time_to_string(double t) {
-    static char buf[100];
+char* precision_time_to_string(double t, char* buf) {
+    struct tm tm;
     char finer[16];
     int hundreds_of_microseconds=(int)(10000*(t-(int)t));
     if (hundreds_of_microseconds == 10000) {
@@ -363,10 +375,7 @@ char* precision_time_to_string(double t) {
         hundreds_of_microseconds=0;
         t+=1.0;
     }
-    time_t x = (time_t)t;
-    struct tm* tm = localtime(&x);
-
-    strftime(buf, sizeof(buf)-1, "%Y-%m-%d %H:%M:%S", tm);
+    strftime(buf, TIME_STRING_LEN, "%Y-%m-%d %H:%M:%S", local_time((time_t)t, &tm));
     sprintf(finer, ".%04d", hundreds_of_microseconds);
     strcat(buf, finer);
     return buf;
@@ -557,7 +566,14 @@ const char* boincerror(int which_error) {
         case 503: return "HTTP service unavailable";
         case 504: return "HTTP gateway timeout";
     }
+    // per-thread buffer where the compiler supports it,
+    // since servers call this from several threads
+    //
+#if defined(__GNUC__) && !defined(__APPLE__) && !defined(_WIN32)
+    static __thread char buf[128];
+#else
     static char buf[128];
+#endif
     sprintf(buf, "Error %d", which_error);
     return buf;
 }
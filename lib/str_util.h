@@ -34,8 +34,11 @@ extern void strip_whitespace(char *str);
 extern void strip_whitespace(std::string&);
 #define safe_strcpy(x, y) strlcpy(x, y, sizeof(x))
 #define safe_strcat(x, y) if (strlen(x)+strlen(y)<sizeof(x)) strcat(x, y)
-extern char* time_to_string(double);
-extern char* precision_time_to_string(double);
+extern char* time_to_string(double, char* buf);
+extern char* precision_time_to_string(double, char* buf);
+    // write the time as a string into buf
+    // (which must have room for TIME_STRING_LEN chars), and return buf
+#define TIME_STRING_LEN 64
 extern std::string timediff_format(double);
 
 inline bool ends_with(std::string const& s, std::string const& suffix) {
@@ -21,17 +21,30 @@
 
 #include "thread.h"
 
+// start a thread running func(this).
+// The thread isn't joinable; it should just return when done.
+//
 #ifdef _WIN32
 int THREAD::run(LPTHREAD_START_ROUTINE func, void* _arg) {
-    CreateThread(NULL, 0, func, this, 0, NULL);
+    arg = _arg;
+    quit_flag = false;
+    HANDLE h = CreateThread(NULL, 0, func, this, 0, NULL);
+    if (!h) return -1;
+    CloseHandle(h);
 #else
 int THREAD::run(void*(*func)(void*), void* _arg) {
     pthread_t id;
     pthread_attr_t thread_attrs;
+    int retval;
+
+    arg = _arg;
+    quit_flag = false;
     pthread_attr_init(&thread_attrs);
-    pthread_create(&id, &thread_attrs, func, this);
+    pthread_attr_setdetachstate(&thread_attrs, PTHREAD_CREATE_DETACHED);
+    retval = pthread_create(&id, &thread_attrs, func, this);
+    pthread_attr_destroy(&thread_attrs);
+    if (retval) return -1;
 #endif
-    arg = _arg;
     return 0;
 }
 
@@ -59,6 +72,6 @@ void THREAD_LOCK::unlock() {
 #ifdef _WIN32
     LeaveCriticalSection(&mutex);
 #else
-    pthread_mutex_lock(&mutex);
+    pthread_mutex_unlock(&mutex);
 #endif
 }
@@ -27,6 +27,8 @@
 
 // This function is called to handle a completed job.
 // Return zero on success.
+// If the assimilator is run with --threads,
+// it's called in several threads at once.
 //
 extern int assimilate_handler(
     WORKUNIT&,              // the workunit
@@ -20,6 +20,12 @@
 // assimilate_handler()
 // in order to make a complete program.
 //
+// Jobs are handled in batches (--batch_size):
+// the results of all the jobs in a batch are fetched with one query,
+// and the jobs are updated with one statement.
+// With --threads N, assimilate_handler() is called for the jobs
+// in a batch in N threads;
+// it must then be thread-safe, and must not use the BOINC DB.
 
 #include "config.h"
 #include <cstring>
@@ -27,6 +33,9 @@
 #include <unistd.h>
 #include <ctime>
 #include <vector>
+#include <map>
+#include <string>
+#include <pthread.h>
 
 #include "boinc_db.h"
 #include "parse.h"
@@ -41,16 +50,21 @@
 #include "assimilate_handler.h"
 
 using std::vector;
+using std::map;
+using std::string;
 
 #define LOCKFILE "assimilator.out"
 #define PIDFILE  "assimilator.pid"
 #define SLEEP_INTERVAL 10
+#define BATCH_SIZE 50
 
 bool update_db = true;
 bool noinsert = false;
 int wu_id_modulus=0, wu_id_remainder=0;
 int sleep_interval = SLEEP_INTERVAL;
 int one_pass_N_WU=0;
+int batch_size = BATCH_SIZE;
+int nthreads = 0;
 int g_argc;
 char** g_argv;
 char* results_prefix = NULL;
@@ -73,6 +87,8 @@ void usage(char** argv) {
         "    [-d | --debug_level N]       Set verbosity level (1 to 4)\n"
         "    [--dont_update_db]    Don't update DB (for testing)\n"
         "    [--noinsert]          Don't insert records in app-specific DB\n"
+        "    [--batch_size N]      Get results and update jobs N jobs at a time (default 50)\n"
+        "    [--threads N]         Call assimilate_handler() in N threads\n"
         "    [-h | --help]                 Show this\n"
         "    [-v | --version]      Show version information\n",
         argv[0]
@@ -80,35 +96,79 @@ void usage(char** argv) {
     exit(0);
 }
 
-// assimilate all WUs that need it
-// return nonzero (true) if did anything
+// a WU to be assimilated, and its results
 //
-bool do_pass(APP& app) {
-    DB_WORKUNIT wu;
-    DB_RESULT canonical_result, result;
-    bool did_something = false;
-    char buf[256];
-    char mod_clause[256];
+struct ASSIMILATE_ITEM {
+    WORKUNIT wu;
+    vector<RESULT> results;
+    RESULT canonical_result;
+    bool no_canonical_result;
+        // set error_mask
     int retval;
-    int num_assimilated=0;
+        // returned by assimilate_handler()
+};
 
-    check_stop_daemons();
+// Code for --threads: call assimilate_handler() for the WUs
+// in a batch in several threads.
 
-    if (wu_id_modulus) {
-        sprintf(mod_clause, " and workunit.id %% %d = %d ",
-                wu_id_modulus, wu_id_remainder
-        );
-    } else {
-        strcpy(mod_clause, "");
+static vector<ASSIMILATE_ITEM*>* handler_items;
+static unsigned int handler_next;
+static pthread_mutex_t handler_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void* handler_thread(void*) {
+    while (1) {
+        pthread_mutex_lock(&handler_mutex);
+        unsigned int i = handler_next++;
+        pthread_mutex_unlock(&handler_mutex);
+        if (i >= handler_items->size()) break;
+        ASSIMILATE_ITEM& ai = *(*handler_items)[i];
+        ai.retval = assimilate_handler(ai.wu, ai.results, ai.canonical_result);
     }
+    return 0;
+}
 
-    sprintf(buf,
-        "where appid=%d and assimilate_state=%d %s limit %d",
-        app.id, ASSIMILATE_READY, mod_clause,
-        one_pass_N_WU ? one_pass_N_WU : 1000
-    );
+static void call_handlers(vector<ASSIMILATE_ITEM*>& items) {
+    unsigned int i;
+    if (!nthreads) {
+        for (i=0; i<items.size(); i++) {
+            ASSIMILATE_ITEM& ai = *items[i];
+            ai.retval = assimilate_handler(ai.wu, ai.results, ai.canonical_result);
+        }
+        return;
+    }
+    vector<pthread_t> threads(nthreads);
+    handler_items = &items;
+    handler_next = 0;
+    for (i=0; i<threads.size(); i++) {
+        if (pthread_create(&threads[i], NULL, handler_thread, NULL)) {
+            log_messages.printf(MSG_CRITICAL, "can't create thread\n");
+            exit(1);
+        }
+    }
+    for (i=0; i<threads.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// get the results of a batch of WUs in a single query
+//
+static void get_results(vector<ASSIMILATE_ITEM*>& items) {
+    DB_RESULT result;
+    map<int, ASSIMILATE_ITEM*> wu_map;
+    string clause;
+    char buf[256];
+    unsigned int i;
+    int retval;
+
+    clause = "where workunitid in (";
+    for (i=0; i<items.size(); i++) {
+        wu_map[items[i]->wu.id] = items[i];
+        sprintf(buf, "%s%d", i?",":"", items[i]->wu.id);
+        clause += buf;
+    }
+    clause += ")";
     while (1) {
-        retval = wu.enumerate(buf);
+        retval = result.enumerate(clause.c_str());
         if (retval) {
             if (retval != ERR_DB_NOT_FOUND) {
                 log_messages.printf(MSG_DEBUG,
@@ -118,25 +178,38 @@ bool do_pass(APP& app) {
             }
             break;
         }
-        vector<RESULT> results;     // must be inside while()!
+        map<int, ASSIMILATE_ITEM*>::iterator it = wu_map.find(result.workunitid);
+        if (it == wu_map.end()) continue;
+        it->second->results.push_back(result);
+    }
+}
 
-        // for testing purposes, pretend we did nothing
-        //
-        if (update_db) {
-            did_something = true;
-        }
+// assimilate a batch of WUs:
+// get their results, call the handler for each one,
+// and update them in a single statement.
+// Return the number of WUs assimilated.
+//
+static int do_batch(vector<ASSIMILATE_ITEM*>& items, DB_WRITE_BATCH& wb) {
+    unsigned int i, j;
+    int retval;
+    ASSIMILATE_ITEM* failed = NULL;
+
+    get_results(items);
+
+    for (i=0; i<items.size(); i++) {
+        ASSIMILATE_ITEM& ai = *items[i];
+        WORKUNIT& wu = ai.wu;
 
         log_messages.printf(MSG_DEBUG,
             "[%s] assimilating WU %d; state=%d\n", wu.name, wu.id, wu.assimilate_state
         );
 
-        sprintf(buf, "where workunitid=%d", wu.id);
-        canonical_result.clear();
+        ai.canonical_result.clear();
+        ai.no_canonical_result = false;
         bool found = false;
-        while (!result.enumerate(buf)) {
-            results.push_back(result);
-            if (result.id == wu.canonical_resultid) {
-                canonical_result = result;
+        for (j=0; j<ai.results.size(); j++) {
+            if (ai.results[j].id == wu.canonical_resultid) {
+                ai.canonical_result = ai.results[j];
                 found = true;
             }
         }
@@ -151,30 +224,33 @@ bool do_pass(APP& app) {
                 "[%s] no canonical result\n", wu.name
             );
             wu.error_mask = WU_ERROR_NO_CANONICAL_RESULT;
-            sprintf(buf, "error_mask=%d", wu.error_mask);
-            wu.update_field(buf);
+            ai.no_canonical_result = true;
         }
+    }
 
-        retval = assimilate_handler(wu, results, canonical_result);
-        if (retval && retval != DEFER_ASSIMILATION) {
-            log_messages.printf(MSG_CRITICAL,
-                "[%s] handler error: %s; exiting\n", wu.name, boincerror(retval)
-            );
-            exit(retval);
-        }
+    call_handlers(items);
 
-        if (update_db) {
+    for (i=0; i<items.size(); i++) {
+        ASSIMILATE_ITEM& ai = *items[i];
+        WORKUNIT& wu = ai.wu;
+        bool handler_error = ai.retval && ai.retval != DEFER_ASSIMILATION;
+
+        DB_ROW_UPDATE ru;
+        if (ai.no_canonical_result) {
+            ru.add("error_mask", "%d", wu.error_mask);
+        }
+        if (update_db && !handler_error) {
             // Defer assimilation until next result is returned
             int assimilate_state = ASSIMILATE_DONE;
-            if (retval == DEFER_ASSIMILATION) {
+            if (ai.retval == DEFER_ASSIMILATION) {
                 assimilate_state = ASSIMILATE_INIT;
             }
-            sprintf(
-                buf, "assimilate_state=%d, transition_time=%d",
-                assimilate_state, (int)time(0)
-            );
-            retval = wu.update_field(buf);
-            if (retval) {
+            ru.add("assimilate_state", "%d", assimilate_state);
+            ru.add("transition_time", "%d", (int)time(0));
+        }
+        if (!ru.empty()) {
+            retval = wb.update(&boinc_db, "workunit", wu.id, ru);
+            if (retval && retval != ERR_DB_NOT_FOUND) {
                 log_messages.printf(MSG_CRITICAL,
                     "[%s] update failed: %s\n", wu.name, boincerror(retval)
                 );
@@ -182,8 +258,103 @@ bool do_pass(APP& app) {
             }
         }
 
-        num_assimilated++;
+        if (handler_error) {
+            log_messages.printf(MSG_CRITICAL,
+                "[%s] handler error: %s\n", wu.name, boincerror(ai.retval)
+            );
+            if (!failed) failed = &ai;
+        }
+    }
+
+    // The handlers of all WUs in the batch have run,
+    // so do the updates of the ones that succeeded
+    // (even if some failed) so that they're not assimilated again
+    //
+    retval = wb.flush(&boinc_db);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "batched update failed: %s\n", boincerror(retval)
+        );
+        exit(1);
+    }
+    if (failed) {
+        log_messages.printf(MSG_CRITICAL,
+            "[%s] handler error: %s; exiting\n",
+            failed->wu.name, boincerror(failed->retval)
+        );
+        exit(failed->retval);
+    }
+    return (int)items.size();
+}
+
+static void free_items(vector<ASSIMILATE_ITEM*>& items) {
+    for (unsigned int i=0; i<items.size(); i++) {
+        delete items[i];
+    }
+    items.clear();
+}
+
+// assimilate all WUs that need it
+// return nonzero (true) if did anything
+//
+bool do_pass(APP& app) {
+    DB_WORKUNIT wu;
+    DB_WRITE_BATCH wb;
+    vector<ASSIMILATE_ITEM*> items;
+    bool did_something = false;
+    char buf[256];
+    char mod_clause[256];
+    int retval;
+    int num_assimilated=0;
+    double start_time = dtime();
+
+    check_stop_daemons();
+
+    wb.max_rows = batch_size+1;
+        // so that we flush only at the end of a batch
+
+    if (wu_id_modulus) {
+        sprintf(mod_clause, " and workunit.id %% %d = %d ",
+                wu_id_modulus, wu_id_remainder
+        );
+    } else {
+        strcpy(mod_clause, "");
+    }
+
+    sprintf(buf,
+        "where appid=%d and assimilate_state=%d %s limit %d",
+        app.id, ASSIMILATE_READY, mod_clause,
+        one_pass_N_WU ? one_pass_N_WU : 1000
+    );
+    while (1) {
+        retval = wu.enumerate(buf);
+        if (retval) {
+            if (retval != ERR_DB_NOT_FOUND) {
+                log_messages.printf(MSG_DEBUG,
+                    "DB connection lost, exiting\n"
+                );
+                exit(0);
+            }
+            break;
+        }
+
+        // for testing purposes, pretend we did nothing
+        //
+        if (update_db) {
+            did_something = true;
+        }
 
+        ASSIMILATE_ITEM* ai = new ASSIMILATE_ITEM;
+        ai->wu = wu;
+        items.push_back(ai);
+        if ((int)items.size() == batch_size) {
+            num_assimilated += do_batch(items, wb);
+            free_items(items);
+        }
+    }
+    if (items.size()) {
+        num_assimilated += do_batch(items, wb);
+        free_items(items);
     }
 
     if (did_something) {
@@ -191,8 +362,10 @@ bool do_pass(APP& app) {
     }
 
     if (num_assimilated)  {
+        double elapsed = dtime() - start_time;
         log_messages.printf(MSG_NORMAL,
-            "Assimilated %d workunits.\n", num_assimilated
+            "Assimilated %d workunits in %.2f sec (%.1f/sec).\n",
+            num_assimilated, elapsed, elapsed>0?num_assimilated/elapsed:0
         );
     }
 
@@ -239,6 +412,11 @@ int main(int argc, char** argv) {
         } else if (is_arg(argv[i], "mod")) {
             wu_id_modulus   = atoi(argv[++i]);
             wu_id_remainder = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "batch_size")) {
+            batch_size = atoi(argv[++i]);
+            if (batch_size < 1) batch_size = 1;
+        } else if (is_arg(argv[i], "threads")) {
+            nthreads = atoi(argv[++i]);
         } else if (is_arg(argv[i], "help") || is_arg(argv[i], "h")) {
             usage(argv);
         } else if (is_arg(argv[i], "v") || is_arg(argv[i], "version")) {
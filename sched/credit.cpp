@@ -876,7 +876,7 @@ int write_modified_app_versions(vector<DB_APP_VERSION>& app_versions) {
             );
             retval = av.update_field(query, clause);
             if (retval) break;
-            if (boinc_db.affected_rows() == 1) break;
+            if (thread_db()->affected_rows() == 1) break;
             retval = av.lookup_id(av.id);
             if (retval) break;
         }
@@ -31,6 +31,10 @@
 #include <sys/stat.h>
 #include <string>
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <pthread.h>
+#include <zlib.h>
 
 #include "boinc_db.h"
 #include "filesys.h"
@@ -77,6 +81,8 @@ struct OUTPUT {
     int compression;
     class ZFILE* zfile;
     class NUMBERED_ZFILE* nzfile;
+    struct ZSTREAM* zs;     // --single_pass
+    int nrecs;
     int parse(FILE*);
 };
 
@@ -85,8 +91,18 @@ struct ENUMERATION {
     int sort;
     char filename[256];
     vector<OUTPUT> outputs;
+    class EXT_SORT* sorter;
     int parse(FILE*);
     int make_it_happen(char*);
+
+    // --single_pass
+    bool need_xml[2];
+        // whether outputs need records without and with detail
+    char output_dir[256];
+    void start(char*);
+    void write(OUTPUT&, string&);
+    void write_rec(string*);
+    void finish();
 };
 
 struct DUMP_SPEC {
@@ -105,6 +121,8 @@ int OUTPUT::parse(FILE* in) {
     compression = COMPRESSION_NONE;
     zfile = 0;
     nzfile = 0;
+    zs = 0;
+    nrecs = 0;
     while (fgets(buf, 256, in)) {
         if (match_tag(buf, "</output>")) return 0;
         if (parse_int(buf, "<recs_per_file>", recs_per_file)) continue;
@@ -137,6 +155,7 @@ int ENUMERATION::parse(FILE* in) {
 
     table = -1;
     sort = SORT_NONE;
+    sorter = 0;
     strcpy(filename, "");
     while (fgets(buf, 256, in)) {
         if (match_tag(buf, "</enumeration>")) {
@@ -293,7 +312,13 @@ void NUMBERED_ZFILE::set_id(int id) {
     }
 }
 
-void write_host(HOST& host, FILE* f, bool detail) {
+// show_hosts, if given, says which users have show_hosts set
+// (indexed by user ID);
+// otherwise we look up the host's user
+//
+void write_host(
+    HOST& host, FILE* f, bool detail, vector<bool>* show_hosts=NULL
+) {
     int retval;
     char p_vendor[2048], p_model[2048], os_name[2048], os_version[2048];
 
@@ -306,7 +331,14 @@ void write_host(HOST& host, FILE* f, bool detail) {
         "    <id>%d</id>\n",
         host.id
     );
-    if (detail) {
+    if (detail && show_hosts) {
+        if (host.userid < (int)show_hosts->size() && (*show_hosts)[host.userid]) {
+            fprintf(f,
+                "    <userid>%d</userid>\n",
+                host.userid
+            );
+        }
+    } else if (detail) {
         DB_USER user;
         retval = user.lookup_id(host.userid);
         if (retval) {
@@ -737,6 +769,965 @@ int ENUMERATION::make_it_happen(char* output_dir) {
     return 0;
 }
 
+// Code for --single_pass.
+// The above reads each table once per enumeration,
+// writes the files with stdio, and then compresses them
+// by running gzip or zip, which reads them back.
+// With --single_pass:
+// - each table is read once (in order of ID),
+//   by its own thread with its own DB connection,
+//   and each record is passed to all the enumerations of that table.
+//   Enumerations sorted by credit collect the records in an EXT_SORT,
+//   and write them when the scan is done.
+// - gzip compression is done in this process, as the files are written,
+//   by a set of worker threads (--threads N).
+//   Blocks of a given file are compressed in order, by one thread at a time;
+//   different files (including the files of a numbered output)
+//   are compressed in parallel.
+// - for host outputs with detail, the IDs of users with show_hosts
+//   are read first, rather than looking up the user of each host.
+
+#define ZBLOCK_SIZE         (256*1024)
+    // size of the blocks passed to worker threads
+#define MAX_QUEUED_BYTES    (64*1024*1024)
+    // if more than this is waiting for worker threads,
+    // table scans wait
+#define SORT_RUN_SIZE       (128*1024*1024)
+    // EXT_SORT keeps this much in memory before writing a run to disk
+
+bool single_pass = false;
+int nthreads = 4;
+
+// an output file that's written by the worker threads
+//
+struct ZSTREAM {
+    string tag;
+    char path[256];
+    int compression;
+    string buf;
+        // data not yet queued
+    std::deque<string*> blocks;
+        // data queued for the worker threads
+    bool closed;
+        // no more data will be queued
+    bool busy;
+        // a worker thread is handling a block of this file
+    FILE* f;
+    z_stream z;
+
+    ZSTREAM(const char* tag, const char* path, int comp);
+    void write(const char* p, size_t n) {
+        buf.append(p, n);
+        if (buf.size() >= ZBLOCK_SIZE) queue_block();
+    }
+    void queue_block();
+    void close();
+
+    // the following are called by worker threads
+    //
+    void open_file();
+    void write_block(string&, bool last);
+};
+
+static vector<ZSTREAM*> zstreams;
+    // streams that worker threads haven't finished
+static pthread_t* zthreads;
+static bool zthreads_quit = false;
+static size_t queued_bytes = 0;
+static double nbytes_in = 0, nbytes_out = 0;
+static pthread_mutex_t zmutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t zwork_cond = PTHREAD_COND_INITIALIZER;
+    // signaled when data is queued or a stream closed
+static pthread_cond_t zdone_cond = PTHREAD_COND_INITIALIZER;
+    // signaled when a worker finishes a block
+
+ZSTREAM::ZSTREAM(const char* tag_, const char* path_, int comp) {
+    char header[256];
+
+    tag = tag_;
+    safe_strcpy(path, path_);
+    compression = comp;
+    closed = false;
+    busy = false;
+    f = 0;
+    sprintf(header,
+        "<?xml version=\"1.0\" encoding=\"iso-8859-1\"?>\n<%s>\n", tag_
+    );
+    buf = header;
+    pthread_mutex_lock(&zmutex);
+    zstreams.push_back(this);
+    pthread_mutex_unlock(&zmutex);
+}
+
+void ZSTREAM::queue_block() {
+    pthread_mutex_lock(&zmutex);
+    while (queued_bytes > MAX_QUEUED_BYTES) {
+        pthread_cond_wait(&zdone_cond, &zmutex);
+    }
+    string* b = new string;
+    b->swap(buf);
+    queued_bytes += b->size();
+    blocks.push_back(b);
+    pthread_cond_broadcast(&zwork_cond);
+    pthread_mutex_unlock(&zmutex);
+}
+
+// Write the closing tag and queue the rest of the data.
+// The worker threads finish and delete the stream.
+//
+void ZSTREAM::close() {
+    buf += "</" + tag + ">\n";
+    queue_block();
+    pthread_mutex_lock(&zmutex);
+    closed = true;
+    pthread_cond_broadcast(&zwork_cond);
+    pthread_mutex_unlock(&zmutex);
+}
+
+void ZSTREAM::open_file() {
+    char buf[256];
+    int retval;
+
+    if (compression == COMPRESSION_GZIP) {
+        sprintf(buf, "%s.gz", path);
+        memset(&z, 0, sizeof(z));
+        retval = deflateInit2(
+            &z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8,
+            Z_DEFAULT_STRATEGY
+        );
+        if (retval != Z_OK) {
+            log_messages.printf(MSG_CRITICAL,
+                "deflateInit2() failed: %d\n", retval
+            );
+            exit(1);
+        }
+    } else {
+        safe_strcpy(buf, path);
+    }
+    f = fopen(buf, "w");
+    if (!f) {
+        log_messages.printf(MSG_CRITICAL,
+            "Couldn't open %s for output\n", buf
+        );
+        exit(1);
+    }
+}
+
+void ZSTREAM::write_block(string& data, bool last) {
+    unsigned char out[ZBLOCK_SIZE];
+    size_t n;
+    int retval;
+
+    if (compression != COMPRESSION_GZIP) {
+        n = fwrite(data.data(), 1, data.size(), f);
+        if (n != data.size()) {
+            log_messages.printf(MSG_CRITICAL, "Couldn't write %s\n", path);
+            exit(1);
+        }
+        return;
+    }
+    z.next_in = (Bytef*)data.data();
+    z.avail_in = data.size();
+    do {
+        z.next_out = out;
+        z.avail_out = sizeof(out);
+        retval = deflate(&z, last?Z_FINISH:Z_NO_FLUSH);
+        if (retval == Z_STREAM_ERROR) {
+            log_messages.printf(MSG_CRITICAL,
+                "deflate() failed for %s\n", path
+            );
+            exit(1);
+        }
+        n = sizeof(out) - z.avail_out;
+        if (fwrite(out, 1, n, f) != n) {
+            log_messages.printf(MSG_CRITICAL, "Couldn't write %s\n", path);
+            exit(1);
+        }
+    } while (z.avail_out == 0);
+    if (last) deflateEnd(&z);
+}
+
+static void* zthread(void*) {
+    unsigned int i;
+    char buf[256];
+    int retval;
+
+    pthread_mutex_lock(&zmutex);
+    while (1) {
+        ZSTREAM* zs = 0;
+        for (i=0; i<zstreams.size(); i++) {
+            ZSTREAM* p = zstreams[i];
+            if (p->busy) continue;
+            if (p->blocks.empty() && !p->closed) continue;
+            zs = p;
+            break;
+        }
+        if (!zs) {
+            if (zthreads_quit) break;
+            pthread_cond_wait(&zwork_cond, &zmutex);
+            continue;
+        }
+        string* b = 0;
+        if (!zs->blocks.empty()) {
+            b = zs->blocks.front();
+            zs->blocks.pop_front();
+        }
+        bool last = zs->closed && zs->blocks.empty();
+        zs->busy = true;
+        pthread_mutex_unlock(&zmutex);
+
+        if (!zs->f) zs->open_file();
+        string empty;
+        zs->write_block(b?*b:empty, last);
+        double nout = 0;
+        if (last) {
+            nout = (double)ftell(zs->f);
+            fclose(zs->f);
+            if (zs->compression == COMPRESSION_ZIP) {
+                sprintf(buf, "zip -q %s", zs->path);
+                retval = system(buf);
+                if (retval) {
+                    log_messages.printf(MSG_CRITICAL,
+                        "%s failed: %s\n", buf, boincerror(retval)
+                    );
+                    exit(retval);
+                }
+            }
+        }
+
+        pthread_mutex_lock(&zmutex);
+        zs->busy = false;
+        if (b) {
+            queued_bytes -= b->size();
+            nbytes_in += b->size();
+            delete b;
+        }
+        if (last) {
+            nbytes_out += nout;
+            zstreams.erase(std::find(zstreams.begin(), zstreams.end(), zs));
+            delete zs;
+        }
+        pthread_cond_broadcast(&zdone_cond);
+    }
+    pthread_mutex_unlock(&zmutex);
+    return 0;
+}
+
+static void start_zthreads() {
+    zthreads = new pthread_t[nthreads];
+    for (int i=0; i<nthreads; i++) {
+        if (pthread_create(&zthreads[i], NULL, zthread, NULL)) {
+            log_messages.printf(MSG_CRITICAL, "can't create thread\n");
+            exit(1);
+        }
+    }
+}
+
+// wait for all closed streams to be written, and stop the threads
+//
+static void finish_zthreads() {
+    pthread_mutex_lock(&zmutex);
+    zthreads_quit = true;
+    pthread_cond_broadcast(&zwork_cond);
+    pthread_mutex_unlock(&zmutex);
+    for (int i=0; i<nthreads; i++) {
+        pthread_join(zthreads[i], NULL);
+    }
+}
+
+// A record to be sorted by key (descending), then by ID.
+// xml[0] and xml[1] are the record without and with detail
+//
+struct SORT_REC {
+    double key;
+    int id;
+    string xml[2];
+    bool operator<(const SORT_REC& r) const {
+        if (key != r.key) return key > r.key;
+        return id < r.id;
+    }
+};
+
+// Sort records in memory if they fit in SORT_RUN_SIZE bytes.
+// Otherwise write sorted runs of that size to temp files,
+// and merge them.
+//
+class EXT_SORT {
+    string path_base;
+    vector<SORT_REC> recs;
+    size_t nbytes;
+    vector<FILE*> runs;
+    vector<SORT_REC> heads;
+        // during merge, the next record of each run
+    vector<bool> have_head;
+    int last_run;
+        // during merge, the run of the record last returned
+    size_t next;
+        // if no runs, the next record in recs
+    int write_run();
+    bool read_rec(FILE*, SORT_REC&);
+public:
+    EXT_SORT(const char* path_base_) : path_base(path_base_), nbytes(0), last_run(-1), next(0) {}
+    int add(double key, int id, string* xml);
+    int start_merge();
+    SORT_REC* get_next();
+};
+
+int EXT_SORT::add(double key, int id, string* xml) {
+    recs.push_back(SORT_REC());
+    SORT_REC& r = recs.back();
+    r.key = key;
+    r.id = id;
+    r.xml[0].swap(xml[0]);
+    r.xml[1].swap(xml[1]);
+    nbytes += sizeof(r) + r.xml[0].size() + r.xml[1].size();
+    if (nbytes >= SORT_RUN_SIZE) {
+        return write_run();
+    }
+    return 0;
+}
+
+static void write_str(string& s, FILE* f) {
+    unsigned int n = s.size();
+    fwrite(&n, sizeof(n), 1, f);
+    fwrite(s.data(), 1, n, f);
+}
+
+static bool read_str(string& s, FILE* f) {
+    unsigned int n;
+    if (fread(&n, sizeof(n), 1, f) != 1) return false;
+    s.resize(n);
+    if (n && fread(&s[0], 1, n, f) != n) return false;
+    return true;
+}
+
+int EXT_SORT::write_run() {
+    char path[256];
+
+    sprintf(path, "%s_sort_%d", path_base.c_str(), (int)runs.size());
+    FILE* f = fopen(path, "w+");
+    if (!f) {
+        log_messages.printf(MSG_CRITICAL, "Couldn't create %s\n", path);
+        return ERR_FOPEN;
+    }
+    unlink(path);       // removed when closed
+    std::sort(recs.begin(), recs.end());
+    for (unsigned int i=0; i<recs.size(); i++) {
+        SORT_REC& r = recs[i];
+        fwrite(&r.key, sizeof(r.key), 1, f);
+        fwrite(&r.id, sizeof(r.id), 1, f);
+        write_str(r.xml[0], f);
+        write_str(r.xml[1], f);
+    }
+    if (fflush(f)) {
+        log_messages.printf(MSG_CRITICAL, "Couldn't write %s\n", path);
+        fclose(f);
+        return ERR_FWRITE;
+    }
+    rewind(f);
+    runs.push_back(f);
+    recs.clear();
+    nbytes = 0;
+    return 0;
+}
+
+bool EXT_SORT::read_rec(FILE* f, SORT_REC& r) {
+    if (fread(&r.key, sizeof(r.key), 1, f) != 1) return false;
+    if (fread(&r.id, sizeof(r.id), 1, f) != 1) return false;
+    if (!read_str(r.xml[0], f)) return false;
+    if (!read_str(r.xml[1], f)) return false;
+    return true;
+}
+
+int EXT_SORT::start_merge() {
+    int retval;
+
+    if (runs.empty()) {
+        std::sort(recs.begin(), recs.end());
+        next = 0;
+        return 0;
+    }
+    if (recs.size()) {
+        retval = write_run();
+        if (retval) return retval;
+    }
+    heads.resize(runs.size());
+    have_head.resize(runs.size());
+    for (unsigned int i=0; i<runs.size(); i++) {
+        have_head[i] = read_rec(runs[i], heads[i]);
+    }
+    return 0;
+}
+
+// return the next record in order, or NULL if none.
+// The record is valid until the next call.
+//
+SORT_REC* EXT_SORT::get_next() {
+    unsigned int i;
+    int best = -1;
+
+    if (runs.empty()) {
+        if (next > 0) {
+            recs[next-1].xml[0].clear();
+            recs[next-1].xml[1].clear();
+        }
+        if (next >= recs.size()) return NULL;
+        return &recs[next++];
+    }
+
+    // the number of runs is small (#records/SORT_RUN_SIZE),
+    // so a linear search is OK
+    //
+    if (last_run >= 0) {
+        have_head[last_run] = read_rec(runs[last_run], heads[last_run]);
+    }
+    for (i=0; i<runs.size(); i++) {
+        if (!have_head[i]) continue;
+        if (best < 0 || heads[i] < heads[best]) best = i;
+    }
+    if (best < 0) {
+        for (i=0; i<runs.size(); i++) {
+            fclose(runs[i]);
+        }
+        runs.clear();
+        last_run = -1;
+        return NULL;
+    }
+    last_run = best;
+    return &heads[best];
+}
+
+void ENUMERATION::start(char* dir) {
+    char path[256];
+    unsigned int i;
+
+    safe_strcpy(output_dir, dir);
+    need_xml[0] = need_xml[1] = false;
+    for (i=0; i<outputs.size(); i++) {
+        OUTPUT& out = outputs[i];
+        need_xml[out.detail?1:0] = true;
+        out.nrecs = 0;
+        out.zs = 0;
+        if (!out.recs_per_file) {
+            sprintf(path, "%s/%s", output_dir, filename);
+            out.zs = new ZSTREAM(tag_name[table], path, out.compression);
+        }
+    }
+    if (sort == SORT_TOTAL_CREDIT || sort == SORT_EXPAVG_CREDIT) {
+        sprintf(path, "%s/%s", output_dir, filename);
+        sorter = new EXT_SORT(path);
+    }
+}
+
+// write a record to an output,
+// starting a new file every recs_per_file records if it's numbered
+//
+void ENUMERATION::write(OUTPUT& out, string& xml) {
+    char path[256];
+
+    if (out.recs_per_file && out.nrecs % out.recs_per_file == 0) {
+        if (out.zs) out.zs->close();
+        sprintf(path, "%s/%s_%d",
+            output_dir, filename, out.nrecs/out.recs_per_file
+        );
+        out.zs = new ZSTREAM(tag_name[table], path, out.compression);
+    }
+    out.nrecs++;
+    out.zs->write(xml.data(), xml.size());
+}
+
+// write a record (without and with detail) to all outputs
+//
+void ENUMERATION::write_rec(string* xml) {
+    for (unsigned int i=0; i<outputs.size(); i++) {
+        OUTPUT& out = outputs[i];
+        write(out, xml[out.detail?1:0]);
+    }
+}
+
+// write sorted records if needed, and close the outputs
+//
+void ENUMERATION::finish() {
+    int retval;
+
+    if (sorter) {
+        retval = sorter->start_merge();
+        if (retval) exit(retval);
+        while (1) {
+            SORT_REC* r = sorter->get_next();
+            if (!r) break;
+            write_rec(r->xml);
+        }
+        delete sorter;
+        sorter = 0;
+    }
+    for (unsigned int i=0; i<outputs.size(); i++) {
+        OUTPUT& out = outputs[i];
+        if (out.zs) out.zs->close();
+        out.zs = 0;
+    }
+}
+
+// the scan of a table, done by its own thread
+//
+struct TABLE_SCAN {
+    int table;
+    vector<ENUMERATION*> enums;
+    const char* clause;
+        // "where" clause; records must be in order of ID
+    DB_CONN* db;
+    pthread_t thread;
+    double nrecs;
+    double elapsed;
+    bool need_xml[2];
+
+    DB_USER user;
+    DB_TEAM team;
+    DB_HOST host;
+    vector<bool> show_hosts;
+    FILE* mf;
+    char* mbuf;
+    size_t msize;
+
+    int get_show_hosts();
+    void format(bool detail, string&);
+    int scan();
+};
+
+// get the IDs of users with show_hosts set,
+// so that we don't have to look up the user of each host
+//
+int TABLE_SCAN::get_show_hosts() {
+    int retval, max_id;
+
+    retval = user.max_id(max_id);
+    if (retval == ERR_DB_NOT_FOUND) return 0;
+    if (retval) return retval;
+    show_hosts.resize(max_id+1, false);
+    while (1) {
+        retval = user.enumerate("where show_hosts<>0", true);
+        if (retval) break;
+        if (user.id <= max_id) show_hosts[user.id] = true;
+    }
+    if (retval != ERR_DB_NOT_FOUND) return retval;
+    return 0;
+}
+
+// get the XML for the current record
+//
+void TABLE_SCAN::format(bool detail, string& s) {
+    rewind(mf);
+    switch (table) {
+    case TABLE_USER:
+        write_user(user, mf, detail);
+        break;
+    case TABLE_TEAM:
+        write_team(team, mf, detail);
+        break;
+    case TABLE_HOST:
+        write_host(host, mf, detail, &show_hosts);
+        break;
+    }
+    fflush(mf);
+    s.assign(mbuf, msize);
+}
+
+int TABLE_SCAN::scan() {
+    unsigned int i;
+    int retval;
+    string xml[2];
+    double start = dtime();
+
+    if (table == TABLE_HOST && need_xml[1]) {
+        retval = get_show_hosts();
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "show_hosts enum: %s\n", boincerror(retval)
+            );
+            return retval;
+        }
+    }
+    mf = open_memstream(&mbuf, &msize);
+    if (!mf) return ERR_MALLOC;
+
+    nrecs = 0;
+    while (1) {
+        // teams do lookups for each record, so we can't use use_result
+        //
+        switch (table) {
+        case TABLE_USER:
+            retval = user.enumerate(clause, true);
+            break;
+        case TABLE_TEAM:
+            retval = team.enumerate(clause);
+            break;
+        case TABLE_HOST:
+            retval = host.enumerate(clause, true);
+            if (!retval && !host.userid) continue;
+            break;
+        }
+        if (retval) break;
+        nrecs++;
+        switch (table) {
+        case TABLE_USER:
+            nusers++;
+            total_credit += user.total_credit;
+            break;
+        case TABLE_TEAM:
+            nteams++;
+            break;
+        case TABLE_HOST:
+            nhosts++;
+            break;
+        }
+
+        for (i=0; i<2; i++) {
+            if (need_xml[i]) format(i==1, xml[i]);
+        }
+        for (i=0; i<enums.size(); i++) {
+            ENUMERATION& e = *enums[i];
+            if (e.sorter) {
+                string x[2];
+                if (e.need_xml[0]) x[0] = xml[0];
+                if (e.need_xml[1]) x[1] = xml[1];
+                double key = 0;
+                int id = 0;
+                switch (table) {
+                case TABLE_USER:
+                    key = (e.sort == SORT_TOTAL_CREDIT)?user.total_credit:user.expavg_credit;
+                    id = user.id;
+                    break;
+                case TABLE_TEAM:
+                    key = (e.sort == SORT_TOTAL_CREDIT)?team.total_credit:team.expavg_credit;
+                    id = team.id;
+                    break;
+                case TABLE_HOST:
+                    key = (e.sort == SORT_TOTAL_CREDIT)?host.total_credit:host.expavg_credit;
+                    id = host.id;
+                    break;
+                }
+                retval = e.sorter->add(key, id, x);
+                if (retval) return retval;
+            } else {
+                e.write_rec(xml);
+            }
+        }
+    }
+    fclose(mf);
+    free(mbuf);
+    if (retval != ERR_DB_NOT_FOUND) {
+        log_messages.printf(MSG_CRITICAL,
+            "%s enum: %s\n", table_name[table], boincerror(retval)
+        );
+        return retval;
+    }
+    for (i=0; i<enums.size(); i++) {
+        enums[i]->finish();
+    }
+    elapsed = dtime() - start;
+    return 0;
+}
+
+static void* scan_thread(void* p) {
+    TABLE_SCAN& ts = *(TABLE_SCAN*)p;
+    int retval;
+
+    mysql_thread_init();
+    set_thread_db(ts.db);
+    retval = ts.scan();
+    if (retval) exit(retval);
+    mysql_thread_end();
+    return 0;
+}
+
+// do the given enumerations with one scan of each table
+//
+int single_pass_dump(
+    vector<ENUMERATION>& enums, char* output_dir, const char* clause,
+    char* db_host
+) {
+    DB_CONN_POOL db_pool;
+    TABLE_SCAN scans[3];
+    vector<TABLE_SCAN*> active;
+    unsigned int i, j;
+    int retval;
+    double start = dtime();
+
+    for (i=0; i<enums.size(); i++) {
+        ENUMERATION& e = enums[i];
+        e.start(output_dir);
+        TABLE_SCAN& ts = scans[e.table];
+        if (ts.enums.empty()) active.push_back(&ts);
+        ts.table = e.table;
+        ts.clause = clause;
+        ts.enums.push_back(&e);
+    }
+    if (active.empty()) return 0;
+
+    retval = db_pool.open(
+        (int)active.size(),
+        config.replica_db_name,
+        db_host?db_host:config.replica_db_host,
+        config.replica_db_user,
+        config.replica_db_passwd
+    );
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't open %d DB connections: %s\n",
+            (int)active.size(), boincerror(retval)
+        );
+        return retval;
+    }
+
+    start_zthreads();
+    for (i=0; i<active.size(); i++) {
+        TABLE_SCAN& ts = *active[i];
+        ts.need_xml[0] = ts.need_xml[1] = false;
+        for (j=0; j<ts.enums.size(); j++) {
+            if (ts.enums[j]->need_xml[0]) ts.need_xml[0] = true;
+            if (ts.enums[j]->need_xml[1]) ts.need_xml[1] = true;
+        }
+        ts.db = db_pool.get();
+        ts.db->set_isolation_level(READ_UNCOMMITTED);
+        ts.user.db = ts.db;
+        ts.team.db = ts.db;
+        ts.host.db = ts.db;
+        if (pthread_create(&ts.thread, NULL, scan_thread, &ts)) {
+            log_messages.printf(MSG_CRITICAL, "can't create thread\n");
+            return ERR_THREAD;
+        }
+    }
+    for (i=0; i<active.size(); i++) {
+        TABLE_SCAN& ts = *active[i];
+        pthread_join(ts.thread, NULL);
+        log_messages.printf(MSG_NORMAL,
+            "%s: %.0f records in %.1f sec (%.0f records/sec)\n",
+            table_name[ts.table], ts.nrecs, ts.elapsed,
+            ts.elapsed>0?ts.nrecs/ts.elapsed:0
+        );
+        db_pool.put(ts.db);
+    }
+    finish_zthreads();
+    db_pool.close();
+
+    double elapsed = dtime() - start;
+    log_messages.printf(MSG_NORMAL,
+        "single pass: %.0f records, %.1f MB of XML (%.1f MB written) in %.1f sec; %.0f records/sec\n",
+        (double)(nusers + nteams + nhosts), nbytes_in/MEGA, nbytes_out/MEGA,
+        elapsed, elapsed>0?(nusers+nteams+nhosts)/elapsed:0
+    );
+    return 0;
+}
+
+// Code for --delta.
+// A full dump writes deltas.xml, giving the time it started.
+// A delta dump writes, for each table in the spec,
+// the records whose expavg_time is after the start of the previous dump
+// (full or delta), i.e. whose credit changed since then
+// (including the decay done by update_stats).
+// These go in a file (user_delta_1.gz, user_delta_2.gz etc.)
+// in final_output_dir, alongside the last full dump,
+// and are listed, with their times, in its deltas.xml.
+// Records are in the same format as in the full dump,
+// so a stats site can apply a delta by replacing the records with those IDs.
+// Changes that don't involve credit (e.g. a user's name or team),
+// and deletions, appear only in the next full dump;
+// --delta does a full dump if the last one is more than --full_interval days old.
+
+#define DELTA_MARGIN        600
+    // also get records updated this long before the previous dump started,
+    // to allow for clock differences and transactions in progress
+#define DELTA_FILENAME      "deltas.xml"
+
+bool delta = false;
+double full_interval = 7;
+
+struct DELTA_INFO {
+    double start_time;
+    double since;
+        // records with expavg_time after this are included
+    vector<string> files;
+};
+
+struct DELTA_STATE {
+    double full_dump_time;
+    vector<DELTA_INFO> deltas;
+    int parse(FILE*);
+    void write(FILE*);
+    int read_file(const char* dir);
+    int write_file(const char* dir);
+    double last_dump_time() {
+        return deltas.empty()?full_dump_time:deltas.back().start_time;
+    }
+};
+
+int DELTA_STATE::parse(FILE* in) {
+    char buf[256], buf2[256];
+
+    full_dump_time = 0;
+    deltas.clear();
+    while (fgets(buf, 256, in)) {
+        if (match_tag(buf, "</deltas>")) {
+            if (!full_dump_time) return ERR_XML_PARSE;
+            return 0;
+        }
+        if (parse_double(buf, "<full_dump_time>", full_dump_time)) continue;
+        if (match_tag(buf, "<delta>")) {
+            DELTA_INFO di;
+            di.start_time = 0;
+            di.since = 0;
+            deltas.push_back(di);
+            continue;
+        }
+        if (deltas.empty()) continue;
+        DELTA_INFO& di = deltas.back();
+        if (parse_double(buf, "<start_time>", di.start_time)) continue;
+        if (parse_double(buf, "<since>", di.since)) continue;
+        if (parse_str(buf, "<file>", buf2, sizeof(buf2))) {
+            di.files.push_back(buf2);
+            continue;
+        }
+    }
+    return ERR_XML_PARSE;
+}
+
+void DELTA_STATE::write(FILE* f) {
+    unsigned int i, j;
+
+    fprintf(f,
+        "<deltas>\n"
+        "    <full_dump_time>%f</full_dump_time>\n",
+        full_dump_time
+    );
+    for (i=0; i<deltas.size(); i++) {
+        DELTA_INFO& di = deltas[i];
+        fprintf(f,
+            "    <delta>\n"
+            "        <start_time>%f</start_time>\n"
+            "        <since>%f</since>\n",
+            di.start_time, di.since
+        );
+        for (j=0; j<di.files.size(); j++) {
+            fprintf(f, "        <file>%s</file>\n", di.files[j].c_str());
+        }
+        fprintf(f, "    </delta>\n");
+    }
+    fprintf(f, "</deltas>\n");
+}
+
+int DELTA_STATE::read_file(const char* dir) {
+    char path[256];
+    int retval;
+
+    sprintf(path, "%s/%s", dir, DELTA_FILENAME);
+    FILE* f = fopen(path, "r");
+    if (!f) return ERR_FOPEN;
+    retval = parse(f);
+    fclose(f);
+    return retval;
+}
+
+// write to a temp file and rename it,
+// so that stats sites never see a partial file
+//
+int DELTA_STATE::write_file(const char* dir) {
+    char path[256], tmp_path[256];
+
+    sprintf(path, "%s/%s", dir, DELTA_FILENAME);
+    sprintf(tmp_path, "%s.tmp", path);
+    FILE* f = fopen(tmp_path, "w");
+    if (!f) {
+        log_messages.printf(MSG_CRITICAL,
+            "Couldn't open %s for output\n", tmp_path
+        );
+        return ERR_FOPEN;
+    }
+    write(f);
+    if (fclose(f)) return ERR_FWRITE;
+    return boinc_rename(tmp_path, path);
+}
+
+// write delta files for the tables in the spec,
+// and add them to final_output_dir
+//
+int delta_dump(
+    DUMP_SPEC& spec, DELTA_STATE& state, double start_time, char* db_host
+) {
+    vector<ENUMERATION> enums;
+    bool have_table[3] = {false, false, false};
+    bool detail = false;
+    unsigned int i, j;
+    int retval, t;
+    char clause[256], name[256], path[256], final_path[256];
+    DELTA_INFO di;
+
+    // write host details if any host output has them.
+    // Team details (the list of members) are omitted.
+    // Joining or leaving a team changes the user's teamid,
+    // not its expavg_time, so membership changes
+    // (like other non-credit changes) wait for the next full dump.
+    //
+    for (i=0; i<spec.enumerations.size(); i++) {
+        ENUMERATION& e = spec.enumerations[i];
+        have_table[e.table] = true;
+        if (e.table != TABLE_HOST) continue;
+        for (j=0; j<e.outputs.size(); j++) {
+            if (e.outputs[j].detail) detail = true;
+        }
+    }
+    for (t=0; t<3; t++) {
+        if (!have_table[t]) continue;
+        ENUMERATION e;
+        e.table = t;
+        e.sort = SORT_ID;
+        e.sorter = 0;
+        sprintf(e.filename, "%s_delta_%d",
+            table_name[t], (int)state.deltas.size()+1
+        );
+        OUTPUT out;
+        out.recs_per_file = 0;
+        out.detail = (t == TABLE_HOST) && detail;
+        out.compression = COMPRESSION_GZIP;
+        out.zfile = 0;
+        out.nzfile = 0;
+        out.zs = 0;
+        out.nrecs = 0;
+        e.outputs.push_back(out);
+        enums.push_back(e);
+    }
+
+    di.start_time = start_time;
+    di.since = state.last_dump_time() - DELTA_MARGIN;
+    sprintf(clause,
+        "where total_credit > 0 and expavg_time > %f order by id", di.since
+    );
+    retval = single_pass_dump(enums, spec.output_dir, clause, db_host);
+    if (retval) return retval;
+
+    for (i=0; i<enums.size(); i++) {
+        sprintf(name, "%s.gz", enums[i].filename);
+        sprintf(path, "%s/%s", spec.output_dir, name);
+        sprintf(final_path, "%s/%s", spec.final_output_dir, name);
+        retval = boinc_rename(path, final_path);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL,
+                "Can't rename %s to %s\n", path, final_path
+            );
+            return retval;
+        }
+        di.files.push_back(name);
+    }
+    state.deltas.push_back(di);
+    retval = state.write_file(spec.final_output_dir);
+    if (retval) return retval;
+    boinc_rmdir(spec.output_dir);
+    log_messages.printf(MSG_NORMAL,
+        "wrote delta of %d users, %d teams, %d hosts since %f\n",
+        nusers, nteams, nhosts, di.since
+    );
+    return 0;
+}
+
 void usage(char* name) {
     fprintf(stderr,
         "This program generates XML files containing project statistics.\n"
@@ -747,6 +1738,14 @@ void usage(char* name) {
         "    --dump_spec filename          Use the given config file (use ../db_dump_spec.xml)\n"
         "    [-d N | --debug_level]        Set verbosity level (1 to 4)\n"
         "    [--db_host H]                 Use the DB server on host H\n"
+        "    [--single_pass]               Read each table once, and compress in this process\n"
+        "    [--threads N]                 With --single_pass, use N compression threads (default 4)\n"
+        "    [--delta]                     Write only records whose credit changed since the last dump,\n"
+        "                                  adding them to the last full dump.\n"
+        "                                  Other changes (names, team membership)\n"
+        "                                  and deletions wait for the next full dump\n"
+        "    [--full_interval X]           With --delta, do a full dump if the last one\n"
+        "                                  is more than X days old (default 7)\n"
         "    [-h | --help]                 Show this\n"
         "    [-v | --version]              Show version information\n",
         name
@@ -789,6 +1788,25 @@ int main(int argc, char** argv) {
                 exit(1);
             }
             db_host = argv[i];
+        } else if (is_arg(argv[i], "single_pass")) {
+            single_pass = true;
+        } else if (is_arg(argv[i], "threads")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[i]);
+            if (nthreads < 1) nthreads = 1;
+        } else if (is_arg(argv[i], "delta")) {
+            delta = true;
+        } else if (is_arg(argv[i], "full_interval")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            full_interval = atof(argv[i]);
         } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
             usage(argv[0]);
             exit(0);
@@ -857,14 +1875,50 @@ int main(int argc, char** argv) {
 
     boinc_mkdir(spec.output_dir);
 
-    unsigned int j;
-    for (j=0; j<spec.enumerations.size(); j++) {
-        ENUMERATION& e = spec.enumerations[j];
-        e.make_it_happen(spec.output_dir);
+    double start_time = dtime();
+    if (delta) {
+        DELTA_STATE state;
+        retval = state.read_file(spec.final_output_dir);
+        if (retval) {
+            log_messages.printf(MSG_NORMAL,
+                "no previous %s; doing full dump\n", DELTA_FILENAME
+            );
+        } else if (start_time - state.full_dump_time > full_interval*86400) {
+            log_messages.printf(MSG_NORMAL,
+                "last full dump is more than %.1f days old; doing full dump\n",
+                full_interval
+            );
+        } else {
+            retval = delta_dump(spec, state, start_time, db_host);
+            if (retval) exit(retval);
+            log_messages.printf(MSG_NORMAL, "db_dump finished\n");
+            exit(0);
+        }
+    }
+
+    if (single_pass) {
+        retval = single_pass_dump(
+            spec.enumerations, spec.output_dir,
+            "where total_credit > 0 order by id", db_host
+        );
+        if (retval) exit(retval);
+    } else {
+        unsigned int j;
+        for (j=0; j<spec.enumerations.size(); j++) {
+            ENUMERATION& e = spec.enumerations[j];
+            e.make_it_happen(spec.output_dir);
+        }
     }
 
     tables_file(spec.output_dir);
 
+    // record the time of this dump, for later --delta dumps
+    //
+    DELTA_STATE state;
+    state.full_dump_time = start_time;
+    retval = state.write_file(spec.output_dir);
+    if (retval) exit(retval);
+
     sprintf(buf, "cp %s %s/db_dump.xml", spec_filename, spec.output_dir);
     retval = system(buf);
     if (retval) {
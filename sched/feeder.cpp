@@ -28,6 +28,8 @@
 //  [ --wmod n i ]          handle only workunits with (id mod n) == i
 //                          recommended if using HR with multiple schedulers
 //  [ --sleep_interval x ]  sleep x seconds if nothing to do
+//  [ --prefetch ]          query the DB for the next batch of jobs
+//                          while the current batch is being used
 //  [ --allapps ]           interleave results from all applications uniformly
 //  [ --appids a1{,a2} ]    get work only for appids a1,...
 //                          (comma-separated list)
@@ -49,16 +51,38 @@
 // So we use the following policies:
 //
 // - Restart the enum at most once during a given array scan
-// - If a scan doesn't add anything (i.e. array is full, or nothing in DB)
+// - If a scan doesn't add anything because the array is full,
+//   then for N seconds, wait until schedulers empty slots
+//   and refill just those slots.
+//   Schedulers notify the feeder of the slots they empty
+//   (SCHED_SHMEM::slot_vacated())
+//   so that they're refilled right away,
+//   rather than the array draining while the feeder sleeps,
+//   and without scanning the whole array.
+// - If a scan doesn't add anything because there's nothing in DB,
 //   sleep for N seconds
 // - If an enumerated job was already in the array,
 //   stop the scan and sleep for N seconds
 // - Otherwise immediately start another scan
+//
+// With --prefetch, jobs are enumerated in order of result ID
+// (as for apps that use HR),
+// and the query for an app's next batch of jobs
+// (those after the last one in the current batch)
+// is done by a separate thread (with its own DB connection)
+// while the current batch is used to fill slots.
+// The next batch may include jobs sent in the meantime;
+// the scheduler checks that jobs are still unsent before sending them,
+// as it does for jobs that have been in the array for a while.
 
 // If -allapps is used:
 // - there are separate DB enumerators for each app
-// - the work array is interleaved by application, based on their weights.
-//   slot_to_app[] maps slot (i.e. work array index) to app index.
+// - the work array is divided among applications, based on their weights.
+//   Each app gets a contiguous range of slots (a "bucket"; see sched_shmem.h)
+//   so that schedulers can skip the slots of apps they can't use.
+//   There are no per-bucket locks;
+//   schedulers claim individual slots with compare-and-swap.
+//   app_indices[] maps slot (i.e. work array index) to app index.
 //   app_count[] is the number of slots per app
 //   (approximately proportional to its weight)
 
@@ -101,6 +125,7 @@
 #include <math.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #include <vector>
 using std::vector;
 
@@ -133,7 +158,6 @@ using std::vector;
 #define ENUM_OVER           2
 
 SCHED_SHMEM* ssp;
-key_t sema_key;
 const char* order_clause="";
 char mod_select_clause[256];
 double sleep_interval = DEFAULT_SLEEP_INTERVAL;
@@ -155,6 +179,118 @@ bool using_hr;
     // true iff any app is using HR
 bool is_main_feeder = true;
     // false if using --mod or --wmod and this one isn't 0
+bool prefetch = false;
+
+// prefetching of the next batch of jobs, per app (see above)
+//
+struct PREFETCH {
+    bool pending;           // query requested but not done yet
+    char query[MAX_QUERY_LEN];
+    MYSQL_RES* rp;          // result of query, if done and successful
+    double time;            // when query was done
+};
+
+static PREFETCH* prefetches;
+static DB_CONN prefetch_db;
+static pthread_mutex_t prefetch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_cond = PTHREAD_COND_INITIALIZER;
+
+static void* prefetch_thread(void*) {
+    int i;
+
+    mysql_thread_init();
+    pthread_mutex_lock(&prefetch_mutex);
+    while (1) {
+        for (i=0; i<napps; i++) {
+            if (prefetches[i].pending) break;
+        }
+        if (i == napps) {
+            pthread_cond_wait(&prefetch_cond, &prefetch_mutex);
+            continue;
+        }
+        PREFETCH& p = prefetches[i];
+        pthread_mutex_unlock(&prefetch_mutex);
+
+        // the main thread doesn't touch p while it's pending
+        //
+        MYSQL_RES* rp = NULL;
+        if (!prefetch_db.do_query(p.query)) {
+            rp = mysql_store_result(prefetch_db.mysql);
+        }
+        if (!rp) {
+            log_messages.printf(MSG_CRITICAL,
+                "prefetch query failed: %s\n", prefetch_db.error_string()
+            );
+        }
+
+        pthread_mutex_lock(&prefetch_mutex);
+        p.rp = rp;
+        p.time = dtime();
+        p.pending = false;
+        pthread_cond_broadcast(&prefetch_cond);
+    }
+    return 0;
+}
+
+// The given app's enumeration has started a new batch;
+// start the query for the batch after it
+//
+static void start_prefetch(
+    int app_index, DB_WORK_ITEM& wi, int limit, const char* select_clause
+) {
+    PREFETCH& p = prefetches[app_index];
+    pthread_mutex_lock(&prefetch_mutex);
+    if (!p.pending && !p.rp) {
+        wi.enum_all_query(p.query, wi.end_id, limit, select_clause);
+        p.pending = true;
+        pthread_cond_broadcast(&prefetch_cond);
+    }
+    pthread_mutex_unlock(&prefetch_mutex);
+}
+
+// The given app's enumeration is about to start a new batch.
+// Wait for its prefetch query, if any, and have the enumeration use it.
+// Don't use the result if it's older than sleep_interval;
+// a new query would see a different set of jobs.
+//
+static void use_prefetch(int app_index, DB_WORK_ITEM& wi) {
+    PREFETCH& p = prefetches[app_index];
+    pthread_mutex_lock(&prefetch_mutex);
+    while (p.pending) {
+        pthread_cond_wait(&prefetch_cond, &prefetch_mutex);
+    }
+    if (p.rp) {
+        if (dtime() - p.time < sleep_interval) {
+            wi.prefetched = p.rp;
+        } else {
+            mysql_free_result(p.rp);
+        }
+        p.rp = NULL;
+    }
+    pthread_mutex_unlock(&prefetch_mutex);
+}
+
+static void prefetch_init() {
+    pthread_t thread;
+    int retval;
+
+    prefetches = (PREFETCH*) calloc(napps, sizeof(PREFETCH));
+    retval = prefetch_db.open(
+        config.db_name, config.db_host, config.db_user, config.db_passwd
+    );
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "prefetch_db.open: %d; %s\n", retval, prefetch_db.error_string()
+        );
+        exit(1);
+    }
+    prefetch_db.set_isolation_level(READ_UNCOMMITTED);
+    retval = pthread_create(&thread, NULL, prefetch_thread, NULL);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL, "can't create prefetch thread\n");
+        exit(1);
+    }
+}
 
 void signal_handler(int) {
     log_messages.printf(MSG_NORMAL, "Signaled by simulator\n");
@@ -188,7 +324,15 @@ int check_reread_trigger() {
             "Found trigger file %s; re-scanning database tables.\n",
             REREAD_DB_FILENAME
         );
+
+        // keep the bucket layout; app_indices[] still refers to it
+        //
+        int nbuckets = ssp->nbuckets;
+        JOB_BUCKET buckets[MAX_JOB_BUCKETS];
+        memcpy(buckets, ssp->buckets, sizeof(buckets));
         ssp->init(num_work_items);
+        ssp->nbuckets = nbuckets;
+        memcpy(ssp->buckets, buckets, sizeof(buckets));
         ssp->scan_tables();
         int retval = unlink(config.project_path(REREAD_DB_FILENAME));
         if (retval) {
@@ -263,11 +407,20 @@ static bool get_job_from_db(
     int hrt = ssp->apps[app_index].homogeneous_redundancy;
 
     while (1) {
-        if (hrt) {
+        bool new_batch = !wi.cursor.active;
+        if (prefetch && new_batch) {
+            use_prefetch(app_index, wi);
+        }
+        if (hrt || prefetch) {
             retval = wi.enumerate_all(enum_size, select_clause);
         } else {
             retval = wi.enumerate(enum_size, select_clause, order_clause);
         }
+        if (prefetch && new_batch && !retval) {
+            // start fetching the batch after this one
+            //
+            start_prefetch(app_index, wi, enum_size, select_clause);
+        }
         if (retval) {
             if (retval != ERR_DB_NOT_FOUND) {
                 // If DB server dies, exit;
@@ -413,6 +566,39 @@ static void update_job_stats() {
     }
 }
 
+// put the job just enumerated by wi in the given (empty) slot
+//
+static void fill_slot(int i, DB_WORK_ITEM& wi) {
+    WU_RESULT& wu_result = ssp->wu_results[i];
+
+    log_messages.printf(MSG_NORMAL,
+        "adding result [RESULT#%u] in slot %d\n",
+        wi.res_id, i
+    );
+    wu_result.resultid = wi.res_id;
+    wu_result.res_priority = wi.res_priority;
+    wu_result.res_server_state = wi.res_server_state;
+    wu_result.res_report_deadline = wi.res_report_deadline;
+    wu_result.workunit.set(wi.wu);
+    // If the workunit has already been allocated to a certain
+    // OS then it should be assigned quickly,
+    // so we set its infeasible_count to 1
+    //
+    if (wi.wu.hr_class > 0) {
+        wu_result.infeasible_count = 1;
+    } else {
+        wu_result.infeasible_count = 0;
+    }
+    // set the need_reliable flag if needed
+    //
+    wu_result.need_reliable = false;
+    if (config.reliable_on_priority && wu_result.res_priority >= config.reliable_on_priority) {
+        wu_result.need_reliable = true;
+    }
+    wu_result.time_added_to_shared_memory = time(0);
+    wu_result.publish();
+}
+
 // Make one pass through the work array, filling in empty slots.
 // Return true if we filled in any.
 //
@@ -443,7 +629,11 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
         switch (wu_result.state) {
         case WR_STATE_PRESENT:
             if (purge_stale_time && wu_result.time_added_to_shared_memory < (time(0) - purge_stale_time)) {
-                wu_result.state = WR_STATE_EMPTY;
+                // a scheduler may be claiming it right now
+                //
+                if (!wu_result.change_state(WR_STATE_PRESENT, WR_STATE_EMPTY)) {
+                    break;
+                }
                 log_messages.printf(MSG_NORMAL,
                     "remove result [RESULT#%d] from slot %d because it is stale\n",
                     wu_result.resultid, i
@@ -458,32 +648,7 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
                 wi, app_index, enum_phase[app_index], ncollisions
             );
             if (found) {
-                log_messages.printf(MSG_NORMAL,
-                    "adding result [RESULT#%u] in slot %d\n",
-                    wi.res_id, i
-                );
-                wu_result.resultid = wi.res_id;
-                wu_result.res_priority = wi.res_priority;
-                wu_result.res_server_state = wi.res_server_state;
-                wu_result.res_report_deadline = wi.res_report_deadline;
-                wu_result.workunit = wi.wu;
-                wu_result.state = WR_STATE_PRESENT;
-                // If the workunit has already been allocated to a certain
-                // OS then it should be assigned quickly,
-                // so we set its infeasible_count to 1
-                //
-                if (wi.wu.hr_class > 0) {
-                    wu_result.infeasible_count = 1;
-                } else {
-                    wu_result.infeasible_count = 0;
-                }
-                // set the need_reliable flag if needed
-                //
-                wu_result.need_reliable = false;
-                if (config.reliable_on_priority && wu_result.res_priority >= config.reliable_on_priority) {
-                    wu_result.need_reliable = true;
-                }
-                wu_result.time_added_to_shared_memory = time(0);
+                fill_slot(i, wi);
                 nadditions++;
             }
             break;
@@ -495,8 +660,7 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
             char buf[256];
             sprintf(buf, "/proc/%d", pid);
             log_messages.printf(MSG_NORMAL, "checking pid %d\n", pid);
-            if (stat(buf, &s)) {
-                wu_result.state = WR_STATE_PRESENT;
+            if (stat(buf, &s) && wu_result.release(pid, WR_STATE_PRESENT)) {
                 log_messages.printf(MSG_NORMAL,
                     "Result reserved by non-existent process PID %d; resetting\n",
                     pid
@@ -517,6 +681,68 @@ static bool scan_work_array(vector<DB_WORK_ITEM> &work_items) {
     return true;
 }
 
+// Fill the slots that schedulers have emptied
+// since nvacated was old_nvacated (and advance old_nvacated),
+// without scanning the rest of the array.
+// Return false if we lost track of some of them,
+// or couldn't fill them (no jobs, or jobs already in the array);
+// the caller should then do a full scan.
+//
+static bool refill_vacated_slots(
+    vector<DB_WORK_ITEM> &work_items, int& old_nvacated
+) {
+    int i, app_index;
+    int enum_phase[napps];
+    int nadditions=0, ncollisions=0;
+    bool found, all_filled = true;
+    vector<int> slots;
+
+    if (!ssp->get_vacated_slots(old_nvacated, slots)) {
+        log_messages.printf(MSG_DEBUG, "lost track of vacated slots\n");
+        return false;
+    }
+    for (i=0; i<napps; i++) {
+        if (work_items[i].cursor.active) {
+            enum_phase[i] = ENUM_FIRST_PASS;
+        } else {
+            enum_phase[i] = ENUM_SECOND_PASS;
+        }
+    }
+    if (using_hr) {
+        hr_count_slots();
+    }
+    for (unsigned int j=0; j<slots.size(); j++) {
+        i = slots[j];
+        if (ssp->wu_results[i].state != WR_STATE_EMPTY) continue;
+        app_index = app_indices[i];
+        found = false;
+        if (enum_phase[app_index] != ENUM_OVER) {
+            found = get_job_from_db(
+                work_items[app_index], app_index,
+                enum_phase[app_index], ncollisions
+            );
+        }
+        if (found) {
+            fill_slot(i, work_items[app_index]);
+            nadditions++;
+        } else {
+            all_filled = false;
+        }
+    }
+    log_messages.printf(MSG_DEBUG,
+        "Added %d results to %d vacated slots\n", nadditions, (int)slots.size()
+    );
+    return all_filled && !ncollisions;
+}
+
+static int nempty_slots() {
+    int n = 0;
+    for (int i=0; i<ssp->max_wu_results; i++) {
+        if (ssp->wu_results[i].state == WR_STATE_EMPTY) n++;
+    }
+    return n;
+}
+
 void feeder_loop() {
     vector<DB_WORK_ITEM> work_items;
     double next_av_update_time=0;
@@ -530,6 +756,7 @@ void feeder_loop() {
 
     while (1) {
         bool action;
+        int nvacated = ssp->nvacated;
         if (config.dont_send_jobs) {
             action = false;
         } else {
@@ -543,10 +770,30 @@ void feeder_loop() {
             signal(SIGUSR2, simulator_signal_handler);
             pause();
 #else
-            log_messages.printf(MSG_DEBUG,
-                "No action; sleeping %.2f sec\n", sleep_interval
-            );
-            boinc_sleep(sleep_interval);
+            if (config.dont_send_jobs || nempty_slots()) {
+                log_messages.printf(MSG_DEBUG,
+                    "No action; sleeping %.2f sec\n", sleep_interval
+                );
+                boinc_sleep(sleep_interval);
+            } else {
+                // The array is full.
+                // For the next sleep_interval seconds,
+                // refill just the slots that schedulers empty;
+                // then do a full scan (which also removes stale jobs
+                // and finds slots we didn't hear about).
+                //
+                log_messages.printf(MSG_DEBUG,
+                    "Array full; refilling vacated slots for %.2f sec\n",
+                    sleep_interval
+                );
+                double end_time = dtime() + sleep_interval;
+                while (1) {
+                    double left = end_time - dtime();
+                    if (left <= 0) break;
+                    if (!ssp->wait_for_vacated(nvacated, 1, left)) break;
+                    if (!refill_vacated_slots(work_items, nvacated)) break;
+                }
+            }
 #endif
         } else {
             if (config.job_size_matching) {
@@ -679,6 +926,7 @@ void usage(char *name) {
         "  [ --mod n i ]                    handle only results with (id mod n) == i\n"
         "  [ --wmod n i ]                   handle only workunits with (id mod n) == i\n"
         "  [ --sleep_interval x ]           sleep x seconds if nothing to do\n"
+        "  [ --prefetch ]                   query DB for next batch of jobs in a separate thread\n"
         "  [ -h | --help ]                  Shows this help text.\n"
         "  [ -v | --version ]               Shows version information.\n",
         name, name
@@ -688,7 +936,6 @@ void usage(char *name) {
 int main(int argc, char** argv) {
     int i, retval;
     void* p;
-    char path[256];
 
     for (i=1; i<argc; i++) {
         if (is_arg(argv[i], "d") || is_arg(argv[i], "debug_level")) {
@@ -746,6 +993,8 @@ int main(int argc, char** argv) {
                 exit(1);
             }
             sleep_interval = atof(argv[i]);
+        } else if (is_arg(argv[i], "prefetch")) {
+            prefetch = true;
         } else if (is_arg(argv[i], "v") || is_arg(argv[i], "version")) {
             show_version();
             exit(0);
@@ -778,10 +1027,6 @@ int main(int argc, char** argv) {
     if (config.shmem_work_items) {
         num_work_items = config.shmem_work_items;
     }
-    strncpy(path, config.project_dir, sizeof(path));
-    get_key(path, 'a', sema_key);
-    destroy_semaphore(sema_key);
-    create_semaphore(sema_key);
 
     retval = destroy_shmem(config.shmem_key);
     if (retval) {
@@ -789,7 +1034,7 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
-    int shmem_size = sizeof(SCHED_SHMEM) + num_work_items*sizeof(WU_RESULT);
+    int shmem_size = SCHED_SHMEM::size(num_work_items);
     retval = create_shmem(config.shmem_key, shmem_size, 0 /* don't set GID */, &p);
     if (retval) {
         log_messages.printf(MSG_CRITICAL, "can't create shmem\n");
@@ -836,7 +1081,8 @@ int main(int argc, char** argv) {
     app_indices = (int*) calloc(ssp->max_wu_results, sizeof(int));
 
     // If all_apps is set, make an array saying which array slot
-    // is associated with which app
+    // is associated with which app,
+    // and describe the resulting per-app buckets in shared mem
     //
     if (all_apps) {
         napps = ssp->napps;
@@ -858,6 +1104,23 @@ int main(int argc, char** argv) {
         weighted_interleave(
             weights, ssp->napps, ssp->max_wu_results, app_indices, counts
         );
+        int slot = 0;
+        for (i=0; i<ssp->napps; i++) {
+            JOB_BUCKET& bucket = ssp->buckets[i];
+            bucket.appid = ssp->apps[i].id;
+            bucket.first_slot = slot;
+            bucket.nslots = counts[i];
+            for (int j=0; j<counts[i]; j++) {
+                app_indices[slot++] = i;
+            }
+            log_messages.printf(MSG_NORMAL,
+                "app %s: %d slots starting at %d\n",
+                ssp->apps[i].name, bucket.nslots, bucket.first_slot
+            );
+        }
+        ssp->nbuckets = ssp->napps;
+        free(weights);
+        free(counts);
     } else {
         napps = 1;
     }
@@ -869,6 +1132,11 @@ int main(int argc, char** argv) {
             "Note: ordering options will not apply to apps for which homogeneous redundancy is used\n"
         );
     }
+    if (prefetch && strlen(order_clause)) {
+        log_messages.printf(MSG_CRITICAL,
+            "Note: ordering options will not apply when --prefetch is used\n"
+        );
+    }
 
     if (config.job_size_matching) {
         retval = ssp->perf_info.read_file();
@@ -880,6 +1148,10 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (prefetch) {
+        prefetch_init();
+    }
+
     signal(SIGUSR1, show_state);
 
     feeder_loop();
@@ -458,7 +458,7 @@ int delete_antique_files() {
             return retval;
         }
 
-        strcpy(timestamp, time_to_string(fr.date_modified));
+        time_to_string(fr.date_modified, timestamp);
         log_messages.printf(MSG_DEBUG,
             "deleting [antique %s] %s\n",
             timestamp, pathname 
@@ -104,14 +104,167 @@ int return_success(const char* text) {
 #define BLOCK_SIZE  16382
 double bytes_left=-1;
 
+// uploads are copied to files in chunks this big
+//
+#define UPLOAD_BUF_SIZE (1024*1024)
+
+// On Linux we can move upload data from the input descriptor
+// to the file with splice(), without copying it through user space.
+// Not with FCGI: there the input is a FastCGI stream, not a descriptor.
+//
+#if defined(HAVE_SPLICE) && !defined(_USING_FCGI_)
+#define USE_SPLICE
+#endif
+
+static int write_block(int fd, unsigned char* buf, int n, char* path) {
+    int to_write = n;
+    while (to_write > 0) {
+        ssize_t ret = write(fd, buf+n-to_write, to_write);
+        if (ret < 0) {
+            const char* errmsg;
+            if (errno == ENOSPC) {
+                errmsg = "No space left on server";
+            } else {
+                errmsg = strerror(errno);
+            }
+            return return_error(ERR_TRANSIENT,
+                "can't write file %s: %s\n", path, errmsg
+            );
+        }
+        to_write -= ret;
+    }
+    return 0;
+}
+
+#ifdef USE_SPLICE
+// Copy the rest of the upload (bytes_left bytes) from "in" to fd.
+// If the input is a pipe, splice directly from it to the file;
+// otherwise go through a pipe of our own.
+// Returns 0 if done, 1 if an error reply was sent,
+// or -1 if splice() doesn't work for this input;
+// the caller should copy the rest (bytes_left) some other way.
+//
+static int splice_socket_to_file(
+    FILE* in, int fd, char* path, unsigned char* buf
+) {
+    struct stat sbuf;
+    int in_fd = fileno(in);
+    int pfd[2];
+    bool direct, first = true;
+    ssize_t n, k, m;
+
+    // first write what stdio has already read ahead
+    // (the headers are parsed with fgets()).
+    // Read with the descriptor non-blocking;
+    // fread() returns a short count only when stdio's buffer is empty
+    // and no more data is available right now.
+    //
+    int flags = fcntl(in_fd, F_GETFL);
+    if (flags < 0 || fcntl(in_fd, F_SETFL, flags|O_NONBLOCK)) return -1;
+    while (bytes_left > 0) {
+        m = bytes_left<(double)UPLOAD_BUF_SIZE ? (ssize_t)bytes_left : UPLOAD_BUF_SIZE;
+        errno = 0;
+        n = fread(buf, 1, m, in);
+        if (n > 0) {
+            if (write_block(fd, buf, n, path)) {
+                fcntl(in_fd, F_SETFL, flags);
+                return 1;
+            }
+            bytes_left -= n;
+        }
+        if (n < m) break;
+    }
+    fcntl(in_fd, F_SETFL, flags);
+    if (bytes_left <= 0) return 0;
+    if (feof(in) || (ferror(in) && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        return return_error(ERR_TRANSIENT,
+            "incomplete socket read: %.0f bytes left\n", bytes_left
+        );
+    }
+    clearerr(in);
+
+    if (fstat(in_fd, &sbuf)) return -1;
+    direct = S_ISFIFO(sbuf.st_mode);
+    if (!direct && pipe(pfd)) return -1;
+
+    while (bytes_left > 0) {
+        m = bytes_left<(double)UPLOAD_BUF_SIZE ? (ssize_t)bytes_left : UPLOAD_BUF_SIZE;
+        if (direct) {
+            n = splice(in_fd, NULL, fd, NULL, m, SPLICE_F_MOVE|SPLICE_F_MORE);
+        } else {
+            n = splice(in_fd, NULL, pfd[1], NULL, m, SPLICE_F_MOVE|SPLICE_F_MORE);
+        }
+        if (n < 0 && first && (errno == EINVAL || errno == ENOSYS)) {
+            if (!direct) {
+                close(pfd[0]);
+                close(pfd[1]);
+            }
+            return -1;
+        }
+        first = false;
+        if (n <= 0) {
+            if (!direct) {
+                close(pfd[0]);
+                close(pfd[1]);
+            }
+            if (n == 0) {
+                return return_error(ERR_TRANSIENT,
+                    "EOF on socket read : asked for %d, got %d\n",
+                    (int)m, 0
+                );
+            }
+            if (direct && errno == ENOSPC) {
+                return return_error(ERR_TRANSIENT,
+                    "can't write file %s: No space left on server\n", path
+                );
+            }
+            return return_error(ERR_TRANSIENT,
+                "error %d (%s) on socket read: asked for %d, got %d\n",
+                errno, strerror(errno), (int)m, 0
+            );
+        }
+        if (!direct) {
+            // move the data from our pipe to the file
+            //
+            for (k=0; k<n; ) {
+                ssize_t ret = splice(pfd[0], NULL, fd, NULL, n-k, SPLICE_F_MOVE);
+                if (ret <= 0) {
+                    close(pfd[0]);
+                    close(pfd[1]);
+                    return return_error(ERR_TRANSIENT,
+                        "can't write file %s: %s\n", path,
+                        (ret<0 && errno == ENOSPC)?"No space left on server":strerror(errno)
+                    );
+                }
+                k += ret;
+            }
+        }
+        bytes_left -= n;
+    }
+    if (!direct) {
+        close(pfd[0]);
+        close(pfd[1]);
+    }
+    return 0;
+}
+#endif
+
 // read from socket, write to file
 // ALWAYS returns an HTML reply
 //
 int copy_socket_to_file(FILE* in, char* path, double offset, double nbytes) {
-    unsigned char buf[BLOCK_SIZE];
+    static unsigned char* buf = 0;
+        // allocated once; with FCGI it's reused across requests
     struct stat sbuf;
     int pid;
 
+    if (!buf) {
+        buf = (unsigned char*)malloc(UPLOAD_BUF_SIZE);
+        if (!buf) {
+            return return_error(ERR_TRANSIENT, "can't allocate buffer");
+        }
+    }
+
     // open file.  Use raw IO not buffered IO so that we can use reliable
     // posix file locking.
     // Advisory file locking is not guaranteed reliable when
@@ -146,7 +299,7 @@ int copy_socket_to_file(FILE* in, char* path, double offset, double nbytes) {
     // check that file length corresponds to offset
     // TODO: use a 64-bit variant
     //
-    if (stat(path, &sbuf)) {
+    if (fstat(fd, &sbuf)) {
         close(fd);
         return return_error(ERR_TRANSIENT,
             "can't stat file %s: %s\n", path, strerror(errno)
@@ -171,11 +324,20 @@ int copy_socket_to_file(FILE* in, char* path, double offset, double nbytes) {
     //
     bytes_left = nbytes - offset;
 
+#ifdef USE_SPLICE
+    int retval = splice_socket_to_file(in, fd, path, buf);
+    if (retval >= 0) {
+        close(fd);
+        if (retval) return retval;
+        return return_success(0);
+    }
+#endif
+
     while (bytes_left > 0) {
 
-        int n, m, to_write;
+        int n, m;
 
-        m = bytes_left<(double)BLOCK_SIZE ? (int)bytes_left : BLOCK_SIZE;
+        m = bytes_left<(double)UPLOAD_BUF_SIZE ? (int)bytes_left : UPLOAD_BUF_SIZE;
 
         // try to get m bytes from socket (n>=0 is number actually returned)
         //
@@ -183,22 +345,9 @@ int copy_socket_to_file(FILE* in, char* path, double offset, double nbytes) {
 
         // try to write n bytes to file
         //
-        to_write=n;
-        while (to_write > 0) {
-            ssize_t ret = write(fd, buf+n-to_write, to_write);
-            if (ret < 0) {
-                close(fd);
-                const char* errmsg;
-                if (errno == ENOSPC) {
-                    errmsg = "No space left on server";
-                } else {
-                    errmsg = strerror(errno);
-                }
-                return return_error(ERR_TRANSIENT,
-                    "can't write file %s: %s\n", path, errmsg
-                );
-            }
-            to_write -= ret;
+        if (write_block(fd, buf, n, path)) {
+            close(fd);
+            return 1;
         }
 
         // check that we got all bytes from socket that were requested
@@ -257,9 +406,7 @@ int handle_file_upload(FILE* in, R_RSA_PUBLIC_KEY& key) {
     strcpy(xml_signature, "");
     bool found_data = false;
     while (fgets(buf, 256, in)) {
-#if 1
-        log_messages.printf(MSG_NORMAL, "got:%s\n", buf);
-#endif
+        log_messages.printf(MSG_DEBUG, "got:%s\n", buf);
         if (match_tag(buf, "<file_info>")) continue;
         if (match_tag(buf, "</file_info>")) continue;
         if (match_tag(buf, "<signed_xml>")) continue;
@@ -670,10 +817,12 @@ int main(int argc, char *argv[]) {
     log_messages.pid = getpid();
     log_messages.set_debug_level(config.fuh_debug_level);
 
+#ifndef _USING_FCGI_
     if (boinc_file_exists(config.project_path("stop_upload"))) {
         return_error(ERR_TRANSIENT, "Maintenance underway: file uploads are temporarily disabled.");
         exit(1);
     }
+#endif
 
     if (!config.ignore_upload_certificates) {
         retval = get_key(key);
@@ -688,6 +837,14 @@ int main(int argc, char *argv[]) {
         counter++;
         //fprintf(stderr, "file_upload_handler (FCGI): counter: %d\n", counter);
         log_messages.set_indent_level(0);
+
+        // we run for a long time; check for stop_upload on each request
+        //
+        if (boinc_file_exists(config.project_path("stop_upload"))) {
+            return_error(ERR_TRANSIENT, "Maintenance underway: file uploads are temporarily disabled.");
+            log_messages.flush();
+            continue;
+        }
 #endif
         handle_request(stdin, key);
 #ifdef _USING_FCGI_
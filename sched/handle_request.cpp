@@ -437,11 +437,11 @@ make_new_host:
             g_reply->insert_message(
                 "Couldn't create host record in database", "low"
             );
-            boinc_db.print_error("host.insert()");
+            thread_db()->print_error("host.insert()");
             log_messages.printf(MSG_CRITICAL, "host.insert() failed\n");
             return retval;
         }
-        host.id = boinc_db.insert_id();
+        host.id = thread_db()->insert_id();
 
 got_host:
         g_reply->host = host;
@@ -557,7 +557,7 @@ static int update_host_record(HOST& initial_host, HOST& xhost, USER& user) {
         md5_block((const unsigned char*)buf, strlen(buf), host.host_cpid);
     }
 
-    char* p = getenv("REMOTE_ADDR");
+    const char* p = request_getenv("REMOTE_ADDR");
     if (p) {
         strlcpy(host.external_ip_addr, p, sizeof(host.external_ip_addr));
     }
@@ -980,7 +980,7 @@ bool wrong_core_client_version() {
 }
 
 inline static const char* get_remote_addr() {
-    const char * r = getenv("REMOTE_ADDR");
+    const char * r = request_getenv("REMOTE_ADDR");
     return r ? r : "?.?.?.?";
 }
 
@@ -1076,7 +1076,8 @@ void process_request(char* code_sign_key) {
     PLATFORM* platform;
     int retval;
     double last_rpc_time, x;
-    struct tm *rpc_time_tm;
+    struct tm rpc_time_tm;
+    unsigned int seed;
     bool ok_to_send_work = !config.dont_send_jobs;
     bool have_no_work = false;
     char buf[256];
@@ -1107,7 +1108,6 @@ void process_request(char* code_sign_key) {
         if (config.locality_scheduling || config.locality_scheduler_fraction || config.enable_assignment) {
             have_no_work = false;
         } else {
-            lock_sema();
             have_no_work = ssp->no_work(g_pid);
             if (have_no_work) {
                 g_wreq->no_jobs_available = true;
@@ -1117,7 +1117,6 @@ void process_request(char* code_sign_key) {
                     );
                 }
             }
-            unlock_sema();
         }
     }
 
@@ -1197,22 +1196,22 @@ void process_request(char* code_sign_key) {
 
     // in deciding whether it's a new day,
     // add a random factor (based on host ID)
-    // to smooth out network traffic over the day
+    // to smooth out network traffic over the day.
+    // Use rand_r() rather than srand()/rand(),
+    // which other threads (--threads) may be using.
     //
-    retval = rand();
-    srand(g_reply->host.id);
-    x = drand()*86400;
-    srand(retval);
+    seed = g_reply->host.id;
+    x = ((double)rand_r(&seed)/(double)RAND_MAX)*86400;
     last_rpc_time = g_reply->host.rpc_time;
     t = g_reply->host.rpc_time + x;
-    rpc_time_tm = localtime(&t);
-    g_request->last_rpc_dayofyear = rpc_time_tm->tm_yday;
+    localtime_r(&t, &rpc_time_tm);
+    g_request->last_rpc_dayofyear = rpc_time_tm.tm_yday;
 
     t = time(0);
     g_reply->host.rpc_time = t;
     t += x;
-    rpc_time_tm = localtime(&t);
-    g_request->current_rpc_dayofyear = rpc_time_tm->tm_yday;
+    localtime_r(&t, &rpc_time_tm);
+    g_request->current_rpc_dayofyear = rpc_time_tm.tm_yday;
 
     retval = modify_host_struct(g_reply->host);
 
@@ -1329,7 +1328,7 @@ static void log_incomplete_request() {
     // BOINC scheduler requests use method POST.
     // So method GET means that someone is trying a browser.
     //
-    char *rm=getenv("REQUEST_METHOD");
+    const char *rm=request_getenv("REQUEST_METHOD");
     bool used_get = false;
     if (rm && !strcmp(rm, "GET")) {
         used_get = true;
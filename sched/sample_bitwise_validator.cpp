@@ -48,8 +48,9 @@ int init_result(RESULT& result, void*& data) {
     int retval;
     FILE_CKSUM_LIST* fcl = new FILE_CKSUM_LIST;
     vector<FILE_INFO> files;
-    char md5_buf[MD5_LEN];
-    double nbytes;
+    vector<FILE_INFO*> fis;
+    vector<const char*> paths;
+    unsigned int i;
 
     retval = get_output_file_infos(result, files);
     if (retval) {
@@ -60,23 +61,41 @@ int init_result(RESULT& result, void*& data) {
         return retval;
     }
 
-    for (unsigned int i=0; i<files.size(); i++) {
+    // hash the files together; md5_files() does several at once
+    //
+    for (i=0; i<files.size(); i++) {
         FILE_INFO& fi = files[i];
         if (fi.no_validate) continue;
-        retval = md5_file(fi.path.c_str(), md5_buf, nbytes);
-        if (retval) {
-            if (fi.optional) {
-                strcpy(md5_buf, "");
+        fis.push_back(&fi);
+        paths.push_back(fi.path.c_str());
+    }
+    int n = (int)paths.size();
+    vector<char> md5_bufs(n*MD5_LEN);
+    vector<char*> md5s(n);
+    vector<double> nbytes(n);
+    vector<int> retvals(n);
+    for (i=0; i<md5s.size(); i++) {
+        md5s[i] = &md5_bufs[i*MD5_LEN];
+    }
+    if (n) {
+        md5_files(n, &paths[0], &md5s[0], &nbytes[0], &retvals[0]);
+    }
+
+    for (i=0; i<fis.size(); i++) {
+        if (retvals[i]) {
+            if (fis[i]->optional) {
+                strcpy(md5s[i], "");
                     // indicate file is missing; not the same as md5("")
             } else {
                 log_messages.printf(MSG_CRITICAL,
                     "[RESULT#%d %s] Couldn't open %s\n",
-                    result.id, result.name, fi.path.c_str()
+                    result.id, result.name, fis[i]->path.c_str()
                 );
-                return retval;
+                delete fcl;
+                return retvals[i];
             }
         }
-        fcl->files.push_back(string(md5_buf));
+        fcl->files.push_back(string(md5s[i]));
     }
     data = (void*) fcl;
     return 0;
@@ -43,7 +43,7 @@
 //
 static bool quick_check(
     WU_RESULT& wu_result,
-    WORKUNIT& wu,       // a mutable copy of wu_result.workunit.
+    WORKUNIT& wu,       // a mutable copy of the fields in wu_result.workunit.
         // We may modify its delay_bound and rsc_fpops_est
     BEST_APP_VERSION* &bavp,
     APP* &app, int& last_retval
@@ -162,13 +162,13 @@ static bool quick_check(
 static bool slow_check(
     WU_RESULT& wu_result,       // the job cache entry.
         // We may refresh its hr_class and app_version_id fields.
+    WORKUNIT& wu,               // our copy of it; refresh these here too
     APP* app,
     BEST_APP_VERSION* bavp      // the app version to be used
 ) {
     int n, retval;
     DB_RESULT result;
     char buf[256];
-    WORKUNIT& wu = wu_result.workunit;
 
     // Don't send if we've already sent a result of this WU to this user.
     //
@@ -235,6 +235,7 @@ static bool slow_check(
         }
         if (app_hr_type(*app)) {
             wu.hr_class = vals[0];
+            wu_result.workunit.hr_class = wu.hr_class;
             if (already_sent_to_different_hr_class(wu, *app)) {
                 if (config.debug_send) {
                     log_messages.printf(MSG_NORMAL,
@@ -253,6 +254,7 @@ static bool slow_check(
         if (app->homogeneous_app_version) {
             int wu_avid = vals[1];
             wu.app_version_id = wu_avid;
+            wu_result.workunit.app_version_id = wu_avid;
             if (wu_avid && wu_avid != bavp->avp->id) {
                 if (config.debug_send) {
                     log_messages.printf(MSG_NORMAL,
@@ -308,27 +310,36 @@ static bool result_still_sendable(DB_RESULT& result, WORKUNIT& wu) {
 // beta_only:
 //      Send only jobs for beta-test apps
 //
+// The array is scanned bucket by bucket,
+// skipping buckets whose app this request can't use.
+// The starting bucket is chosen with probability proportional to its size,
+// so apps are favored in proportion to their share of the array.
+//
 // Return true if no more work is needed.
 //
-static bool scan_work_array() {
-    int i, j, retval, rnd_off, last_retval=0;;
+static bool scan_bucket(int ibucket, int& last_retval) {
+    int i, j, retval, rnd_off, resultid;
     APP* app;
     BEST_APP_VERSION* bavp;
-    bool no_more_needed = false;
     SCHED_DB_RESULT result;
+    JOB_BUCKET& bucket = ssp->buckets[ibucket];
+    WORKUNIT wu;
 
-    lock_sema();
-
-    rnd_off = rand() % ssp->max_wu_results;
-    for (j=0; j<ssp->max_wu_results; j++) {
-        i = (j+rnd_off) % ssp->max_wu_results;
+    rnd_off = rand() % bucket.nslots;
+    for (j=0; j<bucket.nslots; j++) {
+        i = bucket.first_slot + (j+rnd_off) % bucket.nslots;
 
         WU_RESULT& wu_result = ssp->wu_results[i];
+        if (wu_result.state != WR_STATE_PRESENT && wu_result.state != g_pid) {
+            continue;
+        }
+        resultid = wu_result.resultid;
 
-        // make a copy of the WORKUNIT part,
-        // which we can modify without affecting the cache
+        // copy the fields of the WORKUNIT needed for the checks
+        // to a WORKUNIT we can modify without affecting the cache.
+        // The rest (e.g. xml_doc) is copied only if we send the job.
         //
-        WORKUNIT wu = wu_result.workunit;
+        wu_result.workunit.get(wu);
 
         // do fast (non-DB) checks.
         // This may modify wu.rsc_fpops_est
@@ -337,40 +348,46 @@ static bool scan_work_array() {
             continue;
         }
 
-        // mark wu_result as checked out and release semaphore.
-        // from here on in this loop, don't continue on failure;
-        // instead, goto dont_send (so that we reacquire semaphore)
+        // mark wu_result as checked out.
+        // If another scheduler got there first, move on.
+        // If the slot was refilled since we copied it, put it back.
         //
-        // Note: without the semaphore we don't have mutual exclusion;
+        // Note: we don't have mutual exclusion with the DB;
         // ideally we should use a transaction from now until when
         // we commit to sending the results.
+        //
+        if (wu_result.state != g_pid && !wu_result.claim(g_pid)) {
+            continue;
+        }
+        if (wu_result.resultid != resultid) {
+            wu_result.release(g_pid, WR_STATE_PRESENT);
+            continue;
+        }
 
-        wu_result.state = g_pid;
-        unlock_sema();
-
-        if (!slow_check(wu_result, app, bavp)) {
+        if (!slow_check(wu_result, wu, app, bavp)) {
             // if we couldn't send the result to this host,
             // set its state back to PRESENT
             //
-            wu_result.state = WR_STATE_PRESENT;
+            wu_result.release(g_pid, WR_STATE_PRESENT);
         } else {
-            // slow_check() refreshes fields of wu_result.workunit;
-            // update our copy too
+            // keep the summary fields that the checks may have changed
             //
-            wu.hr_class = wu_result.workunit.hr_class;
-            wu.app_version_id = wu_result.workunit.app_version_id;
+            WU_SUMMARY ws;
+            ws.set(wu);
 
             // mark slot as empty AFTER we've copied out of it
             // (since otherwise feeder might overwrite it)
             //
-            wu_result.state = WR_STATE_EMPTY;
+            wu_result.release(g_pid, WR_STATE_EMPTY);
+            ssp->slot_vacated(i);
 
-            // reread result from DB, make sure it's still unsent
+            // read the rest of the WORKUNIT from the DB,
+            // and reread result from DB, make sure it's still unsent
             // TODO: from here to end of add_result_to_reply()
             // (which updates the DB record) should be a transaction
             //
-            result.id = wu_result.resultid;
-            if (result_still_sendable(result, wu)) {
+            result.id = resultid;
+            if (!read_workunit(ws, wu) && result_still_sendable(result, wu)) {
                 retval = add_result_to_reply(result, wu, bavp, false);
 
                 // add_result_to_reply() fails only in pathological cases -
@@ -381,14 +398,31 @@ static bool scan_work_array() {
                 // and hopefully the problem won't happen twice.
             }
         }
-        lock_sema();
         if (!work_needed(false)) {
-            no_more_needed = true;
-            break;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool scan_work_array() {
+    int i, ibucket, last_retval=0;
+    int first = ssp->bucket_of_slot(rand() % ssp->max_wu_results);
+
+    for (i=0; i<ssp->nbuckets; i++) {
+        ibucket = (first+i) % ssp->nbuckets;
+        if (!bucket_usable(ssp->buckets[ibucket])) {
+            if (config.debug_array) {
+                log_messages.printf(MSG_NORMAL,
+                    "[array] skipping bucket %d (app %d)\n",
+                    ibucket, ssp->buckets[ibucket].appid
+                );
+            }
+            continue;
         }
+        if (scan_bucket(ibucket, last_retval)) return true;
     }
-    unlock_sema();
-    return no_more_needed;
+    return false;
 }
 
 // Send work by scanning the job array multiple times,
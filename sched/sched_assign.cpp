@@ -43,9 +43,9 @@ static int send_assigned_job(ASSIGNMENT& asg) {
     DB_WORKUNIT wu;
     char suffix[256], path[256], buf[256];
     const char *rtfpath;
-    static bool first=true;
+    static __thread bool first=true;
     static int seqno=0;
-    static R_RSA_PRIVATE_KEY key;
+    static __thread R_RSA_PRIVATE_KEY key;
     BEST_APP_VERSION* bavp;
                                  
     if (first) {
@@ -75,7 +75,7 @@ static int send_assigned_job(ASSIGNMENT& asg) {
     }
 
     rtfpath = config.project_path("%s", wu.result_template_file);
-    sprintf(suffix, "%d_%d_%d", getpid(), (int)time(0), seqno++);
+    sprintf(suffix, "%d_%d_%d", getpid(), (int)time(0), __sync_fetch_and_add(&seqno, 1));
     retval = create_result(
 		wu, const_cast<char*>(rtfpath), suffix, key, config, 0, 0
 	);
@@ -85,7 +85,7 @@ static int send_assigned_job(ASSIGNMENT& asg) {
         );
         return retval;
     }
-    int result_id = boinc_db.insert_id();
+    int result_id = thread_db()->insert_id();
     SCHED_DB_RESULT result;
     retval = result.lookup_id(result_id);
     add_result_to_reply(result, wu, bavp, false);
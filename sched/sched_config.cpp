@@ -203,6 +203,7 @@ int SCHED_CONFIG::parse(FILE* f) {
         if (xp.parse_bool("dont_store_success_stderr", dont_store_success_stderr)) continue;
         if (xp.parse_int("file_deletion_strategy", file_deletion_strategy)) continue;
         if (xp.parse_int("gpu_multiplier", gpu_multiplier)) continue;
+        if (xp.parse_bool("gzip_replies", gzip_replies)) continue;
         if (xp.parse_bool("ignore_delay_bound", ignore_delay_bound)) continue;
         if (xp.parse_bool("locality_scheduling", locality_scheduling)) continue;
         if (xp.parse_double("locality_scheduler_fraction", locality_scheduler_fraction)) continue;
@@ -376,7 +377,7 @@ static bool is_project_dir(const char* dir) {
 //      specified by a format string + args
 //
 const char *SCHED_CONFIG::project_path(const char *fmt, ...) {
-    static char path[1024];
+    static __thread char path[1024];
     va_list ap;
 
     if (!strlen(project_dir)) {
@@ -110,6 +110,8 @@ struct SCHED_CONFIG {
     int file_deletion_strategy;
         // select method of automatically deleting files from host
     int gpu_multiplier;             // mult is NCPUS + this*NGPUS
+    bool gzip_replies;
+        // compress scheduler replies if the client accepts gzip encoding
     bool ignore_delay_bound;
     bool locality_scheduling;
     double locality_scheduler_fraction;
@@ -590,7 +590,7 @@ bool JOB::get_score() {
     int retval;
 
     WU_RESULT& wu_result = ssp->wu_results[index];
-    wu = wu_result.workunit;
+    wu_result.workunit.get(wu);
     app = ssp->lookup_app(wu.appid);
 
     score = 0;
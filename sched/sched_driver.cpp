@@ -26,7 +26,19 @@
 //
 // Usage: sched_driver --nrequests N --reqs_per_second X
 //
-// Each request asks for a uniformly-distributed random amount of work.
+// With --reqs_per_second 0 requests are generated as fast as possible;
+// use this to measure scheduler throughput, e.g.
+// sched_driver --nrequests 1000 --reqs_per_second 0 | cgi --batch --threads 8
+// vs. the same without --threads.
+// The scheduler logs the number of requests it handled per second.
+//
+// To measure the cost of building large replies, ask for lots of work:
+// sched_driver --nrequests 1000 --reqs_per_second 0 --min_time 1e6 --max_time 1e6 | cgi --batch | wc -c
+// To measure compressed replies, set <gzip_replies> in config.xml
+// and run the scheduler with HTTP_ACCEPT_ENCODING=gzip in its environment.
+//
+// Each request asks for a uniformly-distributed random amount of work
+// (between --min_time and --max_time seconds; default 1).
 // The OS and CPU info is taken from the successive lines of a file of the form
 // | os_name | p_vendor | p_model |
 // Generate this file with a SQL query, trimming off the start and end.
@@ -140,6 +152,9 @@ void usage(char *name) {
         "Options: \n"
         "  --nrequests N                  Sets the total numberer of requests to N\n"
         "  --reqs_per_second X            Sets the number of requests per second to X\n"
+        "                                 (0: as fast as possible)\n"
+        "  --min_time X                   Request at least X seconds of work\n"
+        "  --max_time X                   Request at most X seconds of work\n"
         "  [ -h | --help ]                Show this help text.\n"
         "  [ -v | --version ]             Show version information\n",
         name, name
@@ -167,6 +182,22 @@ int main(int argc, char** argv) {
             }
             reqs_per_second = atof(argv[i]);
         }
+        else if (!strcmp(argv[i], "--min_time")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            min_time = atof(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--max_time")) {
+            if (!argv[++i]) {
+                fprintf(stderr, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            max_time = atof(argv[i]);
+        }
         else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
             usage(argv[0]);
             exit(0);
@@ -180,11 +211,13 @@ int main(int argc, char** argv) {
             exit(1);
         }
     }
+    if (max_time < min_time) max_time = min_time;
     read_hosts();
     double t1, t2, x;
     for (i=0; i<nrequests; i++) {
         t1 = dtime();
         make_request(i);
+        if (!reqs_per_second) continue;
         t2 = dtime();
         x = exponential(1./reqs_per_second);
         if (t2 - t1 < x) {
@@ -22,6 +22,13 @@
 // interest to you.  It won't do anything unless you create
 // (touch) the file 'debug_sched' in the project root directory.
 //
+// --threads N: handle up to N requests at once, in separate threads,
+// each with its own DB connection (from a DB_CONN_POOL).
+// All threads share the process's attachment to the feeder's shared memory.
+// This works with FastCGI (using the reentrant FCGX interface)
+// and with --batch (for measuring throughput with sched_driver).
+// It's Linux-only (slots in the job cache are reserved by thread ID),
+// and it doesn't support locality scheduling.
 
 #include "config.h"
 #include <cassert>
@@ -42,6 +49,10 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include "boinc_db.h"
 #include "parse.h"
@@ -75,9 +86,11 @@ bool use_files = false;     // use disk files for req/reply msgs (for debugging)
 
 GUI_URLS gui_urls;
 PROJECT_FILES project_files;
-key_t sema_key;
-int g_pid;
+__thread int g_pid;
 static bool db_opened=false;
+int nthreads = 0;
+static DB_CONN_POOL db_pool;
+static __thread char** request_envp = 0;
 SCHED_SHMEM* ssp = 0;
 bool batch = false;
 bool mark_jobs_done = false;
@@ -92,6 +105,7 @@ static void usage(char* p) {
         "  --mark_jobs_done   When send a job, also mark it as done.\n"
         "                     (for performance testing)\n"
         "  --debug_log        Write messages to the file 'debug_log'\n"
+        "  --threads N        Handle up to N requests at once\n"
         "  --simulator X      Start with simulated time X\n"
         "                     (only if compiled with GCL_SIMULATOR)\n"
         "  -h | --help        Show this help text\n"
@@ -182,6 +196,24 @@ static void send_message(const char* msg, int delay) {
 int open_database() {
     int retval;
 
+    if (nthreads) {
+        // this thread has its own connection from db_pool
+        //
+        retval = thread_db()->ping();
+        if (!retval) return 0;
+        log_messages.printf(MSG_CRITICAL,
+            "lost connection to database - trying to reconnect\n"
+        );
+        thread_db()->close();
+        retval = thread_db()->open(
+            config.db_name, config.db_host, config.db_user, config.db_passwd
+        );
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL, "can't open database\n");
+        }
+        return retval;
+    }
+
     if (db_opened) {
         retval = boinc_db.ping();
         if (retval) {
@@ -212,6 +244,7 @@ void sigterm_handler(int /*signo*/) {
     if (db_opened) {
         boinc_db.close();
     }
+    db_pool.close();
     log_messages.printf(MSG_CRITICAL,
         "Caught SIGTERM (sent by Apache); exiting\n"
     );
@@ -220,13 +253,20 @@ void sigterm_handler(int /*signo*/) {
     return;
 }
 
+const char* request_getenv(const char* name) {
+#ifdef _USING_FCGI_
+    if (request_envp) return FCGX_GetParam(name, request_envp);
+#endif
+    return getenv(name);
+}
+
 static void log_request_headers(int& length) {
-    char *cl=getenv("CONTENT_LENGTH");
-    char *ri=getenv("REMOTE_ADDR");
-    char *rm=getenv("REQUEST_METHOD");
-    char *ct=getenv("CONTENT_TYPE");
-    char *ha=getenv("HTTP_ACCEPT");
-    char *hu=getenv("HTTP_USER_AGENT");
+    const char *cl=request_getenv("CONTENT_LENGTH");
+    const char *ri=request_getenv("REMOTE_ADDR");
+    const char *rm=request_getenv("REQUEST_METHOD");
+    const char *ct=request_getenv("CONTENT_TYPE");
+    const char *ha=request_getenv("HTTP_ACCEPT");
+    const char *hu=request_getenv("HTTP_USER_AGENT");
 
     if (config.debug_request_details) {
         log_messages.printf(MSG_NORMAL,
@@ -290,9 +330,6 @@ void set_core_dump_size_limit() {
 #endif
 
 void attach_to_feeder_shmem() {
-    char path[256];
-    strncpy(path, config.project_dir, sizeof(path));
-    get_key(path, 'a', sema_key);
     int i, retval;
     void* p;
 
@@ -348,6 +385,204 @@ void attach_to_feeder_shmem() {
     }
 }
 
+// Code for --threads
+//
+// Each thread reserves job-cache slots by its kernel thread ID,
+// which (like a PID) the feeder can check for liveness in /proc.
+//
+static int get_thread_id() {
+#ifdef SYS_gettid
+    return (int)syscall(SYS_gettid);
+#else
+    return getpid();
+#endif
+}
+
+static char* code_sign_key;
+static pthread_mutex_t accept_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int nrequests_handled = 0;
+
+// handle a request that's in memory, and return the reply in a malloced buffer
+//
+static void handle_request_mem(
+    const char* req, size_t req_len, char*& reply, size_t& reply_len
+) {
+    reply = 0;
+    reply_len = 0;
+    if (!req_len) return;
+#ifdef _USING_FCGI_
+    FCGI_FILE* fin = FCGI_OpenFromFILE(fmemopen((void*)req, req_len, "r"));
+    FCGI_FILE* fout = FCGI_OpenFromFILE(open_memstream(&reply, &reply_len));
+#else
+    FILE* fin = fmemopen((void*)req, req_len, "r");
+    FILE* fout = open_memstream(&reply, &reply_len);
+#endif
+    if (!fin || !fout) {
+        log_messages.printf(MSG_CRITICAL, "can't open memory streams\n");
+        if (fin) fclose(fin);
+        if (fout) fclose(fout);
+        return;
+    }
+    handle_request(fin, fout, code_sign_key);
+    fclose(fin);
+    fclose(fout);
+    __sync_fetch_and_add(&nrequests_handled, 1);
+}
+
+static void start_thread(DB_CONN*& db) {
+    g_pid = get_thread_id();
+    mysql_thread_init();
+    db = db_pool.get();
+    set_thread_db(db);
+}
+
+static void end_thread(DB_CONN* db) {
+    set_thread_db(NULL);
+    db_pool.put(db);
+    mysql_thread_end();
+}
+
+#ifdef _USING_FCGI_
+
+static void* fcgi_thread(void*) {
+    FCGX_Request request;
+    DB_CONN* db;
+    std::string req;
+    char buf[4096];
+    char* reply;
+    size_t reply_len;
+    int n;
+
+    start_thread(db);
+    FCGX_InitRequest(&request, 0, 0);
+    while (1) {
+        pthread_mutex_lock(&accept_mutex);
+        int retval = FCGX_Accept_r(&request);
+        pthread_mutex_unlock(&accept_mutex);
+        if (retval < 0) break;
+        request_envp = request.envp;
+
+        if (check_stop_sched()) {
+            FCGX_FPrintF(request.out,
+                "Content-type: text/plain\n\n"
+                "<scheduler_reply>\n"
+                "    <message priority=\"low\">%s</message>\n"
+                "    <request_delay>%d</request_delay>\n"
+                "    <project_is_down/>\n"
+                "</scheduler_reply>\n",
+                "Project is temporarily shut down for maintenance", 3600
+            );
+        } else {
+            req.clear();
+            while ((n = FCGX_GetStr(buf, sizeof(buf), request.in)) > 0) {
+                req.append(buf, n);
+            }
+            handle_request_mem(req.c_str(), req.size(), reply, reply_len);
+            if (reply) {
+                FCGX_PutStr(reply, reply_len, request.out);
+                free(reply);
+            }
+        }
+        request_envp = 0;
+        FCGX_Finish_r(&request);
+    }
+    end_thread(db);
+    return 0;
+}
+
+#else
+
+// --batch --threads: read a sequence of requests from stdin
+// and hand them out to threads
+
+static bool get_batch_request(std::string& req) {
+    char buf[4096];
+    req.clear();
+    pthread_mutex_lock(&accept_mutex);
+    while (fgets(buf, sizeof(buf), stdin)) {
+        req += buf;
+        if (strstr(buf, "</scheduler_request>")) break;
+    }
+    pthread_mutex_unlock(&accept_mutex);
+    return req.size() > 0;
+}
+
+static void* batch_thread(void*) {
+    DB_CONN* db;
+    std::string req;
+    char* reply;
+    size_t reply_len;
+
+    start_thread(db);
+    while (get_batch_request(req)) {
+        handle_request_mem(req.c_str(), req.size(), reply, reply_len);
+        if (reply) {
+            pthread_mutex_lock(&output_mutex);
+            fwrite(reply, 1, reply_len, stdout);
+            fflush(stdout);
+            pthread_mutex_unlock(&output_mutex);
+            free(reply);
+        }
+    }
+    end_thread(db);
+    return 0;
+}
+
+#endif
+
+static void run_threads() {
+    int i, retval;
+    std::vector<pthread_t> threads;
+
+#ifndef SYS_gettid
+    log_messages.printf(MSG_CRITICAL, "--threads is not supported on this OS\n");
+    exit(1);
+#endif
+    if (config.locality_scheduling || config.locality_scheduler_fraction) {
+        log_messages.printf(MSG_CRITICAL,
+            "--threads can't be used with locality scheduling\n"
+        );
+        exit(1);
+    }
+    retval = db_pool.open(
+        nthreads, config.db_name, config.db_host, config.db_user, config.db_passwd
+    );
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't open %d DB connections: %s\n", nthreads, boincerror(retval)
+        );
+        send_message("Server can't open database", 3600);
+        exit(0);
+    }
+    attach_to_feeder_shmem();
+
+    double start = dtime();
+    for (i=0; i<nthreads; i++) {
+        pthread_t t;
+#ifdef _USING_FCGI_
+        retval = pthread_create(&t, NULL, fcgi_thread, NULL);
+#else
+        retval = pthread_create(&t, NULL, batch_thread, NULL);
+#endif
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL, "can't create thread\n");
+            exit(1);
+        }
+        threads.push_back(t);
+    }
+    for (i=0; i<nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = dtime() - start;
+    log_messages.printf(MSG_NORMAL,
+        "%d threads handled %d requests in %.2f sec (%.2f/sec)\n",
+        nthreads, nrequests_handled, elapsed,
+        elapsed>0?nrequests_handled/elapsed:0
+    );
+    db_pool.close();
+}
+
 int main(int argc, char** argv) {
 #ifndef _USING_FCGI_
     FILE* fin, *fout;
@@ -357,7 +592,6 @@ int main(int argc, char** argv) {
     int i, retval;
     char req_path[256], reply_path[256], path[256];
     unsigned int counter=0;
-    char* code_sign_key;
     int length=-1;
     log_messages.pid = getpid();
     bool debug_log = false;
@@ -370,6 +604,13 @@ int main(int argc, char** argv) {
             mark_jobs_done = true;
         } else if (!strcmp(argv[i], "--debug_log")) {
             debug_log = true;
+        } else if (!strcmp(argv[i], "--threads")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[i]);
 #ifdef GCL_SIMULATOR
         } else if (!strcmp(argv[i], "--simulator")) {
             if(!argv[++i]) {
@@ -477,6 +718,20 @@ int main(int argc, char** argv) {
 
 
     g_pid = getpid();
+
+    if (nthreads) {
+#ifndef _USING_FCGI_
+        if (!batch) {
+            log_messages.printf(MSG_CRITICAL,
+                "--threads requires FastCGI or --batch\n"
+            );
+            exit(1);
+        }
+#endif
+        run_threads();
+        exit(0);
+    }
+
 #ifdef _USING_FCGI_
     //while(FCGI_Accept() >= 0 && counter < MAX_FCGI_COUNT) {
     while(FCGI_Accept() >= 0) {
@@ -581,10 +836,18 @@ int main(int argc, char** argv) {
 #endif
 #ifndef _USING_FCGI_
     } else if (batch) {
+        double start = dtime();
+        int n = 0;
         while (!feof(stdin)) {
             handle_request(stdin, stdout, code_sign_key);
             fflush(stdout);
+            n++;
         }
+        double elapsed = dtime() - start;
+        log_messages.printf(MSG_NORMAL,
+            "handled %d requests in %.2f sec (%.2f/sec)\n",
+            n, elapsed, elapsed>0?n/elapsed:0
+        );
 #endif
     } else {
         handle_request(stdin, stdout, code_sign_key);
@@ -59,8 +59,9 @@
 
 extern GUI_URLS gui_urls;
 extern PROJECT_FILES project_files;
-extern key_t sema_key;
-extern int g_pid;
+extern __thread int g_pid;
+    // ID used to reserve job-cache slots:
+    // the PID, or with --threads the kernel thread ID
 extern SCHED_SHMEM* ssp;
 extern bool batch;
     // read sequences of requests from stdin (for testing)
@@ -69,5 +70,9 @@ extern bool mark_jobs_done;
     // (for debugging/testing)
 extern bool all_apps_use_hr;
 
+extern const char* request_getenv(const char*);
+    // like getenv(), but gets the FastCGI parameters
+    // of the request being handled by this thread
+
 extern int open_database();
 extern void debug_sched(const char *trigger);
@@ -34,15 +34,6 @@ bool SCHED_MSG_LOG::v_message_wanted(int kind) const {
     return ( kind <= debug_level );
 }
 
-void SCHED_MSG_LOG::set_indent_level(const int new_indent_level) {
-    if (new_indent_level < 0) indent_level = 0;
-    else if (new_indent_level > 39) indent_level = 39;
-    else indent_level = new_indent_level;
-
-    memset(spaces, ' ', sizeof(spaces));
-    spaces[indent_level] = 0;
-}
-
 #ifdef _USING_FCGI_
 
 SCHED_MSG_LOG::~SCHED_MSG_LOG() {
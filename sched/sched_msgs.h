@@ -34,7 +34,6 @@ public:
     enum { MSG_CRITICAL=1, MSG_NORMAL, MSG_DEBUG };
     SCHED_MSG_LOG(): MSG_LOG(stderr) { debug_level = MSG_NORMAL; }
     void set_debug_level(int new_level) { debug_level = new_level; }
-    void set_indent_level(const int new_indent_level);
 #ifdef _USING_FCGI_
     ~SCHED_MSG_LOG();
     void redirect(FCGI_FILE* f);
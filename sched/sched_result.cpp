@@ -244,10 +244,11 @@ int handle_results() {
         }
 
         if (srip->received_time) {
+            char buf[TIME_STRING_LEN];
             log_messages.printf(MSG_CRITICAL,
                 "[HOST#%d] [RESULT#%d] [WU#%d] already got result, at %s \n",
                 g_reply->host.id, srip->id, srip->workunitid,
-                time_to_string(srip->received_time)
+                time_to_string(srip->received_time, buf)
             );
             srip->id = 0;
             g_reply->result_acks.push_back(std::string(rp->name));
@@ -391,7 +392,7 @@ int handle_results() {
         if (retval) {
             log_messages.printf(MSG_CRITICAL,
                 "[HOST#%d] [RESULT#%d] [WU#%d] can't update result: %s\n",
-                g_reply->host.id, sri.id, sri.workunitid, boinc_db.error_string()
+                g_reply->host.id, sri.id, sri.workunitid, thread_db()->error_string()
             );
         } else {
             g_reply->result_acks.push_back(std::string(sri.name));
@@ -119,7 +119,8 @@ bool wu_is_infeasible_slow(
     }
 
     APP* app = ssp->lookup_app(wu_result.workunit.appid);
-    WORKUNIT wu = wu_result.workunit;
+    WORKUNIT wu;
+    wu_result.workunit.get(wu);
     if (app_hr_type(*app)) {
         if (already_sent_to_different_hr_class(wu, *app)) {
             if (config.debug_send) {
@@ -156,7 +157,7 @@ void JOB_SET::add_job(JOB& job) {
             est_time -= worst_job.est_time;
             disk_usage -= worst_job.disk_usage;
             jobs.pop_back();
-            ssp->wu_results[worst_job.index].state = WR_STATE_PRESENT;
+            ssp->wu_results[worst_job.index].release(g_pid, WR_STATE_PRESENT);
         } else {
             break;
         }
@@ -167,7 +168,7 @@ void JOB_SET::add_job(JOB& job) {
             est_time -= worst_job.est_time;
             disk_usage -= worst_job.disk_usage;
             jobs.pop_back();
-            ssp->wu_results[worst_job.index].state = WR_STATE_PRESENT;
+            ssp->wu_results[worst_job.index].release(g_pid, WR_STATE_PRESENT);
         } else {
             break;
         }
@@ -176,7 +177,7 @@ void JOB_SET::add_job(JOB& job) {
     if ((int)jobs.size() == max_jobs) {
         JOB& worst_job = jobs.back();
         jobs.pop_back();
-        ssp->wu_results[worst_job.index].state = WR_STATE_PRESENT;
+        ssp->wu_results[worst_job.index].release(g_pid, WR_STATE_PRESENT);
     }
 
     std::list<JOB>::iterator i = jobs.begin();
@@ -215,16 +216,20 @@ double JOB_SET::higher_score_disk_usage(double v) {
 
 void JOB_SET::send() {
     WORKUNIT wu;
+    WU_SUMMARY ws;
     SCHED_DB_RESULT result;
     int retval;
 
     std::list<JOB>::iterator i = jobs.begin();
     while (i != jobs.end()) {
         JOB& job = *(i++);
-        WU_RESULT wu_result = ssp->wu_results[job.index];
-        ssp->wu_results[job.index].state = WR_STATE_EMPTY;
-        wu = wu_result.workunit;
+        WU_RESULT& wu_result = ssp->wu_results[job.index];
+        ws = wu_result.workunit;
         result.id = wu_result.resultid;
+        wu_result.release(g_pid, WR_STATE_EMPTY);
+        ssp->slot_vacated(job.index);
+        retval = read_workunit(ws, wu);
+        if (retval) continue;
         retval = read_sendable_result(result);
         if (!retval) {
             add_result_to_reply(result, wu, job.bavp, false);
@@ -233,7 +238,9 @@ void JOB_SET::send() {
 }
 
 void send_work_matchmaker() {
-    int i, slots_locked=0, slots_nonempty=0;
+    int i, b, ibucket, first_bucket, slots_locked=0, slots_nonempty=0;
+    int slots_scanned=0, nbuckets_scanned=0;
+    bool done = false;
     JOB_SET jobs;
     int min_slots = config.mm_min_slots;
     if (!min_slots) min_slots = ssp->max_wu_results/2;
@@ -241,64 +248,86 @@ void send_work_matchmaker() {
     if (!max_slots) max_slots = ssp->max_wu_results;
     int max_locked = 10;
 
-    lock_sema();
-    i = rand() % ssp->max_wu_results;
+    first_bucket = ssp->bucket_of_slot(rand() % ssp->max_wu_results);
 
     // scan through the job cache, maintaining a JOB_SET of jobs
     // that we can send to this client, ordered by score.
+    // Scan only the buckets containing jobs we might send.
     //
-    for (int slots_scanned=0; slots_scanned<max_slots; slots_scanned++) {
-        i = (i+1) % ssp->max_wu_results;
-        WU_RESULT& wu_result = ssp->wu_results[i];
-        switch (wu_result.state) {
-        case WR_STATE_EMPTY:
-            continue;
-        case WR_STATE_PRESENT:
-            slots_nonempty++;
-            break;
-        default:
-            slots_nonempty++;
-            if (wu_result.state == g_pid) break;
-            slots_locked++;
-            continue;
-        }
+    for (b=0; b<ssp->nbuckets && !done; b++) {
+        ibucket = (first_bucket+b) % ssp->nbuckets;
+        JOB_BUCKET& bucket = ssp->buckets[ibucket];
+        if (!bucket_usable(bucket)) continue;
+        nbuckets_scanned++;
 
-        JOB job;
-        job.index = i;
+        i = bucket.first_slot + rand() % bucket.nslots;
+        for (int j=0; j<bucket.nslots; j++) {
+            if (slots_scanned++ >= max_slots) {
+                done = true;
+                break;
+            }
+            i = bucket.first_slot + (i + 1 - bucket.first_slot) % bucket.nslots;
+            WU_RESULT& wu_result = ssp->wu_results[i];
+            switch (wu_result.state) {
+            case WR_STATE_EMPTY:
+                continue;
+            case WR_STATE_PRESENT:
+                slots_nonempty++;
+                break;
+            default:
+                slots_nonempty++;
+                if (wu_result.state == g_pid) break;
+                slots_locked++;
+                continue;
+            }
 
-        // get score for this job, and skip it if it fails quick check.
-        // NOTE: the EDF check done in get_score()
-        // includes only in-progress jobs.
-        //
-        if (!job.get_score()) {
-            continue;
-        }
-        if (config.debug_send) {
-            log_messages.printf(MSG_NORMAL,
-                "[send] score for %s: %f\n", wu_result.workunit.name, job.score
-            );
-        }
+            JOB job;
+            job.index = i;
+            int resultid = wu_result.resultid;
 
-        if (job.score > jobs.lowest_score() || !jobs.request_satisfied()) {
-            ssp->wu_results[i].state = g_pid;
-            unlock_sema();
-            if (wu_is_infeasible_slow(wu_result, *g_request, *g_reply)) {
-                // if we can't use this job, put it back in pool
-                //
-                lock_sema();
-                ssp->wu_results[i].state = WR_STATE_PRESENT;
+            // get score for this job, and skip it if it fails quick check.
+            // NOTE: the EDF check done in get_score()
+            // includes only in-progress jobs.
+            //
+            if (!job.get_score()) {
                 continue;
             }
-            lock_sema();
-            jobs.add_job(job);
-        }
+            if (config.debug_send) {
+                log_messages.printf(MSG_NORMAL,
+                    "[send] score for %s: %f\n", wu_result.workunit.name, job.score
+                );
+            }
+
+            if (job.score > jobs.lowest_score() || !jobs.request_satisfied()) {
+                // reserve the job; if another scheduler got it first,
+                // or it was replaced since we scored it, move on
+                //
+                if (wu_result.state != g_pid && !wu_result.claim(g_pid)) {
+                    continue;
+                }
+                if (wu_result.resultid != resultid) {
+                    wu_result.release(g_pid, WR_STATE_PRESENT);
+                    continue;
+                }
+                if (wu_is_infeasible_slow(wu_result, *g_request, *g_reply)) {
+                    // if we can't use this job, put it back in pool
+                    //
+                    wu_result.release(g_pid, WR_STATE_PRESENT);
+                    continue;
+                }
+                jobs.add_job(job);
+            }
 
-        if (jobs.request_satisfied() && slots_scanned>=min_slots) break;
+            if (jobs.request_satisfied() && slots_scanned>=min_slots) {
+                done = true;
+                break;
+            }
+        }
     }
 
     if (slots_nonempty) {
         g_wreq->no_jobs_available = false;
-    } else {
+    } else if (nbuckets_scanned) {
         log_messages.printf(MSG_CRITICAL,
             "Job cache is empty - check feeder\n"
         );
@@ -306,8 +335,10 @@ void send_work_matchmaker() {
 
     // TODO: trim jobs from tail of list until we pass the EDF check
     //
+    // The slots of the jobs in the set are marked with our PID,
+    // so no other scheduler will touch them.
+    //
     jobs.send();
-    unlock_sema();
     if (slots_locked > max_locked) {
         log_messages.printf(MSG_CRITICAL,
             "Found too many locked slots (%d>%d) - increase array size\n",
@@ -315,4 +346,3 @@ void send_work_matchmaker() {
         );
     }
 }
-
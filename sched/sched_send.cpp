@@ -34,6 +34,7 @@
 #include "parse.h"
 #include "util.h"
 #include "str_util.h"
+#include "str_replace.h"
 #include "synch.h"
 
 #include "credit.h"
@@ -64,7 +65,7 @@ const double DEFAULT_RAM_SIZE = 64000000;
 
 void send_work_matchmaker();
 
-int preferred_app_message_index=0;
+__thread int preferred_app_message_index=0;
 
 const char* infeasible_string(int code) {
     switch (code) {
@@ -466,6 +467,67 @@ bool app_not_selected(WORKUNIT& wu) {
     return true;
 }
 
+// Return false if none of the jobs in the given job-cache bucket
+// could be sent in this request because of their app,
+// so that the scheduler doesn't have to scan the bucket.
+// This applies only the app-level checks
+// that the scheduling policy in use does for each job:
+// JOB::get_score() for send_work_matchmaker(),
+// quick_check() for send_work_old().
+//
+bool bucket_usable(JOB_BUCKET& bucket) {
+    unsigned int i, n;
+
+    if (bucket.nslots <= 0) return false;
+    if (!bucket.appid) return true;
+    APP* app = ssp->lookup_app(bucket.appid);
+    if (!app) return false;
+    n = g_wreq->preferred_apps.size();
+    if (config.matchmaker) {
+        if (app->beta && !config.distinct_beta_apps) {
+            return g_wreq->allow_beta_work;
+        }
+        if (g_wreq->allow_non_preferred_apps) return true;
+    } else {
+        if (g_wreq->beta_only) {
+            if (!app->beta) return false;
+        } else {
+            if (app->beta) return false;
+        }
+        if (!g_wreq->user_apps_only) return true;
+        if (g_wreq->beta_only && !config.distinct_beta_apps) return true;
+    }
+    if (n == 0) return true;
+    for (i=0; i<n; i++) {
+        if (g_wreq->preferred_apps[i].appid == bucket.appid) return true;
+    }
+    if (!config.matchmaker) {
+        g_wreq->no_allowed_apps_available = true;
+    }
+    return false;
+}
+
+// Read the WORKUNIT of a job-cache entry from the DB;
+// the cache has only its summary.
+// The summary fields are then taken from ws,
+// since the scheduler may have changed them (e.g. rsc_fpops_est).
+//
+int read_workunit(WU_SUMMARY& ws, WORKUNIT& wu) {
+    DB_WORKUNIT dbwu;
+    int retval;
+
+    retval = dbwu.lookup_id(ws.id);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't read [WU#%d %s]: %s\n", ws.id, ws.name, boincerror(retval)
+        );
+        return retval;
+    }
+    wu = dbwu;
+    ws.update(wu);
+    return 0;
+}
+
 // see how much RAM we can use on this machine
 //
 static inline void get_mem_sizes() {
@@ -786,40 +848,21 @@ int wu_is_infeasible_fast(
     return retval;
 }
 
-// insert "text" right after "after" in the given buffer
+// get the elements to add to WU's xml_doc
+// when we send it to a client
 //
-static int insert_after(char* buffer, const char* after, const char* text) {
-    char* p;
-    char temp[BLOB_SIZE];
+static void get_wu_tags(
+    WORKUNIT& wu, APP& app, BEST_APP_VERSION* bavp, char* buf
+) {
+    double rsc_fpops_est = wu.rsc_fpops_est;
+    double rsc_fpops_bound = wu.rsc_fpops_bound;
 
-    if (strlen(buffer) + strlen(text) >= BLOB_SIZE-1) {
-        log_messages.printf(MSG_CRITICAL,
-            "insert_after: overflow: %d %d\n",
-            (int)strlen(buffer),
-            (int)strlen(text)
-        );
-        return ERR_BUFFER_OVERFLOW;
-    }
-    p = strstr(buffer, after);
-    if (!p) {
-        log_messages.printf(MSG_CRITICAL,
-            "insert_after: %s not found in %s\n", after, buffer
-        );
-        return ERR_XML_PARSE;
+    // adjust FPOPS figures for anonymous platform
+    //
+    if (bavp->cavp) {
+        rsc_fpops_est *= bavp->cavp->rsc_fpops_scale;
+        rsc_fpops_bound *= bavp->cavp->rsc_fpops_scale;
     }
-    p += strlen(after);
-    strcpy(temp, p);
-    strcpy(p, text);
-    strcat(p, temp);
-    return 0;
-}
-
-// add elements to WU's xml_doc,
-// in preparation for sending it to a client
-//
-static int insert_wu_tags(WORKUNIT& wu, APP& app) {
-    char buf[BLOB_SIZE];
-
     sprintf(buf,
         "    <rsc_fpops_est>%f</rsc_fpops_est>\n"
         "    <rsc_fpops_bound>%f</rsc_fpops_bound>\n"
@@ -827,14 +870,13 @@ static int insert_wu_tags(WORKUNIT& wu, APP& app) {
         "    <rsc_disk_bound>%f</rsc_disk_bound>\n"
         "    <name>%s</name>\n"
         "    <app_name>%s</app_name>\n",
-        wu.rsc_fpops_est,
-        wu.rsc_fpops_bound,
+        rsc_fpops_est,
+        rsc_fpops_bound,
         wu.rsc_memory_bound,
         wu.rsc_disk_bound,
         wu.name,
         app.name
     );
-    return insert_after(wu.xml_doc, "<workunit>\n", buf);
 }
 
 // Add the given workunit, app, and app version to a reply.
@@ -843,7 +885,7 @@ static int add_wu_to_reply(
     WORKUNIT& wu, SCHEDULER_REPLY&, APP* app, BEST_APP_VERSION* bavp
 ) {
     int retval;
-    WORKUNIT wu2, wu3;
+    char buf[4096];
 
     APP_VERSION* avp = bavp->avp;
 
@@ -870,58 +912,28 @@ static int add_wu_to_reply(
         }
     }
 
-    // modify the WU's xml_doc; add <name>, <rsc_*> etc.
+    // add the WU, with <name>, <rsc_*> etc. added to its xml_doc
     //
-    wu2 = wu;       // make copy since we're going to modify its XML field
-
-    // adjust FPOPS figures for anonymous platform
-    //
-    if (bavp->cavp) {
-        wu2.rsc_fpops_est *= bavp->cavp->rsc_fpops_scale;
-        wu2.rsc_fpops_bound *= bavp->cavp->rsc_fpops_scale;
+    get_wu_tags(wu, *app, bavp, buf);
+    if (strlen(config.replace_download_url_by_timezone)) {
+        WORKUNIT wu2 = wu;
+        process_wu_timezone(wu, wu2);
+        retval = g_reply->insert_workunit_unique(wu2, buf);
+    } else {
+        retval = g_reply->insert_workunit_unique(wu, buf);
     }
-    retval = insert_wu_tags(wu2, *app);
     if (retval) {
         log_messages.printf(MSG_CRITICAL,
-            "insert_wu_tags failed: %s\n", boincerror(retval)
+            "insert_workunit_unique failed: %s\n", boincerror(retval)
         );
         return retval;
     }
-    wu3 = wu2;
-    if (strlen(config.replace_download_url_by_timezone)) {
-        process_wu_timezone(wu2, wu3);
-    }
-
-    g_reply->insert_workunit_unique(wu3);
 
     // switch to tighter policy for estimating delay
     //
     return 0;
 }
 
-// add <name> tags to result's xml_doc_in
-//
-static int insert_name_tags(RESULT& result, WORKUNIT const& wu) {
-    char buf[256];
-    int retval;
-
-    sprintf(buf, "<name>%s</name>\n", result.name);
-    retval = insert_after(result.xml_doc_in, "<result>\n", buf);
-    if (retval) return retval;
-    sprintf(buf, "<wu_name>%s</wu_name>\n", wu.name);
-    retval = insert_after(result.xml_doc_in, "<result>\n", buf);
-    if (retval) return retval;
-    return 0;
-}
-
-static int insert_deadline_tag(RESULT& result) {
-    char buf[256];
-    sprintf(buf, "<report_deadline>%d</report_deadline>\n", result.report_deadline);
-    int retval = insert_after(result.xml_doc_in, "<result>\n", buf);
-    if (retval) return retval;
-    return 0;
-}
-
 // update workunit fields when send an instance of it:
 // - transition time
 // - app_version_id, if app uses homogeneous app version
@@ -965,7 +977,7 @@ int update_wu_on_send(WORKUNIT wu, time_t x, APP& app, BEST_APP_VERSION& bav) {
     }
     retval = dbwu.update_field(buf, strlen(where_clause)?where_clause:NULL);
     if (retval) return retval;
-    if (boinc_db.affected_rows() != 1) {
+    if (thread_db()->affected_rows() != 1) {
         return ERR_DB_NOT_FOUND;
     }
     return 0;
@@ -983,14 +995,6 @@ bool wu_already_in_reply(WORKUNIT& wu) {
     return false;
 }
 
-void lock_sema() {
-    lock_semaphore(sema_key);
-}
-
-void unlock_sema() {
-    unlock_semaphore(sema_key);
-}
-
 static inline bool have_cpu_apps() {
     if (g_wreq->anonymous_platform) {
         return g_wreq->have_cpu_apps;
@@ -1235,24 +1239,17 @@ int add_result_to_reply(
         );
     }
 
-    // The following overwrites the result's xml_doc field.
-    // But that's OK cuz we're done with DB updates
+    // The result's <name>, <wu_name> and <report_deadline> elements
+    // are added when the reply is written (see write_to_client())
     //
-    retval = insert_name_tags(result, wu);
-    if (retval) {
+    if (!strstr(result.xml_doc_in, "<result>\n")) {
         log_messages.printf(MSG_CRITICAL,
-            "add_result_to_reply: can't insert name tags: %d\n",
-            retval
+            "add_result_to_reply: no <result> in [RESULT#%d] xml_doc_in\n",
+            result.id
         );
-        return retval;
-    }
-    retval = insert_deadline_tag(result);
-    if (retval) {
-        log_messages.printf(MSG_CRITICAL,
-            "add_result_to_reply: can't insert deadline tag: %s\n", boincerror(retval)
-        );
-        return retval;
+        return ERR_XML_PARSE;
     }
+    safe_strcpy(result.wu_name, wu.name);
     result.bav = *bavp;
     g_reply->insert_result(result);
     if (g_wreq->rsc_spec_request) {
@@ -22,6 +22,7 @@
 
 #include "boinc_db.h"
 #include "sched_types.h"
+#include "sched_shmem.h"
 
 extern void send_work();
 
@@ -64,14 +65,14 @@ extern double estimate_duration(WORKUNIT& wu, BEST_APP_VERSION&);
 
 extern int update_wu_on_send(WORKUNIT wu, time_t x, APP&, BEST_APP_VERSION&);
 
-extern void lock_sema();
-extern void unlock_sema();
 extern const char* infeasible_string(int);
 extern bool app_not_selected(WORKUNIT&);
+extern bool bucket_usable(JOB_BUCKET&);
+extern int read_workunit(WU_SUMMARY&, WORKUNIT&);
 extern bool work_needed(bool);
 extern void send_work_setup();
 extern int effective_ncpus();
-extern int preferred_app_message_index;
+extern __thread int preferred_app_message_index;
 extern void update_n_jobs_today();
 
 #endif
@@ -20,16 +20,23 @@
 // and instances of the scheduling server
 
 #include "config.h"
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <string>
 #include <vector>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 using std::vector;
 
 #include "boinc_db.h"
 #include "error_numbers.h"
+#include "util.h"
 
 #ifdef _USING_FCGI_
 #include "boinc_fcgi.h"
@@ -40,8 +47,56 @@ using std::vector;
 #include "sched_msgs.h"
 
 
+void WU_SUMMARY::set(WORKUNIT& wu) {
+    id = wu.id;
+    appid = wu.appid;
+    batch = wu.batch;
+    hr_class = wu.hr_class;
+    app_version_id = wu.app_version_id;
+    delay_bound = wu.delay_bound;
+    rsc_fpops_est = wu.rsc_fpops_est;
+    rsc_fpops_bound = wu.rsc_fpops_bound;
+    rsc_memory_bound = wu.rsc_memory_bound;
+    rsc_disk_bound = wu.rsc_disk_bound;
+    rsc_bandwidth_bound = wu.rsc_bandwidth_bound;
+    strcpy(name, wu.name);
+}
+
+// Zero the other fields, so that code that uses one by mistake
+// doesn't see a previous job's value or garbage.
+// Don't clear all of xml_doc; that would cost more than the copy.
+//
+void WU_SUMMARY::get(WORKUNIT& wu) {
+    size_t doc_start = offsetof(WORKUNIT, xml_doc);
+    size_t doc_end = doc_start + sizeof(wu.xml_doc);
+    memset(&wu, 0, doc_start);
+    wu.xml_doc[0] = 0;
+    memset((char*)&wu + doc_end, 0, sizeof(WORKUNIT) - doc_end);
+    update(wu);
+}
+
+void WU_SUMMARY::update(WORKUNIT& wu) {
+    wu.id = id;
+    wu.appid = appid;
+    wu.batch = batch;
+    wu.hr_class = hr_class;
+    wu.app_version_id = app_version_id;
+    wu.delay_bound = delay_bound;
+    wu.rsc_fpops_est = rsc_fpops_est;
+    wu.rsc_fpops_bound = rsc_fpops_bound;
+    wu.rsc_memory_bound = rsc_memory_bound;
+    wu.rsc_disk_bound = rsc_disk_bound;
+    wu.rsc_bandwidth_bound = rsc_bandwidth_bound;
+    strcpy(wu.name, name);
+}
+
+int SCHED_SHMEM::size(int nwu_results) {
+    return sizeof(SCHED_SHMEM) + nwu_results*sizeof(WU_RESULT);
+}
+
 void SCHED_SHMEM::init(int nwu_results) {
-    int size = sizeof(SCHED_SHMEM) + nwu_results*sizeof(WU_RESULT);
+    int size = SCHED_SHMEM::size(nwu_results);
+
     memset(this, 0, size);
     ss_size = size;
     platform_size = sizeof(PLATFORM);
@@ -54,6 +109,14 @@ void SCHED_SHMEM::init(int nwu_results) {
     max_app_versions = MAX_APP_VERSIONS;
     max_assignments = MAX_ASSIGNMENTS;
     max_wu_results = nwu_results;
+    max_job_buckets = MAX_JOB_BUCKETS;
+
+    // until the feeder says otherwise, one bucket holds all jobs
+    //
+    nbuckets = 1;
+    buckets[0].appid = 0;
+    buckets[0].first_slot = 0;
+    buckets[0].nslots = nwu_results;
 }
 
 static int error_return(const char* p) {
@@ -62,8 +125,7 @@ static int error_return(const char* p) {
 }
 
 int SCHED_SHMEM::verify() {
-    int size = sizeof(SCHED_SHMEM) + max_wu_results*sizeof(WU_RESULT);
-    if (ss_size != size) return error_return("shmem");
+    if (ss_size != SCHED_SHMEM::size(max_wu_results)) return error_return("shmem");
     if (platform_size != sizeof(PLATFORM)) return error_return("platform");
     if (app_size != sizeof(APP)) return error_return("app");
     if (app_version_size != sizeof(APP_VERSION)) return error_return("app_version");
@@ -73,6 +135,7 @@ int SCHED_SHMEM::verify() {
     if (max_apps != MAX_APPS) return error_return("max apps");
     if (max_app_versions != MAX_APP_VERSIONS) return error_return("max app versions");
     if (max_assignments != MAX_ASSIGNMENTS) return error_return("max assignments");
+    if (max_job_buckets != MAX_JOB_BUCKETS) return error_return("max job buckets");
     return 0;
 }
 
@@ -236,6 +299,18 @@ APP_VERSION* SCHED_SHMEM::lookup_app_version(int id) {
     return NULL;
 }
 
+// return the index of the bucket containing the given slot
+//
+int SCHED_SHMEM::bucket_of_slot(int slot) {
+    for (int i=0; i<nbuckets; i++) {
+        JOB_BUCKET& b = buckets[i];
+        if (slot >= b.first_slot && slot < b.first_slot + b.nslots) {
+            return i;
+        }
+    }
+    return 0;
+}
+
 // see if there's any work.
 // If there is, reserve it for this process
 // (if we don't do this, there's a race condition where lots
@@ -244,8 +319,8 @@ APP_VERSION* SCHED_SHMEM::lookup_app_version(int id) {
 bool SCHED_SHMEM::no_work(int pid) {
     if (!ready) return true;
     for (int i=0; i<max_wu_results; i++) {
-        if (wu_results[i].state == WR_STATE_PRESENT) {
-            wu_results[i].state = pid;
+        if (wu_results[i].state != WR_STATE_PRESENT) continue;
+        if (wu_results[i].claim(pid)) {
             return false;
         }
     }
@@ -254,13 +329,86 @@ bool SCHED_SHMEM::no_work(int pid) {
 
 void SCHED_SHMEM::restore_work(int pid) {
     for (int i=0; i<max_wu_results; i++) {
-        if (wu_results[i].state == pid) {
-            wu_results[i].state = WR_STATE_PRESENT;
+        if (wu_results[i].release(pid, WR_STATE_PRESENT)) {
             return;
         }
     }
 }
 
+// A scheduler calls this after emptying a slot (i.e. sending its job).
+// Record the slot,
+// and wake up the feeder if it's waiting for this many slots to be emptied.
+//
+void SCHED_SHMEM::slot_vacated(int slot) {
+    int n = __sync_add_and_fetch(&nvacated, 1);
+    vacated_slots[(unsigned int)(n-1) % MAX_VACATED_SLOTS] = slot;
+    __sync_synchronize();
+    if (!feeder_waiting || n - feeder_wake_at < 0) return;
+#if defined(__linux__) && defined(SYS_futex)
+    syscall(SYS_futex, &nvacated, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+}
+
+// The feeder calls this when the job array is full.
+// Wait until schedulers have emptied n slots since nvacated was old_nvacated,
+// or until timeout seconds have passed.
+// Return true if any slots were emptied.
+//
+// On Linux we wait on a futex (nvacated) in the shared-memory segment;
+// elsewhere we just sleep.
+//
+bool SCHED_SHMEM::wait_for_vacated(int old_nvacated, int n, double timeout) {
+#if defined(__linux__) && defined(SYS_futex)
+    double deadline = dtime() + timeout;
+    feeder_wake_at = old_nvacated + n;
+    feeder_waiting = 1;
+
+    // make sure a scheduler that increments nvacated after this point
+    // sees feeder_waiting.
+    // If one increments it before, the futex wait returns immediately.
+    //
+    __sync_synchronize();
+    while (1) {
+        int cur = nvacated;
+        if (cur - feeder_wake_at >= 0) break;
+        double left = deadline - dtime();
+        if (left <= 0) break;
+        struct timespec ts;
+        ts.tv_sec = (time_t)left;
+        ts.tv_nsec = (long)((left - ts.tv_sec)*1e9);
+        syscall(SYS_futex, &nvacated, FUTEX_WAIT, cur, &ts, NULL, 0);
+    }
+    feeder_waiting = 0;
+#else
+    if (nvacated - old_nvacated < n) {
+        boinc_sleep(timeout);
+    }
+#endif
+    return nvacated != old_nvacated;
+}
+
+// Get the slots emptied since nvacated was old_nvacated,
+// and advance old_nvacated.
+// A scheduler may not have recorded the slot it just emptied yet,
+// so the caller should treat these as hints (check that they're empty)
+// and scan the whole array now and then.
+// Return false if more slots were emptied than we keep track of.
+//
+bool SCHED_SHMEM::get_vacated_slots(int& old_nvacated, vector<int>& slots) {
+    int n = nvacated;
+    __sync_synchronize();
+    slots.clear();
+    if (n - old_nvacated > MAX_VACATED_SLOTS) {
+        old_nvacated = n;
+        return false;
+    }
+    for (int i=old_nvacated; i-n < 0; i++) {
+        slots.push_back(vacated_slots[(unsigned int)i % MAX_VACATED_SLOTS]);
+    }
+    old_nvacated = n;
+    return true;
+}
+
 void SCHED_SHMEM::show(FILE* f) {
     fprintf(f, "app versions:\n");
     for (int i=0; i<napp_versions; i++) {
@@ -288,6 +436,14 @@ void SCHED_SHMEM::show(FILE* f) {
     );
     fprintf(f, "ready: %d\n", ready);
     fprintf(f, "max_wu_results: %d\n", max_wu_results);
+    fprintf(f, "slots vacated: %d\n", nvacated);
+    fprintf(f, "buckets: %d\n", nbuckets);
+    for (int i=0; i<nbuckets; i++) {
+        JOB_BUCKET& b = buckets[i];
+        fprintf(f, "  bucket %d: appid %d slots %d-%d\n",
+            i, b.appid, b.first_slot, b.first_slot + b.nslots - 1
+        );
+    }
     for (int i=0; i<max_wu_results; i++) {
         WU_RESULT& wu_result = wu_results[i];
         switch(wu_result.state) {
@@ -36,11 +36,25 @@
 #define MAX_APP_VERSIONS    50
 #define MAX_ASSIGNMENTS     10
 
+// The job array is divided into buckets,
+// each a contiguous range of slots holding jobs for one app
+// (or for all apps, if the feeder isn't run with --allapps).
+// A scheduler scans only the buckets it can use.
+//
+#define MAX_JOB_BUCKETS     MAX_APPS
+
+// Schedulers record the slots they empty in a ring buffer of this size,
+// so that the feeder can refill them without scanning the array.
+// Must be a power of 2.
+//
+#define MAX_VACATED_SLOTS   1024
+
 // Default number of work items in shared mem.
-// You can configure this in config.xml (<shmem_work_items>)
-// If you increase this above 100,
-// you may exceed the max shared-memory segment size
-// on some operating systems.
+// You can configure this in config.xml (<shmem_work_items>).
+// Schedulers don't lock the array, so a bigger one doesn't add contention.
+// Each item takes about 400 bytes (a WU_RESULT),
+// on top of about 13MB for the rest of the segment,
+// so the array can hold tens of thousands of jobs.
 //
 #define MAX_WU_RESULTS      100
 
@@ -49,23 +63,89 @@
 #define WR_STATE_PRESENT 1
 // If neither of the above, the value is the PID of a scheduler process
 // that has this item reserved
+//
+// State changes are done with atomic compare-and-swap,
+// so schedulers don't need a semaphore to reserve slots:
+// - a scheduler reserves a PRESENT slot by setting it to its PID (claim()),
+//   and gives it up by setting it to PRESENT or EMPTY (release()).
+//   Since the slot may have been sent and refilled between
+//   when the scheduler examined it and when it claimed it,
+//   the scheduler must check the result ID after claiming.
+// - the feeder fills in an EMPTY slot, then sets it to PRESENT (publish()).
+// - the feeder returns slots reserved by processes
+//   that no longer exist to PRESENT (release() on their behalf).
+
+// The fields of a WORKUNIT needed to decide whether to send a job
+// (quick_check(), wu_is_infeasible_fast(), JOB::get_score()).
+// Only these are kept in shared memory;
+// schedulers read the rest of the WORKUNIT (e.g. its 64KB xml_doc)
+// from the DB when they send the job (read_workunit()).
+// If your wu_is_infeasible_custom() uses other WORKUNIT fields,
+// add them here.
+//
+struct WU_SUMMARY {
+    int id;
+    int appid;
+    int batch;
+    int hr_class;
+    int app_version_id;
+    int delay_bound;
+    double rsc_fpops_est;
+    double rsc_fpops_bound;
+    double rsc_memory_bound;
+    double rsc_disk_bound;
+    double rsc_bandwidth_bound;
+    char name[256];
+
+    void set(WORKUNIT&);
+        // copy these fields from a WORKUNIT
+    void get(WORKUNIT&);
+        // copy these fields to a WORKUNIT, and zero the others
+    void update(WORKUNIT&);
+        // copy these fields to a WORKUNIT, leaving the others alone
+};
 
 // a workunit/result pair
 struct WU_RESULT {
     int state;
         // EMPTY, PRESENT, or PID of locking process
+        // Change only with the functions below
     int infeasible_count;
     bool need_reliable;        // try to send to a reliable host
-    WORKUNIT workunit;
     int resultid;
     int time_added_to_shared_memory;
     int res_priority;
     int res_server_state;
     double res_report_deadline;
     double fpops_size;      // measured in stdevs
+    WU_SUMMARY workunit;
+
+    inline bool change_state(int old_state, int new_state) {
+        return __sync_bool_compare_and_swap(&state, old_state, new_state);
+    }
+    inline bool claim(int pid) {
+        return change_state(WR_STATE_PRESENT, pid);
+    }
+    inline bool release(int pid, int new_state) {
+        return change_state(pid, new_state);
+    }
+    inline void publish() {
+        __sync_synchronize();
+        state = WR_STATE_PRESENT;
+    }
 };
 
-// this struct is followed in memory by an array of WU_RESULTS
+// A range of job slots.
+// Buckets aren't locked;
+// schedulers claim individual slots (WU_RESULT::claim()).
+//
+struct JOB_BUCKET {
+    int appid;              // zero if jobs for any app
+    int first_slot;         // index of first slot in wu_results[]
+    int nslots;
+};
+
+// this struct is followed in memory by an array of WU_RESULTs
 //
 struct SCHED_SHMEM {
     bool ready;             // feeder sets to true when init done
@@ -87,6 +167,20 @@ struct SCHED_SHMEM {
     int max_app_versions;
     int max_assignments;
     int max_wu_results;
+    int max_job_buckets;
+    int nbuckets;
+    int nvacated;
+        // number of slots emptied by schedulers (mod 2^32).
+        // Change only with slot_vacated().
+        // The feeder waits for this to change (wait_for_vacated())
+        // rather than sleeping for a fixed interval.
+    int feeder_waiting;
+        // nonzero if the feeder is in wait_for_vacated()
+    int feeder_wake_at;
+        // if so, the value of nvacated at which to wake it up
+    int vacated_slots[MAX_VACATED_SLOTS];
+        // the slot emptied by the n'th call to slot_vacated()
+        // is vacated_slots[n % MAX_VACATED_SLOTS]
     bool have_cpu_apps;
     bool have_cuda_apps;
     bool have_ati_apps;
@@ -95,13 +189,19 @@ struct SCHED_SHMEM {
     APP apps[MAX_APPS];
     APP_VERSION app_versions[MAX_APP_VERSIONS];
     ASSIGNMENT assignments[MAX_ASSIGNMENTS];
+    JOB_BUCKET buckets[MAX_JOB_BUCKETS];
     WU_RESULT wu_results[0];
 
+    static int size(int nwu_results);
+        // size of the shared-mem segment
     void init(int nwu_results);
     int verify();
     int scan_tables();
     bool no_work(int pid);
     void restore_work(int pid);
+    void slot_vacated(int slot);
+    bool wait_for_vacated(int old_nvacated, int n, double timeout);
+    bool get_vacated_slots(int& old_nvacated, std::vector<int>& slots);
 #ifndef _USING_FCGI_
     void show(FILE*);
 #else
@@ -113,6 +213,8 @@ struct SCHED_SHMEM {
     APP_VERSION* lookup_app_version(int);
     PLATFORM* lookup_platform_id(int);
     PLATFORM* lookup_platform(char*);
+    int bucket_of_slot(int);
 };
 
+
 #endif
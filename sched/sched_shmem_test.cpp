@@ -0,0 +1,343 @@
+// This file is part of BOINC.
+// http://boinc.berkeley.edu
+// Copyright (C) 2012 University of California
+//
+// BOINC is free software; you can redistribute it and/or modify it
+// under the terms of the GNU Lesser General Public License
+// as published by the Free Software Foundation,
+// either version 3 of the License, or (at your option) any later version.
+//
+// BOINC is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+// See the GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with BOINC.  If not, see <http://www.gnu.org/licenses/>.
+
+// sched_shmem_test: measure contention for the scheduler's job cache.
+// Doesn't use the project's DB or shared memory.
+//
+// Creates a private SCHED_SHMEM and forks a simulated feeder,
+// which keeps the job array filled
+// (waiting for schedulers to vacate slots when it's full,
+// and then refilling just those slots, as the feeder does),
+// and N simulated schedulers, each of which repeatedly
+// scans the array from a random point and takes one job.
+//
+// With --scan, instead measures the time to scan the job array:
+// fills it, then repeatedly copies the WORKUNIT fields of each slot
+// the way scan_work_array() does.
+//
+// Usage: sched_shmem_test [options]
+//  [ --nsched N ]      number of scheduler processes (default 8)
+//  [ --nslots N ]      number of job slots (default 100)
+//  [ --duration X ]    run for X seconds (default 10)
+//  [ --refill_batch N ] when the array is full, the feeder waits
+//                      until N slots are vacated (default 1)
+//  [ --sema ]          reserve slots while holding a semaphore,
+//                      as schedulers did before slots were claimed
+//                      with compare-and-swap
+//  [ --scan N ]        scan the array N times
+//  [ --full_copy ]     with --scan, copy a full WORKUNIT for each slot,
+//                      as schedulers did when slots held full WORKUNITs
+
+#include "config.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "synch.h"
+#include "util.h"
+
+#include "sched_shmem.h"
+
+using std::vector;
+
+#define SEMA_KEY    0xbeefcafe
+
+struct COUNTS {
+    double requests;
+    double jobs_sent;
+    double claim_failures;
+    double slots_scanned;
+    double busy_time;
+};
+
+struct CONTROL {
+    bool stop;
+    COUNTS feeder;
+    COUNTS sched[1];
+};
+
+SCHED_SHMEM* ssp;
+CONTROL* control;
+bool use_sema = false;
+int refill_batch = 1;
+bool full_copy = false;
+WORKUNIT scan_wu;
+
+int next_resultid = 1;
+
+// fill the given slot if it's empty; return true if we did
+//
+bool fill_slot(int i, COUNTS& counts) {
+    WU_RESULT& wr = ssp->wu_results[i];
+    counts.slots_scanned++;
+    if (wr.state != WR_STATE_EMPTY) return false;
+    wr.resultid = next_resultid++;
+    scan_wu.id = wr.resultid;
+    wr.workunit.set(scan_wu);
+    wr.infeasible_count = 0;
+    wr.time_added_to_shared_memory = time(0);
+    wr.publish();
+    return true;
+}
+
+// keep the array full of jobs.
+// Scan the whole array only if we lost track of the vacated slots,
+// or if waiting for them timed out.
+//
+void feeder(COUNTS& counts) {
+    int i, nvacated = 0;
+    bool full_scan = true;
+    vector<int> slots;
+
+    while (!control->stop) {
+        int nadded = 0;
+        if (full_scan) {
+            nvacated = ssp->nvacated;
+            for (i=0; i<ssp->max_wu_results; i++) {
+                if (fill_slot(i, counts)) nadded++;
+            }
+        } else if (ssp->get_vacated_slots(nvacated, slots)) {
+            for (i=0; i<(int)slots.size(); i++) {
+                if (fill_slot(slots[i], counts)) nadded++;
+            }
+        }
+        counts.jobs_sent += nadded;
+        full_scan = !ssp->wait_for_vacated(nvacated, refill_batch, .1);
+    }
+}
+
+// take one job from the array, the way scan_work_array() does
+//
+bool get_job(int pid, COUNTS& counts) {
+    int n = ssp->max_wu_results;
+    int off = rand() % n;
+    bool found = false;
+
+    if (use_sema) lock_semaphore(SEMA_KEY);
+    for (int j=0; j<n; j++) {
+        WU_RESULT& wr = ssp->wu_results[(j+off)%n];
+        counts.slots_scanned++;
+        if (wr.state != WR_STATE_PRESENT) continue;
+        if (use_sema) {
+            wr.state = pid;
+            unlock_semaphore(SEMA_KEY);
+            lock_semaphore(SEMA_KEY);
+            wr.state = WR_STATE_EMPTY;
+            ssp->slot_vacated((j+off)%n);
+            found = true;
+            break;
+        }
+        int resultid = wr.resultid;
+        if (!wr.claim(pid)) {
+            counts.claim_failures++;
+            continue;
+        }
+        if (wr.resultid != resultid) {
+            wr.release(pid, WR_STATE_PRESENT);
+            counts.claim_failures++;
+            continue;
+        }
+        wr.release(pid, WR_STATE_EMPTY);
+        ssp->slot_vacated((j+off)%n);
+        found = true;
+        break;
+    }
+    if (use_sema) unlock_semaphore(SEMA_KEY);
+    return found;
+}
+
+void scheduler(COUNTS& counts) {
+    int pid = getpid();
+    srand(pid);
+    while (!control->stop) {
+        double t = dtime();
+        if (get_job(pid, counts)) counts.jobs_sent++;
+        counts.busy_time += dtime() - t;
+        counts.requests++;
+    }
+}
+
+// fill the array, then scan it nscans times
+//
+void scan_test(int nscans) {
+    int i, j, n = ssp->max_wu_results;
+    double x = 0;
+    WORKUNIT* full_wus = 0;
+
+    if (full_copy) {
+        full_wus = (WORKUNIT*)calloc(n, sizeof(WORKUNIT));
+        if (!full_wus) {
+            perror("calloc");
+            exit(1);
+        }
+    }
+    scan_wu.clear();
+    for (i=0; i<n; i++) {
+        WU_RESULT& wr = ssp->wu_results[i];
+        wr.resultid = i+1;
+        scan_wu.id = i+1;
+        scan_wu.rsc_fpops_est = 1e12 + i;
+        wr.workunit.set(scan_wu);
+        if (full_copy) full_wus[i] = scan_wu;
+        wr.publish();
+    }
+    double t = dtime();
+    for (j=0; j<nscans; j++) {
+        for (i=0; i<n; i++) {
+            WU_RESULT& wr = ssp->wu_results[i];
+            if (wr.state != WR_STATE_PRESENT) continue;
+            if (full_copy) {
+                scan_wu = full_wus[i];
+            } else {
+                wr.workunit.get(scan_wu);
+            }
+            x += scan_wu.rsc_fpops_est;
+        }
+    }
+    t = dtime() - t;
+    printf(
+        "copy: %s\n"
+        "slots: %d  scans: %d\n"
+        "sizeof(WU_RESULT): %d  sizeof(WORKUNIT): %d\n"
+        "mean time per slot: %.3f usec\n"
+        "mean time per scan: %.3f msec\n",
+        full_copy?"full WORKUNIT":"WU_SUMMARY",
+        n, nscans,
+        (int)sizeof(WU_RESULT), (int)sizeof(WORKUNIT),
+        1e6*t/((double)n*nscans), 1e3*t/nscans
+    );
+    if (x == 0) printf("no jobs\n");
+    free(full_wus);
+}
+
+void usage() {
+    fprintf(stderr,
+        "Usage: sched_shmem_test [--nsched N] [--nslots N] [--duration X]\n"
+        "    [--refill_batch N] [--sema] [--scan N [--full_copy]]\n"
+    );
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    int i, nsched = 8, nslots = MAX_WU_RESULTS, nscans = 0;
+    double duration = 10;
+
+    for (i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--nsched")) {
+            if (!argv[++i]) usage();
+            nsched = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--nslots")) {
+            if (!argv[++i]) usage();
+            nslots = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--duration")) {
+            if (!argv[++i]) usage();
+            duration = atof(argv[i]);
+        } else if (!strcmp(argv[i], "--refill_batch")) {
+            if (!argv[++i]) usage();
+            refill_batch = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--sema")) {
+            use_sema = true;
+        } else if (!strcmp(argv[i], "--scan")) {
+            if (!argv[++i]) usage();
+            nscans = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--full_copy")) {
+            full_copy = true;
+        } else {
+            usage();
+        }
+    }
+    if (nsched < 1 || nslots < 1 || refill_batch < 1) usage();
+
+    size_t shmem_size = SCHED_SHMEM::size(nslots);
+    ssp = (SCHED_SHMEM*)mmap(
+        NULL, shmem_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0
+    );
+    size_t control_size = sizeof(CONTROL) + nsched*sizeof(COUNTS);
+    control = (CONTROL*)mmap(
+        NULL, control_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0
+    );
+    if (ssp == MAP_FAILED || control == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    ssp->init(nslots);
+    memset(control, 0, control_size);
+    if (nscans) {
+        scan_test(nscans);
+        return 0;
+    }
+    if (use_sema) {
+        destroy_semaphore(SEMA_KEY);
+        if (create_semaphore(SEMA_KEY)) {
+            fprintf(stderr, "can't create semaphore\n");
+            exit(1);
+        }
+    }
+
+    if (!fork()) {
+        feeder(control->feeder);
+        exit(0);
+    }
+    for (i=0; i<nsched; i++) {
+        if (!fork()) {
+            scheduler(control->sched[i]);
+            exit(0);
+        }
+    }
+    boinc_sleep(duration);
+    control->stop = true;
+    while (wait(NULL) > 0) ;
+
+    COUNTS total;
+    memset(&total, 0, sizeof(total));
+    for (i=0; i<nsched; i++) {
+        COUNTS& c = control->sched[i];
+        total.requests += c.requests;
+        total.jobs_sent += c.jobs_sent;
+        total.claim_failures += c.claim_failures;
+        total.slots_scanned += c.slots_scanned;
+        total.busy_time += c.busy_time;
+    }
+    printf(
+        "protocol: %s\n"
+        "schedulers: %d  slots: %d  refill batch: %d  duration: %.1f sec\n"
+        "jobs added by feeder: %.0f (slots examined: %.0f)\n"
+        "requests: %.0f (%.0f/sec)\n"
+        "jobs sent: %.0f (%.0f/sec)\n"
+        "slots scanned per request: %.2f\n"
+        "claim failures: %.0f\n"
+        "mean time per request: %.2f usec\n",
+        use_sema?"semaphore":"compare-and-swap",
+        nsched, nslots, refill_batch, duration,
+        control->feeder.jobs_sent, control->feeder.slots_scanned,
+        total.requests, total.requests/duration,
+        total.jobs_sent, total.jobs_sent/duration,
+        total.requests?total.slots_scanned/total.requests:0,
+        total.claim_failures,
+        total.requests?1e6*total.busy_time/total.requests:0
+    );
+    if (use_sema) {
+        destroy_semaphore(SEMA_KEY);
+    }
+    return 0;
+}
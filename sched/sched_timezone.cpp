@@ -42,8 +42,8 @@ typedef struct urltag {
 // these global variables are needed to pass information into the
 // compare function below.
 //
-static int tzone=0;
-static int hostid=0;
+static __thread int tzone=0;
+static __thread int hostid=0;
 
 // Evaluate differences between time-zone.  Two time zones that differ
 // by almost 24 hours are actually very close on the surface of the
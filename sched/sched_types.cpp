@@ -21,6 +21,7 @@
 #include <vector>
 #include <string>
 #include <cstring>
+#include <zlib.h>
 
 #include "parse.h"
 #include "error_numbers.h"
@@ -41,9 +42,9 @@
 
 using std::string;
 
-SCHEDULER_REQUEST* g_request;
-SCHEDULER_REPLY* g_reply;
-WORK_REQ* g_wreq;
+__thread SCHEDULER_REQUEST* g_request;
+__thread SCHEDULER_REPLY* g_reply;
+__thread WORK_REQ* g_wreq;
 
 // remove (by truncating) any quotes from the given string.
 // This is for things (e.g. authenticator) that will be used in
@@ -610,7 +611,102 @@ SCHEDULER_REPLY::SCHEDULER_REPLY() {
 SCHEDULER_REPLY::~SCHEDULER_REPLY() {
 }
 
+// replies smaller than this aren't worth compressing
+//
+#define GZIP_REPLY_MIN_SIZE     1024
+
 int SCHEDULER_REPLY::write(FILE* fout, SCHEDULER_REQUEST& sreq) {
+    if (config.gzip_replies) {
+        const char* p = request_getenv("HTTP_ACCEPT_ENCODING");
+        if (p && strstr(p, "gzip")) {
+            return write_gzip(fout, sreq);
+        }
+    }
+    fputs("Content-type: text/xml\n\n", fout);
+    return write_body(fout, sreq);
+}
+
+// Write the reply to memory, and send it compressed.
+// The client's HTTP library (libcurl) says it accepts gzip encoding,
+// and decompresses the reply.
+//
+int SCHEDULER_REPLY::write_gzip(FILE* fout, SCHEDULER_REQUEST& sreq) {
+    char* body = 0;
+    size_t body_len = 0;
+    int retval;
+
+#ifdef _USING_FCGI_
+    FCGI_FILE* f = FCGI_OpenFromFILE(open_memstream(&body, &body_len));
+#else
+    FILE* f = open_memstream(&body, &body_len);
+#endif
+    if (!f) {
+        fputs("Content-type: text/xml\n\n", fout);
+        return write_body(fout, sreq);
+    }
+    retval = write_body(f, sreq);
+    fclose(f);
+    if (!body) return ERR_MALLOC;
+
+    if (body_len < GZIP_REPLY_MIN_SIZE) {
+        fputs("Content-type: text/xml\n\n", fout);
+        fwrite(body, 1, body_len, fout);
+        free(body);
+        return retval;
+    }
+
+    // compress the whole body in one call,
+    // into a buffer big enough for the worst case
+    //
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fputs("Content-type: text/xml\n\n", fout);
+        fwrite(body, 1, body_len, fout);
+        free(body);
+        return retval;
+    }
+    uLong zlen = deflateBound(&z, body_len);
+    Bytef* zbuf = (Bytef*)malloc(zlen);
+    if (!zbuf) {
+        deflateEnd(&z);
+        free(body);
+        return ERR_MALLOC;
+    }
+    z.next_in = (Bytef*)body;
+    z.avail_in = body_len;
+    z.next_out = zbuf;
+    z.avail_out = zlen;
+    int zretval = deflate(&z, Z_FINISH);
+    zlen = z.total_out;
+    deflateEnd(&z);
+    if (zretval != Z_STREAM_END) {
+        fputs("Content-type: text/xml\n\n", fout);
+        fwrite(body, 1, body_len, fout);
+        free(zbuf);
+        free(body);
+        return retval;
+    }
+
+    fputs(
+        "Content-type: text/xml\n"
+        "Content-Encoding: gzip\n\n", fout
+    );
+    fwrite(zbuf, 1, zlen, fout);
+    if (config.debug_send) {
+        log_messages.printf(MSG_NORMAL,
+            "[send] compressed reply from %d to %d bytes\n",
+            (int)body_len, (int)zlen
+        );
+    }
+    free(zbuf);
+    free(body);
+    return retval;
+}
+
+// write the reply, not including HTTP headers
+//
+int SCHEDULER_REPLY::write_body(FILE* fout, SCHEDULER_REQUEST& sreq) {
     unsigned int i;
     char buf[BLOB_SIZE];
 
@@ -620,7 +716,6 @@ int SCHEDULER_REPLY::write(FILE* fout, SCHEDULER_REQUEST& sreq) {
     // but this broke 4.19 clients
     //
     fprintf(fout,
-        "Content-type: text/xml\n\n"
         "<scheduler_reply>\n"
         "<scheduler_version>%d</scheduler_version>\n",
         BOINC_MAJOR_VERSION*100+BOINC_MINOR_VERSION
@@ -845,7 +940,7 @@ int SCHEDULER_REPLY::write(FILE* fout, SCHEDULER_REQUEST& sreq) {
     }
 
     for (i=0; i<wus.size(); i++) {
-        fputs(wus[i].xml_doc, fout);
+        wus[i].write(fout);
         fputs("\n", fout);  // for old clients
     }
 
@@ -940,12 +1035,35 @@ void SCHEDULER_REPLY::insert_app_version_unique(APP_VERSION& av) {
     app_versions.push_back(av);
 }
 
-void SCHEDULER_REPLY::insert_workunit_unique(WORKUNIT& wu) {
+// add a WU to the reply, unless it's already there.
+// "added" is elements to add to its xml_doc, after <workunit>
+//
+int SCHEDULER_REPLY::insert_workunit_unique(WORKUNIT& wu, const char* added) {
     unsigned int i;
     for (i=0; i<wus.size(); i++) {
-        if (wu.id == wus[i].id) return;
+        if (wu.id == wus[i].id) return 0;
     }
-    wus.push_back(wu);
+    const char* p = strstr(wu.xml_doc, "<workunit>\n");
+    if (!p) {
+        log_messages.printf(MSG_CRITICAL,
+            "<workunit> not found in [WU#%d] xml_doc\n", wu.id
+        );
+        return ERR_XML_PARSE;
+    }
+    wus.resize(wus.size()+1);
+    REPLY_WU& rwu = wus.back();
+    rwu.id = wu.id;
+    strcpy(rwu.name, wu.name);
+    rwu.xml_doc = wu.xml_doc;
+    rwu.insert_pos = (p - wu.xml_doc) + strlen("<workunit>\n");
+    rwu.added = added;
+    return 0;
+}
+
+void REPLY_WU::write(FILE* fout) {
+    fwrite(xml_doc.c_str(), 1, insert_pos, fout);
+    fputs(added.c_str(), fout);
+    fwrite(xml_doc.c_str()+insert_pos, 1, xml_doc.size()-insert_pos, fout);
 }
 
 void SCHEDULER_REPLY::insert_result(SCHED_DB_RESULT& result) {
@@ -984,16 +1102,12 @@ int APP::write(FILE* fout) {
 }
 
 int APP_VERSION::write(FILE* fout) {
-    char buf[APP_VERSION_XML_BLOB_SIZE];
-
-    strcpy(buf, xml_doc);
-    char* p = strstr(buf, "</app_version>");
+    char* p = strstr(xml_doc, "</app_version>");
     if (!p) {
         fprintf(stderr, "ERROR: app version %d XML has no end tag!\n", id);
         return -1;
     }
-    *p = 0;
-    fputs(buf, fout);
+    fwrite(xml_doc, 1, p-xml_doc, fout);
     PLATFORM* pp = ssp->lookup_platform_id(platformid);
     fprintf(fout, "    <platform>%s</platform>\n", pp->name);
     if (strlen(plan_class)) {
@@ -1041,17 +1155,30 @@ int APP_VERSION::write(FILE* fout) {
     return 0;
 }
 
+// write the result's xml_doc_in,
+// adding <report_deadline>, <wu_name> and <name> after <result>,
+// and app version info at the end
+//
 int SCHED_DB_RESULT::write_to_client(FILE* fout) {
-    char buf[BLOB_SIZE];
-
-    strcpy(buf, xml_doc_in);
-    char* p = strstr(buf, "</result>");
+    char* p = strstr(xml_doc_in, "<result>\n");
     if (!p) {
+        fprintf(stderr, "ERROR: result %d XML has no start tag!\n", id);
+        return -1;
+    }
+    p += strlen("<result>\n");
+    char* q = strstr(p, "</result>");
+    if (!q) {
         fprintf(stderr, "ERROR: result %d XML has no end tag!\n", id);
         return -1;
     }
-    *p = 0;
-    fputs(buf, fout);
+    fwrite(xml_doc_in, 1, p-xml_doc_in, fout);
+    fprintf(fout,
+        "<report_deadline>%d</report_deadline>\n"
+        "<wu_name>%s</wu_name>\n"
+        "<name>%s</name>\n",
+        report_deadline, wu_name, name
+    );
+    fwrite(p, 1, q-p, fout);
     fputs("\n", fout);  // for old clients
 
     APP_VERSION* avp = bav.avp;
@@ -480,6 +480,23 @@ struct WORK_REQ {
     ~WORK_REQ() {}
 };
 
+// a workunit in a scheduler reply.
+// Rather than copying the WORKUNIT and editing its xml_doc,
+// we keep the xml_doc and the elements the scheduler adds to it
+// (<name>, <rsc_fpops_est> etc.) separately,
+// and combine them when the reply is written.
+//
+struct REPLY_WU {
+    int id;
+    char name[256];
+    std::string xml_doc;
+    size_t insert_pos;
+        // the added elements go here (after <workunit>)
+    std::string added;
+
+    void write(FILE*);
+};
+
 // NOTE: if any field requires initialization,
 // you must do it in the constructor.  Nothing is zeroed by default.
 //
@@ -500,7 +517,7 @@ struct SCHEDULER_REPLY {
     TEAM team;
     std::vector<APP> apps;
     std::vector<APP_VERSION> app_versions;
-    std::vector<WORKUNIT>wus;
+    std::vector<REPLY_WU>wus;
     std::vector<SCHED_DB_RESULT>results;
     std::vector<std::string>result_acks;
     std::vector<std::string>result_aborts;
@@ -515,18 +532,24 @@ struct SCHEDULER_REPLY {
     SCHEDULER_REPLY();
     ~SCHEDULER_REPLY();
     int write(FILE*, SCHEDULER_REQUEST&);
+    int write_body(FILE*, SCHEDULER_REQUEST&);
+    int write_gzip(FILE*, SCHEDULER_REQUEST&);
     void insert_app_unique(APP&);
     void insert_app_version_unique(APP_VERSION&);
-    void insert_workunit_unique(WORKUNIT&);
+    int insert_workunit_unique(WORKUNIT&, const char* added);
     void insert_result(SCHED_DB_RESULT&);
     void insert_message(const char* msg, const char* prio);
     void insert_message(USER_MESSAGE&);
     void set_delay(double);
 };
 
-extern SCHEDULER_REQUEST* g_request;
-extern SCHEDULER_REPLY* g_reply;
-extern WORK_REQ* g_wreq;
+// the request being handled.
+// These are per-thread, since the scheduler can handle
+// several requests at once (see --threads in sched_main.cpp)
+//
+extern __thread SCHEDULER_REQUEST* g_request;
+extern __thread SCHEDULER_REPLY* g_reply;
+extern __thread WORK_REQ* g_wreq;
 
 static inline void add_no_work_message(const char* m) {
     g_wreq->add_no_work_message(m);
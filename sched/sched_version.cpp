@@ -422,7 +422,7 @@ static BEST_APP_VERSION* check_homogeneous_app_version(
     WORKUNIT& wu, bool reliable_only
     // TODO: enforce reliable_only
 ) {
-    static BEST_APP_VERSION bav;
+    static __thread BEST_APP_VERSION bav;
 
     bool found=false;
     APP_VERSION *avp = ssp->lookup_app_version(wu.app_version_id);
@@ -27,7 +27,7 @@
 
 #include "time_stats_log.h"
 
-static char* stats_buf = 0;
+static __thread char* stats_buf = 0;
 
 // Got a <time_stats_log> flag in scheduler request.
 // Copy the contents to a malloced buffer;
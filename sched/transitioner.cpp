@@ -25,6 +25,19 @@
 //   [ --d x ]               debug level x
 //   [ --mod n i ]           process only WUs with (id mod n) == i
 //   [ --sleep_interval x ]  sleep x seconds if nothing to do
+//   [ --db_stats ]          after each pass, log the number of DB rows
+//                           examined per WU handled
+//   [ --update_batch_size n ]  do DB updates in batches of n rows
+//   [ --threads n ]         handle WUs in n threads
+//
+// With --threads, the main thread enumerates WUs
+// and passes them to n worker threads,
+// each of which has its own DB connection.
+// A WU is always handled by the same thread (WU ID mod n),
+// and a pass ends only when all its WUs have been handled
+// (and batched updates done),
+// so a WU is never handled by two threads at once.
+// This is an alternative to running several transitioners with --mod.
 
 #include "config.h"
 #include <vector>
@@ -33,7 +46,9 @@
 #include <climits>
 #include <cstdlib>
 #include <string>
+#include <deque>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/time.h>
 
 #include "boinc_db.h"
@@ -56,6 +71,7 @@
 #define PIDFILE                 "transitioner.pid"
 
 #define SELECT_LIMIT    1000
+    // number of WUs to get per query
 
 #define DEFAULT_SLEEP_INTERVAL  5
 
@@ -65,6 +81,11 @@ int mod_n, mod_i;
 bool do_mod = false;
 bool one_pass = false;
 int sleep_interval = DEFAULT_SLEEP_INTERVAL;
+bool db_stats = false;
+int update_batch_size = 0;
+double rows_examined_overhead = 0;
+    // rows examined by DB_CONN::rows_examined() itself
+int nthreads = 0;
 
 void signal_handler(int) {
     log_messages.printf(MSG_NORMAL, "Signaled by simulator\n");
@@ -683,14 +704,181 @@ int handle_wu(
     return 0;
 }
 
+// Code for --threads
+
+#define MAX_QUEUED_WUS  100
+    // max WUs waiting for a given thread
+
+struct WORKER {
+    pthread_t thread;
+    DB_CONN* db;
+    DB_TRANSITIONER_ITEM_SET* transitioner;
+    std::deque<std::vector<TRANSITIONER_ITEM> > queue;
+    bool busy;          // handling a WU
+    bool flush;         // end of pass; do batched updates
+};
+
+static WORKER* workers;
+static DB_CONN_POOL db_pool;
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+    // signaled when work is added
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+    // signaled when work is taken or finished
+
+static void* worker_thread(void* p) {
+    WORKER& w = *(WORKER*)p;
+    std::vector<TRANSITIONER_ITEM> items;
+    int retval;
+
+    mysql_thread_init();
+    set_thread_db(w.db);
+    w.transitioner = new DB_TRANSITIONER_ITEM_SET(w.db);
+    w.transitioner->write_batch.max_rows = update_batch_size;
+
+    pthread_mutex_lock(&worker_mutex);
+    while (1) {
+        if (!w.queue.empty()) {
+            items.swap(w.queue.front());
+            w.queue.pop_front();
+            w.busy = true;
+            pthread_cond_broadcast(&done_cond);
+            pthread_mutex_unlock(&worker_mutex);
+
+            retval = handle_wu(*w.transitioner, items);
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "[WU#%d %s] handle_wu: %s; quitting\n",
+                    items[0].id, items[0].name, boincerror(retval)
+                );
+                exit(1);
+            }
+
+            pthread_mutex_lock(&worker_mutex);
+            w.busy = false;
+            pthread_cond_broadcast(&done_cond);
+        } else if (w.flush) {
+            pthread_mutex_unlock(&worker_mutex);
+            retval = w.transitioner->write_batch.flush(w.db);
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "batched updates failed: %s; exiting\n", boincerror(retval)
+                );
+                exit(1);
+            }
+            pthread_mutex_lock(&worker_mutex);
+            w.flush = false;
+            pthread_cond_broadcast(&done_cond);
+        } else {
+            pthread_cond_wait(&work_cond, &worker_mutex);
+        }
+    }
+    return 0;
+}
+
+static void start_workers() {
+    int retval;
+
+    retval = db_pool.open(
+        nthreads, config.db_name, config.db_host, config.db_user, config.db_passwd
+    );
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "can't open %d DB connections: %s\n", nthreads, boincerror(retval)
+        );
+        exit(1);
+    }
+    workers = new WORKER[nthreads];
+    for (int i=0; i<nthreads; i++) {
+        WORKER& w = workers[i];
+        w.db = db_pool.get();
+        w.transitioner = NULL;
+        w.busy = false;
+        w.flush = false;
+        retval = pthread_create(&w.thread, NULL, worker_thread, &w);
+        if (retval) {
+            log_messages.printf(MSG_CRITICAL, "can't create thread\n");
+            exit(1);
+        }
+    }
+}
+
+// give a WU to its thread, waiting if that thread is too far behind
+//
+static void dispatch_wu(std::vector<TRANSITIONER_ITEM>& items) {
+    WORKER& w = workers[items[0].id % nthreads];
+    pthread_mutex_lock(&worker_mutex);
+    while (w.queue.size() >= MAX_QUEUED_WUS) {
+        pthread_cond_wait(&done_cond, &worker_mutex);
+    }
+    w.queue.push_back(items);
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&worker_mutex);
+}
+
+// wait until the workers have handled all WUs given to them,
+// and done their batched updates
+//
+static void finish_workers() {
+    int i;
+    pthread_mutex_lock(&worker_mutex);
+    for (i=0; i<nthreads; i++) {
+        workers[i].flush = true;
+    }
+    pthread_cond_broadcast(&work_cond);
+    while (1) {
+        for (i=0; i<nthreads; i++) {
+            WORKER& w = workers[i];
+            if (!w.queue.empty() || w.busy || w.flush) break;
+        }
+        if (i == nthreads) break;
+        pthread_cond_wait(&done_cond, &worker_mutex);
+    }
+    pthread_mutex_unlock(&worker_mutex);
+}
+
+// get the number of queries and (if --db_stats) rows examined
+// on all our DB connections,
+// not counting the queries done by previous calls to this.
+// Call this only when worker threads are idle.
+//
+static void get_db_counts(double& nqueries, double& nrows) {
+    static int ncalls = 0;
+    double x;
+    int nconns = nthreads + 1;
+
+    nqueries = boinc_db.nqueries;
+    for (int i=0; i<nthreads; i++) {
+        nqueries += workers[i].db->nqueries;
+    }
+    nrows = 0;
+    if (db_stats) {
+        nqueries -= ncalls*nconns;
+        nrows -= ncalls*nconns*rows_examined_overhead;
+        boinc_db.rows_examined(x);
+        nrows += x;
+        for (int i=0; i<nthreads; i++) {
+            workers[i].db->rows_examined(x);
+            nrows += x;
+        }
+        ncalls++;
+    }
+}
+
 bool do_pass() {
     int retval;
     DB_TRANSITIONER_ITEM_SET transitioner;
     std::vector<TRANSITIONER_ITEM> items;
     bool did_something = false;
+    int nwus = 0;
+    double rows_before, rows_after, queries_before, queries_after;
+    double start_time = dtime();
 
     if (!one_pass) check_stop_daemons();
 
+    transitioner.write_batch.max_rows = update_batch_size;
+    get_db_counts(queries_before, rows_before);
+
     // loop over entries that are due to be checked
     //
     while (1) {
@@ -707,6 +895,12 @@ bool do_pass() {
             break;
         }
         did_something = true;
+        nwus++;
+        if (nthreads) {
+            dispatch_wu(items);
+            if (!one_pass) check_stop_daemons();
+            continue;
+        }
         TRANSITIONER_ITEM& wu_item = items[0];
         retval = handle_wu(transitioner, items);
         if (retval) {
@@ -719,6 +913,46 @@ bool do_pass() {
 
         if (!one_pass) check_stop_daemons();
     }
+    if (nthreads) {
+        finish_workers();
+    }
+    retval = transitioner.write_batch.flush(transitioner.db);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "batched updates failed: %s; exiting\n", boincerror(retval)
+        );
+        exit(1);
+    }
+    if (!nwus) return did_something;
+
+    if (update_batch_size) {
+        char buf[256];
+        DB_WRITE_BATCH total = transitioner.write_batch;
+        for (int i=0; i<nthreads; i++) {
+            DB_WRITE_BATCH& wb = workers[i].transitioner->write_batch;
+            total.nflushes += wb.nflushes;
+            total.nstatements += wb.nstatements;
+            total.nrows_flushed += wb.nrows_flushed;
+            total.flush_time += wb.flush_time;
+        }
+        total.get_stats(buf);
+        log_messages.printf(MSG_NORMAL, "batched updates: %s\n", buf);
+    }
+    if (db_stats || nthreads) {
+        get_db_counts(queries_after, rows_after);
+        double nqueries = queries_after - queries_before;
+        double elapsed = dtime() - start_time;
+        log_messages.printf(MSG_NORMAL,
+            "pass: %d WUs in %.2f sec (%.1f/sec); %.0f DB queries (%.1f per WU)\n",
+            nwus, elapsed, elapsed>0?nwus/elapsed:0, nqueries, nqueries/nwus
+        );
+        if (db_stats) {
+            double nrows = rows_after - rows_before;
+            log_messages.printf(MSG_NORMAL,
+                "%.0f rows examined (%.1f per WU)\n", nrows, nrows/nwus
+            );
+        }
+    }
     return did_something;
 }
 
@@ -733,6 +967,17 @@ void main_loop() {
         exit(1);
     }
 
+    if (db_stats) {
+        double x, y;
+        boinc_db.rows_examined(x);
+        boinc_db.rows_examined(y);
+        rows_examined_overhead = y - x;
+    }
+
+    if (nthreads) {
+        start_workers();
+    }
+
     while (1) {
         log_messages.printf(MSG_DEBUG, "doing a pass\n");
         if (!do_pass()) {
@@ -761,6 +1006,9 @@ void usage(char *name) {
         "  [ --d x ]                       debug level x\n"
         "  [ --mod n i ]                   process only WUs with (id mod n) == i\n"
         "  [ --sleep_interval x ]          sleep x seconds if nothing to do\n"
+        "  [ --db_stats ]                  log DB rows examined per WU\n"
+        "  [ --update_batch_size n ]       do DB updates in batches of n rows\n"
+        "  [ --threads n ]                 handle WUs in n threads\n"
         "  [ -h | --help ]                 Show this help text.\n"
         "  [ -v | --version ]              Shows version information.\n",
         name
@@ -800,6 +1048,22 @@ int main(int argc, char** argv) {
                 exit(1);
             }
             sleep_interval = atoi(argv[i]);
+        } else if (is_arg(argv[i], "db_stats")) {
+            db_stats = true;
+        } else if (is_arg(argv[i], "update_batch_size")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            update_batch_size = atoi(argv[i]);
+        } else if (is_arg(argv[i], "threads")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            nthreads = atoi(argv[i]);
         } else if (is_arg(argv[i], "h") || is_arg(argv[i], "help")) {
             usage(argv[0]);
             exit(0);
@@ -29,12 +29,19 @@
 //  [--update_users]
 //  [--update_hosts]
 //  [--min_age nsec] don't update items updated more recently than this
+//  [--bulk]        update rows with set-based queries (see below)
+//  [--chunk N]     in bulk mode, do N IDs per query
+//  [--check N]     compare the bulk and per-row computations on N rows
+//                  of each table (including team member counts),
+//                  and exit without updating anything
 
 
 #include "config.h"
 #include <cstdio>
 #include <cstring>
+#include <cmath>
 #include <string>
+#include <vector>
 #include <cstdlib>
 #include <unistd.h>
 
@@ -48,12 +55,26 @@
 #include "sched_util.h"
 #include "sched_msgs.h"
 
+using std::vector;
+
 // If the item's average credit has been updated more recently than this,
 // don't update it (optimizes performance).
 
 #define MIN_AGE 86400
 
+// In bulk mode, the number of IDs covered by each query.
+// Each query is a separate transaction,
+// so this bounds the time that rows are locked.
+
+#define DEFAULT_CHUNK_SIZE  10000
+
+// allowed relative difference between the bulk and per-row computations
+
+#define CHECK_TOLERANCE     1e-9
+
 double max_update_time;
+bool bulk = false;
+int chunk_size = DEFAULT_CHUNK_SIZE;
 
 int update_users() {
     DB_USER user;
@@ -191,6 +212,258 @@ int update_teams() {
     return 0;
 }
 
+// Bulk mode.
+// The per-row functions above read every row to be decayed
+// and write it back with a separate query.
+// With millions of hosts this takes hours.
+// Instead, do the computation of update_average() (with no new work)
+// in the DB, with one UPDATE per range of IDs.
+
+// SQL expression for the decayed value of expavg_credit.
+// Like update_average(), leave it alone if expavg_time is zero.
+//
+static void decay_expr(double now, char* buf) {
+    sprintf(buf,
+        "if(expavg_time>0, "
+        "expavg_credit*exp(-greatest(%f-expavg_time, 0)*%.17g), "
+        "expavg_credit)",
+        now, M_LN2/CREDIT_HALF_LIFE
+    );
+}
+
+// decay the rows of the given table (user or host)
+//
+int bulk_update_table(DB_BASE& table) {
+    char expr[256], set_clause[512], where_clause[256];
+    int retval, max_id, id, nrows=0;
+    double now = dtime();
+
+    retval = table.max_id(max_id);
+    if (retval == ERR_DB_NOT_FOUND) return 0;   // empty table
+    if (retval) return retval;
+
+    decay_expr(now, expr);
+
+    // MySQL does single-table assignments from left to right,
+    // so expavg_credit must be computed before expavg_time is changed
+    //
+    sprintf(set_clause, "expavg_credit=%s, expavg_time=%f", expr, now);
+    for (id=0; id<=max_id; id+=chunk_size) {
+        sprintf(where_clause,
+            "id>%d and id<=%d and expavg_credit>0.1 and expavg_time<%f",
+            id, id+chunk_size, max_update_time
+        );
+        retval = table.update_fields_noid(set_clause, where_clause);
+        if (retval) return retval;
+        nrows += table.affected_rows();
+    }
+    log_messages.printf(MSG_NORMAL,
+        "updated %d %s records\n", nrows, table.table_name
+    );
+    return 0;
+}
+
+int bulk_update_users() {
+    DB_USER user;
+    return bulk_update_table(user);
+}
+
+int bulk_update_hosts() {
+    DB_HOST host;
+    return bulk_update_table(host);
+}
+
+// the tables to join to team to get the member counts
+// of teams with IDs in (id0, id1]; the count is ifnull(c.n, 0)
+//
+static void team_count_join(int id0, int id1, char* buf) {
+    sprintf(buf,
+        "team left join "
+        "(select teamid, count(*) as n from user "
+        "where teamid>%d and teamid<=%d group by teamid) as c "
+        "on team.id=c.teamid",
+        id0, id1
+    );
+}
+
+int bulk_update_teams() {
+    DB_TEAM team;
+    char expr[256], set_clause[512], where_clause[256], join[512];
+    char query[MAX_QUERY_LEN];
+    int retval, max_id, id, nrows=0, nchanged=0;
+    double now = dtime();
+
+    retval = team.max_id(max_id);
+    if (retval == ERR_DB_NOT_FOUND) return 0;
+    if (retval) return retval;
+
+    decay_expr(now, expr);
+    sprintf(set_clause,
+        "expavg_credit=if(expavg_time<%f, %s, expavg_credit), "
+        "expavg_time=if(expavg_time<%f, %f, expavg_time)",
+        max_update_time, expr, max_update_time, now
+    );
+    for (id=0; id<=max_id; id+=chunk_size) {
+        // fix member counts.
+        // This is a multi-table update, whose assignments MySQL
+        // may do in any order, so do it separately from the decay.
+        // Our connection uses CLIENT_FOUND_ROWS,
+        // so affected_rows() counts the rows matched, not changed;
+        // match only the teams whose count is wrong.
+        //
+        team_count_join(id, id+chunk_size, join);
+        sprintf(query,
+            "update %s set team.nusers=ifnull(c.n, 0) "
+            "where team.id>%d and team.id<=%d and team.expavg_credit>0.1 "
+            "and team.nusers<>ifnull(c.n, 0)",
+            join, id, id+chunk_size
+        );
+        retval = team.db->do_query(query);
+        if (retval) return retval;
+        nchanged += team.affected_rows();
+
+        sprintf(where_clause,
+            "id>%d and id<=%d and expavg_credit>0.1",
+            id, id+chunk_size
+        );
+        retval = team.update_fields_noid(set_clause, where_clause);
+        if (retval) return retval;
+        nrows += team.affected_rows();
+    }
+    if (nchanged) {
+        log_messages.printf(MSG_CRITICAL,
+            "updated member count for %d teams\n", nchanged
+        );
+    }
+    log_messages.printf(MSG_NORMAL, "updated %d team records\n", nrows);
+    return 0;
+}
+
+// Compare the bulk computation with update_average()
+// for up to n rows of the given table that would be updated.
+// Nothing is changed.
+// Return the number of rows where they differ in nbad.
+//
+int check_bulk_table(DB_BASE& table, int n, int& nbad) {
+    char expr[256], query[MAX_QUERY_LEN];
+    int retval, i;
+    double now = dtime(), x, max_diff=0;
+    vector<int> ids;
+    vector<double> credit, avg_time;
+
+    nbad = 0;
+    decay_expr(now, expr);
+    sprintf(query,
+        "select id, expavg_credit, expavg_time from %s "
+        "where expavg_credit>0.1 and expavg_time<%f limit %d",
+        table.table_name, max_update_time, n
+    );
+    retval = table.db->do_query(query);
+    if (retval) return retval;
+    MYSQL_RES* rp = mysql_store_result(table.db->mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(rp))) {
+        ids.push_back(atoi(row[0]));
+        credit.push_back(atof(row[1]));
+        avg_time.push_back(atof(row[2]));
+    }
+    mysql_free_result(rp);
+
+    for (i=0; i<(int)ids.size(); i++) {
+        sprintf(query, "select %s from %s where id=%d",
+            expr, table.table_name, ids[i]
+        );
+        retval = table.get_double(query, x);
+        if (retval) return retval;
+        update_average(
+            now, 0, 0, CREDIT_HALF_LIFE, credit[i], avg_time[i]
+        );
+        double diff = fabs(x - credit[i]);
+        if (credit[i]) diff /= credit[i];
+        if (diff > max_diff) max_diff = diff;
+        if (diff > CHECK_TOLERANCE) {
+            log_messages.printf(MSG_CRITICAL,
+                "%s %d: per-row %f, bulk %f\n",
+                table.table_name, ids[i], credit[i], x
+            );
+            nbad++;
+        }
+    }
+    log_messages.printf(MSG_NORMAL,
+        "%s: checked %d records, %d mismatches; max relative difference %g\n",
+        table.table_name, (int)ids.size(), nbad, max_diff
+    );
+    return 0;
+}
+
+// Compare the bulk member counts of up to n teams that would be updated
+// with the per-row counts of get_team_totals().
+// Nothing is changed.
+// Return the number of teams where they differ in nbad.
+//
+int check_bulk_team_counts(int n, int& nbad) {
+    DB_TEAM team;
+    DB_USER user;
+    char query[MAX_QUERY_LEN], join[512], buf[256];
+    int retval, i, count, nwrong=0;
+    vector<int> ids, nusers, bulk_nusers;
+
+    nbad = 0;
+    sprintf(query,
+        "select id from team where expavg_credit>0.1 order by id limit %d", n
+    );
+    retval = team.db->do_query(query);
+    if (retval) return retval;
+    MYSQL_RES* rp = mysql_store_result(team.db->mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(rp))) {
+        ids.push_back(atoi(row[0]));
+    }
+    mysql_free_result(rp);
+    if (ids.empty()) return 0;
+
+    team_count_join(ids.front()-1, ids.back(), join);
+    sprintf(query,
+        "select team.id, team.nusers, ifnull(c.n, 0) from %s "
+        "where team.id>%d and team.id<=%d and team.expavg_credit>0.1 "
+        "order by team.id",
+        join, ids.front()-1, ids.back()
+    );
+    retval = team.db->do_query(query);
+    if (retval) return retval;
+    rp = mysql_store_result(team.db->mysql);
+    if (!rp) return ERR_DB_NOT_FOUND;
+    ids.clear();
+    while ((row = mysql_fetch_row(rp))) {
+        ids.push_back(atoi(row[0]));
+        nusers.push_back(atoi(row[1]));
+        bulk_nusers.push_back(atoi(row[2]));
+    }
+    mysql_free_result(rp);
+
+    for (i=0; i<(int)ids.size(); i++) {
+        sprintf(buf, "where teamid=%d", ids[i]);
+        retval = user.count(count, buf);
+        if (retval) return retval;
+        if (count != nusers[i]) nwrong++;
+        if (count != bulk_nusers[i]) {
+            log_messages.printf(MSG_CRITICAL,
+                "team %d: per-row nusers %d, bulk nusers %d\n",
+                ids[i], count, bulk_nusers[i]
+            );
+            nbad++;
+        }
+    }
+    log_messages.printf(MSG_NORMAL,
+        "team: checked nusers of %d records, %d mismatches; "
+        "%d records have the wrong count\n",
+        (int)ids.size(), nbad, nwrong
+    );
+    return 0;
+}
+
 void usage(char *name) {
     fprintf(stderr,
         "Update average credit for idle users, hosts and teams.\n"
@@ -205,14 +478,22 @@ void usage(char *name) {
         "  [ --update_teams ]              Updates teams.\n"
         "  [ --update_users ]              Updates users.\n"
         "  [ --update_hosts ]              Updates hosts.\n"
+        "  [ --min_age nsec ]              Don't update items updated more recently than this.\n"
+        "  [ --bulk ]                      Update with one query per range of IDs,\n"
+        "                                  rather than one query per row.\n"
+        "  [ --chunk N ]                   In bulk mode, do N IDs per query (default %d).\n"
+        "  [ --check N ]                   Compare bulk and per-row computations on N rows\n"
+        "                                  of each table, and of team member counts;\n"
+        "                                  don't update anything.\n"
         "  [ -h | --help ]                 Shows this help text\n"
         "  [ -v | --version ]              Shows version information\n",
-        name
+        name, DEFAULT_CHUNK_SIZE
     );
 }
 
 int main(int argc, char** argv) {
-    int retval, i;
+    int retval, i, check_n = 0;
+    double start;
     bool do_update_teams = false;
     bool do_update_users = false;
     bool do_update_hosts = false;
@@ -231,6 +512,23 @@ int main(int argc, char** argv) {
         } else if (is_arg(argv[i], "min_age")) {
             double x = atof(argv[++i]);
             max_update_time = time(0) - x;
+        } else if (is_arg(argv[i], "bulk")) {
+            bulk = true;
+        } else if (is_arg(argv[i], "chunk")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            chunk_size = atoi(argv[i]);
+            if (chunk_size < 1) chunk_size = DEFAULT_CHUNK_SIZE;
+        } else if (is_arg(argv[i], "check")) {
+            if (!argv[++i]) {
+                log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
+                usage(argv[0]);
+                exit(1);
+            }
+            check_n = atoi(argv[i]);
         } else if (!strcmp(argv[i], "-d")) {
             if (!argv[++i]) {
                 log_messages.printf(MSG_CRITICAL, "%s requires an argument\n\n", argv[--i]);
@@ -283,34 +581,94 @@ int main(int argc, char** argv) {
         );
     }
 
+    if (check_n) {
+        DB_USER user;
+        DB_HOST host;
+        DB_TEAM team;
+        int nbad, nbad_total = 0;
+
+        if (do_update_users) {
+            retval = check_bulk_table(user, check_n, nbad);
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "check of users failed: %s\n", boincerror(retval)
+                );
+                exit(1);
+            }
+            nbad_total += nbad;
+        }
+        if (do_update_hosts) {
+            retval = check_bulk_table(host, check_n, nbad);
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "check of hosts failed: %s\n", boincerror(retval)
+                );
+                exit(1);
+            }
+            nbad_total += nbad;
+        }
+        if (do_update_teams) {
+            retval = check_bulk_table(team, check_n, nbad);
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "check of teams failed: %s\n", boincerror(retval)
+                );
+                exit(1);
+            }
+            nbad_total += nbad;
+            retval = check_bulk_team_counts(check_n, nbad);
+            if (retval) {
+                log_messages.printf(MSG_CRITICAL,
+                    "check of team member counts failed: %s\n",
+                    boincerror(retval)
+                );
+                exit(1);
+            }
+            nbad_total += nbad;
+        }
+        exit(nbad_total?1:0);
+    }
+
     if (do_update_users) {
-        retval = update_users();
+        start = dtime();
+        retval = bulk?bulk_update_users():update_users();
         if (retval) {
             log_messages.printf(MSG_CRITICAL,
                 "update_users failed: %s\n", boincerror(retval)
             );
             exit(1);
         }
+        log_messages.printf(MSG_NORMAL,
+            "update_users done (%.1f sec)\n", dtime()-start
+        );
     }
 
     if (do_update_hosts) {
-        retval = update_hosts();
+        start = dtime();
+        retval = bulk?bulk_update_hosts():update_hosts();
         if (retval) {
             log_messages.printf(MSG_CRITICAL,
                 "update_hosts failed: %s\n", boincerror(retval)
             );
             exit(1);
         }
+        log_messages.printf(MSG_NORMAL,
+            "update_hosts done (%.1f sec)\n", dtime()-start
+        );
     }
 
     if (do_update_teams) {
-        retval = update_teams();
+        start = dtime();
+        retval = bulk?bulk_update_teams():update_teams();
         if (retval) {
             log_messages.printf(MSG_CRITICAL,
                 "update_teams failed: %s\n", boincerror(retval)
             );
             exit(1);
         }
+        log_messages.printf(MSG_NORMAL,
+            "update_teams done (%.1f sec)\n", dtime()-start
+        );
     }
 
     log_messages.printf(MSG_NORMAL, "Finished\n");
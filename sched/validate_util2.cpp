@@ -27,6 +27,7 @@
 
 #include "boinc_db.h"
 #include "error_numbers.h"
+#include "util.h"
 
 #include "sched_config.h"
 #include "sched_msgs.h"
@@ -68,8 +69,11 @@ int check_set(
         had_error[i] = false;
     }
     int good_results = 0;
+    double t;
     for (i=0; i<n; i++) {
+        t = dtime();
         retval = init_result(results[i], data[i]);
+        validate_stats.add_init(dtime() - t);
         if (retval == ERR_OPENDIR) {
             log_messages.printf(MSG_CRITICAL,
                 "check_set: init_result([RESULT#%d %s]) transient failure\n",
@@ -103,7 +107,12 @@ int check_set(
             if (i == j) {
                 ++neq;
                 matches[j] = true;
-            } else if (compare_results(results[i], data[i], results[j], data[j], match)) {
+                continue;
+            }
+            t = dtime();
+            retval = compare_results(results[i], data[i], results[j], data[j], match);
+            validate_stats.add_compare(dtime() - t);
+            if (retval) {
                 log_messages.printf(MSG_CRITICAL,
                     "generic_check_set: check_pair_with_data([RESULT#%d %s], [RESULT#%d %s]) failed\n",
                     results[i].id, results[i].name, results[j].id, results[j].name
@@ -141,9 +150,12 @@ void check_pair(RESULT& r1, RESULT& r2, bool& retry) {
     void* data2;
     int retval;
     bool match;
+    double t;
 
     retry = false;
+    t = dtime();
     retval = init_result(r1, data1);
+    validate_stats.add_init(dtime() - t);
     if (retval == ERR_OPENDIR) {
         log_messages.printf(MSG_CRITICAL,
             "check_pair: init_result([RESULT#%d %s]) transient failure 1\n",
@@ -161,7 +173,9 @@ void check_pair(RESULT& r1, RESULT& r2, bool& retry) {
         return;
     }
 
+    t = dtime();
     retval = init_result(r2, data2);
+    validate_stats.add_init(dtime() - t);
     if (retval == ERR_OPENDIR) {
         log_messages.printf(MSG_CRITICAL,
             "check_pair: init_result([RESULT#%d %s]) transient failure 2\n",
@@ -181,7 +195,9 @@ void check_pair(RESULT& r1, RESULT& r2, bool& retry) {
         return;
     }
 
+    t = dtime();
     retval = compare_results(r1, data1, r2, data2, match);
+    validate_stats.add_compare(dtime() - t);
     r1.validate_state = match?VALIDATE_STATE_VALID:VALIDATE_STATE_INVALID;
     cleanup_result(r1, data1);
     cleanup_result(r2, data2);
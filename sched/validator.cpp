@@ -23,6 +23,8 @@
 //  [--mod n i]                 process only WUs with (id mod n) == i
 //  [--max_granted_credit X]    limit maximum granted credit to X
 //  [--update_credited_job]     add userid/wuid pair to credited_job table
+//  [--update_batch_size N]    do result and WU updates in batches of N rows
+//  [--threads N]               check results in N threads
 //
 //  credit options.  The default is to grant credit using an
 //  adaptive scheme that provides devices neutrality
@@ -33,6 +35,14 @@
 //  [--credit_from_runtime X]   grant credit based on runtime,
 //                              assuming single-CPU app.
 //                              X is the max runtime.
+//
+// With --threads, the main thread enumerates WUs and queues them.
+// N worker threads call check_set() or check_pair() for them,
+// reading and comparing output files in parallel
+// and ahead of the main thread,
+// which does the rest of handle_wu() (credit, host and result updates)
+// for each WU in order.
+// Only the main thread uses the DB.
 
 #include "config.h"
 #include <unistd.h>
@@ -41,7 +51,9 @@
 #include <vector>
 #include <cstdlib>
 #include <string>
+#include <deque>
 #include <signal.h>
+#include <pthread.h>
 
 #include "boinc_db.h"
 #include "util.h"
@@ -90,8 +102,26 @@ double max_runtime = 0;
 double fpops_50_percentile; // used if credit_from_runtime
 double fpops_95_percentile;
 bool no_credit = false;
+int update_batch_size = 0;
+int nthreads = 0;
+
+__thread WORKUNIT* g_wup;
+VALIDATE_STATS validate_stats;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void VALIDATE_STATS::add_init(double t) {
+    pthread_mutex_lock(&stats_mutex);
+    ninit++;
+    init_time += t;
+    pthread_mutex_unlock(&stats_mutex);
+}
 
-WORKUNIT* g_wup;
+void VALIDATE_STATS::add_compare(double t) {
+    pthread_mutex_lock(&stats_mutex);
+    ncompare++;
+    compare_time += t;
+    pthread_mutex_unlock(&stats_mutex);
+}
 vector<DB_APP_VERSION> app_versions;
     // cache of app_versions; used by v2 credit system
 
@@ -152,11 +182,98 @@ static inline void is_invalid(DB_HOST_APP_VERSION& hav) {
     }
 }
 
-// handle a workunit which has new results
+// The part of handling a WU that looks at output files
+// (check_pair() or check_set()).
+// This doesn't use the DB,
+// so with --threads it's done by worker threads ahead of handle_wu().
 //
-int handle_wu(
-    DB_VALIDATOR_ITEM_SET& validator, std::vector<VALIDATOR_ITEM>& items
-) {
+struct WU_CHECK {
+    std::vector<VALIDATOR_ITEM> items;
+    bool done;
+    double check_time;
+
+    // if the WU has a canonical result:
+    // whether check_pair() was called for each item,
+    // and the retry flag it returned
+    // (the items' results are updated by check_pair())
+    //
+    std::vector<bool> pair_checked;
+    std::vector<bool> pair_retry;
+
+    // otherwise: the inputs and outputs of check_set()
+    //
+    std::vector<RESULT> results;
+    int canonicalid;
+    bool retry;
+    int retval;
+};
+
+static inline bool need_check(RESULT& result) {
+    if (result.server_state != RESULT_SERVER_STATE_OVER) return false;
+    if (result.outcome !=  RESULT_OUTCOME_SUCCESS) return false;
+    switch (result.validate_state) {
+    case VALIDATE_STATE_INIT:
+    case VALIDATE_STATE_INCONCLUSIVE:
+        return true;
+    }
+    return false;
+}
+
+// Do the check_pair() or check_set() calls for a WU.
+//
+void check_wu(WU_CHECK& c) {
+    std::vector<VALIDATOR_ITEM>& items = c.items;
+    WORKUNIT& wu = items[0].wu;
+    unsigned int i;
+    double dummy, start_time = dtime();
+
+    g_wup = &wu;
+    c.pair_checked.assign(items.size(), false);
+    c.pair_retry.assign(items.size(), false);
+    c.canonicalid = 0;
+    c.retry = false;
+    c.retval = 0;
+
+    if (wu.canonical_resultid) {
+        RESULT* canonical_result = NULL;
+        for (i=0; i<items.size(); i++) {
+            if (items[i].res.id == wu.canonical_resultid) {
+                canonical_result = &items[i].res;
+            }
+        }
+        if (canonical_result) {
+            for (i=0; i<items.size(); i++) {
+                RESULT& result = items[i].res;
+                if (!need_check(result)) continue;
+                bool retry;
+                check_pair(result, *canonical_result, retry);
+                c.pair_checked[i] = true;
+                c.pair_retry[i] = retry;
+                if (retry) break;
+            }
+        }
+    } else {
+        for (i=0; i<items.size(); i++) {
+            RESULT& result = items[i].res;
+            if ((result.server_state == RESULT_SERVER_STATE_OVER) &&
+                (result.outcome == RESULT_OUTCOME_SUCCESS)
+            ) {
+                c.results.push_back(result);
+            }
+        }
+        if (c.results.size() >= (unsigned int)wu.min_quorum) {
+            c.retval = check_set(
+                c.results, wu, c.canonicalid, dummy, c.retry
+            );
+        }
+    }
+    c.check_time = dtime() - start_time;
+}
+
+// handle a workunit which has new results,
+// and which has been checked by check_wu()
+//
+int handle_wu(DB_VALIDATOR_ITEM_SET& validator, WU_CHECK& check) {
     int canonical_result_index = -1;
     bool update_result, retry;
     TRANSITION_TIME transition_time = NO_CHANGE;
@@ -164,6 +281,7 @@ int handle_wu(
     double credit = 0;
     unsigned int i;
 
+    std::vector<VALIDATOR_ITEM>& items = check.items;
     WORKUNIT& wu = items[0].wu;
     g_wup = &wu;
 
@@ -199,21 +317,13 @@ int handle_wu(
         for (i=0; i<items.size(); i++) {
             RESULT& result = items[i].res;
 
-            if (result.server_state != RESULT_SERVER_STATE_OVER) continue;
-            if (result.outcome !=  RESULT_OUTCOME_SUCCESS) continue;
-            switch (result.validate_state) {
-            case VALIDATE_STATE_INIT:
-            case VALIDATE_STATE_INCONCLUSIVE:
-                break;
-            default:
-                continue;
-            }
+            if (!check.pair_checked[i]) continue;
             log_messages.printf(MSG_NORMAL,
                  "[WU#%d] handle_wu(): testing result %d\n",
                  wu.id, result.id
              );
 
-            check_pair(result, canonical_result, retry);
+            retry = check.pair_retry[i];
             if (retry) {
                 // this usually means an NFS mount has failed;
                 // arrange to try again later.
@@ -357,8 +467,12 @@ int handle_wu(
                 wu.id, wu.name
             );
 
-            double dummy;
-            retval = check_set(results, wu, canonicalid, dummy, retry);
+            // check_set() may have changed the results' states
+            //
+            results = check.results;
+            canonicalid = check.canonicalid;
+            retry = check.retry;
+            retval = check.retval;
             if (retval) {
                 log_messages.printf(MSG_CRITICAL,
                     "[WU#%d %s] check_set() error: %s, exiting\n",
@@ -611,22 +725,171 @@ leave:
     return 0;
 }
 
+// Code for --threads
+
+#define MAX_QUEUED_WUS  100
+    // max WUs checked ahead of the main thread
+
+static std::deque<WU_CHECK*> check_queue;
+    // WUs not yet taken by a worker thread
+static pthread_mutex_t check_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+    // signaled when a WU is queued
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+    // signaled when a WU has been checked
+
+static void* worker_thread(void*) {
+    WU_CHECK* c;
+
+    pthread_mutex_lock(&check_mutex);
+    while (1) {
+        if (check_queue.empty()) {
+            pthread_cond_wait(&work_cond, &check_mutex);
+            continue;
+        }
+        c = check_queue.front();
+        check_queue.pop_front();
+        pthread_mutex_unlock(&check_mutex);
+
+        check_wu(*c);
+
+        pthread_mutex_lock(&check_mutex);
+        c->done = true;
+        pthread_cond_broadcast(&done_cond);
+    }
+    return 0;
+}
+
+static void start_workers() {
+    pthread_t thread;
+    for (int i=0; i<nthreads; i++) {
+        if (pthread_create(&thread, NULL, worker_thread, NULL)) {
+            log_messages.printf(MSG_CRITICAL, "can't create thread\n");
+            exit(1);
+        }
+    }
+}
+
+static void queue_check(WU_CHECK* c) {
+    c->done = false;
+    pthread_mutex_lock(&check_mutex);
+    check_queue.push_back(c);
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&check_mutex);
+}
+
+static void wait_check(WU_CHECK* c) {
+    pthread_mutex_lock(&check_mutex);
+    while (!c->done) {
+        pthread_cond_wait(&done_cond, &check_mutex);
+    }
+    pthread_mutex_unlock(&check_mutex);
+}
+
+// per-pass counts and times for each stage
+//
+struct PASS_STATS {
+    int nwus;
+    int nhandled;
+    double start_time;
+    double enum_time;       // enumerating WUs
+    double check_time;      // check_wu(), summed over threads
+    double wait_time;       // main thread waiting for check_wu()
+    double handle_time;     // handle_wu(), i.e. credit and DB updates
+    VALIDATE_STATS vs;
+
+    void init() {
+        nwus = 0;
+        nhandled = 0;
+        start_time = dtime();
+        enum_time = 0;
+        check_time = 0;
+        wait_time = 0;
+        handle_time = 0;
+        vs = validate_stats;
+    }
+    void print();
+};
+
+void PASS_STATS::print() {
+    double elapsed = dtime() - start_time;
+    int nf = validate_stats.ninit - vs.ninit;
+    int nc = validate_stats.ncompare - vs.ncompare;
+    double tf = validate_stats.init_time - vs.init_time;
+    double tc = validate_stats.compare_time - vs.compare_time;
+    log_messages.printf(nthreads?MSG_NORMAL:MSG_DEBUG,
+        "pass: %d WUs in %.2f sec (%.1f/sec)\n",
+        nwus, elapsed, elapsed>0?nwus/elapsed:0
+    );
+    log_messages.printf(nthreads?MSG_NORMAL:MSG_DEBUG,
+        "   enumerate: %.2f sec; check: %.2f sec in %d threads (%.1f WUs/sec/thread); handle: %.2f sec (%.1f WUs/sec); waited %.2f sec for checks\n",
+        enum_time, check_time, nthreads?nthreads:1,
+        check_time>0?nwus/check_time:0,
+        handle_time, handle_time>0?nhandled/handle_time:0,
+        wait_time
+    );
+    log_messages.printf(nthreads?MSG_NORMAL:MSG_DEBUG,
+        "   init_result: %d in %.2f sec (%.1f/sec); compare_results: %d in %.2f sec (%.1f/sec)\n",
+        nf, tf, tf>0?nf/tf:0, nc, tc, tc>0?nc/tc:0
+    );
+}
+
+// handle the oldest queued WU, once it's been checked
+//
+static int handle_queued_wu(
+    DB_VALIDATOR_ITEM_SET& validator, std::deque<WU_CHECK*>& queue,
+    PASS_STATS& ps
+) {
+    WU_CHECK* c = queue.front();
+    queue.pop_front();
+    double t = dtime();
+    wait_check(c);
+    double t2 = dtime();
+    ps.wait_time += t2 - t;
+    ps.check_time += c->check_time;
+    int retval = handle_wu(validator, *c);
+    ps.handle_time += dtime() - t2;
+    ps.nhandled++;
+    delete c;
+    return retval;
+}
+
 // make one pass through the workunits with need_validate set.
 // return true if there were any
 //
 bool do_validate_scan() {
     DB_VALIDATOR_ITEM_SET validator;
-    std::vector<VALIDATOR_ITEM> items;
+    std::deque<WU_CHECK*> queue;
+        // with --threads: WUs queued for checking, in order
+    WU_CHECK* c;
+    PASS_STATS ps;
     bool found=false;
-    int retval, i=0;
+    int retval;
+    double t;
+
+    validator.write_batch.max_rows = update_batch_size;
+    ps.init();
 
     // loop over entries that need to be checked
     //
     while (1) {
+        // before the enumeration does a new query,
+        // handle the queued WUs so that it doesn't return them again
+        //
+        if (!validator.cursor.active) {
+            while (!queue.empty()) {
+                retval = handle_queued_wu(validator, queue, ps);
+                if (!retval) found = true;
+            }
+        }
+        c = new WU_CHECK;
+        t = dtime();
         retval = validator.enumerate(
-            app.id, SELECT_LIMIT, wu_id_modulus, wu_id_remainder, items
+            app.id, SELECT_LIMIT, wu_id_modulus, wu_id_remainder, c->items
         );
+        ps.enum_time += dtime() - t;
         if (retval) {
+            delete c;
             if (retval != ERR_DB_NOT_FOUND) {
                 log_messages.printf(MSG_DEBUG,
                     "DB connection lost, exiting\n"
@@ -635,10 +898,44 @@ bool do_validate_scan() {
             }
             break;
         }
-        retval = handle_wu(validator, items);
+        ps.nwus++;
+        if (nthreads) {
+            queue_check(c);
+            queue.push_back(c);
+            if (queue.size() > MAX_QUEUED_WUS) {
+                retval = handle_queued_wu(validator, queue, ps);
+                if (!retval) found = true;
+            }
+        } else {
+            t = dtime();
+            check_wu(*c);
+            ps.check_time += dtime() - t;
+            t = dtime();
+            retval = handle_wu(validator, *c);
+            ps.handle_time += dtime() - t;
+            ps.nhandled++;
+            delete c;
+            if (!retval) found = true;
+        }
+        if (ps.nwus == one_pass_N_WU) break;
+    }
+    while (!queue.empty()) {
+        retval = handle_queued_wu(validator, queue, ps);
         if (!retval) found = true;
-        if (++i == one_pass_N_WU) break;
     }
+    retval = validator.write_batch.flush(validator.db);
+    if (retval) {
+        log_messages.printf(MSG_CRITICAL,
+            "batched updates failed: %s; exiting\n", boincerror(retval)
+        );
+        exit(1);
+    }
+    if (update_batch_size && found) {
+        char buf[256];
+        validator.write_batch.get_stats(buf);
+        log_messages.printf(MSG_NORMAL, "batched updates: %s\n", buf);
+    }
+    if (ps.nwus) ps.print();
     return found;
 }
 
@@ -697,6 +994,8 @@ int main(int argc, char** argv) {
       "  --credit_from_wu        Credit is specified in WU XML\n"
       "  --no_credit             Don't grant credit\n"
       "  --sleep_interval n      Set sleep-interval to n\n"
+      "  --update_batch_size n   Do result and WU updates in batches of n rows\n"
+      "  --threads n             Check results in n threads\n"
       "  -d n, --debug_level n   Set log verbosity level, 1-4\n"
       "  -h | --help             Show this\n"
       "  -v | --version          Show version information\n";
@@ -736,6 +1035,10 @@ int main(int argc, char** argv) {
             max_runtime = atof(argv[++i]);
         } else if (is_arg(argv[i], "no_credit")) {
             no_credit = true;
+        } else if (is_arg(argv[i], "update_batch_size")) {
+            update_batch_size = atoi(argv[++i]);
+        } else if (is_arg(argv[i], "threads")) {
+            nthreads = atoi(argv[++i]);
         } else if (is_arg(argv[i], "v") || is_arg(argv[i], "version")) {
             printf("%s\n", SVN_VERSION);
             exit(0);
@@ -805,6 +1108,13 @@ int main(int argc, char** argv) {
 
     install_stop_signal_handler();
 
+    if (nthreads) {
+        log_messages.printf(MSG_NORMAL,
+            "Checking results in %d threads\n", nthreads
+        );
+        start_workers();
+    }
+
     main_loop();
 }
 
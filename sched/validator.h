@@ -24,6 +24,22 @@ extern double max_claimed_credit;
 extern bool grant_claimed_credit;
     // the --grant_claimed_credit cmdline arg, or false
 
-extern WORKUNIT* g_wup;
+extern __thread WORKUNIT* g_wup;
     // A pointer to the WU currently being processed;
-    // you can use this in your init_result() etc. functions
+    // you can use this in your init_result() etc. functions.
+    // With --threads, these may be called in several threads at once,
+    // so they must be thread-safe; g_wup is per-thread.
+
+// time spent reading and comparing output files,
+// i.e. in init_result() and compare_results()
+//
+struct VALIDATE_STATS {
+    int ninit;
+    double init_time;
+    int ncompare;
+    double compare_time;
+
+    void add_init(double);
+    void add_compare(double);
+};
+extern VALIDATE_STATS validate_stats;
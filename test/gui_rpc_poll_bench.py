@@ -0,0 +1,136 @@
+#!/usr/bin/env python
+
+# Compare the cost of polling a running client's state
+# with get_state() and with get_state_changes().
+#
+# Usage: gui_rpc_poll_bench.py [options]
+#   --host H        client host (default localhost)
+#   --port N        GUI RPC port (default 31416)
+#   --passwd P      GUI RPC password, if the client requires one
+#   --npolls N      number of polls of each kind (default 60)
+#   --interval X    seconds between polls (default 1, like the Manager)
+#   --pid N         the client's process ID;
+#                   if given, report the client's CPU time per poll
+#                   (from /proc/N/stat)
+#   --nconns N      open N other (idle) GUI RPC connections first
+#                   (default 0); more than 1024 needs
+#                   a client that doesn't use select()
+#
+# Reports the mean reply size and round-trip time of each kind of poll.
+
+import hashlib, os, re, socket, sys, time
+
+class GUI_RPC:
+    def __init__(self, host, port):
+        self.sock = socket.create_connection((host, port))
+
+    def rpc(self, request):
+        self.sock.sendall((
+            '<boinc_gui_rpc_request>\n%s</boinc_gui_rpc_request>\n\003'
+            % request
+        ).encode())
+        reply = b''
+        while not reply.endswith(b'\003'):
+            buf = self.sock.recv(65536)
+            if not buf:
+                break
+            reply += buf
+        return reply.rstrip(b'\003').decode('utf-8', 'replace')
+
+    def authorize(self, passwd):
+        reply = self.rpc('<auth1/>\n')
+        nonce = re.search('<nonce>(.*)</nonce>', reply).group(1)
+        hash = hashlib.md5((nonce + passwd).encode()).hexdigest()
+        reply = self.rpc(
+            '<auth2>\n<nonce_hash>%s</nonce_hash>\n</auth2>\n' % hash
+        )
+        if '<authorized/>' not in reply:
+            sys.stderr.write('authorization failed\n')
+            sys.exit(1)
+
+def cpu_time(pid):
+    if not pid:
+        return 0
+    f = open('/proc/%d/stat' % pid)
+    fields = f.read().rsplit(')', 1)[1].split()
+    f.close()
+    # utime and stime are fields 14 and 15 (counting from 1)
+    return (int(fields[11]) + int(fields[12]))/float(os.sysconf('SC_CLK_TCK'))
+
+def bench(rpc, name, npolls, interval, pid):
+    epoch = seqno = 0
+    nbytes = 0
+    rtt = 0
+    cpu = cpu_time(pid)
+    for i in range(npolls):
+        if name == 'get_state':
+            request = '<get_state/>\n'
+        else:
+            request = (
+                '<get_state_changes>\n'
+                '   <epoch>%d</epoch>\n'
+                '   <seqno>%d</seqno>\n'
+                '</get_state_changes>\n' % (epoch, seqno)
+            )
+        t = time.time()
+        reply = rpc.rpc(request)
+        rtt += time.time() - t
+        nbytes += len(reply)
+        if name == 'get_state_changes':
+            if '<client_state_changes>' not in reply:
+                sys.stderr.write('client doesn\'t support get_state_changes\n')
+                sys.exit(1)
+            epoch = int(re.search('<epoch>(.*)</epoch>', reply).group(1))
+            seqno = int(re.search('<seqno>(.*)</seqno>', reply).group(1))
+        time.sleep(interval)
+    cpu = cpu_time(pid) - cpu
+    line = '%s: %d polls, %.0f bytes/poll, %.2f ms/poll' % (
+        name, npolls, nbytes/float(npolls), rtt*1000/npolls
+    )
+    if pid:
+        line += ', client CPU %.2f ms/poll' % (cpu*1000/npolls)
+    print(line)
+
+def main():
+    host = 'localhost'
+    port = 31416
+    passwd = None
+    npolls = 60
+    interval = 1.
+    pid = 0
+    nconns = 0
+    args = sys.argv[1:]
+    while len(args) > 1:
+        if args[0] == '--host':
+            host = args[1]
+        elif args[0] == '--port':
+            port = int(args[1])
+        elif args[0] == '--passwd':
+            passwd = args[1]
+        elif args[0] == '--npolls':
+            npolls = int(args[1])
+        elif args[0] == '--interval':
+            interval = float(args[1])
+        elif args[0] == '--pid':
+            pid = int(args[1])
+        elif args[0] == '--nconns':
+            nconns = int(args[1])
+        else:
+            break
+        args = args[2:]
+    if len(args) or npolls < 1:
+        sys.stderr.write(
+            'Usage: gui_rpc_poll_bench.py [--host H] [--port N] [--passwd P] [--npolls N] [--interval X] [--pid N] [--nconns N]\n'
+        )
+        sys.exit(1)
+
+    idle = []
+    for i in range(nconns):
+        idle.append(GUI_RPC(host, port))
+    rpc = GUI_RPC(host, port)
+    if passwd is not None:
+        rpc.authorize(passwd)
+    bench(rpc, 'get_state', npolls, interval, pid)
+    bench(rpc, 'get_state_changes', npolls, interval, pid)
+
+main()
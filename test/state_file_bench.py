@@ -0,0 +1,141 @@
+#!/usr/bin/env python
+
+# Measure how long the client takes to start up with a large state file.
+#
+# Usage: state_file_bench.py [--nresults N] [--dir D] client_path
+#
+# Creates a BOINC data directory D (default ./state_file_bench)
+# with an account file and a client_state.xml with N results
+# (default 20000), each with its own workunit, input file and output file.
+# Then runs "client_path --dir D --show_projects",
+# which exits right after reading the state file,
+# and reports the elapsed time and the state file parse time
+# (from the client's <statefile_debug> message).
+
+import os, re, subprocess, sys, time
+
+MASTER_URL = 'http://bench.example.com/'
+ACCOUNT_FILE = 'account_bench.example.com.xml'
+
+def write_state_file(path, nresults):
+    f = open(path, 'w')
+    f.write('''<client_state>
+<project>
+    <master_url>%s</master_url>
+    <project_name>bench</project_name>
+</project>
+<app>
+    <name>bench_app</name>
+</app>
+<file_info>
+    <name>bench_app_1.0</name>
+    <status>1</status>
+    <executable/>
+</file_info>
+<app_version>
+    <app_name>bench_app</app_name>
+    <version_num>100</version_num>
+    <flops>1e9</flops>
+    <file_ref>
+        <file_name>bench_app_1.0</file_name>
+        <main_program/>
+    </file_ref>
+</app_version>
+''' % MASTER_URL)
+    for i in range(nresults):
+        f.write('''<file_info>
+    <name>wu_%d_in</name>
+    <nbytes>1000</nbytes>
+    <status>1</status>
+</file_info>
+<file_info>
+    <name>wu_%d_0_out</name>
+    <max_nbytes>100000</max_nbytes>
+    <status>0</status>
+    <upload_when_present/>
+</file_info>
+<workunit>
+    <name>wu_%d</name>
+    <app_name>bench_app</app_name>
+    <version_num>100</version_num>
+    <rsc_fpops_est>1e13</rsc_fpops_est>
+    <file_ref>
+        <file_name>wu_%d_in</file_name>
+        <open_name>in</open_name>
+    </file_ref>
+</workunit>
+<result>
+    <name>wu_%d_0</name>
+    <wu_name>wu_%d</wu_name>
+    <version_num>100</version_num>
+    <state>2</state>
+    <report_deadline>%d</report_deadline>
+    <received_time>%d</received_time>
+    <file_ref>
+        <file_name>wu_%d_0_out</file_name>
+        <open_name>out</open_name>
+    </file_ref>
+</result>
+''' % (i, i, i, i, i, i, time.time() + 1e6, time.time() + i, i))
+    f.write('</client_state>\n')
+    f.close()
+
+def main():
+    nresults = 20000
+    dir = 'state_file_bench'
+    args = sys.argv[1:]
+    while len(args) > 1:
+        if args[0] == '--nresults':
+            nresults = int(args[1])
+        elif args[0] == '--dir':
+            dir = args[1]
+        else:
+            break
+        args = args[2:]
+    if len(args) != 1:
+        sys.stderr.write(
+            'Usage: state_file_bench.py [--nresults N] [--dir D] client_path\n'
+        )
+        sys.exit(1)
+    client = os.path.abspath(args[0])
+
+    if not os.path.isdir(dir):
+        os.mkdir(dir)
+    f = open(os.path.join(dir, ACCOUNT_FILE), 'w')
+    f.write('''<account>
+    <master_url>%s</master_url>
+    <authenticator>x</authenticator>
+</account>
+''' % MASTER_URL)
+    f.close()
+    f = open(os.path.join(dir, 'cc_config.xml'), 'w')
+    f.write('''<cc_config>
+<log_flags>
+    <statefile_debug>1</statefile_debug>
+</log_flags>
+<options>
+    <no_gpus>1</no_gpus>
+</options>
+</cc_config>
+''')
+    f.close()
+    write_state_file(os.path.join(dir, 'client_state.xml'), nresults)
+
+    t = time.time()
+    p = subprocess.Popen(
+        [client, '--dir', dir, '--show_projects', '--skip_cpu_benchmarks',
+            '--no_gui_rpc', '--no_info_fetch'
+        ],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT
+    )
+    out = p.communicate()[0].decode('utf-8', 'replace')
+    t = time.time() - t
+    m = re.search(r'\[statefile\] parsed .* in ([0-9.]+) sec', out)
+    print('%d results: client exited after %.2f sec' % (nresults, t))
+    if m:
+        print('state file parse time: %s sec' % m.group(1))
+    else:
+        print('no parse time in client output:')
+        print(out)
+
+main()
@@ -0,0 +1,180 @@
+#!/usr/bin/env python
+
+# Measure the throughput of the file upload handler.
+#
+# Usage: upload_bench.py [options] handler_path
+#   --nuploads N    number of uploads (default 200)
+#   --size N        size of each file (default 1000000)
+#   --nprocs N      number of concurrent handler processes (default 4)
+#   --dir D         project directory to create (default ./upload_bench)
+#   --socket        send request on a socket rather than a pipe
+#                   (Apache's mod_cgid does this; mod_cgi uses a pipe)
+#
+# Creates a minimal project directory (config.xml with
+# <ignore_upload_certificates/>, and an upload directory),
+# runs the handler as a CGI program once per upload,
+# and reports uploads/sec and MB/sec.
+# Then checks that every file arrived intact.
+#
+# To measure a FastCGI handler's per-request cost without process startup,
+# run it under a web server and use a load generator such as "ab".
+
+import os, socket, subprocess, sys, threading, time
+
+def write_config(dir):
+    for d in ['upload', 'cgi-bin', 'keys']:
+        p = os.path.join(dir, d)
+        if not os.path.isdir(p):
+            os.makedirs(p)
+    f = open(os.path.join(dir, 'config.xml'), 'w')
+    f.write('''<boinc>
+<config>
+    <upload_dir>%s</upload_dir>
+    <uldl_dir_fanout>1024</uldl_dir_fanout>
+    <key_dir>%s</key_dir>
+    <ignore_upload_certificates/>
+</config>
+</boinc>
+''' % (os.path.join(dir, 'upload'), os.path.join(dir, 'keys')))
+    f.close()
+
+def request_header(name, size):
+    return ('''<data_server_request>
+    <core_client_major_version>7</core_client_major_version>
+    <core_client_minor_version>0</core_client_minor_version>
+    <core_client_release>0</core_client_release>
+<file_upload>
+<file_info>
+    <name>%s</name>
+    <max_nbytes>%d</max_nbytes>
+</file_info>
+<nbytes>%d</nbytes>
+<offset>0</offset>
+<data>
+''' % (name, size, size)).encode()
+
+class UPLOAD:
+    def __init__(self, handler, env, name, data, use_socket):
+        self.name = name
+        if use_socket:
+            s1, s2 = socket.socketpair()
+            self.p = subprocess.Popen(
+                [handler], stdin=s2.fileno(), stdout=subprocess.PIPE, env=env
+            )
+            s2.close()
+            self.sock = s1
+        else:
+            self.p = subprocess.Popen(
+                [handler], stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                env=env
+            )
+            self.sock = None
+        # send the request in another thread so that uploads overlap
+        #
+        self.thread = threading.Thread(
+            target=self.send, args=(request_header(name, len(data)), data)
+        )
+        self.thread.start()
+
+    def send(self, header, data):
+        if self.sock:
+            self.sock.sendall(header)
+            self.sock.sendall(data)
+            self.sock.shutdown(socket.SHUT_WR)
+        else:
+            self.p.stdin.write(header)
+            self.p.stdin.write(data)
+            self.p.stdin.close()
+
+    def finish(self):
+        out = self.p.stdout.read().decode('utf-8', 'replace')
+        self.p.wait()
+        self.thread.join()
+        if self.sock:
+            self.sock.close()
+        if '<status>0</status>' not in out:
+            sys.stderr.write('upload of %s failed:\n%s\n' % (self.name, out))
+            return False
+        return True
+
+def check_files(dir, nuploads, data):
+    paths = {}
+    for root, dirs, files in os.walk(os.path.join(dir, 'upload')):
+        for f in files:
+            paths[f] = os.path.join(root, f)
+    nbad = 0
+    for i in range(nuploads):
+        name = 'bench_%d' % i
+        if name not in paths or open(paths[name], 'rb').read() != data:
+            nbad += 1
+    return nbad
+
+def main():
+    nuploads = 200
+    size = 1000000
+    nprocs = 4
+    dir = 'upload_bench'
+    use_socket = False
+    args = sys.argv[1:]
+    while len(args) > 1:
+        if args[0] == '--nuploads':
+            nuploads = int(args[1])
+        elif args[0] == '--size':
+            size = int(args[1])
+        elif args[0] == '--nprocs':
+            nprocs = int(args[1])
+        elif args[0] == '--dir':
+            dir = args[1]
+        elif args[0] == '--socket':
+            use_socket = True
+            args = args[1:]
+            continue
+        else:
+            break
+        args = args[2:]
+    if len(args) != 1:
+        sys.stderr.write(
+            'Usage: upload_bench.py [--nuploads N] [--size N] [--nprocs N] [--dir D] [--socket] handler_path\n'
+        )
+        sys.exit(1)
+    handler = os.path.abspath(args[0])
+    dir = os.path.abspath(dir)
+    write_config(dir)
+    for root, dirs, files in os.walk(os.path.join(dir, 'upload')):
+        for f in files:
+            os.unlink(os.path.join(root, f))
+
+    env = dict(os.environ)
+    env['BOINC_PROJECT_DIR'] = dir
+    env['REMOTE_ADDR'] = '127.0.0.1'
+    data = os.urandom(size)
+
+    nfailed = 0
+    running = []
+    t = time.time()
+    for i in range(nuploads):
+        if len(running) >= nprocs:
+            if not running.pop(0).finish():
+                nfailed += 1
+        running.append(
+            UPLOAD(handler, env, 'bench_%d' % i, data, use_socket)
+        )
+    for u in running:
+        if not u.finish():
+            nfailed += 1
+    t = time.time() - t
+
+    print('%d uploads of %d bytes, %d processes, %s: %.2f sec' % (
+        nuploads, size, nprocs, 'socket' if use_socket else 'pipe', t
+    ))
+    print('%.1f uploads/sec, %.1f MB/sec' % (
+        nuploads/t, nuploads*size/t/1e6
+    ))
+    nbad = check_files(dir, nuploads, data)
+    if nfailed or nbad:
+        print('%d uploads failed; %d files missing or corrupted' % (
+            nfailed, nbad
+        ))
+        sys.exit(1)
+
+main()